@@ -1,20 +1,27 @@
 #pragma once
 
 #include <functional>
+#include <future>
 #include <set>
 
 #include "editor.h"
 #include "theme.h"
 #include "zep/line_widgets.h"
 #include "zep/mcommon/file/path.h"
+#include "zep/mcommon/gsl-lite.hpp"
 
-#include "gap_buffer.h"
+#include "line_index.h"
+#include "range_markers.h"
+#include "string_pool.h"
+#include "text_storage.h"
 
 namespace Zep
 {
 
 class ZepSyntax;
+class ZepSearchHighlight;
 class ZepTheme;
+struct ZepFileMapping;
 class ZepMode;
 enum class ThemeColor;
 
@@ -47,7 +54,8 @@ enum : uint32_t
     Dirty = (1 << 4), // Has the file been changed?
     HasWarnings = (1 << 6),
     HasErrors = (1 << 7),
-    DefaultBuffer = (1 << 8) // Default startup buffer
+    DefaultBuffer = (1 << 8), // Default startup buffer
+    Loading = (1 << 9) // Still loading in the background; can't be edited until it is done
 };
 }
 
@@ -136,26 +144,56 @@ enum
 };
 };
 
+// A range of the buffer, shown with colors, underlines or tooltips.
+// Once a marker is added to a buffer, edits move it; the buffer's marker tree holds where it is, and GetRange asks it
 struct RangeMarker
 {
-    BufferRange range;
+    RangeMarker() = default;
+    RangeMarker(const RangeMarker& copy);
+    RangeMarker& operator=(const RangeMarker& copy);
+
+    BufferRange GetRange() const;
+
+    // A marker already in a buffer is moved to the new range
+    void SetRange(const BufferRange& range);
+
     ThemeColor textColor = ThemeColor::Text;
     ThemeColor backgroundColor = ThemeColor::Background;
     ThemeColor highlightColor = ThemeColor::Background;
     uint32_t displayType = RangeMarkerDisplayType::All;
     uint32_t markerType = RangeMarkerType::Message;
-    std::string name;
-    std::string description;
+    InternedString name;
+    InternedString description;
     ToolTipPos tipPos = ToolTipPos::AboveLine;
 
     bool ContainsLocation(long loc) const
     {
-        return range.ContainsLocation(loc);
+        return GetRange().ContainsLocation(loc);
     }
     bool IntersectsRange(const BufferRange& i) const
     {
+        auto range = GetRange();
         return i.first < range.second && i.second > range.first;
     }
+
+private:
+    friend class RangeMarkerTree;
+    BufferRange m_range; // Where the marker is, while it isn't in a tree
+    RangeMarkerTree* m_pTree = nullptr;
+};
+
+// A marker to add with SetMarkers; the strings are copied into the buffer's string pool, so the
+// caller can point them at its own storage
+struct MarkerDesc
+{
+    BufferRange range;
+    ThemeColor textColor = ThemeColor::Text;
+    ThemeColor backgroundColor = ThemeColor::Background;
+    ThemeColor highlightColor = ThemeColor::Background;
+    uint32_t displayType = RangeMarkerDisplayType::All;
+    const char* name = nullptr;
+    const char* description = nullptr;
+    ToolTipPos tipPos = ToolTipPos::AboveLine;
 };
 
 struct ZepRepl
@@ -183,10 +221,23 @@ public:
     void Load(const ZepPath& path);
     bool Save(int64_t& size);
 
+    // Files are loaded in chunks of this size on the thread pool.  The first chunk is shown straight away,
+    // the rest are added in order as they finish, on the editor tick.
+    static const size_t LoadChunkSize = 4 * 1024 * 1024;
+    bool IsLoading() const
+    {
+        return (m_fileFlags & FileFlags::Loading) != 0;
+    }
+    void WaitForLoad();
+
     ZepPath GetFilePath() const;
     void SetFilePath(const ZepPath& path);
 
-    BufferLocation Search(const std::string& str, BufferLocation start, SearchDirection dir = SearchDirection::Forward, BufferLocation end = BufferLocation{ -1l }) const;
+    BufferLocation Search(const std::string& str, BufferLocation start, SearchDirection dir = SearchDirection::Forward, BufferLocation end = BufferLocation{ -1l }, bool ignoreCase = false) const;
+
+    // Find a regular expression (see text_regex.h); the first match starting at or after start, or the last one starting at or before it.
+    // Returns the match, or InvalidOffset for both ends if there isn't one (or the pattern is not valid)
+    BufferRange SearchRegex(const std::string& pattern, BufferLocation start, SearchDirection dir = SearchDirection::Forward, bool ignoreCase = false) const;
 
     BufferLocation GetLinePos(BufferLocation bufferLocation, LineLocation lineLocation) const;
     bool GetLineOffsets(const long line, long& charStart, long& charEnd) const;
@@ -212,6 +263,13 @@ public:
     BufferRange InnerWordMotion(BufferLocation start, uint32_t searchType) const;
     BufferRange StandardCtrlMotion(BufferLocation cursor, SearchDirection searchDir) const;
 
+    // The bracket which pairs with the one at the location, or InvalidOffset.  With a syntax, brackets in strings and
+    // comments are skipped, using the syntax's index of them
+    BufferLocation MatchingBracket(BufferLocation location) const;
+    // The innermost brackets around the location (or which it is on), as [open, close]; of one kind ("(", "{" or "[")
+    // or of any kind for 0
+    bool EnclosingScope(BufferLocation location, BufferRange& range, char bracket = 0) const;
+
     bool Delete(const BufferLocation& startOffset, const BufferLocation& endOffset);
     bool Insert(const BufferLocation& startOffset, const std::string& str);
     bool Replace(const BufferLocation& startOffset, const BufferLocation& endOffset, const std::string& str);
@@ -226,11 +284,22 @@ public:
     BufferLocation LocationFromOffsetByChars(const BufferLocation& location, long offset, LineLocation loc = LineLocation::None) const;
     BufferLocation EndLocation() const;
 
-    const GapBuffer<utf8>& GetText() const
+    const TextStorage<utf8>& GetText() const
     {
-        return m_gapBuffer;
+        return m_text;
     }
+
+    TextStorageType GetStorageType() const
+    {
+        return m_text.GetType();
+    }
+    void SetStorageType(TextStorageType type);
+    // Note: This is a copy of the line ends; use GetLineIndex to walk them without copying
     const std::vector<long> GetLineEnds() const
+    {
+        return m_lineEnds.ToVector();
+    }
+    const LineIndex& GetLineIndex() const
     {
         return m_lineEnds;
     }
@@ -270,6 +339,11 @@ public:
         return m_spSyntax.get();
     }
 
+    ZepSearchHighlight& GetSearchHighlight() const
+    {
+        return *m_spSearchHighlight;
+    }
+
     const std::string& GetName() const
     {
         return m_strName;
@@ -289,11 +363,18 @@ public:
     void AddRangeMarker(std::shared_ptr<RangeMarker> spMarker);
     void ClearRangeMarkers(const std::set<std::shared_ptr<RangeMarker>>& markers);
     void ClearRangeMarkers(uint32_t types);
+
+    // Replace every marker of the type with these, in one go, with a single MarkersChanged.
+    // For diagnostics from a build or a linter; the markers share one allocation and their strings are interned
+    void SetMarkers(uint32_t markerType, gsl::span<const MarkerDesc> markers);
     tRangeMarkers GetRangeMarkers(uint32_t types) const;
     void HideMarkers(uint32_t markerType);
     void ShowMarkers(uint32_t markerType, uint32_t displayType);
 
+    // Markers starting in [begin, end], or starting earlier and reaching into it; in order of start
     void ForEachMarker(uint32_t types, SearchDirection dir, BufferLocation begin, BufferLocation end, std::function<bool(const std::shared_ptr<RangeMarker>&)> fnCB) const;
+
+    // The next marker starting after (or before) the location, wrapping around the buffer
     std::shared_ptr<RangeMarker> FindNextMarker(BufferLocation start, SearchDirection dir, uint32_t markerType);
 
     void SetBufferType(BufferType type);
@@ -332,34 +413,57 @@ public:
 
 private:
     // Internal
-    GapBuffer<utf8>::const_iterator SearchWord(uint32_t searchType, GapBuffer<utf8>::const_iterator itrBegin, GapBuffer<utf8>::const_iterator itrEnd, SearchDirection dir) const;
+    TextStorage<utf8>::const_iterator SearchWord(uint32_t searchType, TextStorage<utf8>::const_iterator itrBegin, TextStorage<utf8>::const_iterator itrEnd, SearchDirection dir) const;
     void ClearRangeMarker(std::shared_ptr<RangeMarker> spMarker);
 
     void MarkUpdate();
 
+    void FinishSetText(std::vector<long>& lineEnds, bool initFromFile);
+    TextStorageType ChooseStorageType(size_t size) const;
+
+    // A piece of a file, prepared on a worker thread
+    struct LoadChunk
+    {
+        const utf8* pView = nullptr; // The text in the file, if it didn't need converting
+        std::vector<utf8> converted; // ... otherwise, the text with \r removed and tabs expanded
+        size_t size = 0;
+        std::vector<long> lineEnds; // Relative to the start of the chunk
+        uint32_t flags = 0; // TextScanFlags
+    };
+    void StartLoad(const std::shared_ptr<ZepFileMapping>& spMapping);
+    void UpdateLoad(bool wait);
+    void CancelLoad();
+
     void UpdateForInsert(const BufferLocation& startOffset, const BufferLocation& endOffset);
     void UpdateForDelete(const BufferLocation& startOffset, const BufferLocation& endOffset);
 
 private:
     bool m_dirty = false; // Is the text modified?
-    GapBuffer<utf8> m_gapBuffer; // Storage for the text - a gap buffer for efficiency
-    std::vector<long> m_lineEnds; // End of each line
+    TextStorage<utf8> m_text; // Storage for the text - a gap buffer, or a rope for big files
+    LineIndex m_lineEnds; // End of each line
     uint32_t m_fileFlags = 0;
     BufferType m_bufferType = BufferType::Normal;
     std::shared_ptr<ZepSyntax> m_spSyntax;
+    std::shared_ptr<ZepSearchHighlight> m_spSearchHighlight;
     std::string m_strName;
     ZepPath m_filePath;
     std::shared_ptr<ZepTheme> m_spOverrideTheme;
     std::map<BufferLocation, std::vector<std::shared_ptr<ILineWidget>>> m_lineWidgets;
 
     BufferRange m_selection;
-    tRangeMarkers m_rangeMarkers;
+    RangeMarkerTree m_rangeMarkers;
+    StringPool m_markerStrings; // Names and descriptions of the markers added by SetMarkers
     BufferLocation m_lastEditLocation{ 0 };
     std::shared_ptr<ZepMode> m_spMode;
     ZepRepl* m_replProvider = nullptr; // May not be set
     SyntaxProvider m_syntaxProvider;
     uint64_t m_updateCount = 0;
     uint64_t m_lastUpdateTime = 0;
+
+    // Load in progress
+    std::shared_ptr<ZepFileMapping> m_spLoadMapping;
+    std::vector<std::future<LoadChunk>> m_loadChunks;
+    size_t m_loadChunksDone = 0;
 };
 
 // Notification payload
@@ -206,6 +206,7 @@ struct EditorConfig
     bool cursorLineSolid = false;
     float backgroundFadeTime = 60.0f;
     float backgroundFadeWait = 60.0f;
+    int64_t ropeStorageThreshold = 32 * 1024 * 1024; // Files at least this big are stored in a rope
 };
 
 class ZepEditor
@@ -325,7 +326,7 @@ public:
 
     void SetBufferSyntax(ZepBuffer& buffer) const;
 
-    EditorConfig GetConfig() const
+    const EditorConfig& GetConfig() const
     {
         return m_config;
     }
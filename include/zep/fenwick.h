@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace Zep
+{
+
+// Prefix sums over a list of values, for the line index and the window's line wrapping.
+// Adding to a value, summing a prefix and searching for a sum are all O(log n)
+template <typename T>
+class Fenwick
+{
+public:
+    void Build(const std::vector<T>& values)
+    {
+        // Linear time construction; each node pushes its sum to its parent
+        m_tree.assign(values.size() + 1, T(0));
+        for (size_t i = 1; i <= values.size(); i++)
+        {
+            m_tree[i] += values[i - 1];
+            auto parent = i + (i & (~i + 1));
+            if (parent <= values.size())
+            {
+                m_tree[parent] += m_tree[i];
+            }
+        }
+
+        m_highBit = values.empty() ? 0 : 1;
+        while (m_highBit * 2 <= values.size())
+        {
+            m_highBit *= 2;
+        }
+    }
+
+    void Add(size_t index, T value)
+    {
+        for (auto i = index + 1; i < m_tree.size(); i += i & (~i + 1))
+        {
+            m_tree[i] += value;
+        }
+    }
+
+    // Sum of the first 'count' values
+    T Prefix(size_t count) const
+    {
+        T sum = T(0);
+        for (auto i = count; i > 0; i -= i & (~i + 1))
+        {
+            sum += m_tree[i];
+        }
+        return sum;
+    }
+
+    // First index where the prefix sum exceeds value; value is made relative to it
+    size_t Search(T& value) const
+    {
+        size_t pos = 0;
+        for (auto step = m_highBit; step != 0; step >>= 1)
+        {
+            if ((pos + step) < m_tree.size() && m_tree[pos + step] <= value)
+            {
+                pos += step;
+                value -= m_tree[pos];
+            }
+        }
+        return pos;
+    }
+
+private:
+    std::vector<T> m_tree;
+    size_t m_highBit = 0;
+};
+
+} // namespace Zep
@@ -2,15 +2,39 @@
 
 #include "zep_config.h"
 
+#include <cstdint>
 #include <memory>
 #include <map>
+#include <mutex>
 #include <string>
+#include <vector>
 #include "zep/mcommon/file/path.h"
 #include <functional>
 
 namespace Zep
 {
 
+// A read only view of the whole of a file
+struct ZepFileMapping
+{
+    virtual ~ZepFileMapping() {};
+    const uint8_t* pData = nullptr;
+    size_t size = 0;
+};
+
+// The fallback mapping; the file is just read into memory
+struct ZepFileMappingRead : public ZepFileMapping
+{
+    ZepFileMappingRead(std::string&& contents)
+        : m_contents(std::move(contents))
+    {
+        pData = (const uint8_t*)m_contents.data();
+        size = m_contents.size();
+    }
+
+    std::string m_contents;
+};
+
 // Zep's view of the outside world in terms of files
 // Below there is a version of this that will work on most platforms using std's <filesystem> for file operations
 // If you want to expose your app's view of the world, you need to implement this minimal set of functions
@@ -21,6 +45,13 @@ public:
     virtual std::string Read(const ZepPath& filePath) = 0;
     virtual bool Write(const ZepPath& filePath, const void* pData, size_t size) = 0;
 
+    // Map a file for reading.  Big files are referenced in place by the buffer, so a file system which can
+    // memory map should, and pages will only be read when they are looked at.  This default just reads the file.
+    virtual std::shared_ptr<ZepFileMapping> Map(const ZepPath& filePath)
+    {
+        return std::make_shared<ZepFileMappingRead>(Read(filePath));
+    }
+
     // The rootpath is either the git working directory or the app current working directory
     virtual ZepPath GetSearchRoot(const ZepPath& start) const = 0;
 
@@ -53,6 +84,7 @@ public:
     ZepFileSystemCPP();
     virtual std::string Read(const ZepPath& filePath) override;
     virtual bool Write(const ZepPath& filePath, const void* pData, size_t size) override;
+    virtual std::shared_ptr<ZepFileMapping> Map(const ZepPath& filePath) override;
     virtual void ScanDirectory(const ZepPath& path, std::function<bool(const ZepPath& path, bool& dont_recurse)> fnScan) const override;
     virtual void SetWorkingDirectory(const ZepPath& path) override;
     virtual const ZepPath& GetWorkingDirectory() const override;
@@ -63,8 +95,21 @@ public:
     virtual bool Equivalent(const ZepPath& path1, const ZepPath& path2) const override;
     virtual ZepPath Canonical(const ZepPath& path) const override;
 
+private:
+    bool IsMapped(uint64_t device, uint64_t inode);
+
 private:
     ZepPath m_workingDirectory;
+
+    // The files mapped for reading; a file is only replaced on save, instead of rewritten, while it is mapped
+    struct MappedFile
+    {
+        uint64_t device;
+        uint64_t inode;
+        std::weak_ptr<ZepFileMapping> wpMapping;
+    };
+    std::mutex m_mappedLock;
+    std::vector<MappedFile> m_mappedFiles;
 };
 #endif // CPP File system
 
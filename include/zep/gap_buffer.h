@@ -29,9 +29,12 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.*/
 #include <memory>
 #include <cassert>
 #include <climits>
+#include <limits>
 #include <cstring>
 #include <string>
 
+#include "text_scan.h"
+
 #ifdef _DEBUG
 #define DEBUG_FILL_GAP for (auto* pCh = m_pGapStart; pCh < m_pGapEnd; pCh++) { *pCh = '@'; }
 #else
@@ -538,18 +541,15 @@ public:
     {
         assert(pEnd <= m_pEnd);
         assert(pStart <= pEnd);
-        while (pStart < m_pGapStart &&
-            pStart < pEnd)
+        if (pStart < m_pGapStart)
         {
-            for (ForwardIt it = s_first; it != s_last; ++it) 
+            auto pBeforeGap = std::min(pEnd, m_pGapStart);
+            auto pFound = (T*)Zep::FindFirstOf<T>(pStart, pBeforeGap, s_first, s_last);
+            if (pFound != pBeforeGap)
             {
-                if (*pStart == *it) 
-                {
-                    assert(pStart <= pEnd);
-                    return pStart;
-                }
+                return pFound;
             }
-            pStart++;
+            pStart = pBeforeGap;
         }
 
         // Skip the gap
@@ -558,20 +558,11 @@ public:
             pStart = m_pGapEnd;
         }
 
-        while (pStart < pEnd)
+        if (pStart >= pEnd)
         {
-            for (ForwardIt it = s_first; it != s_last; ++it) 
-            {
-                if (*pStart == *it) 
-                {
-                    assert(pStart <= pEnd);
-                    return pStart;
-                }
-            }
-            pStart++;
+            return pEnd;
         }
-        assert(pStart <= pEnd);
-        return pEnd;
+        return (T*)Zep::FindFirstOf<T>(pStart, pEnd, s_first, s_last);
     }
 
     template<class ForwardIt>
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+#include "zep/fenwick.h"
+
+namespace Zep
+{
+
+// The end offsets of each line in a buffer; the end is just after the line's '\n' (or the terminating 0).
+// Line ends are held in blocks, each block storing its ends relative to the start of the block.
+// An edit only rewrites the ends in one block; the blocks after it are moved by updating a
+// Fenwick tree of block sizes, so the later offsets are shifted lazily.
+// Looking up a line, finding the line for an offset, and inserting/deleting text are all O(log n)
+class LineIndex
+{
+public:
+    // Blocks are split in two when they grow beyond this many lines
+    static const long MaxBlockLines = 1024;
+
+    // Walks the line ends in order, without copying them
+    class const_iterator
+    {
+    public:
+        typedef std::ptrdiff_t difference_type;
+        typedef long value_type;
+        typedef const long* pointer;
+        typedef long reference;
+        typedef std::forward_iterator_tag iterator_category;
+
+        const_iterator(const LineIndex& index, size_t block, size_t line, long blockStart)
+            : m_pIndex(&index)
+            , m_block(block)
+            , m_line(line)
+            , m_blockStart(blockStart)
+        {
+        }
+
+        bool operator==(const const_iterator& rhs) const { return m_block == rhs.m_block && m_line == rhs.m_line; }
+        bool operator!=(const const_iterator& rhs) const { return !(*this == rhs); }
+
+        long operator*() const { return m_blockStart + m_pIndex->m_blocks[m_block].ends[m_line]; }
+
+        const_iterator& operator++()
+        {
+            auto& ends = m_pIndex->m_blocks[m_block].ends;
+            if (++m_line == ends.size())
+            {
+                m_blockStart += ends.back();
+                m_block++;
+                m_line = 0;
+            }
+            return *this;
+        }
+        const_iterator operator++(int) { auto old = *this; ++(*this); return old; }
+
+    private:
+        const LineIndex* m_pIndex;
+        size_t m_block;
+        size_t m_line;
+        long m_blockStart;
+    };
+
+    const_iterator begin() const { return const_iterator(*this, 0, 0, 0); }
+    const_iterator end() const { return const_iterator(*this, m_blocks.size(), 0, m_totalChars); }
+
+    // Number of lines
+    long size() const { return m_totalLines; }
+    bool empty() const { return m_totalLines == 0; }
+
+    // Lines in the biggest block; used for testing the block layout
+    long GetMaxBlockSize() const;
+
+    void Clear();
+
+    // Replace the index with these (ascending) line ends
+    void Assign(const std::vector<long>& lineEnds);
+    std::vector<long> ToVector() const;
+
+    // The end offset of the line
+    long operator[](long line) const;
+
+    // The first line which ends after the offset; size() if there isn't one
+    long LineFromOffset(long offset) const;
+
+    // Text of length 'length' was inserted at offset; lineEnds are the (absolute) ends of any new lines inside it
+    void Insert(long offset, long length, const std::vector<long>& lineEnds);
+
+    // Text in [startOffset, endOffset) was removed, along with any line ends inside it
+    void Erase(long startOffset, long endOffset);
+
+private:
+    struct Block
+    {
+        std::vector<long> ends; // Relative to the start of the block; the block is ends.back() characters long
+    };
+
+    size_t FindBlockForLine(long& line) const;
+    size_t FindBlockForOffset(long& offset) const;
+    void SplitBlock(size_t block); // Into as many blocks as it takes to fit
+    void Rebuild();
+
+private:
+    std::vector<Block> m_blocks;
+    Fenwick<long> m_blockLines; // Prefix sums over the blocks
+    Fenwick<long> m_blockChars;
+    long m_totalLines = 0;
+    long m_totalChars = 0;
+};
+
+} // namespace Zep
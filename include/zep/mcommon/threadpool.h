@@ -24,6 +24,7 @@ freely, subject to the following restrictions:
 /*
 CM: Note: Modified from the original to support query of the threads available on the machine,
 and fallback to using single threaded if not possible.
+Also adds task priorities, and groups of tasks which can be cancelled together.
 Original here: https://github.com/progschj/ThreadPool
 */
 
@@ -32,7 +33,9 @@ Original here: https://github.com/progschj/ThreadPool
 
 // containers
 #include <vector>
-#include <queue>
+#include <deque>
+#include <array>
+#include <unordered_map>
 // threading
 #include <thread>
 #include <mutex>
@@ -45,6 +48,25 @@ Original here: https://github.com/progschj/ThreadPool
 // exceptions
 #include <stdexcept>
 
+// Higher priority tasks are taken from the queue first; tasks of the same priority in the order they came
+enum class task_priority
+{
+    low,
+    normal,
+    high,
+    count
+};
+
+// Shared by the tasks of a group; a running task checks it to find it has been cancelled
+class cancel_token {
+public:
+    cancel_token() : cancelled(std::make_shared<std::atomic_bool>(false)) {}
+    void cancel() const { *cancelled = true; }
+    bool is_cancelled() const { return *cancelled; }
+private:
+    std::shared_ptr<std::atomic_bool> cancelled;
+};
+
 // std::thread pool for resources recycling
 class ThreadPool {
 public:
@@ -66,11 +88,19 @@ public:
                     {
                         std::unique_lock<std::mutex> lock(this->queue_mutex);
                         this->condition.wait(lock,
-                            [this] { return this->stop || !this->tasks.empty(); });
-                        if (this->stop && this->tasks.empty())
+                            [this] { return this->stop || this->queued != 0; });
+                        if (this->stop && this->queued == 0)
                             return;
-                        task = std::move(this->tasks.front());
-                        this->tasks.pop();
+                        for (auto itr = this->tasks.rbegin(); itr != this->tasks.rend(); ++itr)
+                        {
+                            if (!itr->empty())
+                            {
+                                task = std::move(itr->front().task);
+                                itr->pop_front();
+                                this->queued--;
+                                break;
+                            }
+                        }
                     }
 
                     task();
@@ -94,33 +124,157 @@ public:
                 std::bind(std::forward<F>(f), std::forward<Args>(args)...)
             ));
 
-        // If there are no works, just run the task in the main thread and return
-        if (workers.empty())
+        auto res = task->get_future();
+        push(nullptr, task_priority::normal, [task](){ (*task)(); });
+        return res;
+    }
+    // add a work item owned by group; it is called with the group's token, followed by the arguments.
+    // If the group is cancelled before the task starts, it never runs, and its future is left broken
+    template<class F, class... Args>
+    std::future<typename std::result_of<F(const cancel_token&, Args...)>::type> enqueue_group(const void* group, task_priority priority, F&& f, Args&&... args)
+    {
+        using packaged_task_t = std::packaged_task<typename std::result_of<F(const cancel_token&, Args...)>::type ()>;
+
+        std::shared_ptr<group_state> state;
         {
-            (*task)();
-            return task->get_future();
+            std::unique_lock<std::mutex> lock(this->queue_mutex);
+            auto& entry = this->groups[group];
+            if (!entry)
+                entry = std::make_shared<group_state>();
+            entry->tasks++;
+            state = entry;
         }
+        std::shared_ptr<packaged_task_t> task(new packaged_task_t(
+                std::bind(std::forward<F>(f), state->token, std::forward<Args>(args)...)
+            ));
+
         auto res = task->get_future();
+        push(group, priority, [this, group, state, task](){ (*task)(); finish(group, state); });
+        return res;
+    }
+    // the token the group's tasks are given; the group gets a new one when it is cancelled,
+    // and a group without tasks has none yet, so this is a new one
+    cancel_token group_token(const void* group)
+    {
+        std::unique_lock<std::mutex> lock(this->queue_mutex);
+        auto itrGroup = this->groups.find(group);
+        return itrGroup != this->groups.end() ? itrGroup->second->token : cancel_token();
+    }
+    // the groups with tasks queued or running
+    size_t group_count()
+    {
+        std::unique_lock<std::mutex> lock(this->queue_mutex);
+        return this->groups.size();
+    }
+    // drop the group's tasks which haven't started, and cancel the token of the ones which have.
+    // This doesn't wait for them to see it
+    void cancel_group(const void* group)
+    {
+        std::vector<std::function<void()>> dropped;
         {
             std::unique_lock<std::mutex> lock(this->queue_mutex);
-            this->tasks.emplace([task](){ (*task)(); });
+            auto itrGroup = this->groups.find(group);
+            if (itrGroup == this->groups.end())
+                return;
+            itrGroup->second->token.cancel();
+            this->groups.erase(itrGroup);
+
+            for (auto& queue : this->tasks)
+            {
+                for (auto itr = queue.begin(); itr != queue.end();)
+                {
+                    if (itr->group == group)
+                    {
+                        dropped.push_back(std::move(itr->task));
+                        itr = queue.erase(itr);
+                        this->queued--;
+                    }
+                    else
+                    {
+                        ++itr;
+                    }
+                }
+            }
         }
-        this->condition.notify_one();
-        return res;
+        // The futures of the dropped tasks are broken outside the lock
+    }
+    // cancel everything, and finish with the threads; tasks added after this run immediately
+    void shutdown()
+    {
+        {
+            std::unique_lock<std::mutex> lock(this->queue_mutex);
+            for (auto& group : this->groups)
+                group.second->token.cancel();
+            this->groups.clear();
+            for (auto& queue : this->tasks)
+                queue.clear();
+            this->queued = 0;
+            // set under the lock, so a worker can't check it and then miss the notify
+            this->stop = true;
+        }
+        this->condition.notify_all();
+        for(std::thread& worker : this->workers)
+            worker.join();
+        this->workers.clear();
     }
     // the destructor joins all threads
     virtual ~ThreadPool()
     {
-        this->stop = true;
+        {
+            std::unique_lock<std::mutex> lock(this->queue_mutex);
+            this->stop = true;
+        }
         this->condition.notify_all();
         for(std::thread& worker : this->workers)
             worker.join();
     }
 private:
+    struct group_state
+    {
+        cancel_token token;
+        size_t tasks = 0;
+    };
+
+    // a group is forgotten when its last task is done; unless it was cancelled, and the entry is a new group's
+    void finish(const void* group, const std::shared_ptr<group_state>& state)
+    {
+        std::unique_lock<std::mutex> lock(this->queue_mutex);
+        if (--state->tasks != 0)
+            return;
+        auto itrGroup = this->groups.find(group);
+        if (itrGroup != this->groups.end() && itrGroup->second == state)
+            this->groups.erase(itrGroup);
+    }
+
+    void push(const void* group, task_priority priority, std::function<void()>&& task)
+    {
+        // If there are no works, just run the task in the main thread and return
+        if (workers.empty())
+        {
+            task();
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> lock(this->queue_mutex);
+            this->tasks[size_t(priority)].push_back(queued_task{ group, std::move(task) });
+            this->queued++;
+        }
+        this->condition.notify_one();
+    }
+
+    struct queued_task
+    {
+        const void* group;
+        std::function<void()> task;
+    };
+
     // need to keep track of threads so we can join them
     std::vector< std::thread > workers;
-    // the task queue
-    std::queue< std::function<void()> > tasks;
+    // the task queues, one for each priority
+    std::array< std::deque<queued_task>, size_t(task_priority::count) > tasks;
+    size_t queued = 0;
+    // the token and task count of each group with tasks
+    std::unordered_map< const void*, std::shared_ptr<group_state> > groups;
 
     // synchronization
     std::mutex queue_mutex;
@@ -134,6 +134,9 @@ private:
     void Init();
     bool GetCommand(CommandContext& context);
     bool HandleExCommand(std::string command, const char key);
+    bool Substitute(ZepBuffer& buffer, BufferLocation cursor, const std::string& command);
+    void SetLastSearch(const std::string& pattern);
+    BufferLocation FindSearchMatch(ZepBuffer& buffer, BufferLocation start, SearchDirection dir) const;
 
     std::string m_currentCommand;
     std::string m_lastCommand;
@@ -149,6 +152,8 @@ private:
 
     BufferLocation m_exCommandStartLocation = 0;
     SearchDirection m_lastSearchDirection = SearchDirection::Forward;
+    std::string m_lastSearch;
+    bool m_lastSearchIgnoreCase = false;
 };
 
 } // namespace Zep
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "zep/treap.h"
+
+namespace Zep
+{
+
+struct BufferRange;
+struct RangeMarker;
+
+// The range markers of a buffer, held in a treap ordered by marker start.
+// Each node also tracks the furthest end and the marker types in its subtree, so the markers overlapping a
+// range (or the next one of a type) are found without looking at the rest.
+// An edit moves every marker after it; rather than touching them all, the move is left on the root of each
+// subtree past the edit and pushed down only when a search passes through, so an edit is O(log n) plus the
+// markers it actually overlaps.  Reading a marker's range adds up the moves left on the nodes above it, so
+// RangeMarker::GetRange is O(log n), and looking at the tree never changes it.
+class RangeMarkerTree
+{
+public:
+    using tMarkerCallback = std::function<bool(const std::shared_ptr<RangeMarker>&)>;
+
+    RangeMarkerTree();
+    ~RangeMarkerTree();
+
+    RangeMarkerTree(const RangeMarkerTree& copy) = delete;
+    RangeMarkerTree& operator=(const RangeMarkerTree& copy) = delete;
+
+    size_t size() const
+    {
+        return m_nodes.size();
+    }
+
+    bool empty() const
+    {
+        return m_nodes.empty();
+    }
+
+    void clear();
+
+    // Add the marker at its current range; adding one already in the tree does nothing
+    void Add(const std::shared_ptr<RangeMarker>& spMarker);
+    void Remove(const std::shared_ptr<RangeMarker>& spMarker);
+
+    // Remove every marker of the types, and add these in their place; the tree is rebuilt in one pass,
+    // rather than removing and adding them one at a time
+    void Replace(uint32_t markerTypes, const std::vector<std::shared_ptr<RangeMarker>>& markers);
+
+    // Text was inserted; markers starting at or after the location move along, and markers across it grow
+    void Insert(long location, long length);
+
+    // Text in [first, last) was removed; markers after it move back, and markers inside it shrink
+    void Delete(long first, long last);
+
+    // Call fn with each marker of the types which starts in [begin, end], or starts before begin and reaches
+    // past it; in order of start.  Stops when fn returns false
+    void ForEach(uint32_t markerTypes, bool forward, long begin, long end, const tMarkerCallback& fn) const;
+
+    // The first marker of the types starting after the location (or the last one before it, going backwards)
+    std::shared_ptr<RangeMarker> FindNext(long location, bool forward, uint32_t markerTypes) const;
+
+    // Where a marker in the tree is now
+    BufferRange GetRange(const RangeMarker& marker) const;
+
+    // Move a marker in the tree to a new range
+    void SetRange(RangeMarker& marker, const BufferRange& range);
+
+private:
+    struct Node
+    {
+        std::shared_ptr<RangeMarker> spMarker;
+        long first = 0;
+        long second = 0;
+        long maxSecond = 0; // Furthest end in the subtree
+        long delta = 0; // Move still to be applied to the children
+        uint32_t markerTypes = 0; // All the types in the subtree
+        size_t count = 1;
+        uint32_t priority = 0;
+        Node* pLeft = nullptr;
+        Node* pRight = nullptr;
+        Node* pParent = nullptr;
+    };
+
+    static void Destroy(Node* pNode);
+    static void Detach(Node* pNode, long delta);
+    static void Move(Node* pNode, long delta);
+    static void Push(Node* pNode);
+    static void Pull(Node* pNode);
+    static void SetRange(Node* pNode, long first, long second);
+
+    static void SplitAfter(Node* pNode, long first, Node*& pLeft, Node*& pRight);
+    static void SplitCount(Node* pNode, size_t count, Node*& pLeft, Node*& pRight);
+    static Node* Merge(Node* pLeft, Node* pRight);
+
+    static void Collect(Node* pNode, std::vector<Node*>& nodes);
+
+    static void MoveFrom(Node* pNode, long location, long delta);
+    static void GrowAcross(Node* pNode, long location, long length);
+    static void ClampInto(Node* pNode, long first, long last);
+    // These take the moves still to be applied to the node, so they can search without pushing them down
+    static bool Visit(const Node* pNode, long delta, uint32_t markerTypes, bool forward, long begin, long end, const tMarkerCallback& fn);
+    static const Node* FindAfter(const Node* pNode, long delta, long location, uint32_t markerTypes);
+    static const Node* FindBefore(const Node* pNode, long delta, long location, uint32_t markerTypes);
+
+    void SetRoot(Node* pRoot);
+
+private:
+    Node* m_pRoot = nullptr;
+    std::unordered_map<const RangeMarker*, Node*> m_nodes;
+    TreapPriorities m_priorities;
+};
+
+} // namespace Zep
@@ -0,0 +1,396 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zep/treap.h"
+
+namespace Zep
+{
+
+// A Rope of contiguous chunks, held in an implicit treap ordered by character position.
+// Where the GapBuffer has to move the gap (and everything between) to the edit point, the rope
+// descends to the chunk containing the edit in O(log n) and only ever moves memory inside that chunk.
+// Edits far apart from each other therefore cost the same as edits next to each other.
+// Note: Indexing is a tree descent; sequential readers should use GetSegment and walk the chunk directly.
+// Chunks can also be views of memory owned elsewhere (a mapped file, for example); a view is only
+// copied into the rope when an edit lands in it.
+template <class T>
+class Rope
+{
+public:
+    // Chunks are split when an insert would grow them past this size
+    static const size_t MaxChunk = 4096;
+
+    Rope() = default;
+
+    ~Rope()
+    {
+        Destroy(m_pRoot);
+    }
+
+    Rope(const Rope& copy) = delete;
+    Rope& operator=(const Rope& copy) = delete;
+
+    inline size_t size() const
+    {
+        return m_pRoot ? m_pRoot->size : 0;
+    }
+
+    inline bool empty() const
+    {
+        return size() == 0;
+    }
+
+    void clear()
+    {
+        Destroy(m_pRoot);
+        m_pRoot = nullptr;
+        m_owners.clear();
+    }
+
+    // Replace the contents with this range
+    template <class iter>
+    void assign(iter srcBegin, iter srcEnd)
+    {
+        clear();
+        m_pRoot = Build(srcBegin, srcEnd);
+    }
+
+    template <class iter>
+    void insert(size_t pos, iter srcBegin, iter srcEnd)
+    {
+        assert(pos <= size());
+        auto count = size_t(std::distance(srcBegin, srcEnd));
+        if (count == 0)
+        {
+            return;
+        }
+
+        if (m_pRoot && count <= MaxChunk / 2)
+        {
+            // The common case; typing. Add to the chunk holding the position, splitting a full one first
+            size_t offset = pos;
+            auto pNode = Locate(offset, true, 0);
+            if ((Count(pNode) + count) > MaxChunk)
+            {
+                SplitAt(pos - offset + Count(pNode) / 2);
+            }
+
+            offset = pos;
+            pNode = Locate(offset, true, long(count));
+            Materialize(pNode);
+            pNode->chunk.insert(pNode->chunk.begin() + offset, srcBegin, srcEnd);
+            return;
+        }
+
+        Node* pLeft;
+        Node* pRight;
+        Split(m_pRoot, pos, pLeft, pRight);
+        m_pRoot = Merge(Merge(pLeft, Build(srcBegin, srcEnd)), pRight);
+    }
+
+    void erase(size_t first, size_t last)
+    {
+        assert(first <= last && last <= size());
+        auto count = last - first;
+        if (count == 0)
+        {
+            return;
+        }
+
+        // Removing from inside a single chunk just shrinks it
+        size_t offset = first;
+        auto pNode = Locate(offset, false, 0);
+        if (count < Count(pNode) && (offset + count) <= Count(pNode))
+        {
+            offset = first;
+            pNode = Locate(offset, false, -long(count));
+            Materialize(pNode);
+            pNode->chunk.erase(pNode->chunk.begin() + offset, pNode->chunk.begin() + offset + count);
+            return;
+        }
+
+        Node* pLeft;
+        Node* pMiddle;
+        Node* pRight;
+        Split(m_pRoot, first, pLeft, pRight);
+        Split(pRight, count, pMiddle, pRight);
+        Destroy(pMiddle);
+        m_pRoot = Merge(pLeft, pRight);
+    }
+
+    void push_back(const T& v)
+    {
+        insert(size(), &v, &v + 1);
+    }
+
+    // Add a run of memory owned by someone else to the end, without copying it.
+    // The run is cut into chunk sized views, so an edit only ever copies a chunk of it.
+    // The owner is kept alive for as long as the rope might refer to it
+    void append_view(const T* pData, size_t count, const std::shared_ptr<const void>& spOwner)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        if (m_owners.empty() || m_owners.back() != spOwner)
+        {
+            m_owners.push_back(spOwner);
+        }
+
+        const size_t viewSize = (MaxChunk * 3) / 4;
+        for (size_t offset = 0; offset < count; offset += viewSize)
+        {
+            auto pNode = NewNode();
+            pNode->pView = pData + offset;
+            pNode->viewSize = std::min(viewSize, count - offset);
+            Update(pNode);
+            m_pRoot = Merge(m_pRoot, pNode);
+        }
+    }
+
+    T& operator[](size_t pos)
+    {
+        assert(pos < size());
+        auto pNode = Locate(pos, false, 0);
+        Materialize(pNode);
+        return pNode->chunk[pos];
+    }
+
+    const T& operator[](size_t pos) const
+    {
+        assert(pos < size());
+        auto pNode = Locate(pos, false, 0);
+        return Data(pNode)[pos];
+    }
+
+    // Return the contiguous run of memory holding this position
+    void GetSegment(size_t pos, const T*& pSegment, size_t& segmentStart, size_t& segmentLength) const
+    {
+        assert(pos < size());
+        auto offset = pos;
+        auto pNode = Locate(offset, false, 0);
+        pSegment = Data(pNode);
+        segmentStart = pos - offset;
+        segmentLength = Count(pNode);
+    }
+
+    // Walk the chunks in order
+    template <class F>
+    void ForEachSegment(F fn) const
+    {
+        Walk(m_pRoot, fn);
+    }
+
+    std::string string() const
+    {
+        std::string str;
+        str.reserve(size());
+        ForEachSegment([&](const T* pData, size_t count) {
+            str.append((const char*)pData, count);
+        });
+        return str;
+    }
+
+    // Number of chunks; used for testing the tree shape
+    size_t segment_count() const
+    {
+        size_t count = 0;
+        ForEachSegment([&](const T*, size_t) { count++; });
+        return count;
+    }
+
+private:
+    struct Node
+    {
+        std::vector<T> chunk; // Characters owned by the rope
+        const T* pView = nullptr; // ... or characters owned by someone else
+        size_t viewSize = 0;
+        size_t size = 0; // Characters in this sub tree
+        uint32_t priority = 0;
+        Node* pLeft = nullptr;
+        Node* pRight = nullptr;
+    };
+
+    static inline size_t Size(const Node* pNode)
+    {
+        return pNode ? pNode->size : 0;
+    }
+
+    static inline size_t Count(const Node* pNode)
+    {
+        return pNode->pView ? pNode->viewSize : pNode->chunk.size();
+    }
+
+    static inline const T* Data(const Node* pNode)
+    {
+        return pNode->pView ? pNode->pView : pNode->chunk.data();
+    }
+
+    // Copy a view into the rope, so it can be edited
+    static void Materialize(Node* pNode)
+    {
+        if (pNode->pView)
+        {
+            pNode->chunk.assign(pNode->pView, pNode->pView + pNode->viewSize);
+            pNode->pView = nullptr;
+            pNode->viewSize = 0;
+        }
+    }
+
+    static inline void Update(Node* pNode)
+    {
+        pNode->size = Size(pNode->pLeft) + Count(pNode) + Size(pNode->pRight);
+    }
+
+    Node* NewNode()
+    {
+        auto pNode = new Node();
+        pNode->priority = m_priorities();
+        return pNode;
+    }
+
+    static void Destroy(Node* pNode)
+    {
+        if (!pNode)
+        {
+            return;
+        }
+        Destroy(pNode->pLeft);
+        Destroy(pNode->pRight);
+        delete pNode;
+    }
+
+    template <class F>
+    static void Walk(const Node* pNode, F& fn)
+    {
+        if (!pNode)
+        {
+            return;
+        }
+        Walk(pNode->pLeft, fn);
+        if (Count(pNode) != 0)
+        {
+            fn(Data(pNode), Count(pNode));
+        }
+        Walk(pNode->pRight, fn);
+    }
+
+    // Find the node holding pos, and convert pos to an offset inside its chunk.
+    // For inserts, the end of the last chunk is a valid position.
+    // Sizes on the path down are adjusted by delta, for an edit that is about to happen in the found chunk
+    Node* Locate(size_t& pos, bool forInsert, long delta) const
+    {
+        auto pNode = m_pRoot;
+        while (pNode)
+        {
+            auto leftSize = Size(pNode->pLeft);
+            auto chunkSize = Count(pNode);
+            if (delta != 0)
+            {
+                // Only write for edits; readers on other threads share this path
+                pNode->size += delta;
+            }
+            if (pos < leftSize)
+            {
+                pNode = pNode->pLeft;
+            }
+            else if ((pos - leftSize) < chunkSize || (forInsert && (pos - leftSize) == chunkSize && !pNode->pRight))
+            {
+                pos -= leftSize;
+                return pNode;
+            }
+            else
+            {
+                pos -= leftSize + chunkSize;
+                pNode = pNode->pRight;
+            }
+        }
+        assert(!"Position not in rope");
+        return nullptr;
+    }
+
+    // Ensure a chunk boundary at pos
+    void SplitAt(size_t pos)
+    {
+        Node* pLeft;
+        Node* pRight;
+        Split(m_pRoot, pos, pLeft, pRight);
+        m_pRoot = Merge(pLeft, pRight);
+    }
+
+    // Split the tree into [0, pos) and [pos, size), cutting a chunk in two if necessary
+    void Split(Node* pNode, size_t pos, Node*& pLeft, Node*& pRight)
+    {
+        auto fnLeft = [this](Node* pAt, size_t& at, Node*& pTail) {
+            auto leftSize = Size(pAt->pLeft);
+            auto chunkSize = Count(pAt);
+            if (at <= leftSize)
+            {
+                return false;
+            }
+            if (at >= leftSize + chunkSize)
+            {
+                at -= leftSize + chunkSize;
+                return true;
+            }
+
+            auto offset = at - leftSize;
+            pTail = NewNode();
+            if (pAt->pView)
+            {
+                // Views split without copying
+                pTail->pView = pAt->pView + offset;
+                pTail->viewSize = pAt->viewSize - offset;
+                pAt->viewSize = offset;
+            }
+            else
+            {
+                pTail->chunk.assign(pAt->chunk.begin() + offset, pAt->chunk.end());
+                pAt->chunk.resize(offset);
+            }
+            Update(pTail);
+            return true;
+        };
+        TreapSplit(pNode, pos, pLeft, pRight, fnLeft, Update);
+    }
+
+    static Node* Merge(Node* pLeft, Node* pRight)
+    {
+        return TreapMerge(pLeft, pRight, Update);
+    }
+
+    // Make a tree from a range, in linear time.
+    // Chunks are left 3/4 full so that small inserts don't immediately split them
+    template <class iter>
+    Node* Build(iter srcBegin, iter srcEnd)
+    {
+        std::vector<Node*> nodes;
+        while (srcBegin != srcEnd)
+        {
+            auto count = std::min(size_t(std::distance(srcBegin, srcEnd)), (MaxChunk * 3) / 4);
+            auto itrNext = srcBegin;
+            std::advance(itrNext, count);
+
+            auto pNode = NewNode();
+            pNode->chunk.assign(srcBegin, itrNext);
+            srcBegin = itrNext;
+            nodes.push_back(pNode);
+        }
+        return TreapBuild(nodes, Update);
+    }
+
+private:
+    Node* m_pRoot = nullptr;
+    TreapPriorities m_priorities;
+    std::vector<std::shared_ptr<const void>> m_owners; // Keeps the memory behind views alive
+};
+
+} // namespace Zep
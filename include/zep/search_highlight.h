@@ -0,0 +1,90 @@
+#pragma once
+
+#include "buffer.h"
+
+#include "mcommon/threadpool.h"
+
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Zep
+{
+
+// The matches of the current search pattern in a buffer, found on the thread pool.
+// Matches are kept as a sorted array of start offsets; they are all the length of the pattern.
+// The search starts with the visible range, and results are handed back to the UI on the editor tick.
+// When the pattern is extended, only the previous matches (and anything not yet searched) are checked.
+// Edits shift the matches, and only the text around the edit is searched again.
+class ZepSearchHighlight : public ZepComponent
+{
+public:
+    ZepSearchHighlight(ZepBuffer& buffer);
+    virtual ~ZepSearchHighlight();
+
+    // Highlight this pattern; the visible range is searched before the rest of the buffer
+    void SetPattern(const std::string& pattern, bool ignoreCase, const BufferRange& visibleRange);
+    void Clear();
+
+    const std::string& GetPattern() const
+    {
+        return m_pattern;
+    }
+
+    // The match the cursor is on; shown differently to the others
+    void SetCurrent(BufferLocation location);
+    BufferLocation GetCurrent() const
+    {
+        return m_current;
+    }
+
+    // True until the whole buffer has been searched
+    bool IsSearching() const;
+
+    // Finish searching, and pick up all the results
+    void Wait();
+
+    // All of the matches found so far, sorted
+    const std::vector<long>& GetMatches() const
+    {
+        return m_matches;
+    }
+
+    // The matches which overlap [begin, end)
+    void GetMatches(BufferLocation begin, BufferLocation end, const long*& pBegin, const long*& pEnd) const;
+
+    virtual void Notify(std::shared_ptr<ZepMessage> message) override;
+
+private:
+    void Start();
+    void Interrupt();
+    void MergePending();
+    void SearchRanges(const cancel_token& token);
+    void Publish(std::vector<long>& batch);
+
+    void UpdateForInsert(BufferLocation startOffset, BufferLocation endOffset);
+    void UpdateForDelete(BufferLocation startOffset, BufferLocation endOffset);
+    void UpdateForChange(BufferLocation startOffset, BufferLocation endOffset);
+
+private:
+    ZepBuffer& m_buffer;
+    std::string m_pattern;
+    bool m_ignoreCase = false;
+    BufferLocation m_current = InvalidOffset;
+
+    std::vector<long> m_matches; // Sorted match starts; only touched by the UI
+    std::vector<long> m_candidates; // Sorted matches of a shorter pattern, still to be checked
+
+    // Ranges of match starts still to search, in the order they will be searched.
+    // Only touched by the search job while it is running
+    std::vector<BufferRange> m_verify; // ... by checking the candidates in them
+    std::vector<BufferRange> m_todo; // ... by searching the text
+
+    std::mutex m_pendingLock;
+    std::vector<long> m_pending; // Matches found by the job, not yet merged
+
+    std::future<void> m_searchResult;
+};
+
+} // namespace Zep
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Zep
+{
+
+// A shared, immutable string.  Copies share the text, so thousands of markers with the same message
+// hold one copy of it.  Assigning a plain string makes a new one; use a StringPool to share them
+class InternedString
+{
+public:
+    InternedString() = default;
+
+    InternedString(const char* pStr)
+        : m_spString(std::make_shared<const std::string>(pStr))
+    {
+    }
+
+    InternedString(const std::string& str)
+        : m_spString(std::make_shared<const std::string>(str))
+    {
+    }
+
+    explicit InternedString(std::shared_ptr<const std::string> spString)
+        : m_spString(std::move(spString))
+    {
+    }
+
+    const std::string& str() const
+    {
+        return m_spString ? *m_spString : Empty();
+    }
+
+    operator const std::string&() const
+    {
+        return str();
+    }
+
+    const char* c_str() const
+    {
+        return str().c_str();
+    }
+
+    size_t size() const
+    {
+        return str().size();
+    }
+
+    bool empty() const
+    {
+        return str().empty();
+    }
+
+    // True if the two share the same text, not just equal text
+    bool SameAs(const InternedString& rhs) const
+    {
+        return m_spString == rhs.m_spString;
+    }
+
+    bool operator==(const InternedString& rhs) const
+    {
+        return SameAs(rhs) || str() == rhs.str();
+    }
+
+    bool operator!=(const InternedString& rhs) const
+    {
+        return !(*this == rhs);
+    }
+
+private:
+    static const std::string& Empty()
+    {
+        static const std::string empty;
+        return empty;
+    }
+
+    std::shared_ptr<const std::string> m_spString;
+};
+
+// Hands out one InternedString for each distinct text
+class StringPool
+{
+public:
+    // A null or empty string gives the empty string
+    InternedString Intern(const char* pStr);
+
+    // Forget the strings nothing else is holding
+    void Prune();
+
+    size_t size() const
+    {
+        return m_count;
+    }
+
+private:
+    // Buckets keyed by hash, so a lookup doesn't have to build a std::string
+    std::unordered_map<uint64_t, std::vector<std::shared_ptr<const std::string>>> m_strings;
+    size_t m_count = 0;
+};
+
+} // namespace Zep
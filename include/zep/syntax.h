@@ -1,17 +1,27 @@
 #pragma once
 
 #include "buffer.h"
+#include "syntax_brackets.h"
+#include "syntax_runs.h"
+#include "syntax_words.h"
+
+#include "mcommon/threadpool.h"
 
 #include <atomic>
 #include <future>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace Zep
 {
 
 enum class ThemeColor;
+class ZepWindow;
 
 struct CommentEntry
 {
@@ -29,11 +39,55 @@ enum
 };
 };
 
+// What the end of a line is inside of; the next line carries on in the same state
+struct SyntaxLineState
+{
+    uint8_t quote = 0; // A string continued on the next line by a backslash; this is its quote
+    bool comment = false; // A /* */ comment
+    uint8_t region = 0; // For lexers with their own regions (comments, strings, ...); 0 for none
+    uint16_t depth = 0; // How deep a region that nests is
+
+    bool operator==(const SyntaxLineState& rhs) const
+    {
+        return quote == rhs.quote && comment == rhs.comment && region == rhs.region && depth == rhs.depth;
+    }
+    bool operator!=(const SyntaxLineState& rhs) const
+    {
+        return !(*this == rhs);
+    }
+};
+
+// Lines [first, second) to lex
+using SyntaxLineRange = std::pair<long, long>;
+
 struct SyntaxData
 {
     ThemeColor foreground = ThemeColor::Normal;
     ThemeColor background = ThemeColor::None;
     bool underline = false;
+
+    bool operator==(const SyntaxData& rhs) const
+    {
+        return foreground == rhs.foreground && background == rhs.background && underline == rhs.underline;
+    }
+    bool operator!=(const SyntaxData& rhs) const
+    {
+        return !(*this == rhs);
+    }
+};
+
+// A run of characters [first, last) with the same syntax
+struct SyntaxSpan
+{
+    long first = 0;
+    long last = 0;
+    SyntaxData data;
+};
+
+// Syntax the worker has finished, covering the buffer from the first span to the last
+struct SyntaxPatch
+{
+    std::vector<SyntaxSpan> spans;
 };
 
 class ZepSyntaxAdorn;
@@ -46,38 +100,112 @@ public:
         uint32_t flags = 0);
     virtual ~ZepSyntax();
 
+protected:
+    // For lexers which override LexLine; they call Start once they are constructed
+    ZepSyntax(ZepBuffer& buffer,
+        const std::set<std::string>& keywords,
+        const std::set<std::string>& identifiers,
+        uint32_t flags,
+        bool start);
+    void Start();
+
+public:
     virtual SyntaxData GetSyntaxAt(long index) const;
-    virtual void UpdateSyntax();
+
+    // The syntax of [begin, end) as runs of the same colors, with the adornments applied
+    virtual void GetSyntaxSpans(long begin, long end, std::vector<SyntaxSpan>& spans) const;
+    virtual void UpdateSyntax(const cancel_token& token);
     virtual void Interrupt();
-    virtual void Wait() const;
+    // Finish lexing, and pick up the results
+    virtual void Wait();
 
     virtual long GetProcessedChar() const
     {
         return m_processedChar;
     }
-    virtual const std::vector<SyntaxData>& GetText() const
+
+    // How many lines have been lexed, in total
+    long GetLexedLineCount() const
+    {
+        return m_lexedLineCount;
+    }
+    virtual const SyntaxRuns& GetRuns() const
     {
         return m_syntax;
     }
+
+    // The brackets outside of strings and comments, as far as the lexer has got
+    const SyntaxBrackets& GetBrackets() const
+    {
+        return m_brackets;
+    }
     virtual void Notify(std::shared_ptr<ZepMessage> payload) override;
 
+    // The buffer lines [firstLine, lastLine) a window is showing.  When they are still to be lexed, and so are
+    // lines above them, they are lexed first (from a guess at their starting state) and then again in order.
+    // This doesn't wait for the worker; it picks up the change at the next line
+    void SetVisibleLines(const ZepWindow* pWindow, long firstLine, long lastLine);
+
+    // The window is closing, or showing another buffer
+    void ClearVisibleLines(const ZepWindow* pWindow);
+
 private:
-    virtual void QueueUpdateSyntax(BufferLocation startLocation, BufferLocation endLocation);
+    virtual void QueueUpdateSyntax();
+    void InvalidateLines(long firstLine, long lastLine);
+    void UpdateLinesForInsert(BufferLocation startLocation);
+    void UpdateLinesForDelete(BufferLocation startLocation);
+    template <typename F>
+    void MapVisibleLines(F&& fnMap);
+    SyntaxLineState LexBufferLine(long line, SyntaxLineState state);
+    void LexVisibleLines(const cancel_token& token);
+    void Publish();
+    void MergePending();
+    void UpdateBrackets(const SyntaxPatch& patch);
 
 protected:
+    // Lex the line, which starts in the given state, and return the state it ends in.
+    // Colors are given to AddSpan, from the start of the line to the end
+    virtual SyntaxLineState LexLine(long lineStart, const std::string& line, SyntaxLineState state);
+    void AddSpan(long first, long last, ThemeColor color);
+    ThemeColor GetTokenColor(const char* pToken, const char* pTokenEnd) const;
+
     ZepBuffer& m_buffer;
     std::vector<CommentEntry> m_commentEntries;
-    std::vector<SyntaxData> m_syntax;
+    // The UI reads m_syntax without waiting for the worker, which lexes into runs in m_patch.
+    // Finished lines are handed back in batches, and copied over on the editor tick
+    SyntaxRuns m_syntax;
+    SyntaxBrackets m_brackets;
+    std::vector<SyntaxBracket> m_patchBrackets;
+    SyntaxPatch m_patch;
+    std::mutex m_pendingLock;
+    std::vector<SyntaxPatch> m_pending;
     std::future<void> m_syntaxResult;
     std::atomic<long> m_processedChar = { 0 };
-    std::atomic<long> m_targetChar = { 0 };
+
+    // The state at the end of each line, and the lines still to lex.
+    // After an edit, lexing starts at the first changed line and stops at the first line after the edit that
+    // ends in the same state as it did before; the lines after that can't have changed
+    std::vector<SyntaxLineState> m_lineStates;
+    std::vector<SyntaxLineRange> m_dirtyLines;
+    std::string m_lineText;
+    long m_lexedLineCount = 0;
     std::vector<uint32_t> m_multiCommentStarts;
     std::vector<uint32_t> m_multiCommentEnds;
-    std::set<std::string> m_keywords;
-    std::set<std::string> m_identifiers;
-    std::atomic<bool> m_stop;
+    SyntaxWordTable m_words;
+
+    // The lines each window shows; set by the UI, read by the worker
+    std::mutex m_visibleLock;
+    std::map<const ZepWindow*, SyntaxLineRange> m_visibleLines;
+    std::atomic<bool> m_visibleChanged = { false };
+    std::vector<SyntaxLineRange> m_visibleLexed; // Visible lines lexed out of order since the last edit
+
     std::vector<std::shared_ptr<ZepSyntaxAdorn>> m_adornments;
     uint32_t m_flags;
+
+    // Scratch for GetSyntaxSpans, kept so drawing a line doesn't allocate
+    mutable std::vector<SyntaxSpan> m_spanRuns;
+    mutable std::vector<std::vector<SyntaxSpan>> m_adornSpans;
+    mutable std::vector<size_t> m_adornIndex;
 };
 
 class ZepSyntaxAdorn : public ZepComponent
@@ -92,6 +220,9 @@ public:
 
     virtual SyntaxData GetSyntaxAt(long offset, bool& found) const = 0;
 
+    // The characters in [begin, end) this adornment colors, in order
+    virtual void GetSyntaxSpans(long begin, long end, std::vector<SyntaxSpan>& spans) const = 0;
+
 protected:
     ZepBuffer& m_buffer;
     ZepSyntax& m_syntax;
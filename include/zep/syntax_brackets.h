@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "zep/treap.h"
+
+namespace Zep
+{
+
+enum class BracketType : uint8_t
+{
+    Bracket = 0, // ()
+    Brace = 1, // {}
+    Group = 2, // []
+    Max = 3
+};
+
+struct SyntaxBracket
+{
+    long offset;
+    BracketType type;
+    bool open;
+};
+
+struct SyntaxBracketInfo
+{
+    long offset;
+    BracketType type;
+    bool open;
+    int32_t depth; // Of brackets of its type, before it.  A close at depth 0 has no open
+};
+
+// The brackets in a buffer, in a treap.  Each bracket stores the distance from the bracket before it, so an
+// edit only touches the brackets next to it.  Depths are never stored; each subtree keeps what it does to the
+// depth of the brackets after it, so the depth at a bracket is found on the way down to it, and the
+// matching bracket is found by skipping the subtrees which can't hold it
+class SyntaxBrackets
+{
+public:
+    SyntaxBrackets();
+    ~SyntaxBrackets();
+    SyntaxBrackets(const SyntaxBrackets&) = delete;
+    SyntaxBrackets& operator=(const SyntaxBrackets&) = delete;
+
+    // Which bracket a character is, if it is one
+    static bool GetBracketType(char ch, BracketType& type, bool& open);
+
+    long GetCount() const;
+    void clear();
+
+    // Text was inserted or erased; move the brackets after it
+    void Insert(long location, long length);
+    void Erase(long first, long last);
+
+    // The brackets in [first, last) are now these, in order
+    void Replace(long first, long last, const std::vector<SyntaxBracket>& brackets);
+
+    bool GetBracket(long offset, SyntaxBracketInfo& info) const;
+    void GetBrackets(long begin, long end, std::vector<SyntaxBracketInfo>& brackets) const;
+
+    // The first bracket of the type, if the type has more opens than closes; -1 if not
+    long GetFirstUnclosed(BracketType type) const;
+
+    // The bracket which pairs with the one at offset; -1 if it isn't a bracket or has no pair
+    long MatchingBracket(long offset) const;
+
+    // The innermost pair of brackets around offset, or which offset is one of; of the type, or of any type
+    // for BracketType::Max
+    bool EnclosingScope(long offset, long& open, long& close, BracketType type = BracketType::Max) const;
+
+private:
+    static const int32_t Unbounded = std::numeric_limits<int32_t>::max() / 4;
+
+    // What a run of brackets does to the depth of one type: depth becomes max(floor, depth + shift).
+    // A close at depth 0 doesn't match, and leaves the depth at 0.  The lowest sum of a prefix and the
+    // highest sum of a suffix find where a bracket's pair is
+    struct DepthChange
+    {
+        int32_t shift = 0;
+        int32_t floor = -Unbounded;
+        int32_t minPrefix = Unbounded;
+        int32_t maxSuffix = -Unbounded;
+
+        int32_t Apply(int32_t depth) const
+        {
+            return std::max(floor, depth + shift);
+        }
+        // This, then next
+        DepthChange Then(const DepthChange& next) const
+        {
+            DepthChange change;
+            change.shift = shift + next.shift;
+            change.floor = std::max(next.floor, floor + next.shift);
+            change.minPrefix = std::min(minPrefix, shift + next.minPrefix);
+            change.maxSuffix = std::max(next.maxSuffix, next.shift + maxSuffix);
+            return change;
+        }
+    };
+    using DepthChanges = std::array<DepthChange, size_t(BracketType::Max)>;
+
+    struct Node
+    {
+        Node* pLeft = nullptr;
+        Node* pRight = nullptr;
+        uint32_t priority = 0;
+        long distance = 0; // From the bracket before (or from -1, for the first)
+        long total = 0; // Distance over the subtree
+        BracketType type = BracketType::Bracket;
+        bool open = false;
+        DepthChanges changes; // Over the subtree
+        std::array<long, size_t(BracketType::Max)> counts; // Brackets of each type, over the subtree
+    };
+
+    template <typename F>
+    static void VisitBrackets(const Node* pNode, long nodeStart, const DepthChanges& before, long begin, long end, F&& fn);
+    static long FindClose(const Node* pNode, long nodeStart, long after, size_t type, int32_t& sum);
+    static long FindOpen(const Node* pNode, long nodeStart, long before, size_t type, int32_t& sum);
+
+    static long Total(const Node* pNode)
+    {
+        return pNode ? pNode->total : 0;
+    }
+    static DepthChanges Then(const DepthChanges& first, const DepthChanges& next);
+    static DepthChanges GetOwnChanges(const Node* pNode);
+    static void Pull(Node* pNode);
+    static void Destroy(Node* pNode);
+    Node* MakeNode(long distance, BracketType type, bool open);
+    static void Split(Node* pNode, long offset, Node*& pLeft, Node*& pRight);
+    static Node* Merge(Node* pLeft, Node* pRight);
+    static void AddToFirst(Node* pNode, long distance);
+
+    Node* m_pRoot = nullptr;
+    TreapPriorities m_priorities;
+};
+
+} // namespace Zep
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "syntax.h"
+#include "theme.h"
+
+#include <array>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Zep
+{
+
+class ZepEditor;
+class ZepPath;
+
+// A part of the text colored as one, such as a comment or a string
+struct SyntaxGrammarRegion
+{
+    std::string open;
+    std::string close; // Empty for a region which runs to the end of the line
+    ThemeColor color = ThemeColor::Comment;
+    char escape = 0; // Skips the character after it; at the end of a line, it carries the region on to the next
+    bool multiLine = false; // Carries on over line ends until it is closed
+    bool nested = false; // The open can appear inside, and needs a close of its own
+};
+
+// The strings a lexer looks for at a position, as a DFA; the longest one which matches wins
+class SyntaxMatcher
+{
+public:
+    SyntaxMatcher();
+    void Add(const std::string& str, uint8_t value);
+
+    // The value of the longest string at pos, or 0 if none match; length is set to its length
+    uint8_t Match(const std::string& line, size_t pos, size_t& length) const
+    {
+        length = 0;
+        uint8_t value = 0;
+        int16_t state = 0;
+        for (auto index = pos; index < line.size(); index++)
+        {
+            state = m_next[size_t(state)][uint8_t(line[index])];
+            if (state <= 0)
+            {
+                break;
+            }
+            if (m_accept[size_t(state)] != 0)
+            {
+                value = m_accept[size_t(state)];
+                length = index - pos + 1;
+            }
+        }
+        return value;
+    }
+
+    // True if a string could start with the character; a quick test before calling Match
+    bool CanStart(char ch) const
+    {
+        return m_next[0][uint8_t(ch)] > 0;
+    }
+
+private:
+    std::vector<std::array<int16_t, 256>> m_next; // Transitions; 0 is the start, and no transition
+    std::vector<uint8_t> m_accept; // The value of the string which ends in each state
+};
+
+// A syntax described by data instead of code, so languages can be added without building zep.
+// It is loaded from TOML; see LoadSyntaxGrammar
+struct SyntaxGrammar
+{
+    std::string id;
+    std::vector<std::string> extensions;
+    std::set<std::string> keywords;
+    std::set<std::string> identifiers;
+    std::string delimiters = " \t.;(){}=:,";
+    bool caseInsensitive = false;
+    std::vector<SyntaxGrammarRegion> regions;
+
+    // Build the tables below; call after filling in the fields above
+    void Compile();
+
+    enum class CharClass : uint8_t
+    {
+        Token,
+        Delimiter,
+        Whitespace
+    };
+    std::array<CharClass, 256> charClasses;
+    SyntaxMatcher opens; // Region opens, giving the region index + 1
+    std::vector<SyntaxMatcher> ends; // For each region, its close (1) and, when it nests, its open (2)
+};
+
+// A syntax lexed from the tables of a grammar
+class ZepSyntax_Grammar : public ZepSyntax
+{
+public:
+    ZepSyntax_Grammar(ZepBuffer& buffer, std::shared_ptr<SyntaxGrammar> spGrammar);
+    virtual ~ZepSyntax_Grammar();
+
+protected:
+    virtual SyntaxLineState LexLine(long lineStart, const std::string& line, SyntaxLineState state) override;
+
+private:
+    size_t LexRegion(long lineStart, const std::string& line, size_t first, size_t pos, SyntaxLineState& state);
+
+private:
+    std::shared_ptr<SyntaxGrammar> m_spGrammar;
+};
+
+// Read a grammar from TOML text:
+//
+//   [syntax]
+//   id = "mylang"
+//   extensions = [".my"]
+//   keywords = ["if", "else"]
+//   identifiers = ["print"]
+//   case_insensitive = false
+//   delimiters = " \t.;(){}=:,"
+//
+//   [[syntax.region]]
+//   type = "comment"          # comment, string, keyword, identifier, number or normal
+//   open = "/*"
+//   close = "*/"              # leave out for a region which ends with the line
+//   escape = "\\"
+//   multiline = true
+//   nested = true
+//
+// Returns null, and sets error, if it can't be read
+std::shared_ptr<SyntaxGrammar> LoadSyntaxGrammar(const std::string& text, std::string& error);
+
+void RegisterSyntaxGrammar(ZepEditor& editor, std::shared_ptr<SyntaxGrammar> spGrammar);
+
+// Register each *.toml grammar in the directory
+void RegisterSyntaxGrammars(ZepEditor& editor, const ZepPath& directory);
+
+} // namespace Zep
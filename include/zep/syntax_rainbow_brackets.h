@@ -1,12 +1,13 @@
 #pragma once
 #include "syntax.h"
-#include <list>
+#include "syntax_brackets.h"
 #include <string>
-#include <unordered_map>
 
 namespace Zep
 {
 
+// Colors each bracket by how deep it is, and marks the ones which don't match.
+// All brackets count, even those in strings and comments
 class ZepSyntaxAdorn_RainbowBrackets : public ZepSyntaxAdorn
 {
 public:
@@ -16,29 +17,27 @@ public:
 
     void Notify(std::shared_ptr<ZepMessage> payload) override;
     virtual SyntaxData GetSyntaxAt(long offset, bool& found) const override;
+    virtual void GetSyntaxSpans(long begin, long end, std::vector<SyntaxSpan>& spans) const override;
 
     virtual void Clear(long start, long end);
     virtual void Insert(long start, long end);
     virtual void Update(long start, long end);
 
-private:
-    void RefreshBrackets();
-    enum class BracketType
+    // How many brackets there are
+    long GetBracketCount() const
     {
-        Bracket = 0,
-        Brace = 1,
-        Group = 2,
-        Max = 3
-    };
+        return m_brackets.GetCount();
+    }
 
-    struct Bracket
-    {
-        int32_t indent;
-        BracketType type;
-        bool is_open;
-        bool valid = true;
-    };
-    std::map<BufferLocation, Bracket> m_brackets;
+private:
+    using BracketOffsets = std::array<long, size_t(BracketType::Max)>;
+    static SyntaxData GetBracketSyntax(int32_t indent, bool valid);
+    static SyntaxData GetBracketSyntax(const SyntaxBracketInfo& info, const BracketOffsets& unclosed);
+    BracketOffsets GetUnclosed() const;
+
+    SyntaxBrackets m_brackets;
+    std::vector<SyntaxBracket> m_updated;
+    mutable std::vector<SyntaxBracketInfo> m_spanBrackets;
 };
 
 } // namespace Zep
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "zep/treap.h"
+
+namespace Zep
+{
+
+struct SyntaxData;
+struct SyntaxSpan;
+
+// The syntax of a buffer, held as runs of characters with the same colors.
+// A run packs into 8 bytes, and a line of code has a handful of them, so this is a fraction of the size of
+// a SyntaxData per character.
+// Runs are kept in small chunks, and the chunks in a treap ordered by position; each node knows the length
+// of its subtree, so finding an offset, or replacing a range on an edit, is O(log n) whatever the size of
+// the buffer
+class SyntaxRuns
+{
+public:
+    SyntaxRuns();
+    ~SyntaxRuns();
+
+    SyntaxRuns(const SyntaxRuns& copy) = delete;
+    SyntaxRuns& operator=(const SyntaxRuns& copy) = delete;
+
+    long size() const;
+    void clear();
+
+    // Make it length characters of default syntax
+    void Assign(long length);
+
+    // Add or remove default syntax at the end, to make it length characters
+    void Resize(long length);
+
+    // Replace [first, last) with the spans, which follow on from each other, starting at first
+    void Replace(long first, long last, const std::vector<SyntaxSpan>& spans);
+
+    // Characters of default syntax were inserted
+    void Insert(long location, long length);
+    void Erase(long first, long last);
+
+    SyntaxData Get(long offset) const;
+
+    // The runs which overlap [begin, end), cut to fit it
+    void GetSpans(long begin, long end, std::vector<SyntaxSpan>& spans) const;
+
+    // How many runs are stored; neighbors the same are joined, though not always across chunks
+    size_t GetRunCount() const;
+
+private:
+    struct Run
+    {
+        uint32_t length = 0;
+        uint8_t foreground = 0;
+        uint8_t background = 0;
+        uint8_t underline = 0;
+    };
+
+    struct Node
+    {
+        std::vector<Run> runs;
+        long length = 0; // Characters in this chunk
+        long total = 0; // Characters in the subtree
+        uint32_t priority = 0;
+        Node* pLeft = nullptr;
+        Node* pRight = nullptr;
+    };
+
+    static Run MakeRun(long length, const SyntaxData& data);
+    static SyntaxData GetData(const Run& run);
+    static void AppendRun(std::vector<Run>& runs, Run run, long length);
+
+    static long Total(const Node* pNode)
+    {
+        return pNode ? pNode->total : 0;
+    }
+    static void Destroy(Node* pNode);
+    static void Pull(Node* pNode);
+    static Node* Merge(Node* pLeft, Node* pRight);
+    static Node* RemoveFirst(Node*& pNode);
+    static Node* RemoveLast(Node*& pNode);
+    static void CollectSpans(const Node* pNode, long nodeStart, long begin, long end, std::vector<SyntaxSpan>& spans);
+    static size_t CountRuns(const Node* pNode);
+
+    Node* MakeNode(std::vector<Run>&& runs);
+    void Split(Node* pNode, long offset, Node*& pLeft, Node*& pRight);
+
+private:
+    Node* m_pRoot = nullptr;
+    TreapPriorities m_priorities;
+};
+
+} // namespace Zep
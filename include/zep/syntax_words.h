@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Zep
+{
+
+enum class ThemeColor;
+
+// The keywords and identifiers of a syntax, in an open addressed hash table.
+// A token is looked up where it lies in the line, so lexing doesn't build a string for each one
+class SyntaxWordTable
+{
+public:
+    SyntaxWordTable(const std::set<std::string>& keywords, const std::set<std::string>& identifiers, bool caseInsensitive);
+
+    // The color of the word, or ThemeColor::None if it isn't one of them
+    ThemeColor Find(const char* pWord, size_t length) const;
+
+private:
+    void Add(const std::string& word, ThemeColor color);
+    static uint64_t Hash(const char* pWord, size_t length);
+
+private:
+    struct Entry
+    {
+        uint64_t hash = 0;
+        uint32_t offset = 0; // Into m_words
+        uint32_t length = 0; // 0 for an empty slot
+        ThemeColor color;
+    };
+    std::vector<Entry> m_entries; // A power of 2 in size, and never more than half full
+    std::string m_words; // All of the words, end to end
+    size_t m_maxLength = 0;
+    bool m_caseInsensitive = false;
+};
+
+} // namespace Zep
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "text_storage.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <regex>
+#include <string>
+
+namespace Zep
+{
+
+// Regular expressions over the text storage, without copying it out.
+// Patterns use the ECMAScript syntax of std::regex.  The text is matched a line at a time, so ^ and $ are
+// the line start and end, and a match never crosses a line end.  A line inside one contiguous run of the
+// storage is matched where it is; only a line across the end of a run (the gap, or a rope chunk) is copied.
+
+namespace RegexFlags
+{
+enum
+{
+    None = 0,
+    IgnoreCase = (1 << 0)
+};
+}
+
+// A compiled pattern, and the text that every match of it contains.
+// std::regex tries a match at every position, which is slow; so lines without the literal text are skipped
+// using the vectorized search, and a pattern that is only literal text doesn't use the regex to find matches at all
+struct TextRegex
+{
+    std::regex regex;
+    std::string literal; // Found in every match; may be empty
+    bool literalOnly = false; // The pattern is exactly the literal
+    bool ignoreCase = false;
+};
+
+// Compile the pattern, or return the copy compiled last time; nullptr if the pattern is not valid.
+// Compiling is much slower than most searches, and the same pattern is compiled again and again as it
+// is typed or repeated
+std::shared_ptr<const TextRegex> RegexCompile(const std::string& pattern, uint32_t flags = RegexFlags::None);
+
+// Call fn(match, offset) for each match starting in [first, last), in order, until it returns false.
+// The offset is the location of the match in the text; the whole of each line touched is matched against
+using RegexMatchCallback = std::function<bool(const std::cmatch& match, long offset)>;
+void RegexForEachMatch(const TextStorage<uint8_t>& text, long first, long last, const TextRegex& regex, const RegexMatchCallback& fn);
+
+// Add the replacement for a match to the string.  As in Vim; & or \0 is the match, \1 to \9 are the groups,
+// \n or \r is a new line, and any other escaped character is itself
+void RegexAppendReplacement(std::string& str, const std::cmatch& match, const std::string& replacement);
+
+// The substitution of all the matches in a range, as a single edit
+struct RegexReplaceResult
+{
+    long count = 0; // Matches replaced
+    long first = 0; // The old text replaced; from the start of the first match to the end of the last
+    long last = 0;
+    long lastReplacement = 0; // Where the last replacement starts, in the new text
+    std::string text; // The new text for [first, last)
+};
+
+// Replace the matches starting in [first, last); all of them, or only the first on each line
+RegexReplaceResult RegexReplace(const TextStorage<uint8_t>& text, long first, long last, const TextRegex& regex, const std::string& replacement, bool global);
+
+} // namespace Zep
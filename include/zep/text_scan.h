@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+namespace Zep
+{
+
+// Byte classification and search kernels for text; used when loading, inserting and searching.
+// These are vectorized (SSE2/AVX2) where the CPU supports it, with a scalar fallback.
+// The implementation is picked at runtime, the first time a kernel is called.
+
+namespace TextScanFlags
+{
+enum
+{
+    None = 0,
+    HasCR = (1 << 0),
+    HasTab = (1 << 1)
+};
+}
+
+enum class TextScanLevel
+{
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+// Append (base + index + 1) to lineEnds for each '\n' in the data; i.e. the offset just after it.
+// Returns TextScanFlags for any '\r' or '\t' found, so callers can skip converting clean text
+uint32_t TextScanLines(const uint8_t* pData, size_t count, long base, std::vector<long>& lineEnds);
+
+// Find the first byte in [pStart, pEnd) that is any of the (up to MaxTextScanSet) bytes in the set; pEnd if none
+const size_t MaxTextScanSet = 4;
+const uint8_t* TextScanFindFirstOf(const uint8_t* pStart, const uint8_t* pEnd, const uint8_t* pSet, size_t setCount);
+
+// Find the first (or last) place the needle appears entirely inside [pStart, pEnd); pEnd if it doesn't.
+// The vector versions only compare the whole needle where its first and last characters both match;
+// the scalar version is Boyer-Moore-Horspool.  ignoreCase folds ASCII letters
+const uint8_t* TextScanFindString(const uint8_t* pStart, const uint8_t* pEnd, const uint8_t* pNeedle, size_t count, bool ignoreCase = false);
+const uint8_t* TextScanFindStringReverse(const uint8_t* pStart, const uint8_t* pEnd, const uint8_t* pNeedle, size_t count, bool ignoreCase = false);
+
+// The best level this CPU supports, and the one in use.
+// Setting a level the CPU can't run is clamped to the best supported; this is for testing and benchmarks
+TextScanLevel TextScanGetSupportedLevel();
+TextScanLevel TextScanGetLevel();
+void TextScanSetLevel(TextScanLevel level);
+const char* TextScanLevelName(TextScanLevel level);
+
+// find_first_of for the text containers; byte sized text with a small set goes through the kernel
+template <class T, class ForwardIt>
+const T* FindFirstOf(const T* pStart, const T* pEnd, ForwardIt s_first, ForwardIt s_last)
+{
+    if (sizeof(T) == 1)
+    {
+        uint8_t set[MaxTextScanSet];
+        size_t setCount = 0;
+        for (auto it = s_first; it != s_last && setCount <= MaxTextScanSet; ++it, ++setCount)
+        {
+            if (setCount < MaxTextScanSet)
+            {
+                set[setCount] = uint8_t(*it);
+            }
+        }
+
+        if (setCount <= MaxTextScanSet)
+        {
+            return (const T*)TextScanFindFirstOf((const uint8_t*)pStart, (const uint8_t*)pEnd, set, setCount);
+        }
+    }
+
+    return std::find_first_of(pStart, pEnd, s_first, s_last);
+}
+
+} // namespace Zep
@@ -0,0 +1,433 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gap_buffer.h"
+#include "rope.h"
+#include "text_scan.h"
+
+namespace Zep
+{
+
+enum class TextStorageType
+{
+    GapBuffer, // Fast for local edits, memory moves proportional to the distance between edits
+    Rope       // O(log n) edits anywhere; better for very large files
+};
+
+// The text storage behind a ZepBuffer.
+// This looks like the GapBuffer to clients, but the backing store can be switched between a GapBuffer
+// and a Rope at runtime.  Iterators remember the contiguous segment they are walking, so
+// sequential access only pays for a lookup when it crosses the gap or a rope chunk boundary.
+template <class T>
+class TextStorage
+{
+public:
+    typedef T value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef size_t size_type;
+    typedef const T& const_reference;
+
+    class const_iterator
+    {
+    public:
+        typedef std::ptrdiff_t difference_type;
+        typedef T value_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+        typedef std::random_access_iterator_tag iterator_category;
+
+        size_t p = 0;
+        const TextStorage<T>* pStorage = nullptr;
+
+        const_iterator(const TextStorage<T>& storage, size_t ptr) : p(ptr), pStorage(&storage) { }
+
+        bool operator==(const const_iterator& rhs) const { return (p == rhs.p); }
+        bool operator!=(const const_iterator& rhs) const { return (p != rhs.p); }
+
+        bool operator<(const const_iterator& rhs) const { return (p < rhs.p); }
+        bool operator>(const const_iterator& rhs) const { return (p > rhs.p); }
+        bool operator<=(const const_iterator& rhs) const { return (p <= rhs.p); }
+        bool operator>=(const const_iterator& rhs) const { return (p >= rhs.p); }
+
+        const_iterator& operator++() { p++; return *this; };
+        const_iterator operator++(int) { auto old = *this; p++; return old; }
+        const_iterator& operator--() { p--; return *this; }
+        const_iterator operator--(int) { auto old = *this; p--; return old; }
+
+        const_iterator& operator+=(difference_type rhs) { p += rhs; return *this; }
+        const_iterator operator+(difference_type rhs) const { auto itr = *this; itr.p += rhs; return itr; }
+        const_iterator& operator-=(difference_type rhs) { p -= rhs; return *this; }
+        const_iterator operator-(difference_type rhs) const { auto itr = *this; itr.p -= rhs; return itr; }
+        difference_type operator-(const const_iterator& itr) const { return difference_type(p) - difference_type(itr.p); }
+
+        reference operator*() const { return *Get(p); }
+        pointer operator->() const { return Get(p); }
+        reference operator[](difference_type distance) const { return *Get(p + distance); }
+
+    private:
+        inline const T* Get(size_t pos) const
+        {
+            // Unsigned compare catches positions either side of the cached segment
+            if ((pos - m_segmentStart) >= m_segmentLength)
+            {
+                pStorage->GetSegment(pos, m_pSegment, m_segmentStart, m_segmentLength);
+            }
+            return m_pSegment + (pos - m_segmentStart);
+        }
+
+        mutable const T* m_pSegment = nullptr;
+        mutable size_t m_segmentStart = 0;
+        mutable size_t m_segmentLength = 0;
+    };
+
+    // Writes go through the storage, never through iterators
+    typedef const_iterator iterator;
+
+    TextStorage() { }
+    TextStorage(const TextStorage& copy) = delete;
+    TextStorage& operator=(const TextStorage& copy) = delete;
+
+    const_iterator begin() const { return const_iterator(*this, 0); }
+    const_iterator end() const { return const_iterator(*this, size()); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    TextStorageType GetType() const
+    {
+        return m_type;
+    }
+
+    // Move the contents into a different kind of storage
+    void SetType(TextStorageType type)
+    {
+        if (type == m_type)
+        {
+            return;
+        }
+
+        if (type == TextStorageType::Rope)
+        {
+            // Copy the halves either side of the gap
+            m_rope.clear();
+            m_rope.insert(0, m_gap.m_pStart, m_gap.m_pGapStart);
+            m_rope.insert(m_rope.size(), m_gap.m_pGapEnd, m_gap.m_pEnd);
+            m_gap.clear();
+        }
+        else
+        {
+            m_gap.clear();
+            m_gap.resizeGap(m_rope.size() + GapBuffer<T>::DEFAULT_GAP);
+            m_rope.ForEachSegment([&](const T* pData, size_t count) {
+                m_gap.insert(m_gap.end(), pData, pData + count);
+            });
+            m_rope.clear();
+        }
+        m_type = type;
+    }
+
+    inline size_t size() const
+    {
+        return m_type == TextStorageType::Rope ? m_rope.size() : m_gap.size();
+    }
+
+    inline bool empty() const
+    {
+        return size() == 0;
+    }
+
+    void clear()
+    {
+        if (m_type == TextStorageType::Rope)
+        {
+            m_rope.clear();
+        }
+        else
+        {
+            m_gap.clear();
+        }
+    }
+
+    // Make room for this many more entries, so that appending them doesn't keep growing the gap buffer
+    void reserve_extra(size_t count)
+    {
+        if (m_type == TextStorageType::GapBuffer)
+        {
+            m_gap.resizeGap(count + GapBuffer<T>::DEFAULT_GAP);
+        }
+    }
+
+    template <class iter>
+    void assign(iter srcBegin, iter srcEnd)
+    {
+        if (m_type == TextStorageType::Rope)
+        {
+            m_rope.assign(srcBegin, srcEnd);
+        }
+        else
+        {
+            m_gap.assign(srcBegin, srcEnd);
+        }
+    }
+
+    template <class iter>
+    iterator insert(const_iterator pt, iter srcBegin, iter srcEnd)
+    {
+        if (m_type == TextStorageType::Rope)
+        {
+            m_rope.insert(pt.p, srcBegin, srcEnd);
+        }
+        else
+        {
+            m_gap.insert(m_gap.begin() + pt.p, srcBegin, srcEnd);
+        }
+        return iterator(*this, pt.p);
+    }
+
+    iterator erase(const_iterator start, const_iterator end)
+    {
+        if (m_type == TextStorageType::Rope)
+        {
+            m_rope.erase(start.p, end.p);
+        }
+        else
+        {
+            m_gap.erase(m_gap.begin() + start.p, m_gap.begin() + end.p);
+        }
+        return iterator(*this, start.p);
+    }
+
+    void push_back(const T& v)
+    {
+        if (m_type == TextStorageType::Rope)
+        {
+            m_rope.push_back(v);
+        }
+        else
+        {
+            m_gap.push_back(v);
+        }
+    }
+
+    // Add memory owned by someone else (e.g. a mapped file) to the end.
+    // The rope refers to it in place until it is edited; the gap buffer has to copy it
+    void append_view(const T* pData, size_t count, const std::shared_ptr<const void>& spOwner)
+    {
+        if (m_type == TextStorageType::Rope)
+        {
+            m_rope.append_view(pData, count, spOwner);
+        }
+        else
+        {
+            m_gap.insert(m_gap.end(), pData, pData + count);
+        }
+    }
+
+    T& operator[](size_t pos)
+    {
+        return m_type == TextStorageType::Rope ? m_rope[pos] : m_gap[pos];
+    }
+
+    const T& operator[](size_t pos) const
+    {
+        return m_type == TextStorageType::Rope ? m_rope[pos] : m_gap[pos];
+    }
+
+    // The contiguous run of memory containing pos.  Positions at or past the end
+    // return an empty segment pointing at a terminating 0.
+    void GetSegment(size_t pos, const T*& pSegment, size_t& segmentStart, size_t& segmentLength) const
+    {
+        static const T terminator = T(0);
+        if (pos >= size())
+        {
+            pSegment = &terminator;
+            segmentStart = pos;
+            segmentLength = 0;
+            return;
+        }
+
+        if (m_type == TextStorageType::Rope)
+        {
+            m_rope.GetSegment(pos, pSegment, segmentStart, segmentLength);
+            return;
+        }
+
+        auto gapStart = size_t(m_gap.m_pGapStart - m_gap.m_pStart);
+        if (pos < gapStart)
+        {
+            pSegment = m_gap.m_pStart;
+            segmentStart = 0;
+            segmentLength = gapStart;
+        }
+        else
+        {
+            pSegment = m_gap.m_pGapEnd;
+            segmentStart = gapStart;
+            segmentLength = m_gap.size() - gapStart;
+        }
+    }
+
+    // Call fn(pData, count, offset) for each contiguous run of [first, last)
+    template <class F>
+    void ForEachSegment(size_t first, size_t last, F fn) const
+    {
+        const T* pSegment;
+        size_t segmentStart;
+        size_t segmentLength;
+        while (first < last)
+        {
+            GetSegment(first, pSegment, segmentStart, segmentLength);
+            auto count = std::min(last, segmentStart + segmentLength) - first;
+            if (!fn(pSegment + (first - segmentStart), count, first))
+            {
+                return;
+            }
+            first += count;
+        }
+    }
+
+    // Find the first entry in the set, searching the contiguous runs directly (vectorized for small sets)
+    template <class ForwardIt>
+    const_iterator find_first_of(const_iterator first, const_iterator last, ForwardIt s_first, ForwardIt s_last) const
+    {
+        assert(first <= last);
+        auto found = last.p;
+        ForEachSegment(first.p, last.p, [&](const T* pData, size_t count, size_t offset) {
+            auto pFound = FindFirstOf<T>(pData, pData + count, s_first, s_last);
+            if (pFound != pData + count)
+            {
+                found = offset + size_t(pFound - pData);
+                return false;
+            }
+            return true;
+        });
+
+        // Return invalid if we walked to end without finding
+        return found == last.p ? end() : const_iterator(*this, found);
+    }
+
+    template <class ForwardIt>
+    const_iterator find_first_not_of(const_iterator first, const_iterator last, ForwardIt s_first, ForwardIt s_last) const
+    {
+        auto found = last.p;
+        ForEachSegment(first.p, last.p, [&](const T* pData, size_t count, size_t offset) {
+            for (size_t index = 0; index < count; index++)
+            {
+                if (std::find(s_first, s_last, pData[index]) == s_last)
+                {
+                    found = offset + index;
+                    return false;
+                }
+            }
+            return true;
+        });
+        return found == last.p ? end() : const_iterator(*this, found);
+    }
+
+    // Find the first place the needle appears entirely inside [first, last); returns last if it doesn't.
+    // Each contiguous run is searched directly; a match which crosses into a run is found by searching
+    // a copy of the text around the start of the run
+    size_t find(size_t first, size_t last, const T* pNeedle, size_t count, bool ignoreCase = false) const
+    {
+        static_assert(sizeof(T) == 1, "Searches are for byte text");
+        auto found = last;
+        if (count == 0 || (last - first) < count)
+        {
+            return found;
+        }
+
+        std::vector<T> window;
+        ForEachSegment(first, last, [&](const T* pData, size_t segmentCount, size_t offset) {
+            // Matches starting before the run, which run into it
+            if (offset > first && count > 1)
+            {
+                auto windowStart = std::max(first, offset - (count - 1));
+                auto windowEnd = std::min(last, offset + (count - 1));
+                window.assign(begin() + windowStart, begin() + windowEnd);
+                auto pWindow = (const uint8_t*)window.data();
+                auto pFound = TextScanFindString(pWindow, pWindow + window.size(), (const uint8_t*)pNeedle, count, ignoreCase);
+                if (pFound != pWindow + window.size() && (windowStart + size_t(pFound - pWindow)) < offset)
+                {
+                    found = windowStart + size_t(pFound - pWindow);
+                    return false;
+                }
+            }
+
+            auto pFound = TextScanFindString((const uint8_t*)pData, (const uint8_t*)pData + segmentCount, (const uint8_t*)pNeedle, count, ignoreCase);
+            if (pFound != (const uint8_t*)pData + segmentCount)
+            {
+                found = offset + size_t(pFound - (const uint8_t*)pData);
+                return false;
+            }
+            return true;
+        });
+        return found;
+    }
+
+    // Find the last place the needle appears entirely inside [first, last); returns last if it doesn't
+    size_t rfind(size_t first, size_t last, const T* pNeedle, size_t count, bool ignoreCase = false) const
+    {
+        static_assert(sizeof(T) == 1, "Searches are for byte text");
+        if (count == 0 || (last - first) < count)
+        {
+            return last;
+        }
+
+        std::vector<T> window;
+        const T* pSegment;
+        size_t segmentStart;
+        size_t segmentLength;
+        for (auto end = last; end > first;)
+        {
+            GetSegment(end - 1, pSegment, segmentStart, segmentLength);
+            auto start = std::max(first, segmentStart);
+
+            auto pData = (const uint8_t*)pSegment + (start - segmentStart);
+            auto pDataEnd = pData + (end - start);
+            auto pFound = TextScanFindStringReverse(pData, pDataEnd, (const uint8_t*)pNeedle, count, ignoreCase);
+            if (pFound != pDataEnd)
+            {
+                return start + size_t(pFound - pData);
+            }
+
+            // Matches starting before the run, which run into it
+            if (start > first && count > 1)
+            {
+                auto windowStart = std::max(first, start - (count - 1));
+                auto windowEnd = std::min(last, start + (count - 1));
+                window.assign(begin() + windowStart, begin() + windowEnd);
+                auto pWindow = (const uint8_t*)window.data();
+                pFound = TextScanFindStringReverse(pWindow, pWindow + window.size(), (const uint8_t*)pNeedle, count, ignoreCase);
+                if (pFound != pWindow + window.size() && (windowStart + size_t(pFound - pWindow)) < start)
+                {
+                    return windowStart + size_t(pFound - pWindow);
+                }
+            }
+            end = start;
+        }
+        return last;
+    }
+
+    // Return a string version of the storage, optionally showing the gap
+    std::string string(bool showGap = false) const
+    {
+        if (m_type == TextStorageType::Rope)
+        {
+            return m_rope.string();
+        }
+        return m_gap.string(showGap);
+    }
+
+private:
+    TextStorageType m_type = TextStorageType::GapBuffer;
+    GapBuffer<T> m_gap;
+    Rope<T> m_rope;
+};
+
+} // namespace Zep
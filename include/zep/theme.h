@@ -2,6 +2,8 @@
 
 #include "zep/mcommon/math/math.h"
 
+#include <map>
+
 namespace Zep
 {
 
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace Zep
+{
+
+// The parts every treap here shares: the rope, the syntax runs and brackets, and the range markers.
+// A node has pLeft, pRight and a priority. Each tree passes in how to bring a node's sums up to date from
+// its children (pull), and how to hand its pending changes on to them before they are moved (push)
+
+// Seeded, so a tree has the same shape on every run
+class TreapPriorities
+{
+public:
+    uint32_t operator()()
+    {
+        return uint32_t(m_random());
+    }
+
+private:
+    std::mt19937 m_random{ 0x5eed };
+};
+
+// For the trees which keep nothing pending on a node
+struct TreapNoPush
+{
+    template <typename Node>
+    void operator()(Node*) const
+    {
+    }
+};
+
+// Join two trees, with every node of left before every node of right
+template <typename Node, typename FnPull, typename FnPush = TreapNoPush>
+Node* TreapMerge(Node* pLeft, Node* pRight, const FnPull& fnPull, const FnPush& fnPush = FnPush())
+{
+    if (!pLeft)
+    {
+        return pRight;
+    }
+    if (!pRight)
+    {
+        return pLeft;
+    }
+
+    if (pLeft->priority > pRight->priority)
+    {
+        fnPush(pLeft);
+        pLeft->pRight = TreapMerge(pLeft->pRight, pRight, fnPull, fnPush);
+        fnPull(pLeft);
+        return pLeft;
+    }
+
+    fnPush(pRight);
+    pRight->pLeft = TreapMerge(pLeft, pRight->pLeft, fnPull, fnPush);
+    fnPull(pRight);
+    return pRight;
+}
+
+// Split a tree in two at key. fnLeft(pNode, key, pTail) returns true when the node and the nodes before it go to
+// the left, and then makes key relative to the nodes after it. A node which holds a range can be cut in two
+// across the key; it keeps the part before, and returns the rest in pTail, which starts the right tree
+template <typename Node, typename Key, typename FnLeft, typename FnPull, typename FnPush = TreapNoPush>
+void TreapSplit(Node* pNode, Key key, Node*& pLeft, Node*& pRight, const FnLeft& fnLeft, const FnPull& fnPull, const FnPush& fnPush = FnPush())
+{
+    if (!pNode)
+    {
+        pLeft = pRight = nullptr;
+        return;
+    }
+
+    fnPush(pNode);
+    Node* pTail = nullptr;
+    if (fnLeft(pNode, key, pTail))
+    {
+        if (pTail)
+        {
+            pRight = TreapMerge(pTail, pNode->pRight, fnPull, fnPush);
+            pNode->pRight = nullptr;
+        }
+        else
+        {
+            TreapSplit(pNode->pRight, key, pNode->pRight, pRight, fnLeft, fnPull, fnPush);
+        }
+        pLeft = pNode;
+    }
+    else
+    {
+        TreapSplit(pNode->pLeft, key, pLeft, pNode->pLeft, fnLeft, fnPull, fnPush);
+        pRight = pNode;
+    }
+    fnPull(pNode);
+}
+
+// Make a tree from nodes in order, in linear time; the right spine is kept on a stack
+template <typename Node, typename FnPull>
+Node* TreapBuild(const std::vector<Node*>& nodes, const FnPull& fnPull)
+{
+    std::vector<Node*> spine;
+    for (auto pNode : nodes)
+    {
+        // The node takes the nodes before it with lower priority as its left subtree, and becomes the right
+        // child of the last one with a higher priority
+        Node* pLast = nullptr;
+        while (!spine.empty() && spine.back()->priority < pNode->priority)
+        {
+            pLast = spine.back();
+            spine.pop_back();
+        }
+        pNode->pLeft = pLast;
+        pNode->pRight = nullptr;
+        if (!spine.empty())
+        {
+            spine.back()->pRight = pNode;
+        }
+        spine.push_back(pNode);
+    }
+
+    if (spine.empty())
+    {
+        return nullptr;
+    }
+
+    // Children before parents
+    struct PullAll
+    {
+        static void Pull(Node* pNode, const FnPull& fn)
+        {
+            if (pNode)
+            {
+                Pull(pNode->pLeft, fn);
+                Pull(pNode->pRight, fn);
+                fn(pNode);
+            }
+        }
+    };
+    PullAll::Pull(spine.front(), fnPull);
+    return spine.front();
+}
+
+} // namespace Zep
@@ -5,6 +5,8 @@
 #include <unordered_map>
 
 #include "buffer.h"
+#include "syntax.h"
+#include "window_wrap.h"
 
 namespace Zep
 {
@@ -53,6 +55,37 @@ inline bool operator < (const SpanInfo& lhs, const SpanInfo& rhs)
     return lhs.columnOffsets.second < rhs.columnOffsets.second;
 }
 
+// The spans on screen, a field at a time.  The arrays are kept between layouts, so once they have grown to fit the
+// window a layout doesn't allocate, and a walk over one field doesn't drag the others through the cache
+struct WindowLines
+{
+    std::vector<BufferRange> columnOffsets;
+    std::vector<long> lastNonCROffset;
+    std::vector<float> spanYPx;
+    std::vector<float> textHeight;
+    std::vector<NVec2f> margins;
+    std::vector<long> bufferLineNumber;
+    std::vector<int> lineIndex;
+    std::vector<NVec2f> pixelRenderRange;
+
+    size_t Size() const
+    {
+        return columnOffsets.size();
+    }
+
+    bool Empty() const
+    {
+        return columnOffsets.empty();
+    }
+
+    void Clear();
+    void Add(const SpanInfo& span);
+    SpanInfo Get(size_t index) const;
+
+    // The span holding the location, or -1; the spans are in buffer order, so this is a binary search
+    long Find(BufferLocation location) const;
+};
+
 enum class CursorType
 {
     Hidden,
@@ -150,6 +183,9 @@ public:
     NVec2i BufferToDisplay();
     NVec2i BufferToDisplay(const BufferLocation& location);
 
+    // The buffer text on screen, as of the last draw
+    BufferRange GetVisibleBufferRange() const;
+
     float ToWindowY(float pos) const;
 
     bool IsActiveWindow() const;
@@ -177,17 +213,26 @@ private:
 
 private:
     void UpdateLineSpans();
+    void ResetWrap();
+    WindowWrap::Line EstimateLine(long length) const;
+    void UpdateWrapForEdit(const BufferMessage& message);
+    void MeasureLine(long bufferLine, std::vector<SpanInfo>* pSpans);
+    const std::vector<SpanInfo>& GetLineSpans(long bufferLine);
     void ScrollToCursor();
     void EnsureCursorVisible();
     void UpdateVisibleLineRange();
     bool IsInsideTextRegion(NVec2i pos) const;
 
     void GetCharPointer(BufferLocation loc, const utf8*& pBegin, const utf8*& pEnd, bool& invalidChar);
-    const SpanInfo& GetCursorLineInfo(long y);
+    NVec2f GetCharSize(const utf8* pCh, const utf8* pEnd);
+    float GetCharWidth(BufferLocation loc);
+    bool IsHiddenChar(BufferLocation loc);
+    SpanInfo GetCursorLineInfo(long y);
 
     float TipBoxShadowWidth() const;
     void DisplayToolTip(const NVec2f& pos, const RangeMarker& marker) const;
     bool DisplayLine(SpanInfo& lineInfo, int displayPass);
+    void UpdateMouseHover();
     void DisplayScrollers();
     void DisableToolTipTillMove();
 
@@ -223,7 +268,21 @@ private:
     float m_bufferSizeYPx = 0.0f;
     NVec2i m_visibleLineRange = {0, 0};  // Offset of the displayed area into the text
 
-    std::vector<SpanInfo*> m_windowLines; // Information about the currently displayed lines
+    WindowLines m_windowLines; // Information about the currently displayed lines
+
+    // The wrap of every buffer line, and what it was made for
+    WindowWrap m_lineWrap;
+    NVec2f m_wrapExtents;     // Left and right of the text
+    NVec2f m_wrapCharSize;    // Default char width, and the text height
+    long m_wrapLineChars = 1; // Characters on a screen line, for estimates
+    float m_wrapFirstHeight = 0.0f;
+    float m_wrapNextHeight = 0.0f;
+    bool m_wrapReset = true;
+    bool m_visibleStale = true; // Lines wrapped since the visible lines were found may have moved them
+    std::vector<SpanInfo> m_lineSpans; // The spans of the last line asked for
+    long m_lineSpansLine = -1;
+    std::vector<SyntaxSpan> m_syntaxSpans; // The colors of the line being drawn
+    std::vector<float> m_charPositions; // Where the characters of the line being drawn start
 
     ZepTabWindow& m_tabWindow;
 
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "zep/fenwick.h"
+
+namespace Zep
+{
+
+// How each buffer line in a window wraps onto screen lines, and how tall it is.
+// A line is measured when it is shown, or when an edit touches it; until then its size is an estimate.
+// Lines are held in blocks, as in LineIndex; prefix sums over the blocks, and over the lines in each block,
+// find the buffer line at a screen line or a y position in O(log n). Adding or removing lines only
+// rebuilds the block they are in
+class WindowWrap
+{
+public:
+    // Blocks are split when they grow beyond this many lines
+    static const long MaxBlockLines = 1024;
+
+    struct Line
+    {
+        uint32_t screenLines = 1;
+        float height = 0.0f;
+        bool measured = false;
+    };
+
+    long GetLineCount() const
+    {
+        return m_totalLines;
+    }
+    long GetScreenLineCount() const;
+    float GetHeight() const;
+
+    const Line& GetLine(long line) const;
+
+    // Replace all the lines
+    void Assign(std::vector<Line>&& lines);
+
+    // Lines were added before 'line', or removed from it
+    void Insert(long line, long count, const Line& size);
+    void Erase(long line, long count);
+
+    void SetLine(long line, const Line& size);
+
+    // Where the line starts
+    long GetScreenLine(long line) const;
+    float GetLineY(long line) const;
+
+    // The buffer line on the screen line, or at y; the argument is made relative to the line.
+    // Past the end, this is the last line
+    long FindScreenLine(long& screenLine) const;
+    long FindLineAtY(float& y) const;
+
+private:
+    struct Block
+    {
+        std::vector<Line> lines;
+        Fenwick<long> screenLines;
+        Fenwick<double> heights; // Doubles, so big files don't lose the small heights
+        long totalScreenLines = 0;
+        double totalHeight = 0.0;
+
+        void Rebuild();
+    };
+
+    size_t FindBlockForLine(long& line) const;
+    void SplitBlock(size_t block);
+    void Rebuild();
+
+private:
+    std::vector<Block> m_blocks;
+    Fenwick<long> m_blockLines;
+    Fenwick<long> m_blockScreenLines;
+    Fenwick<double> m_blockHeights;
+    long m_totalLines = 0;
+    long m_totalScreenLines = 0;
+    double m_totalHeight = 0.0;
+};
+
+} // namespace Zep
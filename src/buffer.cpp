@@ -2,11 +2,17 @@
 #include <cctype>
 #include <cstdint>
 #include <cstdlib>
+#include <limits>
 #include <regex>
 
 #include "zep/buffer.h"
 #include "zep/editor.h"
 #include "zep/filesystem.h"
+#include "zep/search_highlight.h"
+#include "zep/syntax.h"
+#include "zep/text_regex.h"
+#include "zep/text_scan.h"
+#include "zep/mcommon/threadutils.h"
 
 #include "zep/mcommon/file/path.h"
 #include "zep/mcommon/string/stringutils.h"
@@ -19,6 +25,27 @@ namespace Zep
 namespace
 {
 
+// Remove \r and convert tabs to 4 spaces; the runs of text between them are copied in one go
+void ConvertCRAndTabs(const utf8* pData, size_t count, std::vector<utf8>& output)
+{
+    static const utf8 specials[] = { '\r', '\t' };
+    auto pEnd = pData + count;
+    while (pData < pEnd)
+    {
+        auto pSpecial = TextScanFindFirstOf(pData, pEnd, specials, 2);
+        output.insert(output.end(), pData, pSpecial);
+        if (pSpecial == pEnd)
+        {
+            break;
+        }
+        if (*pSpecial == '\t')
+        {
+            output.insert(output.end(), 4, ' ');
+        }
+        pData = pSpecial + 1;
+    }
+}
+
 // A VIM-like definition of a word.  Actually, in Vim this can be changed, but this editor
 // assumes a word is alphanumeric or underscore for consistency
 inline bool IsWordChar(const char c)
@@ -65,16 +92,20 @@ inline bool IsNewlineOrEnd(const char c)
 using fnMatch = std::function<bool>(const char);
 
 } // namespace
+const size_t ZepBuffer::LoadChunkSize;
+
 ZepBuffer::ZepBuffer(ZepEditor& editor, const std::string& strName)
     : ZepComponent(editor)
     , m_strName(strName)
 {
+    m_spSearchHighlight = std::make_shared<ZepSearchHighlight>(*this);
     Clear();
 }
 
 ZepBuffer::ZepBuffer(ZepEditor& editor, const ZepPath& path)
     : ZepComponent(editor)
 {
+    m_spSearchHighlight = std::make_shared<ZepSearchHighlight>(*this);
     Load(path);
 }
 
@@ -84,6 +115,11 @@ ZepBuffer::~ZepBuffer()
 
 void ZepBuffer::Notify(std::shared_ptr<ZepMessage> message)
 {
+    // Pick up any more of the file that has finished loading
+    if (message->messageId == Msg::Tick && IsLoading())
+    {
+        UpdateLoad(false);
+    }
 }
 
 long ZepBuffer::GetBufferColumn(BufferLocation location) const
@@ -94,12 +130,7 @@ long ZepBuffer::GetBufferColumn(BufferLocation location) const
 
 long ZepBuffer::GetBufferLine(BufferLocation location) const
 {
-    auto itrLine = std::lower_bound(m_lineEnds.begin(), m_lineEnds.end(), location);
-    if (itrLine != m_lineEnds.end() && location >= *itrLine)
-    {
-        itrLine++;
-    }
-    long line = long(itrLine - m_lineEnds.begin());
+    long line = m_lineEnds.LineFromOffset(location);
     line = std::min(std::max(0l, line), long(m_lineEnds.size() - 1));
     return line;
 }
@@ -119,14 +150,14 @@ BufferLocation ZepBuffer::LocationFromOffsetByChars(const BufferLocation& locati
         if (dir == -1)
             current += dir;
 
-        if (current >= (long)m_gapBuffer.size())
+        if (current >= (long)m_text.size())
             break;
 
         current = std::max(0l, current);
 
-        if (m_gapBuffer[current] == '\n')
+        if (m_text[current] == '\n')
         {
-            if ((current + dir) >= (long)m_gapBuffer.size())
+            if ((current + dir) >= (long)m_text.size())
             {
                 break;
             }
@@ -156,18 +187,76 @@ BufferLocation ZepBuffer::LocationFromOffset(long offset) const
     return BufferLocation{ offset };
 }
 
-BufferLocation ZepBuffer::Search(const std::string& str, BufferLocation start, SearchDirection dir, BufferLocation end) const
+// Find the string, starting at 'start'.
+// Forward searches find the first match at or after start, ending before 'end' (or the end of the buffer).
+// Backward searches find the last match starting at or before start, and at or after 'end' (or the start of the buffer).
+// Returns InvalidOffset if there isn't one
+BufferLocation ZepBuffer::Search(const std::string& str, BufferLocation start, SearchDirection dir, BufferLocation end, bool ignoreCase) const
 {
-    (void)end;
-    (void)dir;
-    (void)start;
-    (void)str;
-    return BufferLocation{ 0 };
+    auto textEnd = long(m_text.size() - 1);
+    auto pNeedle = (const utf8*)str.data();
+    auto count = str.size();
+    if (count == 0 || start < 0 || start > textEnd)
+    {
+        return InvalidOffset;
+    }
+
+    if (dir == SearchDirection::Forward)
+    {
+        auto last = (end < 0) ? textEnd : std::min(end, textEnd);
+        if (start >= last)
+        {
+            return InvalidOffset;
+        }
+        auto found = m_text.find(size_t(start), size_t(last), pNeedle, count, ignoreCase);
+        return found == size_t(last) ? InvalidOffset : BufferLocation(found);
+    }
+
+    auto first = std::max(0l, end);
+    auto last = std::min(textEnd, long(start + count));
+    if (first >= last)
+    {
+        return InvalidOffset;
+    }
+    auto found = m_text.rfind(size_t(first), size_t(last), pNeedle, count, ignoreCase);
+    return found == size_t(last) ? InvalidOffset : BufferLocation(found);
+}
+
+BufferRange ZepBuffer::SearchRegex(const std::string& pattern, BufferLocation start, SearchDirection dir, bool ignoreCase) const
+{
+    BufferRange found(InvalidOffset, InvalidOffset);
+    auto spRegex = RegexCompile(pattern, ignoreCase ? RegexFlags::IgnoreCase : RegexFlags::None);
+    auto textEnd = long(m_text.size() - 1);
+    if (!spRegex || start < 0 || start > textEnd)
+    {
+        return found;
+    }
+
+    auto fnFound = [&](const std::cmatch& match, long offset) {
+        found = BufferRange(offset, offset + long(match.length(0)));
+        return dir == SearchDirection::Backward;
+    };
+
+    if (dir == SearchDirection::Forward)
+    {
+        RegexForEachMatch(m_text, start, textEnd, *spRegex, fnFound);
+        return found;
+    }
+
+    // Walk back in bigger and bigger steps; the last match in a step is the one
+    long last = start + 1;
+    for (long step = 64 * 1024; found.first == InvalidOffset && last > 0; step *= 2)
+    {
+        auto first = std::max(0l, last - step);
+        RegexForEachMatch(m_text, first, last, *spRegex, fnFound);
+        last = first;
+    }
+    return found;
 }
 
 bool ZepBuffer::Valid(BufferLocation location) const
 {
-    if (location < 0 || location >= (BufferLocation)m_gapBuffer.size())
+    if (location < 0 || location >= (BufferLocation)m_text.size())
     {
         return false;
     }
@@ -180,7 +269,7 @@ bool ZepBuffer::MotionBegin(BufferLocation& start) const
     BufferLocation newStart = start;
 
     // Clamp to sensible, begin
-    newStart = std::min(newStart, BufferLocation(m_gapBuffer.size() - 1));
+    newStart = std::min(newStart, BufferLocation(m_text.size() - 1));
     newStart = std::max(0l, newStart);
 
     bool change = newStart != start;
@@ -206,7 +295,7 @@ bool ZepBuffer::Skip(fnMatch IsToken, BufferLocation& start, SearchDirection dir
         return false;
 
     bool moved = false;
-    while (Valid(start) && IsToken(m_gapBuffer[start]))
+    while (Valid(start) && IsToken(m_text[start]))
     {
         Move(start, dir);
         moved = true;
@@ -220,7 +309,7 @@ bool ZepBuffer::SkipOne(fnMatch IsToken, BufferLocation& start, SearchDirection
         return false;
 
     bool moved = false;
-    if (Valid(start) && IsToken(m_gapBuffer[start]))
+    if (Valid(start) && IsToken(m_text[start]))
     {
         Move(start, dir);
         moved = true;
@@ -234,7 +323,7 @@ bool ZepBuffer::SkipNot(fnMatch IsToken, BufferLocation& start, SearchDirection
         return false;
 
     bool moved = false;
-    while (Valid(start) && !IsToken(m_gapBuffer[start]))
+    while (Valid(start) && !IsToken(m_text[start]))
     {
         Move(start, dir);
         moved = true;
@@ -310,7 +399,7 @@ BufferRange ZepBuffer::StandardCtrlMotion(BufferLocation cursor, SearchDirection
     else
     {
         // If on the first char of a new word, skip back
-        if (current > 0 && IsWORDChar(m_gapBuffer[current]) && !IsWORDChar(m_gapBuffer[current - 1]))
+        if (current > 0 && IsWORDChar(m_text[current]) && !IsWORDChar(m_text[current - 1]))
         {
             current--;
         }
@@ -362,50 +451,111 @@ BufferRange ZepBuffer::InnerWordMotion(BufferLocation start, uint32_t searchType
     return r;
 }
 
-BufferLocation ZepBuffer::Find(BufferLocation start, const utf8* pBegin, const utf8* pEnd) const
+namespace
 {
-    if (start > EndLocation())
+// Without a syntax, walk the text for the bracket where the count of opens less closes (or closes less opens,
+// going back) first reaches 1, starting after start
+BufferLocation ScanForBracket(const TextStorage<utf8>& text, BufferLocation start, BracketType type, SearchDirection dir)
+{
+    int32_t count = 0;
+    auto step = dir == SearchDirection::Forward ? 1 : -1;
+    for (auto location = start + step; location >= 0 && location < long(text.size()); location += step)
+    {
+        BracketType foundType;
+        bool open;
+        if (SyntaxBrackets::GetBracketType(char(text[size_t(location)]), foundType, open) && foundType == type)
+        {
+            count += (open == (dir == SearchDirection::Backward)) ? 1 : -1;
+            if (count == 1)
+            {
+                return location;
+            }
+        }
+    }
+    return InvalidOffset;
+}
+} // namespace
+
+BufferLocation ZepBuffer::MatchingBracket(BufferLocation location) const
+{
+    if (m_spSyntax)
+    {
+        auto match = m_spSyntax->GetBrackets().MatchingBracket(location);
+        return match >= 0 ? match : InvalidOffset;
+    }
+
+    BracketType type;
+    bool open;
+    if (location < 0 || location >= long(m_text.size()) || !SyntaxBrackets::GetBracketType(char(m_text[size_t(location)]), type, open))
     {
         return InvalidOffset;
     }
+    return ScanForBracket(m_text, location, type, open ? SearchDirection::Forward : SearchDirection::Backward);
+}
 
-    if (pEnd == nullptr)
+bool ZepBuffer::EnclosingScope(BufferLocation location, BufferRange& range, char bracket) const
+{
+    BracketType type = BracketType::Max;
+    bool open;
+    if (bracket != 0 && !SyntaxBrackets::GetBracketType(bracket, type, open))
     {
-        pEnd = pBegin;
-        while (*pEnd != 0)
+        return false;
+    }
+
+    if (m_spSyntax)
+    {
+        return m_spSyntax->GetBrackets().EnclosingScope(location, range.first, range.second, type);
+    }
+
+    // On a bracket, it is the pair; otherwise the innermost open before, which is closed after
+    BracketType onType;
+    if (location >= 0 && location < long(m_text.size()) && SyntaxBrackets::GetBracketType(char(m_text[size_t(location)]), onType, open) && (type == BracketType::Max || type == onType))
+    {
+        auto match = MatchingBracket(location);
+        if (match != InvalidOffset)
         {
-            pEnd++;
+            range = BufferRange(std::min(location, match), std::max(location, match));
+            return true;
         }
     }
 
-    auto itrBuffer = m_gapBuffer.begin() + start;
-    auto itrEnd = m_gapBuffer.end();
-    while (itrBuffer != itrEnd)
+    range = BufferRange(InvalidOffset, InvalidOffset);
+    for (size_t index = 0; index < size_t(BracketType::Max); index++)
     {
-        auto itrNext = itrBuffer;
-
-        // Loop the string
-        auto pCurrent = pBegin;
-        while (pCurrent != pEnd && itrNext != itrEnd)
+        if (type != BracketType::Max && index != size_t(type))
+        {
+            continue;
+        }
+        auto found = ScanForBracket(m_text, location, BracketType(index), SearchDirection::Backward);
+        if (found > range.first)
         {
-            if (*pCurrent != *itrNext)
+            auto match = ScanForBracket(m_text, found, BracketType(index), SearchDirection::Forward);
+            if (match != InvalidOffset)
             {
-                break;
+                range = BufferRange(found, match);
             }
-            pCurrent++;
-            itrNext++;
-        };
+        }
+    }
+    return range.first != InvalidOffset;
+}
+
+BufferLocation ZepBuffer::Find(BufferLocation start, const utf8* pBegin, const utf8* pEnd) const
+{
+    if (start > EndLocation())
+    {
+        return InvalidOffset;
+    }
 
-        // We sucesfully got to the end
-        if (pCurrent == pEnd)
+    if (pEnd == nullptr)
+    {
+        pEnd = pBegin;
+        while (*pEnd != 0)
         {
-            return (BufferLocation)(itrBuffer - m_gapBuffer.begin());
+            pEnd++;
         }
+    }
 
-        itrBuffer++;
-    };
-
-    return InvalidOffset;
+    return Search(std::string((const char*)pBegin, (const char*)pEnd), start);
 }
 
 BufferLocation ZepBuffer::FindOnLineMotion(BufferLocation start, const utf8* pCh, SearchDirection dir) const
@@ -433,7 +583,7 @@ BufferLocation ZepBuffer::FindOnLineMotion(BufferLocation start, const utf8* pCh
         Skip(NotMatchNotEnd, start, dir);
     }
 
-    if (Valid(start) && *pCh == m_gapBuffer[start])
+    if (Valid(start) && *pCh == m_text[start])
     {
         return start;
     }
@@ -555,7 +705,7 @@ BufferLocation ZepBuffer::ChangeWordMotion(BufferLocation start, uint32_t search
 
 bool ZepBuffer::InsideBuffer(BufferLocation loc) const
 {
-    if (loc >= 0 && loc < BufferLocation(m_gapBuffer.size()))
+    if (loc >= 0 && loc < BufferLocation(m_text.size()))
     {
         return true;
     }
@@ -564,7 +714,7 @@ bool ZepBuffer::InsideBuffer(BufferLocation loc) const
 
 BufferLocation ZepBuffer::Clamp(BufferLocation in) const
 {
-    in = std::min(in, BufferLocation(m_gapBuffer.size() - 1));
+    in = std::min(in, BufferLocation(m_text.size() - 1));
     in = std::max(in, BufferLocation(0));
     return in;
 }
@@ -614,10 +764,16 @@ void ZepBuffer::Load(const ZepPath& path)
     if (GetEditor().GetFileSystem().Exists(path))
     {
         m_filePath = GetEditor().GetFileSystem().Canonical(path);
-        auto read = GetEditor().GetFileSystem().Read(path);
-        if (!read.empty())
+
+        // Big files are referenced from the mapping; only the parts that are edited get copied
+        auto spMapping = GetEditor().GetFileSystem().Map(path);
+        if (spMapping && spMapping->size != 0)
+        {
+            StartLoad(spMapping);
+        }
+        else
         {
-            SetText(read, true);
+            Clear();
         }
     }
     else
@@ -636,6 +792,11 @@ bool ZepBuffer::Save(int64_t& size)
         return false;
     }
 
+    if (IsLoading())
+    {
+        return false;
+    }
+
     if (TestFlags(FileFlags::ReadOnly))
     {
         return false;
@@ -717,96 +878,257 @@ void ZepBuffer::MarkUpdate()
 // Otherwise it is just reset to default state.  A new buffer is always initially cleared.
 void ZepBuffer::Clear()
 {
+    CancelLoad();
+
     bool changed = false;
-    if (m_gapBuffer.size() > 1)
+    auto oldEnd = BufferLocation(m_text.size() - 1);
+    if (m_text.size() > 1)
     {
         // Inform clients we are about to change the buffer
-        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, 0, BufferLocation(m_gapBuffer.size() - 1)));
+        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, 0, BufferLocation(m_text.size() - 1)));
         changed = true;
     }
 
-    m_gapBuffer.clear();
-    m_gapBuffer.push_back(0);
-    m_lineEnds.clear();
+    m_text.clear();
+    m_text.push_back(0);
     SetFlags(FileFlags::TerminatedWithZero);
 
-    m_lineEnds.push_back(long(m_gapBuffer.size()));
+    m_lineEnds.Assign({ long(m_text.size()) });
 
     if (changed)
     {
         MarkUpdate();
-        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextDeleted, 0, BufferLocation(m_gapBuffer.size() - 1)));
+        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextDeleted, 0, oldEnd));
     }
 }
 
+// Big files go in a rope, so that edits far apart don't move the whole file around
+TextStorageType ZepBuffer::ChooseStorageType(size_t size) const
+{
+    return int64_t(size) >= GetEditor().GetConfig().ropeStorageThreshold ? TextStorageType::Rope : TextStorageType::GapBuffer;
+}
+
 // Replace the buffer buffer with the text
 void ZepBuffer::SetText(const std::string& text, bool initFromFile)
 {
     // First, clear it
     Clear();
 
+    std::vector<long> lineEnds;
     if (!text.empty())
     {
         // Since incremental insertion of a big file into a gap buffer gives us worst case performance,
         // We build the buffer in a seperate array and assign it.  Much faster.
         // This is because we remove \r and convert tabs. Tabs are considered 'always evil' and should be
         // 4 spaces.  Take it up with your local code police if you feel aggrieved.
-        std::vector<utf8> input;
+        // One pass finds the line ends, and tells us if there is anything to convert; usually there isn't
+        auto pText = (const utf8*)text.data();
+        auto flags = TextScanLines(pText, text.size(), 0, lineEnds);
+
+        if (flags == TextScanFlags::None)
+        {
+            m_text.SetType(ChooseStorageType(text.size()));
+            m_text.assign(pText, pText + text.size());
+        }
+        else
+        {
+            if (flags & TextScanFlags::HasCR)
+            {
+                m_fileFlags |= FileFlags::StrippedCR;
+            }
+
+            std::vector<utf8> input;
+            input.reserve(text.size());
+            ConvertCRAndTabs(pText, text.size(), input);
+
+            lineEnds.clear();
+            TextScanLines(input.data(), input.size(), 0, lineEnds);
+
+            m_text.SetType(ChooseStorageType(input.size()));
+            m_text.assign(input.begin(), input.end());
+        }
+    }
 
-        m_lineEnds.clear();
+    FinishSetText(lineEnds, initFromFile);
+}
+
+// Load a file in chunks on the thread pool.
+// Each chunk finds its own line ends and converts its own \r and tabs; the chunks are then added in order,
+// their line ends offset by the size of the text before them.  Chunks which didn't need converting are
+// referenced from the mapping rather than copied (only the rope can do this; the gap buffer copies them).
+// The first chunk is waited for, so there is something to show; the buffer is read only until the rest arrive.
+void ZepBuffer::StartLoad(const std::shared_ptr<ZepFileMapping>& spMapping)
+{
+    Clear();
+
+    m_text.SetType(ChooseStorageType(spMapping->size));
+    m_text.reserve_extra(spMapping->size);
+
+    m_spLoadMapping = spMapping;
+    for (size_t chunkStart = 0; chunkStart < spMapping->size; chunkStart += LoadChunkSize)
+    {
+        auto count = std::min(LoadChunkSize, spMapping->size - chunkStart);
 
-        // Update the gap buffer with the text
-        // We remove \r, we only care about \n
-        for (auto& ch : text)
+        // A file ending in 0 already has the terminator we add
+        if (chunkStart + count == spMapping->size && spMapping->pData[spMapping->size - 1] == 0)
         {
-            if (ch == '\r')
+            count--;
+        }
+
+        // The job holds the mapping, in case the load is cancelled before it runs
+        m_loadChunks.push_back(GetEditor().GetThreadPool().enqueue([spMapping, chunkStart, count]() {
+            LoadChunk chunk;
+            auto pData = spMapping->pData + chunkStart;
+            chunk.flags = TextScanLines(pData, count, 0, chunk.lineEnds);
+            if (chunk.flags == TextScanFlags::None)
+            {
+                chunk.pView = pData;
+                chunk.size = count;
+                return chunk;
+            }
+
+            // The line ends move when the chunk is converted, so find them again
+            chunk.converted.reserve(count);
+            ConvertCRAndTabs(pData, count, chunk.converted);
+            chunk.lineEnds.clear();
+            TextScanLines(chunk.converted.data(), chunk.converted.size(), 0, chunk.lineEnds);
+            chunk.size = chunk.converted.size();
+            return chunk;
+        }));
+    }
+
+    SetFlags(FileFlags::Loading);
+    m_loadChunks[0].wait();
+    UpdateLoad(false);
+}
+
+// Add the chunks which have finished loading, in order; waiting for all of them if asked
+void ZepBuffer::UpdateLoad(bool wait)
+{
+    if (!IsLoading())
+    {
+        return;
+    }
+
+    std::vector<LoadChunk> chunks;
+    while (m_loadChunksDone < m_loadChunks.size() && (wait || is_future_ready(m_loadChunks[m_loadChunksDone])))
+    {
+        chunks.push_back(m_loadChunks[m_loadChunksDone++].get());
+    }
+
+    if (!chunks.empty())
+    {
+        // The chunks go in before the terminating 0
+        auto startOffset = long(m_text.size() - 1);
+        long size = 0;
+        for (auto& chunk : chunks)
+        {
+            size += long(chunk.size);
+        }
+
+        bool firstChunk = (startOffset == 0);
+        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, startOffset, startOffset + size));
+
+        std::vector<long> lineEnds;
+        auto chunkOffset = startOffset;
+        m_text.erase(m_text.end() - 1, m_text.end());
+        for (auto& chunk : chunks)
+        {
+            if (chunk.flags & TextScanFlags::HasCR)
             {
                 m_fileFlags |= FileFlags::StrippedCR;
             }
-            else if (ch == '\t')
+
+            if (chunk.pView)
             {
-                input.push_back(' ');
-                input.push_back(' ');
-                input.push_back(' ');
-                input.push_back(' ');
+                m_text.append_view(chunk.pView, chunk.size, m_spLoadMapping);
             }
             else
             {
-                input.push_back(ch);
-                if (ch == '\n')
-                {
-                    m_lineEnds.push_back(long(input.size()));
-                }
+                m_text.insert(m_text.end(), chunk.converted.begin(), chunk.converted.end());
+            }
+
+            for (auto& lineEnd : chunk.lineEnds)
+            {
+                lineEnds.push_back(lineEnd + chunkOffset);
             }
+            chunkOffset += long(chunk.size);
         }
-        m_gapBuffer.assign(input.begin(), input.end());
+        m_text.push_back(0);
+        m_lineEnds.Insert(startOffset, size, lineEnds);
+
+        MarkUpdate();
+
+        // The first text is the Loaded message; the rest is added to it
+        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, firstChunk ? BufferMessageType::Loaded : BufferMessageType::TextAdded, startOffset, startOffset + size));
+
+        // The file content isn't a change
+        ClearFlags(FileFlags::Dirty);
+        GetEditor().RequestRefresh();
     }
 
-    if (m_gapBuffer[m_gapBuffer.size() - 1] != 0)
+    if (m_loadChunksDone == m_loadChunks.size())
+    {
+        CancelLoad();
+    }
+}
+
+void ZepBuffer::WaitForLoad()
+{
+    UpdateLoad(true);
+}
+
+// Forget a load in progress; any chunks still being prepared are thrown away when they finish
+void ZepBuffer::CancelLoad()
+{
+    m_loadChunks.clear();
+    m_loadChunksDone = 0;
+    m_spLoadMapping.reset();
+    ClearFlags(FileFlags::Loading);
+}
+
+// Terminate the new text, index the last line, and tell everyone about it
+void ZepBuffer::FinishSetText(std::vector<long>& lineEnds, bool initFromFile)
+{
+    if (m_text[m_text.size() - 1] != 0)
     {
         m_fileFlags |= FileFlags::TerminatedWithZero;
-        m_gapBuffer.push_back(0);
+        m_text.push_back(0);
     }
 
     // TODO: Why is a line end needed always?
-    m_lineEnds.push_back(long(m_gapBuffer.size()));
+    lineEnds.push_back(long(m_text.size()));
+    m_lineEnds.Assign(lineEnds);
 
     MarkUpdate();
 
     // When loading a file, send the Loaded message to distinguish it from adding to a buffer, and remember that the buffer is not dirty in this case
     if (initFromFile)
     {
-        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::Loaded, BufferLocation{ 0 }, BufferLocation{ long(m_gapBuffer.size()) }));
+        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::Loaded, BufferLocation{ 0 }, BufferLocation{ long(m_text.size()) }));
 
         // Doc is not dirty
         ClearFlags(FileFlags::Dirty);
     }
     else
     {
-        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextAdded, BufferLocation{ 0 }, BufferLocation{ long(m_gapBuffer.size()) }));
+        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextAdded, BufferLocation{ 0 }, BufferLocation{ long(m_text.size()) }));
     }
 }
 
+// Switch the storage for the text; the contents are the same, but the syntax thread must not be walking it
+void ZepBuffer::SetStorageType(TextStorageType type)
+{
+    if (type == m_text.GetType())
+    {
+        return;
+    }
+
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, 0, BufferLocation(m_text.size() - 1)));
+    m_text.SetType(type);
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextChanged, 0, BufferLocation(m_text.size() - 1)));
+}
+
 // TODO: This can be cleaner
 // The function needs to find the point on the line which bufferLocation is on.
 // It needs to account for empty lines or the last line, zero terminated.
@@ -819,17 +1141,17 @@ BufferLocation ZepBuffer::GetLinePos(BufferLocation bufferLocation, LineLocation
     }
 
     bufferLocation = Clamp(bufferLocation);
-    if (m_gapBuffer.empty())
+    if (m_text.empty())
         return bufferLocation;
 
     // If we are on the CR, move back 1, unless the \n is all that is on the line
-    if (m_gapBuffer[bufferLocation] == '\n')
+    if (m_text[bufferLocation] == '\n')
     {
         bufferLocation--;
     }
 
     // Find the end of the previous line
-    while (bufferLocation >= 0 && m_gapBuffer[bufferLocation] != '\n')
+    while (bufferLocation >= 0 && m_text[bufferLocation] != '\n')
     {
         bufferLocation--;
     }
@@ -849,7 +1171,7 @@ BufferLocation ZepBuffer::GetLinePos(BufferLocation bufferLocation, LineLocation
     // The point just after the line end
     case LineLocation::BeyondLineEnd:
     {
-        while (bufferLocation < (long)m_gapBuffer.size() && m_gapBuffer[bufferLocation] != '\n' && m_gapBuffer[bufferLocation] != 0)
+        while (bufferLocation < (long)m_text.size() && m_text[bufferLocation] != '\n' && m_text[bufferLocation] != 0)
         {
             bufferLocation++;
         }
@@ -860,9 +1182,9 @@ BufferLocation ZepBuffer::GetLinePos(BufferLocation bufferLocation, LineLocation
 
     case LineLocation::LineCRBegin:
     {
-        while (bufferLocation < (long)m_gapBuffer.size()
-            && m_gapBuffer[bufferLocation] != '\n'
-            && m_gapBuffer[bufferLocation] != 0)
+        while (bufferLocation < (long)m_text.size()
+            && m_text[bufferLocation] != '\n'
+            && m_text[bufferLocation] != 0)
         {
             bufferLocation++;
         }
@@ -872,7 +1194,7 @@ BufferLocation ZepBuffer::GetLinePos(BufferLocation bufferLocation, LineLocation
 
     case LineLocation::LineFirstGraphChar:
     {
-        while (bufferLocation < (long)m_gapBuffer.size() && !std::isgraph(ToASCII(m_gapBuffer[bufferLocation])) && m_gapBuffer[bufferLocation] != '\n')
+        while (bufferLocation < (long)m_text.size() && !std::isgraph(ToASCII(m_text[bufferLocation])) && m_text[bufferLocation] != '\n')
         {
             bufferLocation++;
         }
@@ -884,9 +1206,9 @@ BufferLocation ZepBuffer::GetLinePos(BufferLocation bufferLocation, LineLocation
     {
         auto start = bufferLocation;
 
-        while (bufferLocation < (long)m_gapBuffer.size()
-            && m_gapBuffer[bufferLocation] != '\n'
-            && m_gapBuffer[bufferLocation] != 0)
+        while (bufferLocation < (long)m_text.size()
+            && m_text[bufferLocation] != '\n'
+            && m_text[bufferLocation] != 0)
         {
             bufferLocation++;
         }
@@ -902,14 +1224,14 @@ BufferLocation ZepBuffer::GetLinePos(BufferLocation bufferLocation, LineLocation
 
     case LineLocation::LineLastGraphChar:
     {
-        while (bufferLocation < (long)m_gapBuffer.size()
-            && m_gapBuffer[bufferLocation] != '\n'
-            && m_gapBuffer[bufferLocation] != 0)
+        while (bufferLocation < (long)m_text.size()
+            && m_text[bufferLocation] != '\n'
+            && m_text[bufferLocation] != 0)
         {
             bufferLocation++;
         }
 
-        while (bufferLocation > 0 && bufferLocation < (long)m_gapBuffer.size() && !std::isgraph(ToASCII(m_gapBuffer[bufferLocation])))
+        while (bufferLocation > 0 && bufferLocation < (long)m_text.size() && !std::isgraph(ToASCII(m_text[bufferLocation])))
         {
             bufferLocation--;
         }
@@ -922,25 +1244,7 @@ BufferLocation ZepBuffer::GetLinePos(BufferLocation bufferLocation, LineLocation
 void ZepBuffer::UpdateForDelete(const BufferLocation& startOffset, const BufferLocation& endOffset)
 {
     auto distance = endOffset - startOffset;
-    ForEachMarker(RangeMarkerType::All, Zep::SearchDirection::Forward, startOffset, EndLocation(), [&](const std::shared_ptr<RangeMarker>& marker) {
-        if (startOffset >= marker->range.second)
-        {
-            return true;
-        }
-        else if (endOffset <= marker->range.first)
-        {
-            marker->range.first -= distance;
-            marker->range.second -= distance;
-        }
-        else
-        {
-            auto overlapStart = std::max(startOffset, marker->range.first);
-            auto overlapEnd = std::min(endOffset, marker->range.second);
-            auto dist = overlapEnd - overlapStart;
-            marker->range.second -= dist;
-        }
-        return true;
-    });
+    m_rangeMarkers.Delete(startOffset, endOffset);
 
     if (!m_lineWidgets.empty())
     {
@@ -974,7 +1278,7 @@ void ZepBuffer::UpdateForDelete(const BufferLocation& startOffset, const BufferL
             auto pWidgets = m_lineWidgets[replace.first];
             m_lineWidgets.erase(replace.first);
 
-            if (replace.second >= 0 && replace.second < (m_gapBuffer.size() - 1))
+            if (replace.second >= 0 && replace.second < (m_text.size() - 1))
             {
                 m_lineWidgets[replace.second] = pWidgets;
             }
@@ -987,20 +1291,7 @@ void ZepBuffer::UpdateForInsert(const BufferLocation& startOffset, const BufferL
     // Move the markers after the insert point forwards, or
     // expand the marker range if inserting inside it (that's a guess!)
     auto distance = endOffset - startOffset;
-
-    ForEachMarker(RangeMarkerType::All, SearchDirection::Forward, startOffset, EndLocation(), [&](const std::shared_ptr<RangeMarker>& marker) {
-        if (marker->range.second <= startOffset)
-        {
-            return true;
-        }
-
-        if (marker->range.first >= startOffset)
-        {
-            marker->range.first += distance;
-            marker->range.second += distance;
-        }
-        return true;
-    });
+    m_rangeMarkers.Insert(startOffset, distance);
 
     if (!m_lineWidgets.empty())
     {
@@ -1026,7 +1317,7 @@ void ZepBuffer::UpdateForInsert(const BufferLocation& startOffset, const BufferL
         {
             auto pWidgets = m_lineWidgets[replace.first];
             m_lineWidgets.erase(replace.first);
-            if (replace.second >= 0 && replace.second < (m_gapBuffer.size() - 1))
+            if (replace.second >= 0 && replace.second < (m_text.size() - 1))
             {
                 m_lineWidgets[replace.second] = pWidgets;
             }
@@ -1036,7 +1327,12 @@ void ZepBuffer::UpdateForInsert(const BufferLocation& startOffset, const BufferL
 
 bool ZepBuffer::Insert(const BufferLocation& startOffset, const std::string& str)
 {
-    if (startOffset > (long)m_gapBuffer.size())
+    if (IsLoading())
+    {
+        return false;
+    }
+
+    if (startOffset > (long)m_text.size())
     {
         return false;
     }
@@ -1048,52 +1344,15 @@ bool ZepBuffer::Insert(const BufferLocation& startOffset, const std::string& str
 
     UpdateForInsert(startOffset, startOffset + changeRange);
 
-    // abcdef\r\nabc<insert>dfdf\r\n
-    auto itrLine = std::lower_bound(m_lineEnds.begin(), m_lineEnds.end(), startOffset);
-    ;
-    if (itrLine != m_lineEnds.end() && *itrLine <= startOffset)
-    {
-        itrLine++;
-    }
-
-    auto itrEnd = str.end();
-    auto itrBegin = str.begin();
-    auto itr = str.begin();
-
     // Make a list of lines to 'insert'
+    // These are the points just after each "\n"
     std::vector<long> lines;
-    std::string lineEndSymbols("\n");
-    while (itr != itrEnd)
-    {
-        // Get to first point after "\n"
-        // That's the point just after the end of the current line
-        itr = std::find_first_of(itr, itrEnd, lineEndSymbols.begin(), lineEndSymbols.end());
-        if (itr != itrEnd)
-        {
-            if (itr != itrEnd && *itr == '\n')
-            {
-                itr++;
-            }
-            lines.push_back(long(itr - itrBegin) + startOffset);
-        }
-    }
+    TextScanLines((const utf8*)str.data(), str.size(), startOffset, lines);
 
-    // Increment the rest of the line ends
-    // We make all the remaning line ends bigger by the fixed_size of the insertion
-    auto itrAdd = itrLine;
-    while (itrAdd != m_lineEnds.end())
-    {
-        *itrAdd += long(str.length());
-        itrAdd++;
-    }
+    // Move the rest of the line ends along by the size of the insertion, adding the new ones
+    m_lineEnds.Insert(startOffset, long(str.length()), lines);
 
-    if (!lines.empty())
-    {
-        // Update the atomic line counter so clients can see where we are up to.
-        m_lineEnds.insert(itrLine, lines.begin(), lines.end());
-    }
-
-    m_gapBuffer.insert(m_gapBuffer.begin() + startOffset, str.begin(), str.end());
+    m_text.insert(m_text.begin() + startOffset, str.begin(), str.end());
 
     MarkUpdate();
 
@@ -1105,7 +1364,12 @@ bool ZepBuffer::Insert(const BufferLocation& startOffset, const std::string& str
 
 bool ZepBuffer::Replace(const BufferLocation& startOffset, const BufferLocation& endOffset, const std::string& str)
 {
-    if (startOffset > (long)m_gapBuffer.size() || endOffset > (long)m_gapBuffer.size())
+    if (IsLoading())
+    {
+        return false;
+    }
+
+    if (startOffset > (long)m_text.size() || endOffset > (long)m_text.size())
     {
         return false;
     }
@@ -1117,7 +1381,7 @@ bool ZepBuffer::Replace(const BufferLocation& startOffset, const BufferLocation&
     for (auto loc = startOffset; loc < endOffset; loc++)
     {
         // Note we don't support utf8 yet
-        m_gapBuffer[loc] = str[0];
+        m_text[loc] = str[0];
     }
 
     MarkUpdate();
@@ -1138,40 +1402,28 @@ bool ZepBuffer::Replace(const BufferLocation& startOffset, const BufferLocation&
 // This makes a few things fall out more easily
 bool ZepBuffer::Delete(const BufferLocation& startOffset, const BufferLocation& endOffset)
 {
-    assert(startOffset >= 0 && endOffset <= (BufferLocation)(m_gapBuffer.size() - 1));
-
-    // We are about to modify this range
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, startOffset, endOffset));
+    assert(startOffset >= 0 && endOffset <= (BufferLocation)(m_text.size() - 1));
 
-    UpdateForDelete(startOffset, endOffset);
-
-    auto itrLine = std::lower_bound(m_lineEnds.begin(), m_lineEnds.end(), startOffset);
-    if (itrLine == m_lineEnds.end())
+    if (IsLoading())
     {
         return false;
     }
 
-    auto itrLastLine = std::upper_bound(itrLine, m_lineEnds.end(), endOffset);
-    auto offsetDiff = endOffset - startOffset;
+    // We are about to modify this range
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, startOffset, endOffset));
 
-    if (*itrLine <= startOffset)
-    {
-        itrLine++;
-    }
+    UpdateForDelete(startOffset, endOffset);
 
-    // Adjust all line offsets beyond us
-    for (auto itr = itrLastLine; itr != m_lineEnds.end(); itr++)
+    if (m_lineEnds.empty() || m_lineEnds[m_lineEnds.size() - 1] < startOffset)
     {
-        *itr -= offsetDiff;
+        return false;
     }
 
-    if (itrLine != itrLastLine)
-    {
-        m_lineEnds.erase(itrLine, itrLastLine);
-    }
+    // Remove the line ends inside the range and move the ones beyond us back
+    m_lineEnds.Erase(startOffset, endOffset);
 
-    m_gapBuffer.erase(m_gapBuffer.begin() + startOffset, m_gapBuffer.begin() + endOffset);
-    assert(m_gapBuffer.size() > 0 && m_gapBuffer[m_gapBuffer.size() - 1] == 0);
+    m_text.erase(m_text.begin() + startOffset, m_text.begin() + endOffset);
+    assert(m_text.size() > 0 && m_text[m_text.size() - 1] == 0);
 
     MarkUpdate();
 
@@ -1185,7 +1437,7 @@ BufferLocation ZepBuffer::EndLocation() const
 {
     // TODO: This isn't safe? What if the buffer is empty
     // I've clamped it for now
-    auto end = std::max((BufferLocation)0, (BufferLocation)m_gapBuffer.size() - 1);
+    auto end = std::max((BufferLocation)0, (BufferLocation)m_text.size() - 1);
     return LocationFromOffset(end);
 }
 
@@ -1229,26 +1481,13 @@ void ZepBuffer::SetSelection(const BufferRange& selection)
 
 void ZepBuffer::AddRangeMarker(std::shared_ptr<RangeMarker> spMarker)
 {
-    m_rangeMarkers[spMarker->range.first].insert(spMarker);
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::MarkersChanged, 0, BufferLocation(m_gapBuffer.size() - 1)));
+    m_rangeMarkers.Add(spMarker);
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::MarkersChanged, 0, BufferLocation(m_text.size() - 1)));
 }
 
 void ZepBuffer::ClearRangeMarker(std::shared_ptr<RangeMarker> spMarker)
 {
-    std::set<BufferLocation> emptyLocations;
-    for (auto& markerPair : m_rangeMarkers)
-    {
-        markerPair.second.erase(spMarker);
-        if (markerPair.second.empty())
-        {
-            emptyLocations.insert(markerPair.first);
-        }
-    }
-
-    for (auto& victim : emptyLocations)
-    {
-        m_rangeMarkers.erase(victim);
-    }
+    m_rangeMarkers.Remove(spMarker);
 }
 
 void ZepBuffer::ClearRangeMarkers(const std::set<std::shared_ptr<RangeMarker>>& markers)
@@ -1257,71 +1496,48 @@ void ZepBuffer::ClearRangeMarkers(const std::set<std::shared_ptr<RangeMarker>>&
     {
         ClearRangeMarker(marker);
     }
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::MarkersChanged, 0, BufferLocation(m_gapBuffer.size() - 1)));
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::MarkersChanged, 0, BufferLocation(m_text.size() - 1)));
 }
 
 void ZepBuffer::ClearRangeMarkers(uint32_t markerType)
 {
-    std::set<std::shared_ptr<RangeMarker>> markers;
-    ForEachMarker(markerType, SearchDirection::Forward, 0, EndLocation(), [&](const std::shared_ptr<RangeMarker>& pMarker) {
-        markers.insert(pMarker);
-        return true;
-    });
+    m_rangeMarkers.Replace(markerType, {});
+    m_markerStrings.Prune();
 
-    for (auto& victim : markers)
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::MarkersChanged, 0, BufferLocation(m_text.size() - 1)));
+}
+
+void ZepBuffer::SetMarkers(uint32_t markerType, gsl::span<const MarkerDesc> markers)
+{
+    // One block for all of the markers; each pointer into it keeps the block alive
+    auto spBlock = std::make_shared<std::vector<RangeMarker>>(size_t(markers.size()));
+    std::vector<std::shared_ptr<RangeMarker>> newMarkers;
+    newMarkers.reserve(spBlock->size());
+    for (size_t index = 0; index < spBlock->size(); index++)
     {
-        ClearRangeMarker(victim);
+        auto& desc = markers[index];
+        auto& marker = (*spBlock)[index];
+        marker.SetRange(desc.range);
+        marker.textColor = desc.textColor;
+        marker.backgroundColor = desc.backgroundColor;
+        marker.highlightColor = desc.highlightColor;
+        marker.displayType = desc.displayType;
+        marker.markerType = markerType;
+        marker.name = m_markerStrings.Intern(desc.name);
+        marker.description = m_markerStrings.Intern(desc.description);
+        marker.tipPos = desc.tipPos;
+        newMarkers.push_back(std::shared_ptr<RangeMarker>(spBlock, &marker));
     }
 
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::MarkersChanged, 0, BufferLocation(m_gapBuffer.size() - 1)));
+    m_rangeMarkers.Replace(markerType, newMarkers);
+    m_markerStrings.Prune();
+
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::MarkersChanged, 0, BufferLocation(m_text.size() - 1)));
 }
 
 void ZepBuffer::ForEachMarker(uint32_t markerType, SearchDirection dir, BufferLocation begin, BufferLocation end, std::function<bool(const std::shared_ptr<RangeMarker>&)> fnCB) const
 {
-    auto itrStart = m_rangeMarkers.lower_bound(begin);
-    if (itrStart == m_rangeMarkers.end())
-        return;
-
-    auto itrEnd = m_rangeMarkers.upper_bound(end);
-
-    if (dir == SearchDirection::Forward)
-    {
-        for (auto itr = itrStart; itr != itrEnd; itr++)
-        {
-            for (auto& markerItem : itr->second)
-            {
-                if ((markerItem->markerType & markerType) == 0)
-                {
-                    continue;
-                }
-
-                if (!fnCB(markerItem))
-                {
-                    return;
-                }
-            }
-        }
-    }
-    else
-    {
-        auto itrREnd = std::make_reverse_iterator(itrStart);
-        auto itrRStart = std::make_reverse_iterator(itrEnd);
-         
-        for (auto itr = itrRStart; itr != itrREnd; itr++)
-        {
-            for (auto& markerItem : itr->second)
-            {
-                if ((markerItem->markerType & markerType) == 0)
-                {
-                    continue;
-                }
-                if (!fnCB(markerItem))
-                {
-                    return;
-                }
-            }
-        }
-    }
+    m_rangeMarkers.ForEach(markerType, dir == SearchDirection::Forward, begin, end, fnCB);
 }
 
 void ZepBuffer::HideMarkers(uint32_t markerType)
@@ -1352,7 +1568,7 @@ tRangeMarkers ZepBuffer::GetRangeMarkers(uint32_t markerType) const
     ForEachMarker(markerType, SearchDirection::Forward, 0, EndLocation(), [&](const std::shared_ptr<RangeMarker>& spMarker) {
         if ((spMarker->markerType & markerType) != 0)
         {
-            markers[spMarker->range.first].insert(spMarker);
+            markers[spMarker->GetRange().first].insert(spMarker);
         }
         return true;
     });
@@ -1363,35 +1579,12 @@ std::shared_ptr<RangeMarker> ZepBuffer::FindNextMarker(BufferLocation start, Sea
 {
     start = std::max(0l, start);
 
-    std::shared_ptr<RangeMarker> spFound;
-    auto search = [&]() {
-        ForEachMarker(markerType, dir, 0, EndLocation(), [&](const std::shared_ptr<RangeMarker>& marker) {
-            if (dir == SearchDirection::Forward)
-            {
-                if (marker->range.first <= start)
-                {
-                    return true;
-                }
-            }
-            else
-            {
-                if (marker->range.first >= start)
-                {
-                    return true;
-                }
-            }
-
-            spFound = marker;
-            return false;
-        });
-    };
-
-    search();
+    bool forward = dir == SearchDirection::Forward;
+    auto spFound = m_rangeMarkers.FindNext(start, forward, markerType);
     if (spFound == nullptr)
     {
         // Wrap
-        start = (dir == SearchDirection::Forward ? 0 : EndLocation());
-        search();
+        spFound = m_rangeMarkers.FindNext(forward ? std::numeric_limits<long>::min() : std::numeric_limits<long>::max(), forward, markerType);
     }
     return spFound;
 }
@@ -1437,22 +1630,26 @@ void ZepBuffer::AddLineWidget(long line, std::shared_ptr<ILineWidget> spWidget)
     GetLineOffsets(line, start, end);
 
     m_lineWidgets[start].push_back(spWidget);
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextChanged, 0, 0));
+
+    // The line is laid out again, with room for the widget
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextChanged, start, start));
 }
 
 void ZepBuffer::ClearLineWidgets(long line)
 {
+    long start = 0;
+    long end = long(m_text.size()) - 1;
     if (line != -1)
     {
-        long start, end;
         GetLineOffsets(line, start, end);
         m_lineWidgets.erase(start);
+        end = start;
     }
     else
     {
         m_lineWidgets.clear();
     }
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextChanged, 0, 0));
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextChanged, start, end));
 }
 
 const ZepBuffer::tLineWidgets* ZepBuffer::GetLineWidgets(long line) const
@@ -108,7 +108,7 @@ void ZepCommand_ReplaceRange::Undo()
         else
         {
             // Delete the previous inserted text
-            m_buffer.Delete(m_startOffset, m_buffer.LocationFromOffsetByChars(m_startOffset, (long)m_strReplace.length()));
+            m_buffer.Delete(m_startOffset, m_startOffset + long(m_strReplace.length()));
             // Insert the deleted text
             m_buffer.Insert(m_startOffset, m_strDeleted);
         }
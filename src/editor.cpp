@@ -7,6 +7,7 @@
 #include "zep/mode_standard.h"
 #include "zep/mode_vim.h"
 #include "zep/syntax.h"
+#include "zep/syntax_grammar.h"
 #include "zep/syntax_providers.h"
 #include "zep/tab_window.h"
 #include "zep/theme.h"
@@ -83,6 +84,7 @@ ZepEditor::ZepEditor(ZepDisplay* pDisplay, const ZepPath& root, uint32_t flags,
     m_commandLines.push_back("");
 
     RegisterSyntaxProviders(*this);
+    RegisterSyntaxGrammars(*this, root / "syntax");
 
     m_editorRegion = std::make_shared<Region>();
     m_editorRegion->vertical = false;
@@ -100,6 +102,10 @@ ZepEditor::ZepEditor(ZepDisplay* pDisplay, const ZepPath& root, uint32_t flags,
 
 ZepEditor::~ZepEditor()
 {
+    // Jobs left running by their owners can use the file system; they finish first.
+    // Anything queued after this runs straight away
+    m_threadPool->shutdown();
+
     delete m_pDisplay;
     delete m_pFileSystem;
 }
@@ -167,6 +173,7 @@ void ZepEditor::LoadConfig(std::shared_ptr<cpptoml::table> spConfig)
         m_config.widgetMargins.x = (float)spConfig->get_qualified_as<double>("editor.widget_margin_top").value_or(1);
         m_config.widgetMargins.y = (float)spConfig->get_qualified_as<double>("editor.widget_margin_bottom").value_or(1);
         m_config.shortTabNames = spConfig->get_qualified_as<bool>("editor.short_tab_names").value_or(false);
+        m_config.ropeStorageThreshold = spConfig->get_qualified_as<int64_t>("editor.rope_storage_threshold").value_or(32 * 1024 * 1024);
         auto styleStr = string_tolower(spConfig->get_qualified_as<std::string>("editor.style").value_or("normal"));
         if (styleStr == "normal")
         {
@@ -199,6 +206,7 @@ void ZepEditor::SaveConfig(std::shared_ptr<cpptoml::table> spConfig)
     table->insert("background_fade_time", (double)m_config.backgroundFadeTime);
     table->insert("background_fade_wait", (double)m_config.backgroundFadeWait);
     table->insert("show_scrollbar", m_config.showScrollBar);
+    table->insert("rope_storage_threshold", m_config.ropeStorageThreshold);
     
     table->insert("line_margin_top", m_config.lineMargins.x);
     table->insert("line_margin_bottom", m_config.lineMargins.y);
@@ -230,6 +238,10 @@ void ZepEditor::SaveBuffer(ZepBuffer& buffer)
     {
         strText << "Failed to save, Locked: " << buffer.GetDisplayName();
     }
+    else if (buffer.IsLoading())
+    {
+        strText << "Failed to save, still loading: " << buffer.GetDisplayName();
+    }
     else if (buffer.GetFilePath().empty())
     {
         strText << "Error: No file name";
@@ -1,5 +1,9 @@
 #include "zep/filesystem.h"
 
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
 
 #include "zep/mcommon/logger.h"
@@ -18,9 +22,35 @@ namespace cpp_fs = std::experimental::filesystem::v1;
 #include <sys/types.h>
 #endif
 
+#if defined(__linux__) || defined(__APPLE__)
+#define ZEP_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace Zep
 {
 
+#if defined(ZEP_MMAP)
+namespace
+{
+
+// A memory mapped file; pages are only read from disk when they are touched.
+// Note: The mapping is private, but truncating the file on disk while it is mapped will fault; Write replaces
+// a mapped file instead of rewriting it, so the mapping keeps the old one.
+struct ZepFileMappingMMap : public ZepFileMapping
+{
+    ~ZepFileMappingMMap()
+    {
+        munmap((void*)pData, size);
+    }
+};
+
+} // namespace
+#endif
+
 ZepFileSystemCPP::ZepFileSystemCPP()
 {
 #if defined(__APPLE__)
@@ -113,15 +143,95 @@ std::string ZepFileSystemCPP::Read(const ZepPath& fileName)
 
 bool ZepFileSystemCPP::Write(const ZepPath& fileName, const void* pData, size_t size)
 {
-    FILE* pFile;
-    pFile = fopen(fileName.string().c_str(), "wb");
-    if (!pFile)
+    auto fnWrite = [&](const std::string& path) {
+        auto pFile = fopen(path.c_str(), "wb");
+        if (!pFile)
+        {
+            return false;
+        }
+        auto written = fwrite(pData, sizeof(uint8_t), size, pFile);
+        return fclose(pFile) == 0 && written == size;
+    };
+
+#if defined(ZEP_MMAP)
+    // Save to the file a link points at, not over the link
+    auto path = fileName.string();
+    char realPath[PATH_MAX];
+    if (realpath(path.c_str(), realPath))
     {
-        return false;
+        path = realPath;
     }
-    fwrite(pData, sizeof(uint8_t), size, pFile);
-    fclose(pFile);
-    return true;
+
+    // A buffer may still be reading the file through a mapping of it; rewriting it in place would change the
+    // text under it, or fault if it got shorter.  So write a new file, and move it over the old one, which stays
+    // whole until the last mapping of it goes.  Any other hard links to it keep the old text
+    struct stat s;
+    if (stat(path.c_str(), &s) == 0 && IsMapped(uint64_t(s.st_dev), uint64_t(s.st_ino)))
+    {
+        auto tempName = path + ".zep_save";
+        if (!fnWrite(tempName))
+        {
+            std::remove(tempName.c_str());
+            return false;
+        }
+
+        // Keep the owner and permissions of the file being replaced, as far as we are allowed
+        if (chown(tempName.c_str(), s.st_uid, s.st_gid) != 0)
+        {
+            LOG(typelog::WARN) << "Couldn't keep the owner of: " << path;
+        }
+        chmod(tempName.c_str(), s.st_mode & 07777);
+
+        if (std::rename(tempName.c_str(), path.c_str()) != 0)
+        {
+            std::remove(tempName.c_str());
+            return false;
+        }
+        return true;
+    }
+    return fnWrite(path);
+#else
+    return fnWrite(fileName.string());
+#endif
+}
+
+std::shared_ptr<ZepFileMapping> ZepFileSystemCPP::Map(const ZepPath& fileName)
+{
+#if defined(ZEP_MMAP)
+    auto fd = open(fileName.string().c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        struct stat s;
+        if (fstat(fd, &s) == 0 && s.st_size > 0)
+        {
+            auto pData = mmap(nullptr, size_t(s.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (pData != MAP_FAILED)
+            {
+                close(fd);
+                auto spMapping = std::make_shared<ZepFileMappingMMap>();
+                spMapping->pData = (const uint8_t*)pData;
+                spMapping->size = size_t(s.st_size);
+
+                std::lock_guard<std::mutex> lock(m_mappedLock);
+                m_mappedFiles.push_back(MappedFile{ uint64_t(s.st_dev), uint64_t(s.st_ino), spMapping });
+                return spMapping;
+            }
+        }
+        close(fd);
+    }
+#endif
+    // Empty files can't be mapped, and some platforms don't have it
+    return IZepFileSystem::Map(fileName);
+}
+
+// Is a mapping of the file still alive; the ones which have gone are forgotten
+bool ZepFileSystemCPP::IsMapped(uint64_t device, uint64_t inode)
+{
+    std::lock_guard<std::mutex> lock(m_mappedLock);
+    m_mappedFiles.erase(std::remove_if(m_mappedFiles.begin(), m_mappedFiles.end(), [](const MappedFile& file) { return file.wpMapping.expired(); }), m_mappedFiles.end());
+    return std::any_of(m_mappedFiles.begin(), m_mappedFiles.end(), [&](const MappedFile& file) {
+        return file.device == device && file.inode == inode;
+    });
 }
 
 void ZepFileSystemCPP::ScanDirectory(const ZepPath& path, std::function<bool(const ZepPath& path, bool& dont_recurse)> fnScan) const
@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+#include "zep/line_index.h"
+
+namespace Zep
+{
+
+void LineIndex::Clear()
+{
+    m_blocks.clear();
+    Rebuild();
+}
+
+void LineIndex::Assign(const std::vector<long>& lineEnds)
+{
+    m_blocks.clear();
+
+    // Fill blocks 3/4 full, so that new lines don't immediately split them
+    const size_t fill = (MaxBlockLines * 3) / 4;
+    long blockStart = 0;
+    for (size_t line = 0; line < lineEnds.size(); line += fill)
+    {
+        Block block;
+        auto last = std::min(lineEnds.size(), line + fill);
+        block.ends.reserve(last - line);
+        for (auto current = line; current < last; current++)
+        {
+            block.ends.push_back(lineEnds[current] - blockStart);
+        }
+        blockStart = lineEnds[last - 1];
+        m_blocks.push_back(std::move(block));
+    }
+    Rebuild();
+}
+
+std::vector<long> LineIndex::ToVector() const
+{
+    std::vector<long> lineEnds;
+    lineEnds.reserve(m_totalLines);
+    lineEnds.assign(begin(), end());
+    return lineEnds;
+}
+
+long LineIndex::operator[](long line) const
+{
+    assert(line >= 0 && line < m_totalLines);
+    auto block = FindBlockForLine(line);
+    return m_blockChars.Prefix(block) + m_blocks[block].ends[line];
+}
+
+long LineIndex::LineFromOffset(long offset) const
+{
+    if (offset >= m_totalChars)
+    {
+        return m_totalLines;
+    }
+
+    auto block = FindBlockForOffset(offset);
+    auto& ends = m_blocks[block].ends;
+    auto itrLine = std::upper_bound(ends.begin(), ends.end(), offset);
+    return m_blockLines.Prefix(block) + long(itrLine - ends.begin());
+}
+
+void LineIndex::Insert(long offset, long length, const std::vector<long>& lineEnds)
+{
+    if (offset >= m_totalChars)
+    {
+        // Beyond the last line end, so nothing moves; just add the new lines
+        if (lineEnds.empty())
+        {
+            return;
+        }
+
+        if (m_blocks.empty())
+        {
+            m_blocks.push_back(Block());
+        }
+
+        auto& block = m_blocks.back();
+        auto blockStart = m_totalChars - (block.ends.empty() ? 0 : block.ends.back());
+        for (auto& end : lineEnds)
+        {
+            block.ends.push_back(end - blockStart);
+        }
+        if (long(block.ends.size()) > MaxBlockLines)
+        {
+            SplitBlock(m_blocks.size() - 1);
+        }
+        Rebuild();
+        return;
+    }
+
+    // Only the block holding the edit is rewritten; later blocks move with the block sizes
+    auto local = offset;
+    auto blockIndex = FindBlockForOffset(local);
+    auto& ends = m_blocks[blockIndex].ends;
+    auto blockStart = offset - local;
+
+    auto itrLine = std::upper_bound(ends.begin(), ends.end(), local);
+    for (auto itr = itrLine; itr != ends.end(); itr++)
+    {
+        *itr += length;
+    }
+
+    if (!lineEnds.empty())
+    {
+        auto at = itrLine - ends.begin();
+        ends.insert(itrLine, lineEnds.size(), 0);
+        for (size_t i = 0; i < lineEnds.size(); i++)
+        {
+            ends[at + i] = lineEnds[i] - blockStart;
+        }
+    }
+
+    if (long(ends.size()) > MaxBlockLines)
+    {
+        SplitBlock(blockIndex);
+        Rebuild();
+        return;
+    }
+
+    m_blockChars.Add(blockIndex, length);
+    m_blockLines.Add(blockIndex, long(lineEnds.size()));
+    m_totalChars += length;
+    m_totalLines += long(lineEnds.size());
+}
+
+void LineIndex::Erase(long startOffset, long endOffset)
+{
+    if (startOffset >= endOffset)
+    {
+        return;
+    }
+
+    // Lines ending inside (start, end] are removed, lines after that move back
+    auto firstLine = LineFromOffset(startOffset);
+    auto lastLine = LineFromOffset(endOffset);
+    if (firstLine >= m_totalLines)
+    {
+        return;
+    }
+
+    auto diff = endOffset - startOffset;
+    auto firstLocal = firstLine;
+    auto firstBlock = FindBlockForLine(firstLocal);
+
+    if (lastLine < m_totalLines)
+    {
+        auto lastLocal = lastLine;
+        auto lastBlock = FindBlockForLine(lastLocal);
+        if (firstBlock == lastBlock)
+        {
+            auto& ends = m_blocks[firstBlock].ends;
+            ends.erase(ends.begin() + firstLocal, ends.begin() + lastLocal);
+            for (auto itr = ends.begin() + firstLocal; itr != ends.end(); itr++)
+            {
+                *itr -= diff;
+            }
+
+            m_blockChars.Add(firstBlock, -diff);
+            m_blockLines.Add(firstBlock, -(lastLine - firstLine));
+            m_totalChars -= diff;
+            m_totalLines -= (lastLine - firstLine);
+            return;
+        }
+    }
+
+    // The edit spans blocks; merge what is left of them into one
+    auto blockStart = m_blockChars.Prefix(firstBlock);
+    Block merged;
+    merged.ends.assign(m_blocks[firstBlock].ends.begin(), m_blocks[firstBlock].ends.begin() + firstLocal);
+
+    auto lastBlock = m_blocks.size();
+    if (lastLine < m_totalLines)
+    {
+        auto lastLocal = lastLine;
+        lastBlock = FindBlockForLine(lastLocal);
+        auto lastBlockStart = m_blockChars.Prefix(lastBlock);
+        auto& ends = m_blocks[lastBlock].ends;
+        for (auto itr = ends.begin() + lastLocal; itr != ends.end(); itr++)
+        {
+            merged.ends.push_back(*itr + lastBlockStart - diff - blockStart);
+        }
+        lastBlock++;
+    }
+
+    m_blocks.erase(m_blocks.begin() + firstBlock, m_blocks.begin() + lastBlock);
+    if (!merged.ends.empty())
+    {
+        m_blocks.insert(m_blocks.begin() + firstBlock, std::move(merged));
+        if (long(m_blocks[firstBlock].ends.size()) > MaxBlockLines)
+        {
+            SplitBlock(firstBlock);
+        }
+    }
+    Rebuild();
+}
+
+size_t LineIndex::FindBlockForLine(long& line) const
+{
+    auto block = m_blockLines.Search(line);
+    assert(block < m_blocks.size());
+    return block;
+}
+
+size_t LineIndex::FindBlockForOffset(long& offset) const
+{
+    return m_blockChars.Search(offset);
+}
+
+void LineIndex::SplitBlock(size_t blockIndex)
+{
+    // A big insert (a paste, or a chunk of a file being loaded) can need many blocks; they are left 3/4 full
+    const size_t fill = (MaxBlockLines * 3) / 4;
+    auto ends = std::move(m_blocks[blockIndex].ends);
+    if (long(ends.size()) <= MaxBlockLines)
+    {
+        m_blocks[blockIndex].ends = std::move(ends);
+        return;
+    }
+
+    std::vector<Block> blocks((ends.size() + fill - 1) / fill);
+    long blockStart = 0;
+    for (size_t index = 0; index < blocks.size(); index++)
+    {
+        auto first = index * fill;
+        auto last = std::min(ends.size(), first + fill);
+        blocks[index].ends.reserve(last - first);
+        for (auto line = first; line < last; line++)
+        {
+            blocks[index].ends.push_back(ends[line] - blockStart);
+        }
+        blockStart = ends[last - 1];
+    }
+    m_blocks[blockIndex] = std::move(blocks[0]);
+    m_blocks.insert(m_blocks.begin() + blockIndex + 1, std::make_move_iterator(blocks.begin() + 1), std::make_move_iterator(blocks.end()));
+}
+
+long LineIndex::GetMaxBlockSize() const
+{
+    long maxLines = 0;
+    for (auto& block : m_blocks)
+    {
+        maxLines = std::max(maxLines, long(block.ends.size()));
+    }
+    return maxLines;
+}
+
+void LineIndex::Rebuild()
+{
+    std::vector<long> lines;
+    std::vector<long> chars;
+    lines.reserve(m_blocks.size());
+    chars.reserve(m_blocks.size());
+
+    m_totalLines = 0;
+    m_totalChars = 0;
+    for (auto& block : m_blocks)
+    {
+        lines.push_back(long(block.ends.size()));
+        chars.push_back(block.ends.back());
+        m_totalLines += lines.back();
+        m_totalChars += chars.back();
+    }
+    m_blockLines.Build(lines);
+    m_blockChars.Build(chars);
+}
+
+} // namespace Zep
@@ -151,7 +151,7 @@ bool ZepMode::HandleGlobalCommand(const std::string& cmd, uint32_t modifiers, bo
         auto pFound = buffer.FindNextMarker(GetCurrentWindow()->GetBufferCursor(), dir, RangeMarkerType::Message);
         if (pFound)
         {
-            GetCurrentWindow()->SetBufferCursor(pFound->range.first);
+            GetCurrentWindow()->SetBufferCursor(pFound->GetRange().first);
         }
         return true;
     }
@@ -21,16 +21,8 @@ ZepMode_Search::ZepMode_Search(ZepEditor& editor, ZepWindow& launchWindow, ZepWi
 
 ZepMode_Search::~ZepMode_Search()
 {
-    // Ensure threads have finished
-    if (m_indexResult.valid())
-    {
-        m_indexResult.wait();
-    }
-
-    if (m_searchResult.valid())
-    {
-        m_searchResult.wait();
-    }
+    // The jobs only use what they were given, so they are left to stop on their own
+    GetEditor().GetThreadPool().cancel_group(this);
 }
 
 void ZepMode_Search::AddKeyPress(uint32_t key, uint32_t modifiers)
@@ -173,20 +165,25 @@ void ZepMode_Search::Begin()
     m_window.GetBuffer().SetText(std::string("Indexing: ") + m_startPath.string());
 
     fileSearchActive = true;
-    m_indexResult = GetEditor().GetThreadPool().enqueue([&, ignorePaths, includePaths](const ZepPath& root) {
+    auto& fileSystem = GetEditor().GetFileSystem();
+    m_indexResult = GetEditor().GetThreadPool().enqueue_group(this, task_priority::low, [&fileSystem, ignorePaths, includePaths](const cancel_token& token, const ZepPath& root) {
         auto spResult = std::make_shared<FileSearchResult>();
         spResult->root = ZepPath(root.string());
 
         try
         {
             // Index the whole subtree, ignoring any patterns supplied to us
-            GetEditor().GetFileSystem().ScanDirectory(root, [&](const ZepPath& p, bool& recurse) -> bool {
+            fileSystem.ScanDirectory(root, [&](const ZepPath& p, bool& recurse) -> bool {
+                if (token.is_cancelled())
+                {
+                    return false;
+                }
                 recurse = true;
 
-                auto bDir = GetEditor().GetFileSystem().IsDirectory(p);
+                auto bDir = fileSystem.IsDirectory(p);
 
                 // Add this one to our list
-                auto targetZep = GetEditor().GetFileSystem().Canonical(p);
+                auto targetZep = fileSystem.Canonical(p);
                 auto rel = path_get_relative(root, targetZep);
 
                 bool matched = true;
@@ -392,23 +389,30 @@ void ZepMode_Search::UpdateTree()
         char startChar = m_searchTerm[m_indexTree.size() - 1];
 
         // Search for a match at the next level of the search tree
-        m_searchResult = GetEditor().GetThreadPool().enqueue([&](std::shared_ptr<IndexSet> spStartSet, const char startChar) {
+        auto spFilePaths = m_spFilePaths;
+        auto caseImportant = m_caseImportant;
+        m_searchResult = GetEditor().GetThreadPool().enqueue_group(this, task_priority::high, [spFilePaths, caseImportant](const cancel_token& token, std::shared_ptr<IndexSet> spStartSet, const char startChar) {
             auto spResult = std::make_shared<IndexSet>();
             for (auto& searchPair : spStartSet->indices)
             {
+                if (token.is_cancelled())
+                {
+                    break;
+                }
+
                 auto index = searchPair.second.index;
                 auto loc = searchPair.second.location;
                 auto dist = searchPair.first;
 
                 size_t pos = 0;
-                if (m_caseImportant)
+                if (caseImportant)
                 {
-                    auto str = m_spFilePaths->paths[index].string();
+                    auto str = spFilePaths->paths[index].string();
                     pos = str.find_first_of(startChar, loc);
                 }
                 else
                 {
-                    auto str = m_spFilePaths->lowerPaths[index];
+                    auto str = spFilePaths->lowerPaths[index];
                     pos = str.find_first_of(startChar, loc);
                 }
 
@@ -1,10 +1,14 @@
+#include <algorithm>
 #include <cctype>
+#include <cstring>
 #include <sstream>
 
 #include "zep/buffer.h"
 #include "zep/mode_search.h"
 #include "zep/mode_vim.h"
+#include "zep/search_highlight.h"
 #include "zep/tab_window.h"
+#include "zep/text_regex.h"
 #include "zep/theme.h"
 #include "zep/window.h"
 
@@ -329,15 +333,15 @@ void ZepMode_Vim::SwitchMode(EditorMode mode)
     if (mode == EditorMode::None)
         return;
 
-    if (mode == EditorMode::Insert && GetCurrentWindow() && GetCurrentWindow()->GetBuffer().TestFlags(FileFlags::ReadOnly))
+    if (mode == EditorMode::Insert && GetCurrentWindow() && (GetCurrentWindow()->GetBuffer().TestFlags(FileFlags::ReadOnly) || GetCurrentWindow()->GetBuffer().IsLoading()))
     {
         mode = EditorMode::Normal;
     }
 
-    // When leaving Ex mode, reset search markers
+    // When leaving Ex mode, stop highlighting the search
     if (m_currentMode == EditorMode::Ex)
     {
-        GetCurrentWindow()->GetBuffer().HideMarkers(RangeMarkerType::Search);
+        GetCurrentWindow()->GetBuffer().GetSearchHighlight().Clear();
     }
 
     m_currentMode = mode;
@@ -451,6 +455,32 @@ bool ZepMode_Vim::GetOperationRange(const std::string& op, EditorMode mode, Buff
         beginRange = bufferCursor;
         endRange = buffer.LocationFromOffsetByChars(bufferCursor, 1);
     }
+    else if (op == "%")
+    {
+        // From the cursor to the pair of the first bracket at or after it on the line, including both
+        auto lineEnd = buffer.GetLinePos(bufferCursor, LineLocation::LineCRBegin);
+        for (auto location = bufferCursor; location < lineEnd; location++)
+        {
+            auto match = buffer.MatchingBracket(location);
+            if (match != InvalidOffset)
+            {
+                beginRange = std::min(bufferCursor, match);
+                endRange = std::max(bufferCursor, match) + 1;
+                break;
+            }
+        }
+    }
+    else if (op.size() == 2 && (op[0] == 'i' || op[0] == 'a'))
+    {
+        // A bracket block; inside the brackets, or including them.  'b' is (), 'B' is {}
+        auto bracket = op[1] == 'b' ? '(' : (op[1] == 'B' ? '{' : op[1]);
+        BufferRange scope;
+        if (std::strchr("(){}[]", bracket) != nullptr && buffer.EnclosingScope(bufferCursor, scope, bracket))
+        {
+            beginRange = op[0] == 'i' ? scope.first + 1 : scope.first;
+            endRange = op[0] == 'i' ? scope.second : scope.second + 1;
+        }
+    }
     return beginRange != -1;
 }
 
@@ -567,6 +597,9 @@ bool ZepMode_Vim::HandleExCommand(std::string strCommand, const char key)
                 pTab->AddWindow(&GetEditor().GetActiveTabWindow()->GetActiveWindow()->GetBuffer(), pWindow, false);
             }
         }
+        else if (Substitute(buffer, bufferCursor, strCommand))
+        {
+        }
         else if (strCommand.find(":e") == 0)
         {
             auto strTok = string_split(strCommand, " ");
@@ -626,7 +659,7 @@ bool ZepMode_Vim::HandleExCommand(std::string strCommand, const char key)
                 start = buffer.GetLinePos(bufferCursor, LineLocation::LineFirstGraphChar);
                 end = buffer.GetLinePos(bufferCursor, LineLocation::LineLastGraphChar) + 1;
             }
-            spMarker->range = BufferRange{ start, end };
+            spMarker->SetRange(BufferRange{ start, end });
             switch (markerType)
             {
             case 5:
@@ -772,58 +805,26 @@ bool ZepMode_Vim::HandleExCommand(std::string strCommand, const char key)
     }
     else if (!m_currentCommand.empty() && m_currentCommand[0] == '/' || m_currentCommand[0] == '?')
     {
-        // TODO: Busy editing the search string; do the search
+        // Busy editing the search string; do the search
         if (m_currentCommand.length() > 0)
         {
             auto pWindow = GetEditor().GetActiveTabWindow()->GetActiveWindow();
             auto& buffer = pWindow->GetBuffer();
-            auto searchString = m_currentCommand.substr(1);
-
-            buffer.ClearRangeMarkers(RangeMarkerType::Search);
-
-            uint32_t numMarkers = 0;
-            BufferLocation start = 0;
+            SetLastSearch(m_currentCommand.substr(1));
 
-            if (!searchString.empty())
-            {
-                static const uint32_t MaxMarkers = 1000;
-                while (numMarkers < MaxMarkers)
-                {
-                    auto found = buffer.Find(start, (utf8*)& searchString[0], (utf8*)& searchString[searchString.length()]);
-                    if (found == InvalidOffset)
-                    {
-                        break;
-                    }
-
-                    start = found + 1;
-
-                    auto spMarker = std::make_shared<RangeMarker>();
-                    spMarker->backgroundColor = ThemeColor::VisualSelectBackground;
-                    spMarker->textColor = ThemeColor::Text;
-                    spMarker->range = BufferRange(found, BufferLocation(found + searchString.length()));
-                    spMarker->displayType = RangeMarkerDisplayType::Background;
-                    spMarker->markerType = RangeMarkerType::Search;
-                    buffer.AddRangeMarker(spMarker);
-
-                    numMarkers++;
-                }
-            }
+            // Highlight all the matches; this happens in the background, starting with the ones on screen
+            auto& searchHighlight = buffer.GetSearchHighlight();
+            searchHighlight.SetPattern(m_lastSearch, m_lastSearchIgnoreCase, pWindow->GetVisibleBufferRange());
 
             SearchDirection dir = (m_currentCommand[0] == '/') ? SearchDirection::Forward : SearchDirection::Backward;
             m_lastSearchDirection = dir;
 
             // Find the one on or in front of the cursor, in either direction.
-            auto startLocation = m_exCommandStartLocation;
-            if (dir == SearchDirection::Forward)
-                startLocation--;
-            else
-                startLocation++;
-
-            auto pMark = buffer.FindNextMarker(startLocation, dir, RangeMarkerType::Search);
-            if (pMark)
+            auto found = FindSearchMatch(buffer, m_exCommandStartLocation, dir);
+            if (found != InvalidOffset)
             {
-                pWindow->SetBufferCursor(pMark->range.first);
-                pMark->backgroundColor = ThemeColor::Info;
+                pWindow->SetBufferCursor(found);
+                searchHighlight.SetCurrent(found);
             }
             else
             {
@@ -834,6 +835,143 @@ bool ZepMode_Vim::HandleExCommand(std::string strCommand, const char key)
     return false;
 }
 
+// :s/pattern/replacement/flags on the cursor line, or :%s on all of them.
+// The pattern is a regular expression (see text_regex.h); the flags are g (every match on a line), i and I (ignore/match case).
+// All the replacements are made as one edit, so one undo takes them all back
+bool ZepMode_Vim::Substitute(ZepBuffer& buffer, BufferLocation cursor, const std::string& strCommand)
+{
+    size_t index = 1;
+    bool allLines = false;
+    if (index < strCommand.size() && strCommand[index] == '%')
+    {
+        allLines = true;
+        index++;
+    }
+
+    if ((index + 1) >= strCommand.size() || strCommand[index] != 's' || std::isalnum(ToASCII(strCommand[index + 1])))
+    {
+        return false;
+    }
+    index++;
+
+    // Split into pattern, replacement and flags; an escaped delimiter is just the character
+    auto delimiter = strCommand[index++];
+    std::string parts[3];
+    size_t part = 0;
+    for (; index < strCommand.size(); index++)
+    {
+        auto ch = strCommand[index];
+        if (ch == '\\' && (index + 1) < strCommand.size())
+        {
+            if (strCommand[index + 1] != delimiter)
+            {
+                parts[part].push_back(ch);
+            }
+            parts[part].push_back(strCommand[++index]);
+        }
+        else if (ch == delimiter && part < 2)
+        {
+            part++;
+        }
+        else
+        {
+            parts[part].push_back(ch);
+        }
+    }
+
+    const auto& pattern = parts[0];
+    const auto& replacement = parts[1];
+    bool global = parts[2].find('g') != std::string::npos;
+    bool ignoreCase = parts[2].find('i') != std::string::npos;
+    if (pattern.empty())
+    {
+        GetEditor().SetCommandText("No pattern");
+        return true;
+    }
+
+    auto spRegex = RegexCompile(pattern, ignoreCase ? RegexFlags::IgnoreCase : RegexFlags::None);
+    if (!spRegex)
+    {
+        GetEditor().SetCommandText("Invalid pattern: " + pattern);
+        return true;
+    }
+
+    if (buffer.IsLoading())
+    {
+        GetEditor().SetCommandText("Can't substitute, still loading");
+        return true;
+    }
+
+    long first = 0;
+    long last = buffer.EndLocation();
+    if (!allLines)
+    {
+        buffer.GetLineOffsets(buffer.GetBufferLine(cursor), first, last);
+    }
+
+    auto result = RegexReplace(buffer.GetText(), first, last, *spRegex, replacement, global);
+    if (result.count == 0)
+    {
+        GetEditor().SetCommandText("Pattern not found: " + pattern);
+        return true;
+    }
+
+    // Leave the cursor at the start of the line with the last replacement on it
+    auto lineEnd = result.text.rfind('\n', size_t(result.lastReplacement - result.first));
+    auto cursorAfter = (lineEnd == std::string::npos) ? buffer.GetLinePos(result.first, LineLocation::LineBegin) : result.first + long(lineEnd) + 1;
+
+    std::shared_ptr<ZepCommand> spCommand;
+    if (result.first == result.last)
+    {
+        spCommand = std::make_shared<ZepCommand_Insert>(buffer, result.first, result.text, cursor, cursorAfter);
+    }
+    else
+    {
+        spCommand = std::make_shared<ZepCommand_ReplaceRange>(buffer, ReplaceRangeMode::Replace, result.first, result.last, result.text, cursor, cursorAfter);
+    }
+    AddCommand(spCommand);
+
+    if (result.count > 1)
+    {
+        GetEditor().SetCommandText(std::to_string(result.count) + " substitutions");
+    }
+    return true;
+}
+
+// Remember the search pattern; as in Vim, \c anywhere in it makes the search ignore case (and \C forces case)
+void ZepMode_Vim::SetLastSearch(const std::string& pattern)
+{
+    m_lastSearch.clear();
+    m_lastSearchIgnoreCase = false;
+    for (size_t index = 0; index < pattern.size(); index++)
+    {
+        if (pattern[index] == '\\' && index + 1 < pattern.size() && (pattern[index + 1] == 'c' || pattern[index + 1] == 'C'))
+        {
+            m_lastSearchIgnoreCase = pattern[index + 1] == 'c';
+            index++;
+            continue;
+        }
+        m_lastSearch.push_back(pattern[index]);
+    }
+}
+
+// The next match of the last search, starting at (and including) start; wraps around the buffer
+BufferLocation ZepMode_Vim::FindSearchMatch(ZepBuffer& buffer, BufferLocation start, SearchDirection dir) const
+{
+    if (m_lastSearch.empty())
+    {
+        return InvalidOffset;
+    }
+
+    start = std::max(0l, std::min(start, buffer.EndLocation()));
+    auto found = buffer.Search(m_lastSearch, start, dir, InvalidOffset, m_lastSearchIgnoreCase);
+    if (found == InvalidOffset)
+    {
+        found = buffer.Search(m_lastSearch, dir == SearchDirection::Forward ? 0 : buffer.EndLocation(), dir, InvalidOffset, m_lastSearchIgnoreCase);
+    }
+    return found;
+}
+
 bool ZepMode_Vim::GetCommand(CommandContext& context)
 {
     auto bufferCursor = GetCurrentWindow()->GetBufferCursor();
@@ -869,6 +1007,15 @@ bool ZepMode_Vim::GetCommand(CommandContext& context)
         GetCurrentWindow()->SetBufferCursor(context.buffer.GetLinePos(bufferCursor, LineLocation::LineFirstGraphChar));
         return true;
     }
+    else if (context.command == "%")
+    {
+        BufferLocation beginRange, endRange;
+        if (GetOperationRange("%", context.mode, beginRange, endRange))
+        {
+            GetCurrentWindow()->SetBufferCursor(beginRange == bufferCursor ? endRange - 1 : beginRange);
+        }
+        return true;
+    }
     // Moving between tabs
     else if (context.command == "H" && (context.modifierKeys & ModifierKey::Shift))
     {
@@ -1200,6 +1347,13 @@ bool ZepMode_Vim::GetCommand(CommandContext& context)
                 context.op = CommandOperation::Delete;
             }
         }
+        else if (context.command == "d%" || (context.command.size() == 3 && (context.command[1] == 'i' || context.command[1] == 'a')))
+        {
+            if (GetOperationRange(context.command.substr(1), context.mode, context.beginRange, context.endRange))
+            {
+                context.op = CommandOperation::Delete;
+            }
+        }
         else if (context.command.find("dt") == 0)
         {
             if (context.command.length() == 3)
@@ -1351,6 +1505,13 @@ bool ZepMode_Vim::GetCommand(CommandContext& context)
                 context.op = CommandOperation::Delete;
             }
         }
+        else if (context.command == "c%" || (context.command.size() == 3 && (context.command[1] == 'i' || context.command[1] == 'a')))
+        {
+            if (GetOperationRange(context.command.substr(1), context.mode, context.beginRange, context.endRange))
+            {
+                context.op = CommandOperation::Delete;
+            }
+        }
         else if (context.command.find("ct") == 0)
         {
             if (context.command.length() == 3)
@@ -1425,6 +1586,18 @@ bool ZepMode_Vim::GetCommand(CommandContext& context)
                 context.endRange = context.buffer.GetLinePos(context.bufferCursor, LineLocation::BeyondLineEnd);
                 context.op = CommandOperation::CopyLines;
             }
+            else if (context.command == "yi" || context.command == "ya")
+            {
+                context.commandResult.flags |= CommandResultFlags::NeedMoreChars;
+            }
+            else if (context.command == "y%" || (context.command.size() == 3 && (context.command[1] == 'i' || context.command[1] == 'a')))
+            {
+                if (GetOperationRange(context.command.substr(1), context.mode, context.beginRange, context.endRange))
+                {
+                    context.registers.push('0');
+                    context.op = CommandOperation::Copy;
+                }
+            }
         }
 
         if (context.op == CommandOperation::None)
@@ -1574,21 +1747,19 @@ bool ZepMode_Vim::GetCommand(CommandContext& context)
         }
         context.commandResult.flags |= CommandResultFlags::NeedMoreChars;
     }
-    else if (context.command[0] == 'n')
+    else if (context.command[0] == 'n' || context.command[0] == 'N')
     {
-        auto pMark = buffer.FindNextMarker(context.bufferCursor, m_lastSearchDirection, RangeMarkerType::Search);
-        if (pMark)
+        // Search the text itself, so that every match can be reached
+        auto dir = m_lastSearchDirection;
+        if (context.command[0] == 'N')
         {
-            GetCurrentWindow()->SetBufferCursor(pMark->range.first);
+            dir = (dir == SearchDirection::Forward) ? SearchDirection::Backward : SearchDirection::Forward;
         }
-        return true;
-    }
-    else if (context.command[0] == 'N')
-    {
-        auto pMark = buffer.FindNextMarker(context.bufferCursor, m_lastSearchDirection == SearchDirection::Forward ? SearchDirection::Backward : SearchDirection::Forward, RangeMarkerType::Search);
-        if (pMark)
+
+        auto found = FindSearchMatch(buffer, context.bufferCursor + (dir == SearchDirection::Forward ? 1 : -1), dir);
+        if (found != InvalidOffset)
         {
-            GetCurrentWindow()->SetBufferCursor(pMark->range.first);
+            GetCurrentWindow()->SetBufferCursor(found);
         }
         return true;
     }
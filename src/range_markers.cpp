@@ -0,0 +1,492 @@
+#include "zep/range_markers.h"
+#include "zep/buffer.h"
+
+#include <algorithm>
+
+namespace Zep
+{
+
+RangeMarker::RangeMarker(const RangeMarker& copy)
+{
+    *this = copy;
+}
+
+// A copy isn't in the tree of the marker it was copied from
+RangeMarker& RangeMarker::operator=(const RangeMarker& copy)
+{
+    auto range = copy.GetRange();
+    textColor = copy.textColor;
+    backgroundColor = copy.backgroundColor;
+    highlightColor = copy.highlightColor;
+    displayType = copy.displayType;
+    markerType = copy.markerType;
+    name = copy.name;
+    description = copy.description;
+    tipPos = copy.tipPos;
+    SetRange(range);
+    return *this;
+}
+
+BufferRange RangeMarker::GetRange() const
+{
+    return m_pTree ? m_pTree->GetRange(*this) : m_range;
+}
+
+void RangeMarker::SetRange(const BufferRange& range)
+{
+    if (m_pTree)
+    {
+        m_pTree->SetRange(*this, range);
+    }
+    else
+    {
+        m_range = range;
+    }
+}
+
+RangeMarkerTree::RangeMarkerTree()
+{
+}
+
+RangeMarkerTree::~RangeMarkerTree()
+{
+    clear();
+}
+
+void RangeMarkerTree::clear()
+{
+    Detach(m_pRoot, 0);
+    Destroy(m_pRoot);
+    m_pRoot = nullptr;
+    m_nodes.clear();
+}
+
+// The markers leave the tree, keeping where they are
+void RangeMarkerTree::Detach(Node* pNode, long delta)
+{
+    if (pNode)
+    {
+        pNode->spMarker->m_range = BufferRange(pNode->first + delta, pNode->second + delta);
+        pNode->spMarker->m_pTree = nullptr;
+        Detach(pNode->pLeft, delta + pNode->delta);
+        Detach(pNode->pRight, delta + pNode->delta);
+    }
+}
+
+void RangeMarkerTree::Destroy(Node* pNode)
+{
+    if (pNode)
+    {
+        Destroy(pNode->pLeft);
+        Destroy(pNode->pRight);
+        delete pNode;
+    }
+}
+
+// Move a whole subtree; its children are moved when they are next pushed
+void RangeMarkerTree::Move(Node* pNode, long delta)
+{
+    if (pNode)
+    {
+        pNode->first += delta;
+        pNode->second += delta;
+        pNode->maxSecond += delta;
+        pNode->delta += delta;
+    }
+}
+
+void RangeMarkerTree::Push(Node* pNode)
+{
+    if (pNode->delta != 0)
+    {
+        Move(pNode->pLeft, pNode->delta);
+        Move(pNode->pRight, pNode->delta);
+        pNode->delta = 0;
+    }
+}
+
+void RangeMarkerTree::Pull(Node* pNode)
+{
+    pNode->count = 1;
+    pNode->maxSecond = pNode->second;
+    pNode->markerTypes = pNode->spMarker->markerType;
+    for (auto pChild : { pNode->pLeft, pNode->pRight })
+    {
+        if (pChild)
+        {
+            pNode->count += pChild->count;
+            pNode->maxSecond = std::max(pNode->maxSecond, pChild->maxSecond);
+            pNode->markerTypes |= pChild->markerTypes;
+            pChild->pParent = pNode;
+        }
+    }
+}
+
+void RangeMarkerTree::SetRange(Node* pNode, long first, long second)
+{
+    pNode->first = first;
+    pNode->second = second;
+}
+
+void RangeMarkerTree::SetRoot(Node* pRoot)
+{
+    m_pRoot = pRoot;
+    if (m_pRoot)
+    {
+        m_pRoot->pParent = nullptr;
+    }
+}
+
+// Left gets the markers starting at or before first
+void RangeMarkerTree::SplitAfter(Node* pNode, long first, Node*& pLeft, Node*& pRight)
+{
+    auto fnLeft = [](Node* pAt, long at, Node*&) {
+        return pAt->first <= at;
+    };
+    TreapSplit(pNode, first, pLeft, pRight, fnLeft, Pull, Push);
+}
+
+// Left gets the first count markers
+void RangeMarkerTree::SplitCount(Node* pNode, size_t count, Node*& pLeft, Node*& pRight)
+{
+    auto fnLeft = [](Node* pAt, size_t& at, Node*&) {
+        auto leftCount = pAt->pLeft ? pAt->pLeft->count : 0;
+        if (at <= leftCount)
+        {
+            return false;
+        }
+        at -= leftCount + 1;
+        return true;
+    };
+    TreapSplit(pNode, count, pLeft, pRight, fnLeft, Pull, Push);
+}
+
+RangeMarkerTree::Node* RangeMarkerTree::Merge(Node* pLeft, Node* pRight)
+{
+    return TreapMerge(pLeft, pRight, Pull, Push);
+}
+
+void RangeMarkerTree::Add(const std::shared_ptr<RangeMarker>& spMarker)
+{
+    if (m_nodes.find(spMarker.get()) != m_nodes.end())
+    {
+        return;
+    }
+
+    // A marker is only in one tree
+    if (spMarker->m_pTree)
+    {
+        spMarker->m_pTree->Remove(spMarker);
+    }
+
+    auto pNode = new Node();
+    pNode->spMarker = spMarker;
+    pNode->first = spMarker->m_range.first;
+    pNode->second = spMarker->m_range.second;
+    pNode->priority = m_priorities();
+    Pull(pNode);
+    m_nodes[spMarker.get()] = pNode;
+    spMarker->m_pTree = this;
+
+    // After any markers with the same start
+    Node* pLeft;
+    Node* pRight;
+    SplitAfter(m_pRoot, pNode->first, pLeft, pRight);
+    SetRoot(Merge(Merge(pLeft, pNode), pRight));
+}
+
+void RangeMarkerTree::Remove(const std::shared_ptr<RangeMarker>& spMarker)
+{
+    auto itrFound = m_nodes.find(spMarker.get());
+    if (itrFound == m_nodes.end())
+    {
+        return;
+    }
+
+    // Its position in the tree; the starts may be out of date, but the counts never are
+    auto pNode = itrFound->second;
+    size_t index = pNode->pLeft ? pNode->pLeft->count : 0;
+    for (auto pChild = pNode; pChild->pParent; pChild = pChild->pParent)
+    {
+        auto pParent = pChild->pParent;
+        if (pParent->pRight == pChild)
+        {
+            index += (pParent->pLeft ? pParent->pLeft->count : 0) + 1;
+        }
+    }
+
+    Node* pLeft;
+    Node* pRight;
+    Node* pVictim;
+    SplitCount(m_pRoot, index, pLeft, pRight);
+    SplitCount(pRight, 1, pVictim, pRight);
+    SetRoot(Merge(pLeft, pRight));
+
+    // The splits pushed the moves down to it
+    m_nodes.erase(itrFound);
+    pVictim->pLeft = pVictim->pRight = nullptr;
+    Detach(pVictim, 0);
+    Destroy(pVictim);
+}
+
+// All the nodes in order, with their moves pushed down and their links cleared
+void RangeMarkerTree::Collect(Node* pNode, std::vector<Node*>& nodes)
+{
+    if (!pNode)
+    {
+        return;
+    }
+
+    Push(pNode);
+    Collect(pNode->pLeft, nodes);
+    nodes.push_back(pNode);
+    Collect(pNode->pRight, nodes);
+    pNode->pLeft = pNode->pRight = pNode->pParent = nullptr;
+}
+
+void RangeMarkerTree::Replace(uint32_t markerTypes, const std::vector<std::shared_ptr<RangeMarker>>& markers)
+{
+    // The markers staying, in order
+    std::vector<Node*> nodes;
+    nodes.reserve(m_nodes.size() + markers.size());
+    Collect(m_pRoot, nodes);
+    m_pRoot = nullptr;
+
+    auto itrKept = std::remove_if(nodes.begin(), nodes.end(), [&](Node* pNode) {
+        if ((pNode->spMarker->markerType & markerTypes) == 0)
+        {
+            return false;
+        }
+        m_nodes.erase(pNode->spMarker.get());
+        Detach(pNode, 0);
+        delete pNode;
+        return true;
+    });
+    nodes.erase(itrKept, nodes.end());
+
+    // The new ones, sorted by start
+    auto keptCount = nodes.size();
+    m_nodes.reserve(keptCount + markers.size());
+    for (auto& spMarker : markers)
+    {
+        if (spMarker->m_pTree && spMarker->m_pTree != this)
+        {
+            spMarker->m_pTree->Remove(spMarker);
+        }
+        if (!m_nodes.emplace(spMarker.get(), nullptr).second)
+        {
+            continue;
+        }
+
+        auto pNode = new Node();
+        pNode->spMarker = spMarker;
+        pNode->first = spMarker->m_range.first;
+        pNode->second = spMarker->m_range.second;
+        pNode->priority = m_priorities();
+        m_nodes[spMarker.get()] = pNode;
+        spMarker->m_pTree = this;
+        nodes.push_back(pNode);
+    }
+
+    auto fnLess = [](Node* pLeft, Node* pRight) {
+        return pLeft->first < pRight->first;
+    };
+    std::stable_sort(nodes.begin() + keptCount, nodes.end(), fnLess);
+    std::inplace_merge(nodes.begin(), nodes.begin() + keptCount, nodes.end(), fnLess);
+
+    SetRoot(TreapBuild(nodes, Pull));
+}
+
+// Move the markers starting at or after the location
+void RangeMarkerTree::MoveFrom(Node* pNode, long location, long delta)
+{
+    if (!pNode)
+    {
+        return;
+    }
+
+    Push(pNode);
+    if (pNode->first >= location)
+    {
+        SetRange(pNode, pNode->first + delta, pNode->second + delta);
+        Move(pNode->pRight, delta);
+        MoveFrom(pNode->pLeft, location, delta);
+    }
+    else
+    {
+        MoveFrom(pNode->pRight, location, delta);
+    }
+    Pull(pNode);
+}
+
+// Grow the markers starting before the location and ending after it
+void RangeMarkerTree::GrowAcross(Node* pNode, long location, long length)
+{
+    if (!pNode || pNode->maxSecond <= location)
+    {
+        return;
+    }
+
+    Push(pNode);
+    GrowAcross(pNode->pLeft, location, length);
+    if (pNode->first < location)
+    {
+        if (pNode->second > location)
+        {
+            SetRange(pNode, pNode->first, pNode->second + length);
+        }
+        GrowAcross(pNode->pRight, location, length);
+    }
+    Pull(pNode);
+}
+
+// Pull the ends of markers inside [first, last) back to first, and the ends after it back by the length.
+// The markers starting at or after last are left to MoveFrom
+void RangeMarkerTree::ClampInto(Node* pNode, long first, long last)
+{
+    if (!pNode)
+    {
+        return;
+    }
+
+    auto fnMap = [&](long location) {
+        return location < first ? location : (location < last ? first : location - (last - first));
+    };
+
+    Push(pNode);
+    if (pNode->first >= first || (pNode->pLeft && pNode->pLeft->maxSecond > first))
+    {
+        ClampInto(pNode->pLeft, first, last);
+    }
+
+    if (pNode->first < last)
+    {
+        if (pNode->first >= first || pNode->second > first)
+        {
+            SetRange(pNode, fnMap(pNode->first), fnMap(pNode->second));
+        }
+        ClampInto(pNode->pRight, first, last);
+    }
+    Pull(pNode);
+}
+
+void RangeMarkerTree::Insert(long location, long length)
+{
+    if (length <= 0)
+    {
+        return;
+    }
+    GrowAcross(m_pRoot, location, length);
+    MoveFrom(m_pRoot, location, length);
+}
+
+void RangeMarkerTree::Delete(long first, long last)
+{
+    if (first >= last)
+    {
+        return;
+    }
+    ClampInto(m_pRoot, first, last);
+    MoveFrom(m_pRoot, last, first - last);
+}
+
+bool RangeMarkerTree::Visit(const Node* pNode, long delta, uint32_t markerTypes, bool forward, long begin, long end, const tMarkerCallback& fn)
+{
+    if (!pNode || (pNode->markerTypes & markerTypes) == 0)
+    {
+        return true;
+    }
+
+    // Where the node is, and the move its children still need
+    auto first = pNode->first + delta;
+    auto second = pNode->second + delta;
+    auto childDelta = delta + pNode->delta;
+
+    // Markers in the left starting before begin are only wanted if they reach past it; and everything on the
+    // right starts after this one
+    bool visitLeft = first >= begin || (pNode->pLeft && (pNode->pLeft->maxSecond + childDelta) > begin);
+    bool visitRight = first <= end;
+    bool visitNode = first <= end && (first >= begin || second > begin) && (pNode->spMarker->markerType & markerTypes) != 0;
+
+    if (forward)
+    {
+        return (!visitLeft || Visit(pNode->pLeft, childDelta, markerTypes, forward, begin, end, fn)) && (!visitNode || fn(pNode->spMarker)) && (!visitRight || Visit(pNode->pRight, childDelta, markerTypes, forward, begin, end, fn));
+    }
+    return (!visitRight || Visit(pNode->pRight, childDelta, markerTypes, forward, begin, end, fn)) && (!visitNode || fn(pNode->spMarker)) && (!visitLeft || Visit(pNode->pLeft, childDelta, markerTypes, forward, begin, end, fn));
+}
+
+void RangeMarkerTree::ForEach(uint32_t markerTypes, bool forward, long begin, long end, const tMarkerCallback& fn) const
+{
+    Visit(m_pRoot, 0, markerTypes, forward, begin, end, fn);
+}
+
+const RangeMarkerTree::Node* RangeMarkerTree::FindAfter(const Node* pNode, long delta, long location, uint32_t markerTypes)
+{
+    if (!pNode || (pNode->markerTypes & markerTypes) == 0)
+    {
+        return nullptr;
+    }
+
+    if (pNode->first + delta > location)
+    {
+        if (auto pFound = FindAfter(pNode->pLeft, delta + pNode->delta, location, markerTypes))
+        {
+            return pFound;
+        }
+        if (pNode->spMarker->markerType & markerTypes)
+        {
+            return pNode;
+        }
+    }
+    return FindAfter(pNode->pRight, delta + pNode->delta, location, markerTypes);
+}
+
+const RangeMarkerTree::Node* RangeMarkerTree::FindBefore(const Node* pNode, long delta, long location, uint32_t markerTypes)
+{
+    if (!pNode || (pNode->markerTypes & markerTypes) == 0)
+    {
+        return nullptr;
+    }
+
+    if (pNode->first + delta < location)
+    {
+        if (auto pFound = FindBefore(pNode->pRight, delta + pNode->delta, location, markerTypes))
+        {
+            return pFound;
+        }
+        if (pNode->spMarker->markerType & markerTypes)
+        {
+            return pNode;
+        }
+    }
+    return FindBefore(pNode->pLeft, delta + pNode->delta, location, markerTypes);
+}
+
+std::shared_ptr<RangeMarker> RangeMarkerTree::FindNext(long location, bool forward, uint32_t markerTypes) const
+{
+    auto pFound = forward ? FindAfter(m_pRoot, 0, location, markerTypes) : FindBefore(m_pRoot, 0, location, markerTypes);
+    return pFound ? pFound->spMarker : nullptr;
+}
+
+BufferRange RangeMarkerTree::GetRange(const RangeMarker& marker) const
+{
+    // The node has its own moves; the ones still to come are left on the nodes above it
+    auto pNode = m_nodes.at(&marker);
+    auto range = BufferRange(pNode->first, pNode->second);
+    for (auto pParent = pNode->pParent; pParent; pParent = pParent->pParent)
+    {
+        range.first += pParent->delta;
+        range.second += pParent->delta;
+    }
+    return range;
+}
+
+void RangeMarkerTree::SetRange(RangeMarker& marker, const BufferRange& range)
+{
+    auto spMarker = m_nodes.at(&marker)->spMarker;
+    Remove(spMarker);
+    marker.m_range = range;
+    Add(spMarker);
+}
+
+} // namespace Zep
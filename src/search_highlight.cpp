@@ -0,0 +1,421 @@
+#include "zep/search_highlight.h"
+#include "zep/editor.h"
+
+#include "zep/mcommon/threadutils.h"
+
+#include <algorithm>
+
+namespace Zep
+{
+
+namespace
+{
+// Match starts searched between checks for an interrupt, and hand backs to the UI
+const long SearchBlockSize = 1024 * 1024;
+
+// Put the parts of the ranges inside the visible range first, keeping the rest in order
+void Prioritize(std::vector<BufferRange>& ranges, const BufferRange& visibleRange)
+{
+    std::vector<BufferRange> inside;
+    std::vector<BufferRange> outside;
+    for (auto& range : ranges)
+    {
+        auto first = std::max(range.first, visibleRange.first);
+        auto last = std::min(range.second, visibleRange.second);
+        if (first >= last)
+        {
+            outside.push_back(range);
+            continue;
+        }
+
+        inside.push_back(BufferRange(first, last));
+        if (range.first < first)
+        {
+            outside.push_back(BufferRange(range.first, first));
+        }
+        if (last < range.second)
+        {
+            outside.push_back(BufferRange(last, range.second));
+        }
+    }
+    inside.insert(inside.end(), outside.begin(), outside.end());
+    ranges.swap(inside);
+}
+
+// Remove the offsets in [first, last), and move the ones after it by delta
+void RemoveAndShift(std::vector<long>& offsets, long first, long last, long delta)
+{
+    auto itrFirst = std::lower_bound(offsets.begin(), offsets.end(), first);
+    auto itrLast = std::lower_bound(itrFirst, offsets.end(), last);
+    auto itr = offsets.erase(itrFirst, itrLast);
+    if (delta != 0)
+    {
+        for (; itr != offsets.end(); ++itr)
+        {
+            *itr += delta;
+        }
+    }
+}
+
+// Move the ranges to account for an edit, removing any that are now empty
+template <class F>
+void MapRanges(std::vector<BufferRange>& ranges, F fnMap)
+{
+    for (auto& range : ranges)
+    {
+        range = BufferRange(fnMap(range.first), fnMap(range.second));
+    }
+    ranges.erase(std::remove_if(ranges.begin(), ranges.end(), [](const BufferRange& range) { return range.first >= range.second; }), ranges.end());
+}
+} // namespace
+
+ZepSearchHighlight::ZepSearchHighlight(ZepBuffer& buffer)
+    : ZepComponent(buffer.GetEditor())
+    , m_buffer(buffer)
+{
+}
+
+ZepSearchHighlight::~ZepSearchHighlight()
+{
+    Interrupt();
+}
+
+void ZepSearchHighlight::SetPattern(const std::string& pattern, bool ignoreCase, const BufferRange& visibleRange)
+{
+    Interrupt();
+    m_current = InvalidOffset;
+
+    if (pattern.empty())
+    {
+        Clear();
+        return;
+    }
+
+    if (pattern != m_pattern || ignoreCase != m_ignoreCase)
+    {
+        auto textEnd = long(m_buffer.GetText().size()) - 1;
+
+        // A longer version of the pattern can only match where the shorter one did.
+        // So the matches so far (and any candidates not checked yet) are all that need checking; the text not
+        // yet searched still needs searching
+        bool narrowing = !m_pattern.empty() && ignoreCase == m_ignoreCase && pattern.size() > m_pattern.size() && pattern.compare(0, m_pattern.size(), m_pattern) == 0;
+        if (narrowing)
+        {
+            std::vector<long> candidates;
+            for (auto& range : m_verify)
+            {
+                auto itrFirst = std::lower_bound(m_candidates.begin(), m_candidates.end(), range.first);
+                auto itrLast = std::lower_bound(itrFirst, m_candidates.end(), range.second);
+                candidates.insert(candidates.end(), itrFirst, itrLast);
+            }
+            candidates.insert(candidates.end(), m_matches.begin(), m_matches.end());
+            std::sort(candidates.begin(), candidates.end());
+            candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+            m_candidates.swap(candidates);
+            m_verify.assign(1, BufferRange(0, textEnd));
+        }
+        else
+        {
+            m_candidates.clear();
+            m_verify.clear();
+            m_todo.assign(1, BufferRange(0, textEnd));
+        }
+
+        m_matches.clear();
+        m_pattern = pattern;
+        m_ignoreCase = ignoreCase;
+        GetEditor().RequestRefresh();
+    }
+
+    Prioritize(m_verify, visibleRange);
+    Prioritize(m_todo, visibleRange);
+    Start();
+}
+
+void ZepSearchHighlight::Clear()
+{
+    Interrupt();
+
+    m_pattern.clear();
+    m_current = InvalidOffset;
+    m_matches.clear();
+    m_candidates.clear();
+    m_verify.clear();
+    m_todo.clear();
+    GetEditor().RequestRefresh();
+}
+
+void ZepSearchHighlight::SetCurrent(BufferLocation location)
+{
+    m_current = location;
+    GetEditor().RequestRefresh();
+}
+
+bool ZepSearchHighlight::IsSearching() const
+{
+    return m_searchResult.valid() && !is_future_ready(m_searchResult);
+}
+
+void ZepSearchHighlight::Wait()
+{
+    if (m_searchResult.valid())
+    {
+        m_searchResult.wait();
+    }
+    MergePending();
+}
+
+void ZepSearchHighlight::GetMatches(BufferLocation begin, BufferLocation end, const long*& pBegin, const long*& pEnd) const
+{
+    // A match starting before the range can still reach into it
+    auto pMatches = m_matches.data();
+    auto pMatchesEnd = pMatches + m_matches.size();
+    pBegin = std::lower_bound(pMatches, pMatchesEnd, begin - long(m_pattern.size()) + 1);
+    pEnd = std::lower_bound(pBegin, pMatchesEnd, end);
+}
+
+void ZepSearchHighlight::Start()
+{
+    if (m_verify.empty())
+    {
+        m_candidates.clear();
+    }
+
+    if (m_pattern.empty() || (m_verify.empty() && m_todo.empty()))
+    {
+        return;
+    }
+
+    m_searchResult = GetEditor().GetThreadPool().enqueue_group(this, task_priority::normal, [=](const cancel_token& token) {
+        SearchRanges(token);
+    });
+
+    // Without worker threads, the search has already happened
+    MergePending();
+}
+
+void ZepSearchHighlight::Interrupt()
+{
+    // Stop the search, and keep what it found; the ranges left are picked up by the next one.
+    // A search still in the queue is dropped without waiting; one running stops at the end of its block
+    GetEditor().GetThreadPool().cancel_group(this);
+    if (m_searchResult.valid())
+    {
+        m_searchResult.wait();
+        m_searchResult = std::future<void>();
+    }
+
+    MergePending();
+}
+
+void ZepSearchHighlight::Publish(std::vector<long>& batch)
+{
+    if (batch.empty())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_pendingLock);
+    m_pending.insert(m_pending.end(), batch.begin(), batch.end());
+    batch.clear();
+}
+
+void ZepSearchHighlight::MergePending()
+{
+    std::vector<long> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingLock);
+        pending.swap(m_pending);
+    }
+
+    if (pending.empty())
+    {
+        return;
+    }
+
+    // Each block is found in order, but the blocks are not
+    std::sort(pending.begin(), pending.end());
+    auto oldSize = m_matches.size();
+    m_matches.insert(m_matches.end(), pending.begin(), pending.end());
+    std::inplace_merge(m_matches.begin(), m_matches.begin() + oldSize, m_matches.end());
+    m_matches.erase(std::unique(m_matches.begin(), m_matches.end()), m_matches.end());
+
+    GetEditor().RequestRefresh();
+}
+
+// Runs on the thread pool; the buffer is not changed while this is running
+void ZepSearchHighlight::SearchRanges(const cancel_token& token)
+{
+    auto& text = m_buffer.GetText();
+    auto textEnd = long(text.size()) - 1;
+    auto pNeedle = (const utf8*)m_pattern.data();
+    auto count = long(m_pattern.size());
+
+    std::vector<long> batch;
+
+    // Check the candidates
+    while (!m_verify.empty())
+    {
+        if (token.is_cancelled())
+        {
+            return;
+        }
+
+        auto& range = m_verify.front();
+        auto blockEnd = std::min(range.second, range.first + SearchBlockSize);
+        auto itrFirst = std::lower_bound(m_candidates.begin(), m_candidates.end(), range.first);
+        auto itrLast = std::lower_bound(itrFirst, m_candidates.end(), blockEnd);
+        for (auto itr = itrFirst; itr != itrLast; ++itr)
+        {
+            auto first = size_t(*itr);
+            auto last = first + count;
+            if (long(last) <= textEnd && text.find(first, last, pNeedle, count, m_ignoreCase) == first)
+            {
+                batch.push_back(*itr);
+            }
+        }
+        Publish(batch);
+
+        range.first = blockEnd;
+        if (range.first >= range.second)
+        {
+            m_verify.erase(m_verify.begin());
+        }
+    }
+
+    // Search the text
+    while (!m_todo.empty())
+    {
+        if (token.is_cancelled())
+        {
+            return;
+        }
+
+        auto& range = m_todo.front();
+        auto blockEnd = std::min(range.second, range.first + SearchBlockSize);
+
+        // Matches starting in the block can finish after it
+        auto last = size_t(std::min(blockEnd + count - 1, textEnd));
+        auto pos = size_t(range.first);
+        while (pos < last)
+        {
+            auto found = text.find(pos, last, pNeedle, count, m_ignoreCase);
+            if (found == last)
+            {
+                break;
+            }
+            batch.push_back(long(found));
+            pos = found + 1;
+        }
+        Publish(batch);
+
+        range.first = blockEnd;
+        if (range.first >= range.second)
+        {
+            m_todo.erase(m_todo.begin());
+        }
+    }
+}
+
+// Text was inserted at startOffset; matches after it move along, and matches across it are gone
+void ZepSearchHighlight::UpdateForInsert(BufferLocation startOffset, BufferLocation endOffset)
+{
+    auto length = endOffset - startOffset;
+    auto first = std::max(0l, startOffset - long(m_pattern.size()) + 1);
+
+    RemoveAndShift(m_matches, first, startOffset, length);
+    RemoveAndShift(m_candidates, first, startOffset, length);
+
+    auto fnMap = [&](long location) {
+        return location < startOffset ? location : location + length;
+    };
+    MapRanges(m_verify, fnMap);
+    MapRanges(m_todo, fnMap);
+
+    // New matches can only start near the insert
+    m_todo.insert(m_todo.begin(), BufferRange(first, endOffset));
+}
+
+// Text was removed; matches inside or across it are gone, and matches after it move back
+void ZepSearchHighlight::UpdateForDelete(BufferLocation startOffset, BufferLocation endOffset)
+{
+    auto length = endOffset - startOffset;
+    auto first = std::max(0l, startOffset - long(m_pattern.size()) + 1);
+
+    RemoveAndShift(m_matches, first, endOffset, -length);
+    RemoveAndShift(m_candidates, first, endOffset, -length);
+
+    auto fnMap = [&](long location) {
+        return location < startOffset ? location : std::max(startOffset, location - length);
+    };
+    MapRanges(m_verify, fnMap);
+    MapRanges(m_todo, fnMap);
+
+    // New matches can only be those across the join
+    if (first < startOffset)
+    {
+        m_todo.insert(m_todo.begin(), BufferRange(first, startOffset));
+    }
+}
+
+// Text was changed in place
+void ZepSearchHighlight::UpdateForChange(BufferLocation startOffset, BufferLocation endOffset)
+{
+    auto first = std::max(0l, startOffset - long(m_pattern.size()) + 1);
+
+    RemoveAndShift(m_matches, first, endOffset, 0);
+    RemoveAndShift(m_candidates, first, endOffset, 0);
+
+    if (first < endOffset)
+    {
+        m_todo.insert(m_todo.begin(), BufferRange(first, endOffset));
+    }
+}
+
+void ZepSearchHighlight::Notify(std::shared_ptr<ZepMessage> spMsg)
+{
+    // Pick up any results from the search
+    if (spMsg->messageId == Msg::Tick)
+    {
+        MergePending();
+    }
+    else if (spMsg->messageId == Msg::Buffer)
+    {
+        auto spBufferMsg = std::static_pointer_cast<BufferMessage>(spMsg);
+        if (spBufferMsg->pBuffer != &m_buffer || m_pattern.empty())
+        {
+            return;
+        }
+
+        if (spBufferMsg->type == BufferMessageType::PreBufferChange)
+        {
+            Interrupt();
+            return;
+        }
+
+        Interrupt();
+        if (spBufferMsg->type == BufferMessageType::TextAdded || spBufferMsg->type == BufferMessageType::Loaded)
+        {
+            UpdateForInsert(spBufferMsg->startLocation, spBufferMsg->endLocation);
+        }
+        else if (spBufferMsg->type == BufferMessageType::TextDeleted)
+        {
+            UpdateForDelete(spBufferMsg->startLocation, spBufferMsg->endLocation);
+        }
+        else if (spBufferMsg->type == BufferMessageType::TextChanged)
+        {
+            UpdateForChange(spBufferMsg->startLocation, spBufferMsg->endLocation);
+        }
+        else
+        {
+            return;
+        }
+
+        // The current match may not be one any more
+        m_current = InvalidOffset;
+        Start();
+    }
+}
+
+} // namespace Zep
@@ -0,0 +1,67 @@
+#include "zep/string_pool.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace Zep
+{
+
+namespace
+{
+// FNV-1a; the strings are short messages, so a simple hash is enough
+uint64_t HashString(const char* pStr, size_t length)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t index = 0; index < length; index++)
+    {
+        hash = (hash ^ uint8_t(pStr[index])) * 0x100000001b3ull;
+    }
+    return hash;
+}
+} // namespace
+
+InternedString StringPool::Intern(const char* pStr)
+{
+    if (pStr == nullptr || *pStr == 0)
+    {
+        return InternedString();
+    }
+
+    auto length = std::strlen(pStr);
+    auto& bucket = m_strings[HashString(pStr, length)];
+    for (auto& spString : bucket)
+    {
+        if (spString->size() == length && std::memcmp(spString->data(), pStr, length) == 0)
+        {
+            return InternedString(spString);
+        }
+    }
+
+    bucket.push_back(std::make_shared<const std::string>(pStr, length));
+    m_count++;
+    return InternedString(bucket.back());
+}
+
+void StringPool::Prune()
+{
+    for (auto itr = m_strings.begin(); itr != m_strings.end();)
+    {
+        auto& bucket = itr->second;
+        auto itrUnused = std::remove_if(bucket.begin(), bucket.end(), [](const std::shared_ptr<const std::string>& spString) {
+            return spString.use_count() == 1;
+        });
+        m_count -= size_t(std::distance(itrUnused, bucket.end()));
+        bucket.erase(itrUnused, bucket.end());
+
+        if (bucket.empty())
+        {
+            itr = m_strings.erase(itr);
+        }
+        else
+        {
+            itr++;
+        }
+    }
+}
+
+} // namespace Zep
@@ -4,28 +4,57 @@
 #include "zep/theme.h"
 
 #include "zep/mcommon/logger.h"
-#include "zep/mcommon/string/stringutils.h"
 
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <string>
 #include <vector>
 
 namespace Zep
 {
 
+namespace
+{
+// Lines lexed between hand backs to the UI
+const long PublishBlockLines = 1024;
+} // namespace
+
 ZepSyntax::ZepSyntax(
     ZepBuffer& buffer,
     const std::set<std::string>& keywords,
     const std::set<std::string>& identifiers,
     uint32_t flags)
+    : ZepSyntax(buffer, keywords, identifiers, flags, true)
+{
+}
+
+ZepSyntax::ZepSyntax(
+    ZepBuffer& buffer,
+    const std::set<std::string>& keywords,
+    const std::set<std::string>& identifiers,
+    uint32_t flags,
+    bool start)
     : ZepComponent(buffer.GetEditor())
     , m_buffer(buffer)
-    , m_keywords(keywords)
-    , m_identifiers(identifiers)
-    , m_stop(false)
+    , m_words(keywords, identifiers, (flags & ZepSyntaxFlags::CaseInsensitive) != 0)
     , m_flags(flags)
 {
-    m_syntax.resize(m_buffer.GetText().size());
+    m_syntax.Assign(long(m_buffer.GetText().size()));
     m_adornments.push_back(std::make_shared<ZepSyntaxAdorn_RainbowBrackets>(*this, m_buffer));
+
+    if (start)
+    {
+        Start();
+    }
+}
+
+void ZepSyntax::Start()
+{
+    // Lex whatever is in the buffer already
+    m_lineStates.resize(size_t(m_buffer.GetLineCount()));
+    InvalidateLines(0, m_buffer.GetLineCount());
+    QueueUpdateSyntax();
 }
 
 ZepSyntax::~ZepSyntax()
@@ -33,10 +62,10 @@ ZepSyntax::~ZepSyntax()
     Interrupt();
 }
 
+// Doesn't wait for the worker; lines it hasn't handed back yet show their last colors
 SyntaxData ZepSyntax::GetSyntaxAt(long offset) const
 {
-    Wait();
-    if (m_processedChar < offset || (long)m_syntax.size() <= offset)
+    if (offset < 0 || m_syntax.size() <= offset)
     {
         return SyntaxData{};
     }
@@ -50,57 +79,314 @@ SyntaxData ZepSyntax::GetSyntaxAt(long offset) const
             return data;
         }
     }
-    return m_syntax[offset];
+    return m_syntax.Get(offset);
 }
 
-void ZepSyntax::Wait() const
+void ZepSyntax::GetSyntaxSpans(long begin, long end, std::vector<SyntaxSpan>& spans) const
+{
+    spans.clear();
+    begin = std::max(0l, begin);
+    end = std::min(end, m_syntax.size());
+    if (begin >= end)
+    {
+        return;
+    }
+
+    // The stored runs, and each adornment's spans, walked along with the characters; the first adornment to
+    // color one wins
+    auto& runs = m_spanRuns;
+    m_syntax.GetSpans(begin, end, runs);
+    size_t runIndex = 0;
+
+    auto& adornSpans = m_adornSpans;
+    auto& adornIndex = m_adornIndex;
+    adornSpans.resize(m_adornments.size());
+    adornIndex.assign(m_adornments.size(), 0);
+    for (size_t adorn = 0; adorn < m_adornments.size(); adorn++)
+    {
+        m_adornments[adorn]->GetSyntaxSpans(begin, end, adornSpans[adorn]);
+    }
+
+    for (auto ch = begin; ch < end; ch++)
+    {
+        while (runs[runIndex].last <= ch)
+        {
+            runIndex++;
+        }
+
+        auto pData = &runs[runIndex].data;
+        for (size_t adorn = 0; adorn < adornSpans.size(); adorn++)
+        {
+            auto& adornSpan = adornSpans[adorn];
+            auto& index = adornIndex[adorn];
+            while (index < adornSpan.size() && adornSpan[index].last <= ch)
+            {
+                index++;
+            }
+            if (index < adornSpan.size() && adornSpan[index].first <= ch)
+            {
+                pData = &adornSpan[index].data;
+                break;
+            }
+        }
+
+        if (!spans.empty() && spans.back().data == *pData)
+        {
+            spans.back().last = ch + 1;
+        }
+        else
+        {
+            SyntaxSpan span;
+            span.first = ch;
+            span.last = ch + 1;
+            span.data = *pData;
+            spans.push_back(span);
+        }
+    }
+}
+
+void ZepSyntax::Wait()
 {
     if (m_syntaxResult.valid())
     {
         m_syntaxResult.wait();
     }
+    MergePending();
 }
 
 void ZepSyntax::Interrupt()
 {
-    // Stop the thread, wait for it
-    m_stop = true;
+    // A job still in the queue is dropped without waiting.  One already lexing stops at the next line; it reads
+    // the buffer, so it has to be done before the buffer changes
+    GetEditor().GetThreadPool().cancel_group(this);
     if (m_syntaxResult.valid())
     {
-        m_syntaxResult.get();
+        m_syntaxResult.wait();
+        m_syntaxResult = std::future<void>();
     }
-    m_stop = false;
+
+    // Keep what it finished; the rest is lexed next time
+    MergePending();
 }
 
-void ZepSyntax::QueueUpdateSyntax(BufferLocation startLocation, BufferLocation endLocation)
+// Called by the worker with the lines it has finished since last time
+void ZepSyntax::Publish()
 {
-    assert(startLocation >= 0);
-    assert(endLocation >= startLocation);
-    // Record the max location the syntax is valid up to.  This will
-    // ensure that multiple calls to restart the thread keep track of where to start
-    // This means a small edit at the end of a big file, followed by a small edit at the top
-    // is the worst case scenario, because
-    m_processedChar = std::min(startLocation, long(m_processedChar));
-    m_targetChar = std::max(endLocation, long(m_targetChar));
+    if (m_patch.spans.empty())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_pendingLock);
+    m_pending.push_back(std::move(m_patch));
+    m_patch.spans.clear();
+}
+
+// Copy the lines the worker has finished into the syntax the UI reads
+void ZepSyntax::MergePending()
+{
+    std::vector<SyntaxPatch> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingLock);
+        pending.swap(m_pending);
+    }
+
+    if (pending.empty())
+    {
+        return;
+    }
+
+    for (auto& patch : pending)
+    {
+        m_syntax.Replace(patch.spans.front().first, patch.spans.back().last, patch.spans);
+        UpdateBrackets(patch);
+    }
+
+    GetEditor().RequestRefresh();
+}
+
+// Find the brackets in the lines of a patch; those in comments and strings don't pair up with the code
+void ZepSyntax::UpdateBrackets(const SyntaxPatch& patch)
+{
+    auto first = patch.spans.front().first;
+    auto last = std::min(patch.spans.back().last, long(m_buffer.GetText().size()));
+    if (first >= last)
+    {
+        return;
+    }
 
+    m_patchBrackets.clear();
+    auto itrSpan = patch.spans.begin();
+    m_buffer.GetText().ForEachSegment(size_t(first), size_t(last), [&](const utf8* pData, size_t count, size_t segmentStart) {
+        for (size_t index = 0; index < count; index++)
+        {
+            SyntaxBracket bracket;
+            if (!SyntaxBrackets::GetBracketType(char(pData[index]), bracket.type, bracket.open))
+            {
+                continue;
+            }
+
+            bracket.offset = long(segmentStart + index);
+            while (itrSpan->last <= bracket.offset)
+            {
+                ++itrSpan;
+            }
+            if (itrSpan->data.foreground != ThemeColor::Comment && itrSpan->data.foreground != ThemeColor::String)
+            {
+                m_patchBrackets.push_back(bracket);
+            }
+        }
+        return true;
+    });
+    m_brackets.Replace(first, last, m_patchBrackets);
+}
+
+void ZepSyntax::QueueUpdateSyntax()
+{
     // Make sure the syntax buffer is big enough - adding normal syntax to the end
     // This may also 'chop'
-    m_syntax.resize(m_buffer.GetText().size(), SyntaxData{});
+    m_syntax.Resize(long(m_buffer.GetText().size()));
+
+    if (m_dirtyLines.empty())
+    {
+        return;
+    }
 
-    m_processedChar = std::min(long(m_processedChar), long(m_buffer.GetText().size() - 1));
-    m_targetChar = std::min(long(m_targetChar), long(m_buffer.GetText().size() - 1));
+    // The syntax is good up to the first line to lex
+    long lineStart, lineEnd;
+    m_buffer.GetLineOffsets(m_dirtyLines[0].first, lineStart, lineEnd);
+    m_processedChar = std::min(lineStart, long(m_buffer.GetText().size() - 1));
 
     // Have the thread update the syntax in the new region
     // If the pool has no threads, this will end up serial
-    m_syntaxResult = GetEditor().GetThreadPool().enqueue([=]() {
-        UpdateSyntax();
+    m_syntaxResult = GetEditor().GetThreadPool().enqueue_group(this, task_priority::normal, [=](const cancel_token& token) {
+        UpdateSyntax(token);
     });
+
+    // Without worker threads, the lexing has already happened
+    MergePending();
+}
+
+// Add the lines to the ones to lex, keeping the ranges sorted and apart
+void ZepSyntax::InvalidateLines(long firstLine, long lastLine)
+{
+    firstLine = std::max(0l, firstLine);
+    lastLine = std::min(lastLine, long(m_lineStates.size()));
+    if (firstLine >= lastLine)
+    {
+        return;
+    }
+
+    auto itr = std::lower_bound(m_dirtyLines.begin(), m_dirtyLines.end(), SyntaxLineRange(firstLine, firstLine));
+    if (itr != m_dirtyLines.begin() && std::prev(itr)->second >= firstLine)
+    {
+        itr--;
+    }
+
+    // Swallow the ranges touching this one
+    auto itrLast = itr;
+    while (itrLast != m_dirtyLines.end() && itrLast->first <= lastLine)
+    {
+        firstLine = std::min(firstLine, itrLast->first);
+        lastLine = std::max(lastLine, itrLast->second);
+        itrLast++;
+    }
+    itr = m_dirtyLines.erase(itr, itrLast);
+    m_dirtyLines.insert(itr, SyntaxLineRange(firstLine, lastLine));
+}
+
+// Text was added; the line states of any new lines go in before the line holding the insert, so the old state
+// of that line stays with its end
+void ZepSyntax::UpdateLinesForInsert(BufferLocation startLocation)
+{
+    auto startLine = m_buffer.GetBufferLine(startLocation);
+    auto added = m_buffer.GetLineCount() - long(m_lineStates.size());
+    if (added > 0)
+    {
+        m_lineStates.insert(m_lineStates.begin() + startLine, size_t(added), SyntaxLineState{});
+        auto fnMap = [&](long line) {
+            return line > startLine ? line + added : line;
+        };
+        for (auto& range : m_dirtyLines)
+        {
+            range = SyntaxLineRange(fnMap(range.first), fnMap(range.second));
+        }
+        MapVisibleLines(fnMap);
+    }
+    InvalidateLines(startLine, startLine + std::max(0l, added) + 1);
+}
+
+// Text was removed; the line holding the delete keeps the state of the last line it was joined to
+void ZepSyntax::UpdateLinesForDelete(BufferLocation startLocation)
+{
+    auto startLine = m_buffer.GetBufferLine(startLocation);
+    auto removed = long(m_lineStates.size()) - m_buffer.GetLineCount();
+    if (removed > 0)
+    {
+        m_lineStates.erase(m_lineStates.begin() + startLine, m_lineStates.begin() + startLine + removed);
+
+        auto fnMap = [&](long line) {
+            return line <= startLine ? line : std::max(startLine, line - removed);
+        };
+        for (auto& range : m_dirtyLines)
+        {
+            range = SyntaxLineRange(fnMap(range.first), fnMap(range.second));
+        }
+        m_dirtyLines.erase(std::remove_if(m_dirtyLines.begin(), m_dirtyLines.end(), [](const SyntaxLineRange& range) { return range.first >= range.second; }), m_dirtyLines.end());
+        MapVisibleLines(fnMap);
+    }
+    InvalidateLines(startLine, startLine + 1);
+}
+
+// Move the lines the windows show along with an edit, until they next tell us; a window left showing nothing is dropped
+template <typename F>
+void ZepSyntax::MapVisibleLines(F&& fnMap)
+{
+    std::lock_guard<std::mutex> lock(m_visibleLock);
+    for (auto itr = m_visibleLines.begin(); itr != m_visibleLines.end();)
+    {
+        itr->second = SyntaxLineRange(fnMap(itr->second.first), fnMap(itr->second.second));
+        if (itr->second.first >= itr->second.second)
+        {
+            itr = m_visibleLines.erase(itr);
+        }
+        else
+        {
+            itr++;
+        }
+    }
+    m_visibleChanged = true;
+}
+
+void ZepSyntax::SetVisibleLines(const ZepWindow* pWindow, long firstLine, long lastLine)
+{
+    std::lock_guard<std::mutex> lock(m_visibleLock);
+    auto& visible = m_visibleLines[pWindow];
+    if (visible != SyntaxLineRange(firstLine, lastLine))
+    {
+        visible = SyntaxLineRange(firstLine, lastLine);
+        m_visibleChanged = true;
+    }
+}
+
+void ZepSyntax::ClearVisibleLines(const ZepWindow* pWindow)
+{
+    std::lock_guard<std::mutex> lock(m_visibleLock);
+    if (m_visibleLines.erase(pWindow) != 0)
+    {
+        m_visibleChanged = true;
+    }
 }
 
 void ZepSyntax::Notify(std::shared_ptr<ZepMessage> spMsg)
 {
+    // Pick up the lines the worker has finished
+    if (spMsg->messageId == Msg::Tick)
+    {
+        MergePending();
+    }
     // Handle any interesting buffer messages
-    if (spMsg->messageId == Msg::Buffer)
+    else if (spMsg->messageId == Msg::Buffer)
     {
         auto spBufferMsg = std::static_pointer_cast<BufferMessage>(spMsg);
         if (spBufferMsg->pBuffer != &m_buffer)
@@ -114,184 +400,387 @@ void ZepSyntax::Notify(std::shared_ptr<ZepMessage> spMsg)
         else if (spBufferMsg->type == BufferMessageType::TextDeleted)
         {
             Interrupt();
-            m_syntax.erase(m_syntax.begin() + spBufferMsg->startLocation, m_syntax.begin() + spBufferMsg->endLocation);
-            QueueUpdateSyntax(spBufferMsg->startLocation, spBufferMsg->endLocation);
+            m_visibleLexed.clear();
+            m_syntax.Erase(spBufferMsg->startLocation, spBufferMsg->endLocation);
+            m_brackets.Erase(spBufferMsg->startLocation, spBufferMsg->endLocation);
+            UpdateLinesForDelete(spBufferMsg->startLocation);
+            QueueUpdateSyntax();
+        }
+        else if (spBufferMsg->type == BufferMessageType::Loaded)
+        {
+            // All new; start again
+            Interrupt();
+            m_syntax.Assign(long(m_buffer.GetText().size()));
+            m_brackets.clear();
+            m_lineStates.assign(size_t(m_buffer.GetLineCount()), SyntaxLineState{});
+            m_dirtyLines.clear();
+            m_visibleLexed.clear();
+            InvalidateLines(0, m_buffer.GetLineCount());
+            QueueUpdateSyntax();
         }
-        else if (spBufferMsg->type == BufferMessageType::TextAdded ||
-            spBufferMsg->type == BufferMessageType::Loaded)
+        else if (spBufferMsg->type == BufferMessageType::TextAdded)
         {
             Interrupt();
-            m_syntax.insert(m_syntax.begin() + spBufferMsg->startLocation, spBufferMsg->endLocation - spBufferMsg->startLocation, SyntaxData{});
-            QueueUpdateSyntax(spBufferMsg->startLocation, spBufferMsg->endLocation);
+            m_visibleLexed.clear();
+            m_syntax.Insert(spBufferMsg->startLocation, spBufferMsg->endLocation - spBufferMsg->startLocation);
+            m_brackets.Insert(spBufferMsg->startLocation, spBufferMsg->endLocation - spBufferMsg->startLocation);
+            UpdateLinesForInsert(spBufferMsg->startLocation);
+            QueueUpdateSyntax();
         }
         else if (spBufferMsg->type == BufferMessageType::TextChanged)
         {
             Interrupt();
-            QueueUpdateSyntax(spBufferMsg->startLocation, spBufferMsg->endLocation);
+            m_visibleLexed.clear();
+            InvalidateLines(m_buffer.GetBufferLine(spBufferMsg->startLocation), m_buffer.GetBufferLine(spBufferMsg->endLocation) + 1);
+            QueueUpdateSyntax();
         }
     }
 }
 
-// TODO: Multiline comments
-void ZepSyntax::UpdateSyntax()
+// Lex the line, which starts in the given state, and return the state it ends in.
+// The line doesn't include its '\n'; its colors are added to the runs to hand back
+SyntaxLineState ZepSyntax::LexLine(long lineStart, const std::string& line, SyntaxLineState state)
 {
-    auto& buffer = m_buffer.GetText();
-    auto itrCurrent = buffer.begin() + m_processedChar;
-    auto itrEnd = buffer.begin() + m_targetChar;
+    // The characters which split tokens
+    static const std::array<bool, 256> delims = []() {
+        std::array<bool, 256> table{};
+        for (auto ch : std::string(" \t.\n;(){}=:"))
+        {
+            table[uint8_t(ch)] = true;
+        }
+        return table;
+    }();
+    auto isDelim = [](char ch) {
+        return delims[uint8_t(ch)];
+    };
 
-    assert(std::distance(itrCurrent, itrEnd) < int(m_syntax.size()));
-    assert(m_syntax.size() == buffer.size());
+    // Mark a region of the syntax buffer with the correct marker
+    auto mark = [&](size_t first, size_t last, ThemeColor type) {
+        AddSpan(lineStart + long(first), lineStart + long(last), type);
+    };
+
+    auto count = line.size();
+    auto isCommentStart = [&](size_t pos) {
+        return line[pos] == '/' && (pos + 1) < count && (line[pos + 1] == '/' || line[pos + 1] == '*');
+    };
 
+    // Mark a string from its opening quote (or the line start, if it carries on from the last line);
+    // returns the position after it, or the line end if it doesn't finish on this line
+    auto findString = [&](size_t first, size_t pos, utf8 quote) {
+        for (; pos < count; pos++)
+        {
+            if (line[pos] == quote)
+            {
+                mark(first, pos + 1, ThemeColor::String);
+                state.quote = 0;
+                return pos + 1;
+            }
 
-    std::string delim(" \t.\n;(){}=:");
-    std::string lineEnd("\n");
+            // Ignore quoted
+            if (line[pos] == '\\')
+            {
+                if (++pos == count)
+                {
+                    // A '\\' at the end carries the string on to the next line
+                    mark(first, count, ThemeColor::String);
+                    state.quote = quote;
+                    return count;
+                }
+            }
+        }
+        mark(first, count, ThemeColor::String);
+        state.quote = 0;
+        return count;
+    };
 
-    // Walk backwards to previous delimiter
-    while (itrCurrent > buffer.begin())
+    size_t pos = 0;
+    if (state.comment)
     {
-        if (std::find(delim.begin(), delim.end(), *itrCurrent) == delim.end())
+        auto found = line.find("*/");
+        if (found == std::string::npos)
         {
-            itrCurrent--;
+            mark(0, count, ThemeColor::Comment);
+            return state;
         }
-        else
+        mark(0, found + 2, ThemeColor::Comment);
+        state.comment = false;
+        pos = found + 2;
+    }
+    else if (state.quote != 0)
+    {
+        pos = findString(0, 0, state.quote);
+    }
+
+    while (pos < count)
+    {
+        auto ch = line[pos];
+        if (isCommentStart(pos))
         {
-            break;
+            if (line[pos + 1] == '/')
+            {
+                mark(pos, count, ThemeColor::Comment);
+                break;
+            }
+
+            auto found = line.find("*/", pos + 2);
+            if (found == std::string::npos)
+            {
+                mark(pos, count, ThemeColor::Comment);
+                state.comment = true;
+                break;
+            }
+            mark(pos, found + 2, ThemeColor::Comment);
+            pos = found + 2;
+            continue;
+        }
+
+        if (ch == '\"' || ch == '\'')
+        {
+            pos = findString(pos, pos + 1, utf8(ch));
+            continue;
+        }
+
+        if (isDelim(ch))
+        {
+            mark(pos, pos + 1, ch == ' ' ? ThemeColor::Whitespace : ThemeColor::Normal);
+            pos++;
+            continue;
+        }
+
+        // Find a token, up to a delimiter or a comment
+        auto last = pos + 1;
+        while (last < count && !isDelim(line[last]) && !isCommentStart(last))
+        {
+            last++;
         }
+
+        mark(pos, last, GetTokenColor(line.data() + pos, line.data() + last));
+        pos = last;
     }
 
-    // Back to the previous line
-    while (itrCurrent > buffer.begin() && *itrCurrent != '\n')
+    return state;
+}
+
+// Look the token up where it is, rather than making a string of it
+ThemeColor ZepSyntax::GetTokenColor(const char* pToken, const char* pTokenEnd) const
+{
+    auto color = m_words.Find(pToken, size_t(pTokenEnd - pToken));
+    if (color != ThemeColor::None)
     {
-        itrCurrent--;
+        return color;
     }
-    itrEnd = buffer.find_first_of(itrEnd, buffer.end(), lineEnd.begin(), lineEnd.end());
-
-    // Mark a region of the syntax buffer with the correct marker
-    auto mark = [&](GapBuffer<utf8>::const_iterator itrA, GapBuffer<utf8>::const_iterator itrB, ThemeColor type, ThemeColor background) {
-        std::fill(m_syntax.begin() + (itrA - buffer.begin()), m_syntax.begin() + (itrB - buffer.begin()), SyntaxData{ type, background });
-    };
 
-    auto markSingle = [&](GapBuffer<utf8>::const_iterator itrA, ThemeColor type, ThemeColor background) {
-        (m_syntax.begin() + (itrA - buffer.begin()))->foreground = type;
-        (m_syntax.begin() + (itrA - buffer.begin()))->background = background;
-    };
+    if (std::all_of(pToken, pTokenEnd, [](char tokenCh) { return tokenCh >= '0' && tokenCh <= '9'; }))
+    {
+        return ThemeColor::Number;
+    }
+    else if (std::all_of(pToken, pTokenEnd, [](char tokenCh) { return tokenCh != 0 && std::strchr("{}()[]", tokenCh) != nullptr; }))
+    {
+        return ThemeColor::Parenthesis;
+    }
+    return ThemeColor::Normal;
+}
 
-    // Update start location
-    m_processedChar = long(itrCurrent - buffer.begin());
+// Lex a line of the buffer, which starts in the given state, and return the state it ends in
+SyntaxLineState ZepSyntax::LexBufferLine(long line, SyntaxLineState state)
+{
+    auto& buffer = m_buffer.GetText();
 
-    //LOG(DEBUG) << "Updating Syntax: Start=" << m_processedChar << ", End=" << std::distance(buffer.begin(), itrEnd);
+    // The line, without its '\n' (or the 0 at the end of the buffer)
+    long lineStart, lineEnd;
+    m_buffer.GetLineOffsets(line, lineStart, lineEnd);
+    m_lineText.clear();
+    buffer.ForEachSegment(size_t(lineStart), size_t(lineEnd), [&](const utf8* pData, size_t count, size_t) {
+        m_lineText.append((const char*)pData, count);
+        return true;
+    });
+    if (!m_lineText.empty() && (m_lineText.back() == '\n' || m_lineText.back() == 0))
+    {
+        m_lineText.pop_back();
+    }
 
-    // Walk the buffer updating information about syntax coloring
-    while (itrCurrent != itrEnd)
+    // A break between this line and the last one handed back starts a new batch
+    if (!m_patch.spans.empty() && m_patch.spans.back().last != lineStart)
     {
-        if (m_stop == true)
-        {
-            return;
-        }
+        Publish();
+    }
+    if (m_patch.spans.empty())
+    {
+        SyntaxSpan start;
+        start.first = start.last = lineStart;
+        m_patch.spans.push_back(start);
+    }
 
-        // Find a token, skipping delim <itrFirst, itrLast>
-        auto itrFirst = buffer.find_first_not_of(itrCurrent, buffer.end(), delim.begin(), delim.end());
-        if (itrFirst == buffer.end())
-            break;
+    state = LexLine(lineStart, m_lineText, state);
+    m_lexedLineCount++;
 
-        auto itrLast = buffer.find_first_of(itrFirst, buffer.end(), delim.begin(), delim.end());
+    // Anything not marked, such as the '\n', is normal
+    AddSpan(lineEnd, lineEnd, ThemeColor::Normal);
+    return state;
+}
 
-        // Ensure we found a token
-        assert(itrLast >= itrFirst);
+// Add to the runs to hand back; lexing marks a line from start to end, so this is always on the end.
+// There is always a span to add to; a batch starts with an empty one
+void ZepSyntax::AddSpan(long first, long last, ThemeColor color)
+{
+    SyntaxData data;
+    data.foreground = color;
 
-        // Mark whitespace
-        for (auto& itr = itrCurrent; itr < itrFirst; itr++)
+    // Fill any gap
+    auto& spans = m_patch.spans;
+    if (spans.back().last < first)
+    {
+        if (spans.back().data == SyntaxData{})
         {
-            if (*itr == ' ')
-            {
-                mark(itr, itr + 1, ThemeColor::Whitespace, ThemeColor::None);
-            }
+            spans.back().last = first;
         }
-
-        // Do I need to make a string here?
-        auto token = std::string(itrFirst, itrLast);
-        if (m_flags & ZepSyntaxFlags::CaseInsensitive)
+        else
         {
-            token = string_tolower(token);
+            SyntaxSpan gap;
+            gap.first = spans.back().last;
+            gap.last = first;
+            spans.push_back(gap);
         }
+    }
+    first = std::max(first, spans.back().last);
 
-        if (m_keywords.find(token) != m_keywords.end())
+    if (first >= last)
+    {
+        return;
+    }
+
+    if (spans.back().data == data)
+    {
+        spans.back().last = last;
+    }
+    else
+    {
+        SyntaxSpan span;
+        span.first = first;
+        span.last = last;
+        span.data = data;
+        spans.push_back(span);
+    }
+}
+
+// Lex the visible lines that are waiting behind other lines still to lex.
+// Their starting state is a guess (the one from before the edit), so they stay on the list to lex again in order;
+// the guess is nearly always right, and the colors show up straight away instead of after the rest of the file
+void ZepSyntax::LexVisibleLines(const cancel_token& token)
+{
+    std::vector<SyntaxLineRange> visibleLines;
+    {
+        std::lock_guard<std::mutex> lock(m_visibleLock);
+        for (auto& visible : m_visibleLines)
         {
-            mark(itrFirst, itrLast, ThemeColor::Keyword, ThemeColor::None);
+            visibleLines.push_back(visible.second);
         }
-        else if (m_identifiers.find(token) != m_identifiers.end())
+    }
+
+    auto lineCount = long(m_lineStates.size());
+    for (auto& visible : visibleLines)
+    {
+        auto firstLine = std::max(0l, visible.first);
+        auto lastLine = std::min(visible.second, lineCount);
+
+        // Nothing to do if lexing in order gets here first
+        if (firstLine >= lastLine || m_dirtyLines.empty() || m_dirtyLines.front().first >= firstLine)
         {
-            mark(itrFirst, itrLast, ThemeColor::Identifier, ThemeColor::None);
+            continue;
         }
-        else if (token.find_first_not_of("0123456789") == std::string::npos)
+
+        // ... or if none of the visible lines need it
+        auto itrDirty = std::find_if(m_dirtyLines.begin(), m_dirtyLines.end(), [&](const SyntaxLineRange& range) {
+            return range.second > firstLine;
+        });
+        if (itrDirty == m_dirtyLines.end() || itrDirty->first >= lastLine)
         {
-            mark(itrFirst, itrLast, ThemeColor::Number, ThemeColor::None);
+            continue;
         }
-        else if (token.find_first_not_of("{}()[]") == std::string::npos)
+
+        if (std::find(m_visibleLexed.begin(), m_visibleLexed.end(), SyntaxLineRange(firstLine, lastLine)) != m_visibleLexed.end())
         {
-            mark(itrFirst, itrLast, ThemeColor::Parenthesis, ThemeColor::None);
+            continue;
         }
-        else
+
+        auto state = m_lineStates[firstLine - 1];
+        auto line = firstLine;
+        for (; line < lastLine && !token.is_cancelled(); line++)
         {
-            mark(itrFirst, itrLast, ThemeColor::Normal, ThemeColor::None);
+            state = LexBufferLine(line, state);
         }
+        Publish();
+
+        InvalidateLines(firstLine, lastLine);
+        m_visibleLexed.push_back(SyntaxLineRange(firstLine, lastLine));
+    }
+}
+
+void ZepSyntax::UpdateSyntax(const cancel_token& token)
+{
+    auto& buffer = m_buffer.GetText();
+    auto lineCount = long(m_lineStates.size());
 
-        // Find String
-        auto findString = [&](utf8 ch) {
-            auto itrString = itrFirst;
-            if (*itrString == ch)
+    m_visibleChanged = false;
+    LexVisibleLines(token);
+
+    while (!m_dirtyLines.empty())
+    {
+        auto line = m_dirtyLines.front().first;
+        auto lexTo = m_dirtyLines.front().second;
+        m_dirtyLines.erase(m_dirtyLines.begin());
+
+        auto state = line > 0 ? m_lineStates[line - 1] : SyntaxLineState{};
+        auto publishLine = line;
+        while (line < lineCount)
+        {
+            if (token.is_cancelled() || m_visibleChanged)
             {
-                itrString++;
+                // Carry on from here next time
+                InvalidateLines(line, std::max(lexTo, line + 1));
+                break;
+            }
 
-                while (itrString < buffer.end())
-                {
-                    // handle end of string
-                    if (*itrString == ch)
-                    {
-                        itrString++;
-                        mark(itrFirst, itrString, ThemeColor::String, ThemeColor::None);
-                        itrLast = itrString + 1;
-                        break;
-                    }
-
-                    if (itrString < (buffer.end() - 1))
-                    {
-                        auto itrNext = itrString + 1;
-                        // Ignore quoted
-                        if (*itrString == '\\' && *itrNext == ch)
-                        {
-                            itrString++;
-                        }
-                    }
-
-                    itrString++;
-                }
+            state = LexBufferLine(line, state);
+
+            bool changed = state != m_lineStates[line];
+            m_lineStates[line] = state;
+            line++;
+
+            if (line - publishLine >= PublishBlockLines)
+            {
+                Publish();
+                publishLine = line;
             }
-        };
-        findString('\"');
-        findString('\'');
 
-        std::string commentStr = "/";
-        auto itrComment = buffer.find_first_of(itrFirst, itrLast, commentStr.begin(), commentStr.end());
-        if (itrComment != buffer.end())
-        {
-            auto itrCommentStart = itrComment++;
-            if (itrComment < buffer.end())
+            // Take in any lines to lex that this has reached
+            while (!m_dirtyLines.empty() && m_dirtyLines.front().first <= line)
             {
-                if (*itrComment == '/')
-                {
-                    itrLast = buffer.find_first_of(itrCommentStart, buffer.end(), lineEnd.begin(), lineEnd.end());
-                    mark(itrCommentStart, itrLast, ThemeColor::Comment, ThemeColor::None);
-                }
+                lexTo = std::max(lexTo, m_dirtyLines.front().second);
+                m_dirtyLines.erase(m_dirtyLines.begin());
+            }
+
+            // The rest of the lines start the same way they did before
+            if (line >= lexTo && !changed)
+            {
+                break;
             }
         }
+        Publish();
 
-        itrCurrent = itrLast;
+        if (token.is_cancelled())
+        {
+            return;
+        }
+
+        // A window scrolled; look at what it shows now
+        if (m_visibleChanged.exchange(false))
+        {
+            LexVisibleLines(token);
+        }
     }
 
     // If we got here, we sucessfully completed
-    // Reset the target to the beginning
-    m_targetChar = long(0);
     m_processedChar = long(buffer.size() - 1);
 }
 
@@ -0,0 +1,411 @@
+#include "zep/syntax_brackets.h"
+
+namespace Zep
+{
+
+SyntaxBrackets::SyntaxBrackets()
+{
+}
+
+SyntaxBrackets::~SyntaxBrackets()
+{
+    Destroy(m_pRoot);
+}
+
+bool SyntaxBrackets::GetBracketType(char ch, BracketType& type, bool& open)
+{
+    switch (ch)
+    {
+    case '(':
+    case ')':
+        type = BracketType::Bracket;
+        break;
+    case '{':
+    case '}':
+        type = BracketType::Brace;
+        break;
+    case '[':
+    case ']':
+        type = BracketType::Group;
+        break;
+    default:
+        return false;
+    }
+    open = ch == '(' || ch == '{' || ch == '[';
+    return true;
+}
+
+long SyntaxBrackets::GetCount() const
+{
+    long count = 0;
+    if (m_pRoot)
+    {
+        for (auto typeCount : m_pRoot->counts)
+        {
+            count += typeCount;
+        }
+    }
+    return count;
+}
+
+void SyntaxBrackets::clear()
+{
+    Destroy(m_pRoot);
+    m_pRoot = nullptr;
+}
+
+void SyntaxBrackets::Insert(long location, long length)
+{
+    // Only the first bracket after the text stores the distance to it
+    Node* pBefore;
+    Node* pAfter;
+    Split(m_pRoot, location, pBefore, pAfter);
+    AddToFirst(pAfter, length);
+    m_pRoot = Merge(pBefore, pAfter);
+}
+
+void SyntaxBrackets::Erase(long first, long last)
+{
+    // Remove the brackets in the range, and bring the ones after it back
+    Node* pBefore;
+    Node* pRange;
+    Node* pAfter;
+    Split(m_pRoot, first, pBefore, pAfter);
+    Split(pAfter, last - Total(pBefore), pRange, pAfter);
+    AddToFirst(pAfter, Total(pRange) - (last - first));
+    Destroy(pRange);
+    m_pRoot = Merge(pBefore, pAfter);
+}
+
+void SyntaxBrackets::Replace(long first, long last, const std::vector<SyntaxBracket>& brackets)
+{
+    // Take out the brackets in the range; the first one after it is then measured from the one before
+    Node* pBefore;
+    Node* pRange;
+    Node* pAfter;
+    Split(m_pRoot, first, pBefore, pAfter);
+    Split(pAfter, last - Total(pBefore), pRange, pAfter);
+    AddToFirst(pAfter, Total(pRange));
+    Destroy(pRange);
+    pRange = nullptr;
+
+    // And put the new ones in
+    auto previous = Total(pBefore) - 1;
+    for (auto& bracket : brackets)
+    {
+        pRange = Merge(pRange, MakeNode(bracket.offset - previous, bracket.type, bracket.open));
+        previous = bracket.offset;
+    }
+    AddToFirst(pAfter, -(previous - (Total(pBefore) - 1)));
+
+    m_pRoot = Merge(Merge(pBefore, pRange), pAfter);
+}
+
+bool SyntaxBrackets::GetBracket(long offset, SyntaxBracketInfo& info) const
+{
+    bool found = false;
+    VisitBrackets(m_pRoot, 0, DepthChanges{}, offset, offset + 1, [&](const SyntaxBracketInfo& bracket) {
+        info = bracket;
+        found = true;
+    });
+    return found;
+}
+
+void SyntaxBrackets::GetBrackets(long begin, long end, std::vector<SyntaxBracketInfo>& brackets) const
+{
+    brackets.clear();
+    VisitBrackets(m_pRoot, 0, DepthChanges{}, begin, end, [&](const SyntaxBracketInfo& bracket) {
+        brackets.push_back(bracket);
+    });
+}
+
+long SyntaxBrackets::GetFirstUnclosed(BracketType type) const
+{
+    if (!m_pRoot || m_pRoot->changes[size_t(type)].Apply(0) <= 0)
+    {
+        return -1;
+    }
+
+    auto pNode = m_pRoot;
+    long nodeStart = 0;
+    while (pNode)
+    {
+        if (pNode->pLeft && pNode->pLeft->counts[size_t(type)] > 0)
+        {
+            pNode = pNode->pLeft;
+            continue;
+        }
+
+        auto offset = nodeStart + Total(pNode->pLeft) + pNode->distance - 1;
+        if (pNode->type == type)
+        {
+            return offset;
+        }
+        nodeStart = offset + 1;
+        pNode = pNode->pRight;
+    }
+    return -1;
+}
+
+long SyntaxBrackets::MatchingBracket(long offset) const
+{
+    SyntaxBracketInfo info;
+    if (!GetBracket(offset, info))
+    {
+        return -1;
+    }
+
+    int32_t sum = 0;
+    if (info.open)
+    {
+        return FindClose(m_pRoot, 0, offset, size_t(info.type), sum);
+    }
+
+    // A close with nothing open has no pair
+    return info.depth > 0 ? FindOpen(m_pRoot, 0, offset, size_t(info.type), sum) : -1;
+}
+
+bool SyntaxBrackets::EnclosingScope(long offset, long& open, long& close, BracketType type) const
+{
+    // On a bracket, it is the pair
+    SyntaxBracketInfo info;
+    if (GetBracket(offset, info) && (type == BracketType::Max || type == info.type))
+    {
+        auto match = MatchingBracket(offset);
+        if (match >= 0)
+        {
+            open = std::min(offset, match);
+            close = std::max(offset, match);
+            return true;
+        }
+    }
+
+    // Otherwise the innermost open before it, which is closed after it
+    open = -1;
+    for (size_t index = 0; index < size_t(BracketType::Max); index++)
+    {
+        if (type != BracketType::Max && index != size_t(type))
+        {
+            continue;
+        }
+
+        int32_t sum = 0;
+        auto found = FindOpen(m_pRoot, 0, offset, index, sum);
+        if (found > open)
+        {
+            sum = 0;
+            auto match = FindClose(m_pRoot, 0, found, index, sum);
+            if (match >= 0)
+            {
+                open = found;
+                close = match;
+            }
+        }
+    }
+    return open >= 0;
+}
+
+// Call fn for each bracket in [begin, end), in order, with the depth of its type before it.
+// Subtrees outside the range are skipped, using what they do to the depth
+template <typename F>
+void SyntaxBrackets::VisitBrackets(const Node* pNode, long nodeStart, const DepthChanges& before, long begin, long end, F&& fn)
+{
+    if (!pNode)
+    {
+        return;
+    }
+
+    auto leftEnd = nodeStart + Total(pNode->pLeft);
+    if (begin < leftEnd)
+    {
+        VisitBrackets(pNode->pLeft, nodeStart, before, begin, end, fn);
+    }
+
+    auto atNode = pNode->pLeft ? Then(before, pNode->pLeft->changes) : before;
+    auto offset = leftEnd + pNode->distance - 1;
+    if (offset >= begin && offset < end)
+    {
+        fn(SyntaxBracketInfo{ offset, pNode->type, pNode->open, atNode[size_t(pNode->type)].Apply(0) });
+    }
+
+    if (end > offset + 1 && pNode->pRight)
+    {
+        VisitBrackets(pNode->pRight, offset + 1, Then(atNode, GetOwnChanges(pNode)), begin, end, fn);
+    }
+}
+
+// The first bracket of the type after the offset where the sum of the opens (+1) and closes (-1) since it
+// reaches -1; the close of an open at the offset.  Subtrees the sum can't reach -1 in are stepped over
+long SyntaxBrackets::FindClose(const Node* pNode, long nodeStart, long after, size_t type, int32_t& sum)
+{
+    if (!pNode || nodeStart + pNode->total - 1 <= after)
+    {
+        return -1;
+    }
+
+    auto& change = pNode->changes[type];
+    if (nodeStart > after && sum + change.minPrefix > -1)
+    {
+        sum += change.shift;
+        return -1;
+    }
+
+    auto found = FindClose(pNode->pLeft, nodeStart, after, type, sum);
+    if (found >= 0)
+    {
+        return found;
+    }
+
+    auto offset = nodeStart + Total(pNode->pLeft) + pNode->distance - 1;
+    if (offset > after && size_t(pNode->type) == type)
+    {
+        sum += pNode->open ? 1 : -1;
+        if (sum == -1)
+        {
+            return offset;
+        }
+    }
+    return FindClose(pNode->pRight, offset + 1, after, type, sum);
+}
+
+// The last bracket of the type before the offset where the sum back to it reaches +1; the open of a close
+// at the offset, or of the pair around it
+long SyntaxBrackets::FindOpen(const Node* pNode, long nodeStart, long before, size_t type, int32_t& sum)
+{
+    if (!pNode || nodeStart >= before)
+    {
+        return -1;
+    }
+
+    auto& change = pNode->changes[type];
+    if (nodeStart + pNode->total - 1 < before && sum + change.maxSuffix < 1)
+    {
+        sum += change.shift;
+        return -1;
+    }
+
+    auto offset = nodeStart + Total(pNode->pLeft) + pNode->distance - 1;
+    auto found = FindOpen(pNode->pRight, offset + 1, before, type, sum);
+    if (found >= 0)
+    {
+        return found;
+    }
+
+    if (offset < before && size_t(pNode->type) == type)
+    {
+        sum += pNode->open ? 1 : -1;
+        if (sum == 1)
+        {
+            return offset;
+        }
+    }
+    return FindOpen(pNode->pLeft, nodeStart, before, type, sum);
+}
+
+SyntaxBrackets::DepthChanges SyntaxBrackets::Then(const DepthChanges& first, const DepthChanges& next)
+{
+    DepthChanges changes;
+    for (size_t type = 0; type < changes.size(); type++)
+    {
+        changes[type] = first[type].Then(next[type]);
+    }
+    return changes;
+}
+
+// An open adds one to the depth of its type; a close takes one off, but not below 0
+SyntaxBrackets::DepthChanges SyntaxBrackets::GetOwnChanges(const Node* pNode)
+{
+    DepthChanges changes;
+    auto& change = changes[size_t(pNode->type)];
+    change.shift = pNode->open ? 1 : -1;
+    change.minPrefix = change.shift;
+    change.maxSuffix = change.shift;
+    if (!pNode->open)
+    {
+        change.floor = 0;
+    }
+    return changes;
+}
+
+void SyntaxBrackets::Pull(Node* pNode)
+{
+    pNode->total = pNode->distance + Total(pNode->pLeft) + Total(pNode->pRight);
+
+    pNode->counts.fill(0);
+    pNode->counts[size_t(pNode->type)] = 1;
+    pNode->changes = GetOwnChanges(pNode);
+    if (pNode->pLeft)
+    {
+        pNode->changes = Then(pNode->pLeft->changes, pNode->changes);
+    }
+    if (pNode->pRight)
+    {
+        pNode->changes = Then(pNode->changes, pNode->pRight->changes);
+    }
+    for (size_t type = 0; type < pNode->counts.size(); type++)
+    {
+        pNode->counts[type] += (pNode->pLeft ? pNode->pLeft->counts[type] : 0) + (pNode->pRight ? pNode->pRight->counts[type] : 0);
+    }
+}
+
+void SyntaxBrackets::Destroy(Node* pNode)
+{
+    if (pNode)
+    {
+        Destroy(pNode->pLeft);
+        Destroy(pNode->pRight);
+        delete pNode;
+    }
+}
+
+SyntaxBrackets::Node* SyntaxBrackets::MakeNode(long distance, BracketType type, bool open)
+{
+    auto pNode = new Node();
+    pNode->distance = distance;
+    pNode->type = type;
+    pNode->open = open;
+    pNode->priority = m_priorities();
+    Pull(pNode);
+    return pNode;
+}
+
+// Left gets the brackets before offset, which is measured from the start of the subtree
+void SyntaxBrackets::Split(Node* pNode, long offset, Node*& pLeft, Node*& pRight)
+{
+    auto fnLeft = [](Node* pAt, long& at, Node*&) {
+        auto nodeEnd = Total(pAt->pLeft) + pAt->distance;
+        if (nodeEnd - 1 < at)
+        {
+            at -= nodeEnd;
+            return true;
+        }
+        return false;
+    };
+    TreapSplit(pNode, offset, pLeft, pRight, fnLeft, Pull);
+}
+
+SyntaxBrackets::Node* SyntaxBrackets::Merge(Node* pLeft, Node* pRight)
+{
+    return TreapMerge(pLeft, pRight, Pull);
+}
+
+// Add to the distance of the first bracket, which moves it and all of those after it
+void SyntaxBrackets::AddToFirst(Node* pNode, long distance)
+{
+    if (!pNode)
+    {
+        return;
+    }
+
+    if (pNode->pLeft)
+    {
+        AddToFirst(pNode->pLeft, distance);
+    }
+    else
+    {
+        pNode->distance += distance;
+    }
+    pNode->total += distance;
+}
+
+} // namespace Zep
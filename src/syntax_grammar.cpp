@@ -0,0 +1,346 @@
+#include "zep/syntax_grammar.h"
+#include "zep/editor.h"
+#include "zep/filesystem.h"
+
+#include "zep/mcommon/file/cpptoml.h"
+#include "zep/mcommon/logger.h"
+#include "zep/mcommon/string/stringutils.h"
+
+#include <map>
+#include <sstream>
+
+namespace Zep
+{
+
+namespace
+{
+// What a region's end matcher finds
+const uint8_t RegionClose = 1;
+const uint8_t RegionOpen = 2;
+} // namespace
+
+SyntaxMatcher::SyntaxMatcher()
+    : m_next(1)
+    , m_accept(1, 0)
+{
+    m_next[0].fill(0);
+}
+
+void SyntaxMatcher::Add(const std::string& str, uint8_t value)
+{
+    size_t state = 0;
+    for (auto ch : str)
+    {
+        auto& next = m_next[state][uint8_t(ch)];
+        if (next == 0)
+        {
+            next = int16_t(m_next.size());
+            m_next.emplace_back();
+            m_next.back().fill(0);
+            m_accept.push_back(0);
+        }
+        state = size_t(m_next[state][uint8_t(ch)]);
+    }
+
+    // The first string added wins; so a region's close beats its open when they are the same
+    if (state != 0 && m_accept[state] == 0)
+    {
+        m_accept[state] = value;
+    }
+}
+
+void SyntaxGrammar::Compile()
+{
+    charClasses.fill(CharClass::Token);
+    for (auto ch : delimiters)
+    {
+        charClasses[uint8_t(ch)] = CharClass::Delimiter;
+    }
+    charClasses[uint8_t(' ')] = charClasses[uint8_t(' ')] == CharClass::Delimiter ? CharClass::Whitespace : CharClass::Token;
+    charClasses[uint8_t('\t')] = charClasses[uint8_t('\t')] == CharClass::Delimiter ? CharClass::Whitespace : CharClass::Token;
+
+    opens = SyntaxMatcher();
+    ends.assign(regions.size(), SyntaxMatcher());
+    for (size_t index = 0; index < regions.size(); index++)
+    {
+        auto& region = regions[index];
+        opens.Add(region.open, uint8_t(index + 1));
+        ends[index].Add(region.close, RegionClose);
+        if (region.nested)
+        {
+            ends[index].Add(region.open, RegionOpen);
+        }
+    }
+}
+
+ZepSyntax_Grammar::ZepSyntax_Grammar(ZepBuffer& buffer, std::shared_ptr<SyntaxGrammar> spGrammar)
+    : ZepSyntax(buffer, spGrammar->keywords, spGrammar->identifiers, spGrammar->caseInsensitive ? ZepSyntaxFlags::CaseInsensitive : 0, false)
+    , m_spGrammar(spGrammar)
+{
+    Start();
+}
+
+ZepSyntax_Grammar::~ZepSyntax_Grammar()
+{
+    // The worker calls LexLine; it must be done before this goes
+    Interrupt();
+}
+
+SyntaxLineState ZepSyntax_Grammar::LexLine(long lineStart, const std::string& line, SyntaxLineState state)
+{
+    auto& grammar = *m_spGrammar;
+    auto count = line.size();
+
+    size_t pos = 0;
+    if (state.region != 0)
+    {
+        pos = LexRegion(lineStart, line, 0, 0, state);
+    }
+
+    size_t length;
+    while (pos < count)
+    {
+        auto ch = line[pos];
+        if (grammar.opens.CanStart(ch))
+        {
+            auto region = grammar.opens.Match(line, pos, length);
+            if (region != 0)
+            {
+                state.region = region;
+                state.depth = 1;
+                pos = LexRegion(lineStart, line, pos, pos + length, state);
+                continue;
+            }
+        }
+
+        auto charClass = grammar.charClasses[uint8_t(ch)];
+        if (charClass != SyntaxGrammar::CharClass::Token)
+        {
+            AddSpan(lineStart + long(pos), lineStart + long(pos + 1), charClass == SyntaxGrammar::CharClass::Whitespace ? ThemeColor::Whitespace : ThemeColor::Normal);
+            pos++;
+            continue;
+        }
+
+        // A token runs up to a delimiter, or something which opens a region
+        auto last = pos + 1;
+        while (last < count && grammar.charClasses[uint8_t(line[last])] == SyntaxGrammar::CharClass::Token && !(grammar.opens.CanStart(line[last]) && grammar.opens.Match(line, last, length) != 0))
+        {
+            last++;
+        }
+        AddSpan(lineStart + long(pos), lineStart + long(last), GetTokenColor(line.data() + pos, line.data() + last));
+        pos = last;
+    }
+
+    return state;
+}
+
+// Color the region in state from first, looking for its end from pos; returns where it ends, or the line end.
+// The state is left in the region if it carries on to the next line
+size_t ZepSyntax_Grammar::LexRegion(long lineStart, const std::string& line, size_t first, size_t pos, SyntaxLineState& state)
+{
+    auto& grammar = *m_spGrammar;
+    auto& region = grammar.regions[state.region - 1];
+    auto& ends = grammar.ends[state.region - 1];
+    auto count = line.size();
+
+    size_t length;
+    while (pos < count)
+    {
+        auto ch = line[pos];
+        if (region.escape != 0 && ch == region.escape)
+        {
+            pos += 2;
+            if (pos > count)
+            {
+                // An escape at the end carries the region on to the next line
+                AddSpan(lineStart + long(first), lineStart + long(count), region.color);
+                return count;
+            }
+            continue;
+        }
+
+        if (ends.CanStart(ch))
+        {
+            auto found = ends.Match(line, pos, length);
+            if (found == RegionClose)
+            {
+                pos += length;
+                if (--state.depth == 0)
+                {
+                    AddSpan(lineStart + long(first), lineStart + long(pos), region.color);
+                    state.region = 0;
+                    return pos;
+                }
+                continue;
+            }
+            else if (found == RegionOpen)
+            {
+                pos += length;
+                state.depth++;
+                continue;
+            }
+        }
+        pos++;
+    }
+
+    AddSpan(lineStart + long(first), lineStart + long(count), region.color);
+    if (!region.multiLine || region.close.empty())
+    {
+        state.region = 0;
+        state.depth = 0;
+    }
+    return count;
+}
+
+namespace
+{
+bool GetRegionColor(const std::string& type, ThemeColor& color)
+{
+    static const std::map<std::string, ThemeColor> colors = {
+        { "comment", ThemeColor::Comment },
+        { "string", ThemeColor::String },
+        { "keyword", ThemeColor::Keyword },
+        { "identifier", ThemeColor::Identifier },
+        { "number", ThemeColor::Number },
+        { "normal", ThemeColor::Normal }
+    };
+    auto itr = colors.find(string_tolower(type));
+    if (itr == colors.end())
+    {
+        return false;
+    }
+    color = itr->second;
+    return true;
+}
+
+template <class T>
+void GetStrings(const cpptoml::table& table, const std::string& key, T& strings)
+{
+    auto values = table.get_array_of<std::string>(key);
+    if (values)
+    {
+        for (auto& value : *values)
+        {
+            strings.insert(strings.end(), value);
+        }
+    }
+}
+} // namespace
+
+std::shared_ptr<SyntaxGrammar> LoadSyntaxGrammar(const std::string& text, std::string& error)
+{
+    try
+    {
+        std::istringstream stream(text);
+        cpptoml::parser parser{ stream };
+        auto spConfig = parser.parse();
+
+        auto spSyntax = spConfig->get_table("syntax");
+        if (!spSyntax)
+        {
+            error = "No [syntax] table";
+            return nullptr;
+        }
+
+        auto spGrammar = std::make_shared<SyntaxGrammar>();
+        spGrammar->id = spSyntax->get_as<std::string>("id").value_or("");
+        if (spGrammar->id.empty())
+        {
+            error = "No syntax id";
+            return nullptr;
+        }
+        GetStrings(*spSyntax, "extensions", spGrammar->extensions);
+        GetStrings(*spSyntax, "keywords", spGrammar->keywords);
+        GetStrings(*spSyntax, "identifiers", spGrammar->identifiers);
+        spGrammar->delimiters = spSyntax->get_as<std::string>("delimiters").value_or(spGrammar->delimiters);
+        spGrammar->caseInsensitive = spSyntax->get_as<bool>("case_insensitive").value_or(false);
+
+        if (auto spRegions = spSyntax->get_table_array("region"))
+        {
+            for (auto& spRegion : *spRegions)
+            {
+                SyntaxGrammarRegion region;
+                auto type = spRegion->get_as<std::string>("type").value_or("comment");
+                if (!GetRegionColor(type, region.color))
+                {
+                    error = "Unknown region type: " + type;
+                    return nullptr;
+                }
+
+                region.open = spRegion->get_as<std::string>("open").value_or("");
+                region.close = spRegion->get_as<std::string>("close").value_or("");
+                auto escape = spRegion->get_as<std::string>("escape").value_or("");
+                region.escape = escape.empty() ? 0 : escape[0];
+                region.multiLine = spRegion->get_as<bool>("multiline").value_or(false);
+                region.nested = spRegion->get_as<bool>("nested").value_or(false);
+                if (region.open.empty())
+                {
+                    error = "A region has no open";
+                    return nullptr;
+                }
+                spGrammar->regions.push_back(region);
+            }
+        }
+
+        // The line state holds the region in a byte
+        if (spGrammar->regions.size() > 255)
+        {
+            error = "Too many regions";
+            return nullptr;
+        }
+
+        spGrammar->Compile();
+        return spGrammar;
+    }
+    catch (cpptoml::parse_exception& ex)
+    {
+        error = ex.what();
+    }
+    catch (...)
+    {
+        error = "Failed to parse";
+    }
+    return nullptr;
+}
+
+void RegisterSyntaxGrammar(ZepEditor& editor, std::shared_ptr<SyntaxGrammar> spGrammar)
+{
+    editor.RegisterSyntaxFactory(spGrammar->extensions, SyntaxProvider{ spGrammar->id, tSyntaxFactory([spGrammar](ZepBuffer* pBuffer) {
+        return std::make_shared<ZepSyntax_Grammar>(*pBuffer, spGrammar);
+    }) });
+}
+
+void RegisterSyntaxGrammars(ZepEditor& editor, const ZepPath& directory)
+{
+    auto& fileSystem = editor.GetFileSystem();
+    if (!fileSystem.Exists(directory) || !fileSystem.IsDirectory(directory))
+    {
+        return;
+    }
+
+    // Only the grammars in the folder itself
+    fileSystem.ScanDirectory(directory, [&](const ZepPath& path, bool& recurse) {
+        recurse = false;
+        if (path.extension() != ".toml")
+        {
+            return true;
+        }
+
+        std::string error;
+        auto spGrammar = LoadSyntaxGrammar(fileSystem.Read(path), error);
+        if (spGrammar)
+        {
+            LOG(INFO) << "Syntax grammar: " << spGrammar->id;
+            RegisterSyntaxGrammar(editor, spGrammar);
+        }
+        else
+        {
+            std::ostringstream str;
+            str << path.filename().string() << " : Failed to parse. " << error;
+            editor.SetCommandText(str.str());
+        }
+        return true;
+    });
+}
+
+} // namespace Zep
@@ -47,157 +47,109 @@ void ZepSyntaxAdorn_RainbowBrackets::Notify(std::shared_ptr<ZepMessage> spMsg)
     }
 }
 
-SyntaxData ZepSyntaxAdorn_RainbowBrackets::GetSyntaxAt(long offset, bool& found) const
+SyntaxData ZepSyntaxAdorn_RainbowBrackets::GetBracketSyntax(int32_t indent, bool valid)
 {
     SyntaxData data;
-    auto itr = m_brackets.find(offset);
-    if (itr == m_brackets.end())
-    {
-        found = false;
-        return data;
-    }
-
-    found = true;
-    if (!itr->second.valid)
+    if (!valid)
     {
         data.foreground = ThemeColor::Text;
         data.background = ThemeColor::Error;
     }
     else
     {
-        data.foreground = (ThemeColor)(((int32_t)ThemeColor::UniqueColor0 + itr->second.indent) % (int32_t)ThemeColor::UniqueColorLast);
+        data.foreground = (ThemeColor)(((int32_t)ThemeColor::UniqueColor0 + indent) % (int32_t)ThemeColor::UniqueColorLast);
         data.background = ThemeColor::None;
     }
-        
     return data;
 }
 
-void ZepSyntaxAdorn_RainbowBrackets::Insert(long start, long end)
+SyntaxData ZepSyntaxAdorn_RainbowBrackets::GetBracketSyntax(const SyntaxBracketInfo& info, const BracketOffsets& unclosed)
 {
-    // Adjust all the brackets after us by the same distance
-    auto diff = end - start;
-    std::map<BufferLocation, Bracket> replace;
-    for (auto& b : m_brackets)
+    // The first bracket of a type which is left open at the end is marked, to show there is one
+    if (unclosed[size_t(info.type)] == info.offset)
     {
-        if (b.first < start)
-            replace[b.first] = b.second;
-        else
-            replace[b.first + diff] = b.second;
+        return GetBracketSyntax(0, false);
     }
-    std::swap(m_brackets, replace);
 
-    RefreshBrackets();
+    if (info.open)
+    {
+        return GetBracketSyntax(info.depth, true);
+    }
+
+    // Allow one bracket error, before going back to normal
+    return GetBracketSyntax(info.depth - 1, info.depth > 0);
 }
 
-void ZepSyntaxAdorn_RainbowBrackets::Clear(long start, long end)
+ZepSyntaxAdorn_RainbowBrackets::BracketOffsets ZepSyntaxAdorn_RainbowBrackets::GetUnclosed() const
 {
-    // Remove brackets in the erased section
-    for (auto current = start; current < end; current++)
+    BracketOffsets unclosed;
+    for (size_t type = 0; type < unclosed.size(); type++)
     {
-        m_brackets.erase(BufferLocation(current));
+        unclosed[type] = m_brackets.GetFirstUnclosed(BracketType(type));
     }
+    return unclosed;
+}
+
+SyntaxData ZepSyntaxAdorn_RainbowBrackets::GetSyntaxAt(long offset, bool& found) const
+{
+    SyntaxBracketInfo info;
+    found = m_brackets.GetBracket(offset, info);
+    return found ? GetBracketSyntax(info, GetUnclosed()) : SyntaxData{};
+}
 
-    // Adjust remaining brackets by the difference
-    auto diff = end - start;
-    std::map<BufferLocation, Bracket> replace;
-    for (auto& b : m_brackets)
+void ZepSyntaxAdorn_RainbowBrackets::GetSyntaxSpans(long begin, long end, std::vector<SyntaxSpan>& spans) const
+{
+    spans.clear();
+    m_brackets.GetBrackets(begin, end, m_spanBrackets);
+    if (m_spanBrackets.empty())
     {
-        if (b.first < start)
-            replace[b.first] = b.second;
-        else
-            replace[b.first - diff] = b.second;
+        return;
     }
-    std::swap(m_brackets, replace);
 
-    RefreshBrackets();
+    auto unclosed = GetUnclosed();
+    for (auto& bracket : m_spanBrackets)
+    {
+        SyntaxSpan span;
+        span.first = bracket.offset;
+        span.last = bracket.offset + 1;
+        span.data = GetBracketSyntax(bracket, unclosed);
+        spans.push_back(span);
+    }
 }
 
-void ZepSyntaxAdorn_RainbowBrackets::Update(long start, long end)
+void ZepSyntaxAdorn_RainbowBrackets::Insert(long start, long end)
 {
-    auto& buffer = m_buffer.GetText();
-    auto itrStart = buffer.begin() + start;
-    auto itrEnd = buffer.begin() + end;
+    m_brackets.Insert(start, end - start);
+}
 
-    for (auto itrBracket = itrStart; itrBracket != itrEnd; itrBracket++)
-    {
-        auto offset = itrBracket - buffer.begin();
-        if (*itrBracket == '(')
-        {
-            m_brackets[BufferLocation(offset)] = Bracket{0, BracketType::Bracket, true};
-        }
-        else if (*itrBracket == ')')
-        {
-            m_brackets[BufferLocation(offset)] = Bracket{0, BracketType::Bracket, false};
-        }
-        else if (*itrBracket == '[')
-        {
-            m_brackets[BufferLocation(offset)] = Bracket{0, BracketType::Group, true};
-        }
-        else if (*itrBracket == ']')
-        {
-            m_brackets[BufferLocation(offset)] = Bracket{0, BracketType::Group, false};
-        }
-        else if (*itrBracket == '{')
-        {
-            m_brackets[BufferLocation(offset)] = Bracket{0, BracketType::Brace, true};
-        }
-        else if (*itrBracket == '}')
-        {
-            m_brackets[BufferLocation(offset)] = Bracket{0, BracketType::Brace, false};
-        }
-        else
-        {
-            auto itr = m_brackets.find(BufferLocation(offset));
-            if (itr != std::end(m_brackets))
-            {
-                m_brackets.erase(itr);
-            }
-        }
-    }
-    RefreshBrackets();
+void ZepSyntaxAdorn_RainbowBrackets::Clear(long start, long end)
+{
+    m_brackets.Erase(start, end);
 }
 
-void ZepSyntaxAdorn_RainbowBrackets::RefreshBrackets()
+void ZepSyntaxAdorn_RainbowBrackets::Update(long start, long end)
 {
-    std::vector<int32_t> indents((int)BracketType::Max, 0);
-    for (auto& b : m_brackets)
+    auto& buffer = m_buffer.GetText();
+    end = std::min(end, long(buffer.size()));
+    if (start >= end)
     {
-        auto& bracket = b.second;
-        if (!bracket.is_open)
-        {
-            indents[int(bracket.type)]--;
-        }
-        bracket.indent = indents[int(bracket.type)];
-        // Allow one bracket error, before going back to normal
-        bracket.valid = (indents[int(bracket.type)] < 0) ? false : true;
-        if (!bracket.valid)
-        {
-            indents[int(bracket.type)] = 0;
-        }
-        if (bracket.is_open)
-        {
-            indents[int(bracket.type)]++;
-        }
+        return;
     }
 
-    auto MarkTails = [&](auto type)
-    {
-        if (indents[int(type)] > 0)
+    m_updated.clear();
+    buffer.ForEachSegment(size_t(start), size_t(end), [&](const utf8* pData, size_t count, size_t segmentStart) {
+        for (size_t index = 0; index < count; index++)
         {
-            for (auto& b : m_brackets)
+            SyntaxBracket bracket;
+            if (SyntaxBrackets::GetBracketType(char(pData[index]), bracket.type, bracket.open))
             {
-                if (b.second.type == type)
-                {
-                    b.second.valid = false;
-                    return;
-                }
+                bracket.offset = long(segmentStart + index);
+                m_updated.push_back(bracket);
             }
-
         }
-    };
-    MarkTails(BracketType::Brace);
-    MarkTails(BracketType::Bracket);
-    MarkTails(BracketType::Group);
+        return true;
+    });
+    m_brackets.Replace(start, end, m_updated);
 }
 
 } // namespace Zep
@@ -0,0 +1,390 @@
+#include "zep/syntax_runs.h"
+#include "zep/syntax.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace Zep
+{
+
+namespace
+{
+// Runs in a chunk; small enough to copy on an edit, big enough that the tree is a fraction of the runs
+const size_t ChunkRuns = 64;
+} // namespace
+
+SyntaxRuns::SyntaxRuns()
+{
+}
+
+SyntaxRuns::~SyntaxRuns()
+{
+    Destroy(m_pRoot);
+}
+
+long SyntaxRuns::size() const
+{
+    return Total(m_pRoot);
+}
+
+void SyntaxRuns::clear()
+{
+    Destroy(m_pRoot);
+    m_pRoot = nullptr;
+}
+
+void SyntaxRuns::Assign(long length)
+{
+    clear();
+    Insert(0, length);
+}
+
+void SyntaxRuns::Resize(long length)
+{
+    auto current = size();
+    if (length > current)
+    {
+        Insert(current, length - current);
+    }
+    else if (length < current)
+    {
+        Erase(length, current);
+    }
+}
+
+void SyntaxRuns::Insert(long location, long length)
+{
+    if (length <= 0)
+    {
+        return;
+    }
+
+    SyntaxSpan span;
+    span.first = location;
+    span.last = location + length;
+    Replace(location, location, std::vector<SyntaxSpan>{ span });
+}
+
+void SyntaxRuns::Erase(long first, long last)
+{
+    if (first < last)
+    {
+        Replace(first, last, std::vector<SyntaxSpan>{});
+    }
+}
+
+void SyntaxRuns::Replace(long first, long last, const std::vector<SyntaxSpan>& spans)
+{
+    first = std::max(0l, first);
+    last = std::min(last, size());
+    if (first > last)
+    {
+        return;
+    }
+
+    // Cut out [first, last), along with the chunks either side of it
+    Node* pBefore;
+    Node* pRange;
+    Node* pAfter;
+    Split(m_pRoot, first, pBefore, pAfter);
+    Split(pAfter, last - first, pRange, pAfter);
+    Destroy(pRange);
+
+    auto pLeftEdge = RemoveLast(pBefore);
+    auto pRightEdge = RemoveFirst(pAfter);
+
+    // Join the runs up again, so the edges of an edit don't leave small chunks behind
+    std::vector<Run> runs;
+    if (pLeftEdge)
+    {
+        runs.swap(pLeftEdge->runs);
+        delete pLeftEdge;
+    }
+    for (auto& span : spans)
+    {
+        auto length = span.last - span.first;
+        AppendRun(runs, MakeRun(0, span.data), length);
+    }
+    if (pRightEdge)
+    {
+        for (auto& run : pRightEdge->runs)
+        {
+            AppendRun(runs, run, run.length);
+        }
+        delete pRightEdge;
+    }
+
+    // Share the runs out evenly over as few chunks as will hold them
+    Node* pMiddle = nullptr;
+    auto chunks = (runs.size() + ChunkRuns - 1) / ChunkRuns;
+    for (size_t chunk = 0; chunk < chunks; chunk++)
+    {
+        auto itrBegin = runs.begin() + (runs.size() * chunk) / chunks;
+        auto itrEnd = runs.begin() + (runs.size() * (chunk + 1)) / chunks;
+        pMiddle = Merge(pMiddle, MakeNode(std::vector<Run>(itrBegin, itrEnd)));
+    }
+
+    m_pRoot = Merge(Merge(pBefore, pMiddle), pAfter);
+}
+
+SyntaxData SyntaxRuns::Get(long offset) const
+{
+    auto pNode = m_pRoot;
+    while (pNode)
+    {
+        auto leftTotal = Total(pNode->pLeft);
+        if (offset < leftTotal)
+        {
+            pNode = pNode->pLeft;
+        }
+        else if (offset < leftTotal + pNode->length)
+        {
+            offset -= leftTotal;
+            for (auto& run : pNode->runs)
+            {
+                if (offset < long(run.length))
+                {
+                    return GetData(run);
+                }
+                offset -= run.length;
+            }
+            break;
+        }
+        else
+        {
+            offset -= leftTotal + pNode->length;
+            pNode = pNode->pRight;
+        }
+    }
+    return SyntaxData{};
+}
+
+void SyntaxRuns::GetSpans(long begin, long end, std::vector<SyntaxSpan>& spans) const
+{
+    spans.clear();
+    if (begin < end)
+    {
+        CollectSpans(m_pRoot, 0, begin, end, spans);
+    }
+}
+
+size_t SyntaxRuns::GetRunCount() const
+{
+    return CountRuns(m_pRoot);
+}
+
+SyntaxRuns::Run SyntaxRuns::MakeRun(long length, const SyntaxData& data)
+{
+    Run run;
+    run.length = uint32_t(length);
+    run.foreground = uint8_t(data.foreground);
+    run.background = uint8_t(data.background);
+    run.underline = data.underline ? 1 : 0;
+    return run;
+}
+
+SyntaxData SyntaxRuns::GetData(const Run& run)
+{
+    SyntaxData data;
+    data.foreground = ThemeColor(run.foreground);
+    data.background = ThemeColor(run.background);
+    data.underline = run.underline != 0;
+    return data;
+}
+
+// Add length characters colored like run, joining it to the last run if they match
+void SyntaxRuns::AppendRun(std::vector<Run>& runs, Run run, long length)
+{
+    const long MaxRunLength = std::numeric_limits<uint32_t>::max();
+    while (length > 0)
+    {
+        if (!runs.empty())
+        {
+            auto& last = runs.back();
+            if (last.foreground == run.foreground && last.background == run.background && last.underline == run.underline && last.length < MaxRunLength)
+            {
+                auto add = std::min(length, MaxRunLength - long(last.length));
+                last.length += uint32_t(add);
+                length -= add;
+                continue;
+            }
+        }
+
+        run.length = 0;
+        runs.push_back(run);
+    }
+}
+
+void SyntaxRuns::Destroy(Node* pNode)
+{
+    if (pNode)
+    {
+        Destroy(pNode->pLeft);
+        Destroy(pNode->pRight);
+        delete pNode;
+    }
+}
+
+void SyntaxRuns::Pull(Node* pNode)
+{
+    pNode->total = pNode->length + Total(pNode->pLeft) + Total(pNode->pRight);
+}
+
+SyntaxRuns::Node* SyntaxRuns::MakeNode(std::vector<Run>&& runs)
+{
+    auto pNode = new Node();
+    pNode->runs = std::move(runs);
+    for (auto& run : pNode->runs)
+    {
+        pNode->length += run.length;
+    }
+    pNode->total = pNode->length;
+    pNode->priority = m_priorities();
+    return pNode;
+}
+
+// Left gets the first offset characters; a chunk across the offset is cut in two
+void SyntaxRuns::Split(Node* pNode, long offset, Node*& pLeft, Node*& pRight)
+{
+    auto fnLeft = [this](Node* pAt, long& at, Node*& pTail) {
+        auto leftTotal = Total(pAt->pLeft);
+        if (at <= leftTotal)
+        {
+            return false;
+        }
+        if (at >= leftTotal + pAt->length)
+        {
+            at -= leftTotal + pAt->length;
+            return true;
+        }
+
+        // Find the run the offset is in, and cut it
+        auto inside = at - leftTotal;
+        size_t index = 0;
+        while (inside >= long(pAt->runs[index].length))
+        {
+            inside -= pAt->runs[index].length;
+            index++;
+        }
+
+        std::vector<Run> tail(pAt->runs.begin() + index, pAt->runs.end());
+        pAt->runs.resize(index);
+        if (inside > 0)
+        {
+            pAt->runs.push_back(tail.front());
+            pAt->runs.back().length = uint32_t(inside);
+            tail.front().length -= uint32_t(inside);
+        }
+
+        pTail = MakeNode(std::move(tail));
+        pAt->length -= pTail->length;
+        return true;
+    };
+    TreapSplit(pNode, offset, pLeft, pRight, fnLeft, Pull);
+}
+
+SyntaxRuns::Node* SyntaxRuns::Merge(Node* pLeft, Node* pRight)
+{
+    return TreapMerge(pLeft, pRight, Pull);
+}
+
+SyntaxRuns::Node* SyntaxRuns::RemoveFirst(Node*& pNode)
+{
+    if (!pNode)
+    {
+        return nullptr;
+    }
+
+    if (!pNode->pLeft)
+    {
+        auto pFirst = pNode;
+        pNode = pNode->pRight;
+        pFirst->pRight = nullptr;
+        Pull(pFirst);
+        return pFirst;
+    }
+
+    auto pFirst = RemoveFirst(pNode->pLeft);
+    Pull(pNode);
+    return pFirst;
+}
+
+SyntaxRuns::Node* SyntaxRuns::RemoveLast(Node*& pNode)
+{
+    if (!pNode)
+    {
+        return nullptr;
+    }
+
+    if (!pNode->pRight)
+    {
+        auto pLast = pNode;
+        pNode = pNode->pLeft;
+        pLast->pLeft = nullptr;
+        Pull(pLast);
+        return pLast;
+    }
+
+    auto pLast = RemoveLast(pNode->pRight);
+    Pull(pNode);
+    return pLast;
+}
+
+void SyntaxRuns::CollectSpans(const Node* pNode, long nodeStart, long begin, long end, std::vector<SyntaxSpan>& spans)
+{
+    if (!pNode)
+    {
+        return;
+    }
+
+    auto chunkStart = nodeStart + Total(pNode->pLeft);
+    auto chunkEnd = chunkStart + pNode->length;
+    if (begin < chunkStart)
+    {
+        CollectSpans(pNode->pLeft, nodeStart, begin, end, spans);
+    }
+
+    if (begin < chunkEnd && end > chunkStart)
+    {
+        auto runStart = chunkStart;
+        for (auto& run : pNode->runs)
+        {
+            auto runEnd = runStart + long(run.length);
+            auto first = std::max(runStart, begin);
+            auto last = std::min(runEnd, end);
+            if (first < last)
+            {
+                auto data = GetData(run);
+                if (!spans.empty() && spans.back().last == first && spans.back().data == data)
+                {
+                    spans.back().last = last;
+                }
+                else
+                {
+                    SyntaxSpan span;
+                    span.first = first;
+                    span.last = last;
+                    span.data = data;
+                    spans.push_back(span);
+                }
+            }
+            if (runEnd >= end)
+            {
+                break;
+            }
+            runStart = runEnd;
+        }
+    }
+
+    if (end > chunkEnd)
+    {
+        CollectSpans(pNode->pRight, chunkEnd, begin, end, spans);
+    }
+}
+
+size_t SyntaxRuns::CountRuns(const Node* pNode)
+{
+    return pNode ? pNode->runs.size() + CountRuns(pNode->pLeft) + CountRuns(pNode->pRight) : 0;
+}
+
+} // namespace Zep
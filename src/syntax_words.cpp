@@ -0,0 +1,108 @@
+#include "zep/syntax_words.h"
+#include "zep/theme.h"
+
+#include "zep/mcommon/string/murmur_hash.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace Zep
+{
+
+SyntaxWordTable::SyntaxWordTable(const std::set<std::string>& keywords, const std::set<std::string>& identifiers, bool caseInsensitive)
+    : m_caseInsensitive(caseInsensitive)
+{
+    size_t size = 16;
+    while (size < (keywords.size() + identifiers.size()) * 2)
+    {
+        size *= 2;
+    }
+    m_entries.resize(size);
+
+    // A word in both is a keyword
+    for (auto& word : keywords)
+    {
+        Add(word, ThemeColor::Keyword);
+    }
+    for (auto& word : identifiers)
+    {
+        Add(word, ThemeColor::Identifier);
+    }
+}
+
+uint64_t SyntaxWordTable::Hash(const char* pWord, size_t length)
+{
+    return murmur_hash_64(pWord, uint32_t(length), 0);
+}
+
+void SyntaxWordTable::Add(const std::string& word, ThemeColor color)
+{
+    if (word.empty() || Find(word.c_str(), word.size()) != ThemeColor::None)
+    {
+        return;
+    }
+
+    // Case insensitive syntaxes match the lower case word
+    auto stored = word;
+    if (m_caseInsensitive)
+    {
+        for (auto& ch : stored)
+        {
+            ch = char(std::tolower((unsigned char)ch));
+        }
+    }
+
+    auto hash = Hash(stored.c_str(), stored.size());
+    auto mask = m_entries.size() - 1;
+    auto index = size_t(hash) & mask;
+    while (m_entries[index].length != 0)
+    {
+        index = (index + 1) & mask;
+    }
+
+    auto& entry = m_entries[index];
+    entry.hash = hash;
+    entry.offset = uint32_t(m_words.size());
+    entry.length = uint32_t(stored.size());
+    entry.color = color;
+    m_words += stored;
+    m_maxLength = std::max(m_maxLength, stored.size());
+}
+
+ThemeColor SyntaxWordTable::Find(const char* pWord, size_t length) const
+{
+    // Nothing longer than the longest word can match, which also bounds the lower case copy
+    if (length == 0 || length > m_maxLength)
+    {
+        return ThemeColor::None;
+    }
+
+    char lower[256];
+    if (m_caseInsensitive)
+    {
+        if (length > sizeof(lower))
+        {
+            return ThemeColor::None;
+        }
+        for (size_t index = 0; index < length; index++)
+        {
+            lower[index] = char(std::tolower((unsigned char)pWord[index]));
+        }
+        pWord = lower;
+    }
+
+    auto hash = Hash(pWord, length);
+    auto mask = m_entries.size() - 1;
+    for (auto index = size_t(hash) & mask; m_entries[index].length != 0; index = (index + 1) & mask)
+    {
+        auto& entry = m_entries[index];
+        if (entry.hash == hash && entry.length == length && std::memcmp(m_words.data() + entry.offset, pWord, length) == 0)
+        {
+            return entry.color;
+        }
+    }
+    return ThemeColor::None;
+}
+
+} // namespace Zep
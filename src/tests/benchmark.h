@@ -0,0 +1,36 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "zep/mcommon/animation/timer.h"
+
+// Helpers for the benchmark tests (*.bench.cpp). These are gtest cases like the unit tests,
+// but are built into the 'benchmarks' executable, which isn't run by ctest.
+namespace Zep
+{
+
+// Report the time taken for a number of operations
+inline void BenchmarkReport(const std::string& name, const timer& t, uint64_t operations)
+{
+    auto elapsed = timer_get_elapsed(t);
+    std::cout << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(12) << timer_to_ms(elapsed) << " ms"
+              << std::setw(14) << (operations ? double(elapsed) / double(operations) : 0.0) << " us/op"
+              << std::endl;
+}
+
+// Report the throughput of a pass over a number of bytes
+inline void BenchmarkReportThroughput(const std::string& name, const timer& t, uint64_t bytes)
+{
+    auto seconds = std::max(timer_get_elapsed_seconds(t), 1e-9);
+    std::cout << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(12) << seconds * 1000.0 << " ms"
+              << std::setw(14) << (double(bytes) / seconds) / (1024.0 * 1024.0 * 1024.0) << " GB/s"
+              << std::endl;
+}
+
+} // namespace Zep
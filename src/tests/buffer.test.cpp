@@ -1,9 +1,255 @@
 #include <gtest/gtest.h>
 
+#include "config_app.h"
+
 #include "zep/buffer.h"
+#include "zep/display.h"
+#include "zep/editor.h"
+#include "zep/filesystem.h"
+#include "zep/mcommon/file/cpptoml.h"
+
+#include <fstream>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace Zep;
 
 // TODO The buffer tests were depricated, need to replace?
 // They are covered pretty well by the mode tests
 
+class BufferTest : public testing::Test
+{
+public:
+    BufferTest()
+    {
+        spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    }
+
+    // Make every file big enough to be loaded through a mapping
+    void SetRopeThreshold(int64_t threshold)
+    {
+        auto spConfig = cpptoml::make_table();
+        auto spEditorConfig = cpptoml::make_table();
+        spEditorConfig->insert("rope_storage_threshold", threshold);
+        spConfig->insert("editor", spEditorConfig);
+        spEditor->LoadConfig(spConfig);
+    }
+
+public:
+    std::shared_ptr<ZepEditor> spEditor;
+};
+
+TEST_F(BufferTest, LoadMapped)
+{
+    // Enough text for many chunks, with tabs and CRs in some of them
+    std::string text;
+    for (int line = 0; line < 2000; line++)
+    {
+        text += (line % 100 == 0) ? "\tTabbed line\r\n" : "A line of text " + std::to_string(line) + "\n";
+    }
+
+    auto path = ZepPath("buffer_test_mapped.txt");
+    std::ofstream(path.string(), std::ios::binary) << text;
+
+    auto pReadBuffer = spEditor->GetEmptyBuffer("read.txt");
+    pReadBuffer->SetText(text);
+
+    SetRopeThreshold(0);
+    auto pBuffer = spEditor->GetFileBuffer(path);
+    ASSERT_EQ(pBuffer->GetStorageType(), TextStorageType::Rope);
+    ASSERT_TRUE(pBuffer->TestFlags(FileFlags::StrippedCR));
+    ASSERT_TRUE(pBuffer->GetText().string() == pReadBuffer->GetText().string());
+    ASSERT_TRUE(pBuffer->GetLineEnds() == pReadBuffer->GetLineEnds());
+
+    // Edits copy the mapped text they touch
+    pBuffer->Insert(5, "hello\n");
+    pReadBuffer->Insert(5, "hello\n");
+    pBuffer->Delete(1000, 5000);
+    pReadBuffer->Delete(1000, 5000);
+    ASSERT_TRUE(pBuffer->GetText().string() == pReadBuffer->GetText().string());
+    ASSERT_EQ(pBuffer->GetLineCount(), pReadBuffer->GetLineCount());
+
+    std::remove(path.string().c_str());
+}
+
+// Saving over the file a buffer was mapped from leaves the text in memory as it was
+TEST_F(BufferTest, SaveMapped)
+{
+    std::string text;
+    for (int line = 0; line < 2000; line++)
+    {
+        text += "A line of text " + std::to_string(line) + "\n";
+    }
+
+    auto path = ZepPath("buffer_test_save_mapped.txt");
+    std::ofstream(path.string(), std::ios::binary) << text;
+
+    // The buffer ends with a 0, which isn't saved
+    SetRopeThreshold(0);
+    auto pBuffer = spEditor->GetFileBuffer(path);
+    ASSERT_EQ(pBuffer->GetStorageType(), TextStorageType::Rope);
+
+    // Shifts the rest of the file along, under the views of it
+    pBuffer->Insert(0, "0123456789\n");
+    text.insert(0, "0123456789\n");
+
+    int64_t size;
+    ASSERT_TRUE(pBuffer->Save(size));
+    ASSERT_TRUE(pBuffer->GetText().string() == text + '\0');
+
+    // A smaller file, so the old views would reach past its end
+    pBuffer->Delete(0, 20000);
+    text.erase(0, 20000);
+    ASSERT_TRUE(pBuffer->Save(size));
+    ASSERT_TRUE(pBuffer->GetText().string() == text + '\0');
+    ASSERT_TRUE(pBuffer->Save(size));
+    ASSERT_TRUE(spEditor->GetFileSystem().Read(path) == text);
+
+    std::remove(path.string().c_str());
+}
+
+#if defined(__linux__) || defined(__APPLE__)
+// A file that isn't mapped is written in place; links to it still see the new text
+TEST_F(BufferTest, SaveKeepsLinks)
+{
+    auto path = ZepPath("buffer_test_save_links.txt");
+    auto linkPath = ZepPath("buffer_test_save_links_symlink.txt");
+    auto hardPath = ZepPath("buffer_test_save_links_hard.txt");
+    std::ofstream(path.string(), std::ios::binary) << "Some text\n";
+    std::remove(linkPath.string().c_str());
+    std::remove(hardPath.string().c_str());
+    ASSERT_EQ(symlink(path.string().c_str(), linkPath.string().c_str()), 0);
+    ASSERT_EQ(link(path.string().c_str(), hardPath.string().c_str()), 0);
+
+    struct stat before;
+    ASSERT_EQ(stat(path.string().c_str(), &before), 0);
+
+    auto pBuffer = spEditor->GetFileBuffer(linkPath);
+    pBuffer->Insert(0, "More ");
+    int64_t size;
+    ASSERT_TRUE(pBuffer->Save(size));
+
+    struct stat linkStat;
+    struct stat after;
+    ASSERT_EQ(lstat(linkPath.string().c_str(), &linkStat), 0);
+    ASSERT_TRUE(S_ISLNK(linkStat.st_mode));
+    ASSERT_EQ(stat(path.string().c_str(), &after), 0);
+    ASSERT_EQ(after.st_ino, before.st_ino);
+    ASSERT_TRUE(spEditor->GetFileSystem().Read(hardPath) == "More Some text\n");
+
+    std::remove(linkPath.string().c_str());
+    std::remove(hardPath.string().c_str());
+    std::remove(path.string().c_str());
+}
+#endif
+
+// A file of several chunks, loaded on worker threads, matches the same text set directly
+TEST(BufferLoadTest, LoadChunksInParallel)
+{
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, 0);
+
+    // Tabs and CRs only in the middle chunk, so the others are referenced from the file
+    std::string text;
+    for (int line = 0; text.size() < ZepBuffer::LoadChunkSize * 2 + 1000; line++)
+    {
+        bool middle = text.size() > ZepBuffer::LoadChunkSize && text.size() < ZepBuffer::LoadChunkSize * 2;
+        text += (middle && line % 100 == 0) ? "\tTabbed line\r\n" : "A line of text " + std::to_string(line) + "\n";
+    }
+
+    auto path = ZepPath("buffer_test_chunked.txt");
+    std::ofstream(path.string(), std::ios::binary) << text;
+
+    auto pReadBuffer = spEditor->GetEmptyBuffer("read.txt");
+    pReadBuffer->SetText(text);
+
+    auto pBuffer = spEditor->GetFileBuffer(path);
+    if (pBuffer->IsLoading())
+    {
+        // Read only until the rest of the file arrives
+        ASSERT_FALSE(pBuffer->Insert(0, "x"));
+    }
+    pBuffer->WaitForLoad();
+
+    ASSERT_FALSE(pBuffer->IsLoading());
+    ASSERT_FALSE(pBuffer->TestFlags(FileFlags::Dirty));
+    ASSERT_TRUE(pBuffer->TestFlags(FileFlags::StrippedCR));
+    ASSERT_TRUE(pBuffer->GetText().string() == pReadBuffer->GetText().string());
+    ASSERT_TRUE(pBuffer->GetLineEnds() == pReadBuffer->GetLineEnds());
+    ASSERT_TRUE(pBuffer->Insert(0, "x"));
+
+    std::remove(path.string().c_str());
+}
+
+// Matches are found across the gap and across rope chunks, in both directions
+TEST_F(BufferTest, Search)
+{
+    std::string text;
+    for (int line = 0; line < 3000; line++)
+    {
+        text += "Line " + std::to_string(line) + " has a Needle in it\n";
+    }
+
+    for (auto type : { TextStorageType::GapBuffer, TextStorageType::Rope })
+    {
+        auto pBuffer = spEditor->GetEmptyBuffer("search.txt");
+        pBuffer->SetText(text);
+        pBuffer->SetStorageType(type);
+
+        // Put the gap (and chunk boundaries) in the middle of some matches
+        auto expected = text;
+        for (long offset : { 7000l, 40000l, 80000l })
+        {
+            pBuffer->Insert(offset, "Ne");
+            expected.insert(offset, "Ne");
+        }
+
+        for (long start : { 0l, 6999l, 39990l, 80001l, long(expected.size()) - 20 })
+        {
+            for (auto ignoreCase : { false, true })
+            {
+                auto needle = ignoreCase ? std::string("NEEDLE") : std::string("Needle");
+                auto equal = [&](char a, char b) {
+                    return ignoreCase ? std::tolower(a) == std::tolower(b) : a == b;
+                };
+
+                auto itrForward = std::search(expected.begin() + start, expected.end(), needle.begin(), needle.end(), equal);
+                auto found = pBuffer->Search(needle, start, SearchDirection::Forward, InvalidOffset, ignoreCase);
+                ASSERT_EQ(found, itrForward == expected.end() ? InvalidOffset : long(itrForward - expected.begin()));
+
+                auto itrBackwardEnd = expected.begin() + std::min(expected.size(), start + needle.size());
+                auto itrBackward = std::find_end(expected.begin(), itrBackwardEnd, needle.begin(), needle.end(), equal);
+                found = pBuffer->Search(needle, start, SearchDirection::Backward, InvalidOffset, ignoreCase);
+                ASSERT_EQ(found, itrBackward == itrBackwardEnd ? InvalidOffset : long(itrBackward - expected.begin()));
+            }
+        }
+        ASSERT_EQ(pBuffer->Search("Not in there", 0), InvalidOffset);
+    }
+}
+
+TEST_F(BufferTest, SearchRegex)
+{
+    std::string text;
+    for (int line = 0; line < 20000; line++)
+    {
+        text += "Line " + std::to_string(line) + " has a number\n";
+    }
+    auto pBuffer = spEditor->GetEmptyBuffer("search.txt");
+    pBuffer->SetText(text);
+
+    auto lineStart = long(text.find("Line 100 "));
+    auto found = pBuffer->SearchRegex("^Line 1\\d\\d ", lineStart - 1);
+    ASSERT_EQ(found.first, lineStart);
+    ASSERT_EQ(found.second, lineStart + 9);
+
+    // Backwards finds the last one at or before the start; here, a long way back
+    found = pBuffer->SearchRegex("LINE 1\\d\\d ", long(text.size()) - 1, SearchDirection::Backward, true);
+    ASSERT_EQ(found.first, long(text.find("Line 199 ")));
+    found = pBuffer->SearchRegex("number$", lineStart, SearchDirection::Backward);
+    ASSERT_EQ(found.first, lineStart - 7);
+
+    ASSERT_EQ(pBuffer->SearchRegex("Line 20000", 0).first, InvalidOffset);
+    ASSERT_EQ(pBuffer->SearchRegex("Line (", 0).first, InvalidOffset);
+}
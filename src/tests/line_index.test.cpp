@@ -0,0 +1,139 @@
+#include "zep/line_index.h"
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <random>
+
+using namespace Zep;
+
+namespace
+{
+
+// The simple vector version of the line index, as the buffer used to keep it
+struct LineEndsModel
+{
+    std::vector<long> ends;
+
+    long LineFromOffset(long offset) const
+    {
+        return long(std::upper_bound(ends.begin(), ends.end(), offset) - ends.begin());
+    }
+
+    void Insert(long offset, long length, const std::vector<long>& lines)
+    {
+        auto itrLine = std::upper_bound(ends.begin(), ends.end(), offset);
+        for (auto itr = itrLine; itr != ends.end(); itr++)
+        {
+            *itr += length;
+        }
+        ends.insert(itrLine, lines.begin(), lines.end());
+    }
+
+    void Erase(long startOffset, long endOffset)
+    {
+        auto itrLine = std::upper_bound(ends.begin(), ends.end(), startOffset);
+        auto itrLastLine = std::upper_bound(ends.begin(), ends.end(), endOffset);
+        for (auto itr = itrLastLine; itr != ends.end(); itr++)
+        {
+            *itr -= (endOffset - startOffset);
+        }
+        ends.erase(itrLine, itrLastLine);
+    }
+};
+
+} // namespace
+
+TEST(LineIndex, Lookup)
+{
+    LineIndex index;
+    index.Assign({ 4, 8, 9, 15 });
+    ASSERT_EQ(index.size(), 4);
+    ASSERT_EQ(index[2], 9);
+    ASSERT_EQ(index.LineFromOffset(0), 0);
+    ASSERT_EQ(index.LineFromOffset(4), 1);
+    ASSERT_EQ(index.LineFromOffset(8), 2);
+    ASSERT_EQ(index.LineFromOffset(14), 3);
+    ASSERT_EQ(index.LineFromOffset(15), 4);
+
+    // "ab\n" inserted at the start of line 1
+    index.Insert(4, 3, { 7 });
+    ASSERT_EQ(index.ToVector(), std::vector<long>({ 4, 7, 11, 12, 18 }));
+
+    index.Erase(3, 8);
+    ASSERT_EQ(index.ToVector(), std::vector<long>({ 6, 7, 13 }));
+}
+
+// Random edits, over enough lines to need many blocks, checked against the vector version
+TEST(LineIndex, RandomEdits)
+{
+    std::mt19937 random(3);
+    LineEndsModel model;
+    for (long line = 1; line <= 20000; line++)
+    {
+        model.ends.push_back(line * 10);
+    }
+
+    LineIndex index;
+    index.Assign(model.ends);
+
+    for (int edit = 0; edit < 5000; edit++)
+    {
+        auto total = model.ends.back();
+        auto offset = long(random() % total);
+        if (random() % 2)
+        {
+            auto length = long(random() % 4000) + 1;
+            std::vector<long> lines;
+            for (long pos = 1; pos <= length; pos++)
+            {
+                if (random() % 8 == 0)
+                {
+                    lines.push_back(offset + pos);
+                }
+            }
+            index.Insert(offset, length, lines);
+            model.Insert(offset, length, lines);
+        }
+        else
+        {
+            auto endOffset = std::min(total - 1, offset + long(random() % 3000));
+            index.Erase(offset, endOffset);
+            model.Erase(offset, endOffset);
+        }
+
+        ASSERT_EQ(index.size(), long(model.ends.size()));
+        auto probe = long(random() % model.ends.back());
+        ASSERT_EQ(index.LineFromOffset(probe), model.LineFromOffset(probe));
+        auto line = long(random() % model.ends.size());
+        ASSERT_EQ(index[line], model.ends[line]);
+    }
+    ASSERT_TRUE(index.ToVector() == model.ends);
+}
+
+// Big inserts, as a paste or a file loading in chunks makes, are spread over blocks that fit
+TEST(LineIndex, SplitsBigInserts)
+{
+    LineEndsModel model;
+    LineIndex index;
+    auto fnAppend = [&](long offset, long lines) {
+        std::vector<long> ends;
+        for (long line = 1; line <= lines; line++)
+        {
+            ends.push_back(offset + line * 5);
+        }
+        index.Insert(offset, lines * 5, ends);
+        model.Insert(offset, lines * 5, ends);
+    };
+
+    // The end, as the loader adds each chunk, and then the middle
+    for (int chunk = 0; chunk < 5; chunk++)
+    {
+        fnAppend(model.ends.empty() ? 0 : model.ends.back(), 80000);
+        ASSERT_LE(index.GetMaxBlockSize(), long(LineIndex::MaxBlockLines));
+    }
+    fnAppend(model.ends[1000] - 2, 50000);
+    ASSERT_LE(index.GetMaxBlockSize(), long(LineIndex::MaxBlockLines));
+
+    ASSERT_EQ(index.size(), long(model.ends.size()));
+    ASSERT_TRUE(index.ToVector() == model.ends);
+}
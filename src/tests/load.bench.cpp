@@ -0,0 +1,115 @@
+#include "config_app.h"
+
+#include "zep/buffer.h"
+#include "zep/display.h"
+#include "zep/editor.h"
+#include "zep/mcommon/file/cpptoml.h"
+
+#include "benchmark.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <limits>
+
+using namespace Zep;
+
+namespace
+{
+
+// Megabytes of text to load; override with ZEP_BENCH_LOAD_MB
+size_t LoadBenchmarkSize()
+{
+    auto pszSize = std::getenv("ZEP_BENCH_LOAD_MB");
+    return size_t(pszSize ? std::atoi(pszSize) : 1024) * 1024 * 1024;
+}
+
+ZepPath MakeLoadBenchmarkFile()
+{
+    ZepPath path("zep_load_benchmark.txt");
+    auto size = LoadBenchmarkSize();
+
+    std::ifstream existing(path.string(), std::ios::binary | std::ios::ate);
+    if (existing && size_t(existing.tellg()) == size)
+    {
+        return path;
+    }
+
+    std::string block;
+    for (int line = 0; block.size() < 1024 * 1024; line++)
+    {
+        block += "Line " + std::to_string(line) + ": The quick brown fox jumps over the lazy dog\n";
+    }
+
+    std::ofstream out(path.string(), std::ios::binary);
+    for (size_t written = 0; written < size; written += block.size())
+    {
+        out.write(block.data(), std::min(block.size(), size - written));
+    }
+    return path;
+}
+
+// Read a value from /proc/self/status, in KB
+uint64_t ReadProcessStatus(const char* pszKey)
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, strlen(pszKey), pszKey) == 0)
+        {
+            return std::strtoull(line.c_str() + strlen(pszKey) + 1, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+// Reset the peak resident set size, so each run is measured on its own
+void ResetPeakRSS()
+{
+    std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+void LoadFile(const ZepPath& path, const std::string& name, int64_t ropeThreshold, uint32_t editorFlags = ZepEditorFlags::DisableThreads)
+{
+    ResetPeakRSS();
+    auto baseRSS = ReadProcessStatus("VmRSS:");
+
+    timer t;
+    timer_start(t);
+    {
+        auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, editorFlags);
+        auto spConfig = cpptoml::make_table();
+        auto spEditorConfig = cpptoml::make_table();
+        spEditorConfig->insert("rope_storage_threshold", ropeThreshold);
+        spConfig->insert("editor", spEditorConfig);
+        spEditor->LoadConfig(spConfig);
+
+        auto pBuffer = spEditor->InitWithFileOrDir(path.string());
+        BenchmarkReport(name + ", load", t, 1);
+
+        spEditor->SetDisplayRegion(NVec2f(0.0f, 0.0f), NVec2f(1024.0f, 1024.0f));
+        spEditor->Display();
+        BenchmarkReport(name + ", first frame", t, 1);
+
+        // With threads, the rest of the file arrives after the first frame
+        pBuffer->WaitForLoad();
+        BenchmarkReport(name + ", fully loaded", t, 1);
+
+        std::cout << name << ", peak RSS growth: " << (ReadProcessStatus("VmHWM:") - baseRSS) / 1024 << " MB" << std::endl;
+        ASSERT_GT(pBuffer->GetLineCount(), 1);
+    }
+}
+
+} // namespace
+
+// Time to first frame, full load and peak memory for a big file; mapped and read, with and without worker threads
+TEST(LoadBenchmark, BigFile)
+{
+    auto path = MakeLoadBenchmarkFile();
+    LoadFile(path, "Mapped load", 32 * 1024 * 1024);
+    LoadFile(path, "Read load", std::numeric_limits<int64_t>::max());
+    LoadFile(path, "Threaded mapped load", 32 * 1024 * 1024, 0);
+    LoadFile(path, "Threaded read load", std::numeric_limits<int64_t>::max(), 0);
+}
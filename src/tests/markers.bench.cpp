@@ -0,0 +1,100 @@
+#include "config_app.h"
+
+#include "zep/buffer.h"
+#include "zep/display.h"
+#include "zep/editor.h"
+
+#include "benchmark.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+using namespace Zep;
+
+namespace
+{
+
+// Diagnostics as a build might report them; a few distinct messages, repeated on many lines
+std::vector<MarkerDesc> MakeDiagnostics(long count, long lineLength)
+{
+    static const char* messages[] = {
+        "unused variable 'result'",
+        "implicit conversion loses integer precision: 'long' to 'int'",
+        "comparison of integers of different signs: 'size_t' and 'long'",
+        "declaration shadows a local variable"
+    };
+
+    std::vector<MarkerDesc> descs(static_cast<size_t>(count));
+    for (long index = 0; index < count; index++)
+    {
+        auto& desc = descs[size_t(index)];
+        desc.range = BufferRange(index * lineLength + 4, index * lineLength + 12);
+        desc.highlightColor = (index % 3) ? ThemeColor::Warning : ThemeColor::Error;
+        desc.displayType = RangeMarkerDisplayType::Underline | RangeMarkerDisplayType::Indicator | RangeMarkerDisplayType::Tooltip;
+        desc.name = (index % 3) ? "Warning" : "Error";
+        desc.description = messages[index % 4];
+    }
+    return descs;
+}
+
+} // namespace
+
+TEST(MarkersBenchmark, LoadDiagnostics)
+{
+    const long Count = 100000;
+    const long LineLength = 40;
+
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    std::string line(LineLength - 1, 'x');
+    std::string text;
+    for (long index = 0; index < Count; index++)
+    {
+        text += line + "\n";
+    }
+    auto pBuffer = spEditor->InitWithText("Markers Benchmark", text);
+    auto descs = MakeDiagnostics(Count, LineLength);
+
+    // One at a time, as before
+    timer t;
+    timer_start(t);
+    for (auto& desc : descs)
+    {
+        auto spMarker = std::make_shared<RangeMarker>();
+        spMarker->SetRange(desc.range);
+        spMarker->highlightColor = desc.highlightColor;
+        spMarker->displayType = desc.displayType;
+        spMarker->name = desc.name;
+        spMarker->description = desc.description;
+        pBuffer->AddRangeMarker(spMarker);
+    }
+    BenchmarkReport("AddRangeMarker 100k", t, Count);
+
+    timer_start(t);
+    pBuffer->ClearRangeMarkers(RangeMarkerType::Message);
+    BenchmarkReport("ClearRangeMarkers 100k", t, Count);
+
+    timer_start(t);
+    pBuffer->SetMarkers(RangeMarkerType::Message, descs);
+    BenchmarkReport("SetMarkers 100k", t, Count);
+
+    // The next build's results
+    timer_start(t);
+    pBuffer->SetMarkers(RangeMarkerType::Message, descs);
+    BenchmarkReport("SetMarkers 100k, replacing 100k", t, Count);
+    ASSERT_EQ(pBuffer->GetRangeMarkers(RangeMarkerType::Message).size(), size_t(Count));
+
+    // Typing at the top of the buffer moves them all
+    const long Edits = 1000;
+    timer_start(t);
+    for (long index = 0; index < Edits; index++)
+    {
+        pBuffer->Insert(0, "a");
+    }
+    BenchmarkReport("Insert with 100k markers after it", t, Edits);
+    ASSERT_EQ(pBuffer->FindNextMarker(0, SearchDirection::Forward, RangeMarkerType::Message)->GetRange().first, Edits + 4);
+
+    timer_start(t);
+    pBuffer->SetMarkers(RangeMarkerType::Message, {});
+    BenchmarkReport("SetMarkers to nothing, clearing 100k", t, Count);
+}
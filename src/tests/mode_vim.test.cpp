@@ -4,6 +4,7 @@
 #include "zep/display.h"
 #include "zep/editor.h"
 #include "zep/mode_vim.h"
+#include "zep/search_highlight.h"
 #include "zep/tab_window.h"
 #include "zep/window.h"
 
@@ -179,6 +180,12 @@ TEST_F(VimTest, BACKSPACE)
 // Dot!
 COMMAND_TEST(dot_ciw, "four two three", "ciwfourjkl.l.", "four three");
 COMMAND_TEST(dot_ciw_step, "four two three", "ciwfourjklll.lll.", "four four four");
+COMMAND_TEST(delete_percent, "f(a, b) c", "ld%", "f c");
+COMMAND_TEST(delete_inner_bracket, "f(a, (b)) c", "fadi(", "f() c");
+COMMAND_TEST(delete_inner_b, "f(a, (b)) c", "fbdib", "f(a, ()) c");
+COMMAND_TEST(delete_a_brace, "x {a [b] c} y", "fbda{", "x  y");
+COMMAND_TEST(change_inner_group, "x[a, b]", "fbci]c", "x[c]");
+COMMAND_TEST(yank_inner_bracket, "f(ab) g", "lyi(P", "f(abab) g");
 COMMAND_TEST(dot_3x, "four two three", "l3xll.", "f tthree");
 COMMAND_TEST(dot_d2w_count3, "one two three four five", "d2w3.", "");
 
@@ -398,6 +405,11 @@ CURSOR_TEST(motion_W, "one! two three", "W", 5, 0);
 CURSOR_TEST(motion_W_over_line, "one;\ntwo", "W", 0, 1);
 
 CURSOR_TEST(motion_w_over_nonascii, "abc\200 def", "w", 3, 0);
+CURSOR_TEST(motion_percent, "f(a[1], b) c", "%", 9, 0);
+CURSOR_TEST(motion_percent_back, "f(a[1], b) c", "%%", 1, 0);
+CURSOR_TEST(motion_percent_inner, "f(a[1], b) c", "fa%", 5, 0);
+CURSOR_TEST(motion_percent_lines, "{\n  x;\n}", "%", 0, 2);
+CURSOR_TEST(motion_percent_unmatched, "f(a b", "%", 0, 0);
 CURSOR_TEST(motion_W_over_nonascii, "abc\200 def", "W", 3, 0);
 
 CURSOR_TEST(motion_b, "one! two three", "wwb", 3, 0);
@@ -427,4 +439,92 @@ CURSOR_TEST(find_a_char_repeat, "one one one", "fo;", 8, 0);
 CURSOR_TEST(find_a_char_num, "one2 one2", "2f2", 8, 0);
 CURSOR_TEST(find_a_char_beside, "ooo", "fo;", 2, 0);
 
+CURSOR_TEST(search_forward, "one two\nthree two", "/two\n", 4, 0);
+CURSOR_TEST(search_next_wraps, "one two\nthree two", "/two\nnn", 4, 0);
+CURSOR_TEST(search_next, "one two\nthree two", "/two\nn", 6, 1);
+CURSOR_TEST(search_previous, "one two\nthree two", "/two\nN", 6, 1);
+CURSOR_TEST(search_backward_wraps, "one two\nthree two", "?two\n", 6, 1);
+CURSOR_TEST(search_ignore_case, "one two\nthree TWO", "/TWO\\c\nn", 6, 1);
+CURSOR_TEST(search_case, "one two\nthree TWO", "/TWO\n", 6, 1);
 
+
+TEST_F(VimTest, SearchHighlightsEveryMatch)
+{
+    std::string text;
+    for (int line = 0; line < 1500; line++)
+    {
+        text += "a line with two in it\n";
+    }
+    pBuffer->SetText(text);
+
+    // While typing the search, all the matches are highlighted; not just the first 1000
+    spMode->AddCommandText("/two");
+    auto& searchHighlight = pBuffer->GetSearchHighlight();
+    searchHighlight.Wait();
+    ASSERT_EQ(searchHighlight.GetMatches().size(), size_t(1500));
+    ASSERT_EQ(searchHighlight.GetCurrent(), 12);
+
+    // ... and they are cleared when the search is done, and n reaches all of them
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_TRUE(searchHighlight.GetMatches().empty());
+    for (int count = 0; count < 1200; count++)
+    {
+        spMode->AddKeyPress('n');
+    }
+    ASSERT_EQ(pWindow->BufferToDisplay().y, 1200);
+}
+
+// Ex commands, run with return
+#define EX_COMMAND_TEST(name, source, command, target)             \
+    TEST_F(VimTest, name)                                          \
+    {                                                              \
+        pBuffer->SetText(source);                                  \
+        spMode->AddCommandText(command);                           \
+        spMode->AddKeyPress(ExtKeys::RETURN);                      \
+        ASSERT_STREQ(pBuffer->GetText().string().c_str(), target); \
+    };
+
+EX_COMMAND_TEST(substitute_line, "one one\none", ":s/one/two/", "two one\none");
+EX_COMMAND_TEST(substitute_line_global, "one one\none", ":s/one/two/g", "two two\none");
+EX_COMMAND_TEST(substitute_all, "one one\none", ":%s/one/two/", "two one\ntwo");
+EX_COMMAND_TEST(substitute_all_global, "one one\none", ":%s/one/two/g", "two two\ntwo");
+EX_COMMAND_TEST(substitute_groups, "one two\nthree four", ":%s/(\\w+) (\\w+)/\\2 \\1/", "two one\nfour three");
+EX_COMMAND_TEST(substitute_ignore_case, "One one", ":s/one/two/gi", "two two");
+EX_COMMAND_TEST(substitute_delimiter, "a/b", ":s#/#\\##", "a#b");
+EX_COMMAND_TEST(substitute_line_start, "one\ntwo", ":%s/^/# /", "# one\n# two");
+EX_COMMAND_TEST(substitute_not_found, "one", ":s/two/three/", "one");
+
+TEST_F(VimTest, SubstituteUndoesInOneStep)
+{
+    std::string text;
+    for (int line = 0; line < 1000; line++)
+    {
+        text += "a line of text\n";
+    }
+    pBuffer->SetText(text);
+    pWindow->SetBufferCursor(0);
+
+    spMode->AddCommandText(":%s/\\w+/word/g");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(pBuffer->GetText().string().find("line"), std::string::npos);
+    ASSERT_EQ(pWindow->BufferToDisplay().y, 999);
+
+    spMode->AddCommandText("u");
+    ASSERT_TRUE(pBuffer->GetText().string() == text + std::string(1, '\0'));
+    spMode->Redo();
+    ASSERT_EQ(pBuffer->GetText().string().find("line"), std::string::npos);
+}
+
+// With a syntax, brackets in strings and comments are left out of the pairs
+TEST_F(VimTest, BracketsSkipStringsAndComments)
+{
+    auto pCppBuffer = spEditor->InitWithText("test.cpp", "f(a, \")\", /* ( */ b) x");
+    pCppBuffer->GetSyntax()->Wait();
+    auto pCppWindow = spEditor->GetActiveTabWindow()->GetActiveWindow();
+    pCppWindow->SetBufferCursor(1);
+    spMode->AddCommandText("%");
+    ASSERT_EQ(pCppWindow->GetBufferCursor(), 19);
+
+    spMode->AddCommandText("di(");
+    ASSERT_STREQ(pCppBuffer->GetText().string().c_str(), "f() x");
+}
@@ -0,0 +1,322 @@
+#include <gtest/gtest.h>
+
+#include "config_app.h"
+
+#include "zep/buffer.h"
+#include "zep/display.h"
+#include "zep/editor.h"
+#include "zep/range_markers.h"
+
+#include <limits>
+#include <random>
+#include <set>
+
+using namespace Zep;
+
+namespace
+{
+
+std::shared_ptr<RangeMarker> MakeMarker(long first, long second, uint32_t markerType = RangeMarkerType::Message)
+{
+    auto spMarker = std::make_shared<RangeMarker>();
+    spMarker->SetRange(BufferRange(first, second));
+    spMarker->markerType = markerType;
+    return spMarker;
+}
+
+using tRange = std::pair<long, long>;
+
+tRange Range(const std::shared_ptr<RangeMarker>& spMarker)
+{
+    auto range = spMarker->GetRange();
+    return tRange(range.first, range.second);
+}
+
+// The markers visited, as they are seen
+std::vector<tRange> Visit(const RangeMarkerTree& tree, long begin, long end, uint32_t markerTypes = RangeMarkerType::All, bool forward = true)
+{
+    std::vector<tRange> ranges;
+    tree.ForEach(markerTypes, forward, begin, end, [&](const std::shared_ptr<RangeMarker>& spMarker) {
+        ranges.push_back(Range(spMarker));
+        return true;
+    });
+    return ranges;
+}
+
+} // namespace
+
+TEST(RangeMarkerTree, FindsOverlapping)
+{
+    RangeMarkerTree tree;
+    tree.Add(MakeMarker(10, 20));
+    tree.Add(MakeMarker(0, 100));
+    tree.Add(MakeMarker(30, 35, RangeMarkerType::Search));
+    tree.Add(MakeMarker(50, 50));
+    ASSERT_EQ(tree.size(), size_t(4));
+
+    ASSERT_TRUE(Visit(tree, 21, 29) == std::vector<tRange>({ tRange(0, 100) }));
+    ASSERT_TRUE(Visit(tree, 15, 30) == std::vector<tRange>({ tRange(0, 100), tRange(10, 20), tRange(30, 35) }));
+    ASSERT_TRUE(Visit(tree, 15, 30, RangeMarkerType::Message) == std::vector<tRange>({ tRange(0, 100), tRange(10, 20) }));
+    ASSERT_TRUE(Visit(tree, 40, 60, RangeMarkerType::All, false) == std::vector<tRange>({ tRange(50, 50), tRange(0, 100) }));
+
+    ASSERT_EQ(Range(tree.FindNext(10, true, RangeMarkerType::All)), tRange(30, 35));
+    ASSERT_EQ(Range(tree.FindNext(10, true, RangeMarkerType::Message)), tRange(50, 50));
+    ASSERT_EQ(Range(tree.FindNext(30, false, RangeMarkerType::All)), tRange(10, 20));
+    ASSERT_TRUE(tree.FindNext(50, true, RangeMarkerType::All) == nullptr);
+}
+
+TEST(RangeMarkerTree, FollowsEdits)
+{
+    RangeMarkerTree tree;
+    auto spBefore = MakeMarker(0, 5);
+    auto spAcross = MakeMarker(5, 15);
+    auto spAfter = MakeMarker(20, 25);
+    auto spInside = MakeMarker(11, 12);
+    for (auto& spMarker : { spBefore, spAcross, spAfter, spInside })
+    {
+        tree.Add(spMarker);
+    }
+
+    // A held marker's range is right without walking the tree first
+    tree.Insert(10, 3);
+    ASSERT_EQ(Range(spBefore), tRange(0, 5));
+    ASSERT_EQ(Range(spAcross), tRange(5, 18));
+    ASSERT_EQ(Range(spInside), tRange(14, 15));
+    ASSERT_EQ(Range(spAfter), tRange(23, 28));
+
+    tree.Delete(3, 15);
+    ASSERT_EQ(Range(spBefore), tRange(0, 3));
+    ASSERT_EQ(Range(spAcross), tRange(3, 6));
+    ASSERT_EQ(Range(spInside), tRange(3, 3));
+    ASSERT_EQ(Range(spAfter), tRange(11, 16));
+
+    // A removed marker keeps where it was, and no longer follows the edits
+    tree.Remove(spAcross);
+    tree.Remove(spAcross);
+    tree.Insert(0, 10);
+    ASSERT_EQ(tree.size(), size_t(3));
+    ASSERT_EQ(Range(spAcross), tRange(3, 6));
+    ASSERT_TRUE(Visit(tree, 0, 100) == std::vector<tRange>({ tRange(10, 13), tRange(13, 13), tRange(21, 26) }));
+
+    // Setting the range of a marker in the tree moves it there
+    spAfter->SetRange(BufferRange(0, 2));
+    ASSERT_EQ(tree.size(), size_t(3));
+    ASSERT_EQ(Range(spAfter), tRange(0, 2));
+    ASSERT_TRUE(Visit(tree, 0, 100) == std::vector<tRange>({ tRange(0, 2), tRange(10, 13), tRange(13, 13) }));
+    ASSERT_EQ(tree.FindNext(5, true, RangeMarkerType::All), spBefore);
+
+    // Copies aren't in the tree
+    auto copy = *spBefore;
+    tree.Insert(0, 1);
+    ASSERT_EQ(copy.GetRange().first, 10);
+    ASSERT_EQ(Range(spBefore), tRange(11, 14));
+}
+
+// Random edits and queries, against moving every marker by hand
+TEST(RangeMarkerTree, MatchesSimpleList)
+{
+    std::mt19937 random(1234);
+    auto fnRandom = [&](long count) {
+        return long(random() % uint32_t(count));
+    };
+
+    RangeMarkerTree tree;
+    std::vector<std::shared_ptr<RangeMarker>> markers;
+    std::vector<tRange> expected;
+
+    for (int step = 0; step < 2000; step++)
+    {
+        auto action = fnRandom(10);
+        if (action < 3 || markers.empty())
+        {
+            auto first = fnRandom(1000);
+            auto spMarker = MakeMarker(first, first + fnRandom(50), fnRandom(2) ? RangeMarkerType::Message : RangeMarkerType::Search);
+            tree.Add(spMarker);
+            markers.push_back(spMarker);
+            expected.push_back(Range(spMarker));
+        }
+        else if (action < 4)
+        {
+            auto index = size_t(fnRandom(long(markers.size())));
+            tree.Remove(markers[index]);
+            markers.erase(markers.begin() + index);
+            expected.erase(expected.begin() + index);
+        }
+        else if (action < 6)
+        {
+            auto location = fnRandom(1000);
+            auto length = fnRandom(20) + 1;
+            tree.Insert(location, length);
+            for (auto& range : expected)
+            {
+                if (range.first >= location)
+                {
+                    range = tRange(range.first + length, range.second + length);
+                }
+                else if (range.second > location)
+                {
+                    range.second += length;
+                }
+            }
+        }
+        else if (action < 8)
+        {
+            auto first = fnRandom(1000);
+            auto last = first + fnRandom(30) + 1;
+            tree.Delete(first, last);
+            auto fnMap = [&](long location) {
+                return location < first ? location : (location < last ? first : location - (last - first));
+            };
+            for (auto& range : expected)
+            {
+                range = tRange(fnMap(range.first), fnMap(range.second));
+            }
+        }
+        else
+        {
+            auto begin = fnRandom(1000);
+            auto end = begin + fnRandom(100);
+            auto markerTypes = uint32_t(fnRandom(3) + 1);
+
+            std::multiset<tRange> found;
+            tree.ForEach(markerTypes, true, begin, end, [&](const std::shared_ptr<RangeMarker>& spMarker) {
+                found.insert(Range(spMarker));
+                return true;
+            });
+
+            std::multiset<tRange> wanted;
+            for (size_t index = 0; index < markers.size(); index++)
+            {
+                auto& range = expected[index];
+                if ((markers[index]->markerType & markerTypes) && range.first <= end && (range.first >= begin || range.second > begin))
+                {
+                    wanted.insert(range);
+                }
+            }
+            ASSERT_TRUE(found == wanted);
+
+            // The next start after the location
+            auto spNext = tree.FindNext(begin, true, markerTypes);
+            long nextStart = std::numeric_limits<long>::max();
+            for (size_t index = 0; index < markers.size(); index++)
+            {
+                if ((markers[index]->markerType & markerTypes) && expected[index].first > begin)
+                {
+                    nextStart = std::min(nextStart, expected[index].first);
+                }
+            }
+            ASSERT_EQ(spNext ? spNext->GetRange().first : std::numeric_limits<long>::max(), nextStart);
+        }
+    }
+
+    // Every marker ends up where it should
+    Visit(tree, std::numeric_limits<long>::min(), std::numeric_limits<long>::max());
+    for (size_t index = 0; index < markers.size(); index++)
+    {
+        ASSERT_EQ(Range(markers[index]), expected[index]);
+    }
+}
+
+TEST(RangeMarkerTree, BufferMovesMarkers)
+{
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->InitWithText("Test Buffer", "one two three\nfour five\n");
+
+    auto spMarker = MakeMarker(4, 7);
+    pBuffer->AddRangeMarker(spMarker);
+    pBuffer->AddRangeMarker(MakeMarker(14, 18, RangeMarkerType::Search));
+
+    pBuffer->Insert(0, "zero ");
+    ASSERT_EQ(pBuffer->FindNextMarker(0, SearchDirection::Forward, RangeMarkerType::Message), spMarker);
+    ASSERT_EQ(Range(spMarker), tRange(9, 12));
+
+    // Wraps around
+    ASSERT_EQ(pBuffer->FindNextMarker(10, SearchDirection::Forward, RangeMarkerType::Message), spMarker);
+    ASSERT_EQ(pBuffer->FindNextMarker(10, SearchDirection::Backward, RangeMarkerType::All), spMarker);
+    ASSERT_EQ(Range(pBuffer->FindNextMarker(5, SearchDirection::Backward, RangeMarkerType::All)), tRange(19, 23));
+
+    // Deleting from inside a marker shrinks it
+    pBuffer->Delete(10, 20);
+    ASSERT_EQ(pBuffer->GetRangeMarkers(RangeMarkerType::All).size(), size_t(2));
+    long count = 0;
+    pBuffer->ForEachMarker(RangeMarkerType::Message, SearchDirection::Forward, 11, 14, [&](const std::shared_ptr<RangeMarker>& spFound) {
+        count++;
+        return true;
+    });
+    ASSERT_EQ(count, 0);
+    ASSERT_EQ(Range(spMarker), tRange(9, 10));
+
+    pBuffer->ClearRangeMarkers(RangeMarkerType::All);
+    ASSERT_TRUE(pBuffer->GetRangeMarkers(RangeMarkerType::All).empty());
+}
+
+namespace
+{
+
+// Counts the marker change messages for a buffer
+class MarkerListener : public ZepComponent
+{
+public:
+    MarkerListener(ZepEditor& editor)
+        : ZepComponent(editor)
+    {
+    }
+
+    virtual void Notify(std::shared_ptr<ZepMessage> spMsg) override
+    {
+        if (spMsg->messageId == Msg::Buffer && std::static_pointer_cast<BufferMessage>(spMsg)->type == BufferMessageType::MarkersChanged)
+        {
+            changes++;
+        }
+    }
+
+    int changes = 0;
+};
+
+} // namespace
+
+TEST(RangeMarkerTree, SetMarkersReplacesLayer)
+{
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->InitWithText("Test Buffer", std::string(1000, 'x'));
+    MarkerListener listener(*spEditor);
+
+    auto spSearch = MakeMarker(5, 10, RangeMarkerType::Search);
+    pBuffer->AddRangeMarker(spSearch);
+
+    std::vector<MarkerDesc> descs(100);
+    for (size_t index = 0; index < descs.size(); index++)
+    {
+        descs[index].range = BufferRange(long(990 - index * 9), long(995 - index * 9));
+        descs[index].name = "warning";
+        descs[index].description = (index % 2) ? "unused variable" : "implicit conversion";
+    }
+
+    listener.changes = 0;
+    pBuffer->SetMarkers(RangeMarkerType::Message, descs);
+    ASSERT_EQ(listener.changes, 1);
+
+    auto markers = pBuffer->GetRangeMarkers(RangeMarkerType::Message);
+    ASSERT_EQ(markers.size(), size_t(100));
+    ASSERT_EQ(markers.begin()->first, 990 - 99 * 9);
+
+    // The same messages share their text
+    auto& spFirst = *markers.begin()->second.begin();
+    auto& spLast = *markers.rbegin()->second.begin();
+    ASSERT_STREQ(spFirst->description.c_str(), "unused variable");
+    ASSERT_STREQ(spLast->description.c_str(), "implicit conversion");
+    ASSERT_TRUE(spFirst->name.SameAs(spLast->name));
+    ASSERT_TRUE((*std::next(markers.begin(), 2)->second.begin())->description.SameAs(spFirst->description));
+
+    // A new set replaces the old one, and leaves the other types alone
+    descs.resize(3);
+    pBuffer->SetMarkers(RangeMarkerType::Message, descs);
+    ASSERT_EQ(pBuffer->GetRangeMarkers(RangeMarkerType::Message).size(), size_t(3));
+    ASSERT_EQ(pBuffer->FindNextMarker(0, SearchDirection::Forward, RangeMarkerType::Search), spSearch);
+
+    listener.changes = 0;
+    pBuffer->ClearRangeMarkers(RangeMarkerType::Message);
+    ASSERT_EQ(listener.changes, 1);
+    ASSERT_TRUE(pBuffer->GetRangeMarkers(RangeMarkerType::Message).empty());
+    ASSERT_EQ(pBuffer->GetRangeMarkers(RangeMarkerType::All).size(), size_t(1));
+}
@@ -0,0 +1,92 @@
+#include "config_app.h"
+
+#include "zep/buffer.h"
+#include "zep/display.h"
+#include "zep/editor.h"
+#include "zep/mode_vim.h"
+#include "zep/tab_window.h"
+#include "zep/text_regex.h"
+#include "zep/window.h"
+
+#include "benchmark.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+using namespace Zep;
+
+namespace
+{
+
+// A few MB of source-like text, with a match to replace on every line
+std::string MakeRegexBenchmarkText(int lines)
+{
+    std::string text;
+    for (int line = 0; line < lines; line++)
+    {
+        text += "    auto value" + std::to_string(line) + " = ComputeSomething(left, right) + other_value * 3;\n";
+    }
+    return text;
+}
+
+} // namespace
+
+TEST(RegexBenchmark, Substitute)
+{
+    const int Lines = 100000;
+    auto text = MakeRegexBenchmarkText(Lines);
+
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    auto spMode = std::make_shared<ZepMode_Vim>(*spEditor);
+    auto pBuffer = spEditor->InitWithText("Regex Benchmark", text);
+    auto pWindow = spEditor->GetActiveTabWindow()->GetActiveWindow();
+    spEditor->SetDisplayRegion(NVec2f(0.0f, 0.0f), NVec2f(1024.0f, 1024.0f));
+
+    for (auto type : { TextStorageType::GapBuffer, TextStorageType::Rope })
+    {
+        pBuffer->SetText(text);
+        pBuffer->SetStorageType(type);
+        auto name = std::string(type == TextStorageType::Rope ? "Rope" : "GapBuffer");
+
+        // Put the gap in the middle of the text
+        pBuffer->Insert(long(text.size() / 2), " ");
+        pBuffer->Delete(long(text.size() / 2), long(text.size() / 2) + 1);
+
+        timer t;
+        timer_start(t);
+        auto spRegex = RegexCompile("ComputeSomething");
+        long count = 0;
+        RegexForEachMatch(pBuffer->GetText(), 0, pBuffer->EndLocation(), *spRegex, [&](const std::cmatch&, long) {
+            count++;
+            return true;
+        });
+        BenchmarkReportThroughput("Regex match every line, " + name, t, text.size());
+        ASSERT_EQ(count, Lines);
+
+        // The whole command; find, build the new text, and make the edit.
+        // A plain rename first, then one with a group, where std::regex is tried at each position in every line
+        pWindow->SetBufferCursor(0);
+        timer_start(t);
+        spMode->AddCommandText(":%s/ComputeSomething/ComputeOther/g");
+        spMode->AddKeyPress(ExtKeys::RETURN);
+        BenchmarkReport(":%s rename with 100k replacements, " + name, t, Lines);
+        ASSERT_EQ(pBuffer->SearchRegex("ComputeSomething", 0).first, InvalidOffset);
+
+        timer_start(t);
+        spMode->AddCommandText("u");
+        BenchmarkReport(":%s rename undo, " + name, t, Lines);
+
+        pWindow->SetBufferCursor(0);
+        timer_start(t);
+        spMode->AddCommandText(":%s/(\\w+)\\(left, right\\)/\\1(right, left)/g");
+        spMode->AddKeyPress(ExtKeys::RETURN);
+        BenchmarkReport(":%s with groups and 100k replacements, " + name, t, Lines);
+        ASSERT_EQ(pBuffer->GetText().size(), text.size() + 1);
+        ASSERT_EQ(pBuffer->SearchRegex("left, right", 0).first, InvalidOffset);
+
+        timer_start(t);
+        spMode->AddCommandText("u");
+        BenchmarkReport(":%s undo, " + name, t, Lines);
+        ASSERT_TRUE(pBuffer->GetText().string() == text + std::string(1, '\0'));
+    }
+}
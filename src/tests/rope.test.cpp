@@ -0,0 +1,109 @@
+#include "config_app.h"
+
+#include "zep/buffer.h"
+#include "zep/display.h"
+#include "zep/editor.h"
+#include "zep/rope.h"
+#include "zep/text_storage.h"
+
+#include <gtest/gtest.h>
+#include <random>
+
+using namespace Zep;
+
+TEST(Rope, InsertErase)
+{
+    Rope<char> rope;
+    std::string foo("Hello");
+    rope.insert(0, foo.begin(), foo.end());
+    ASSERT_EQ(rope.string(), "Hello");
+
+    foo = " World";
+    rope.insert(rope.size(), foo.begin(), foo.end());
+    ASSERT_EQ(rope.string(), "Hello World");
+    ASSERT_EQ(rope[6], 'W');
+
+    rope.erase(0, 6);
+    ASSERT_EQ(rope.string(), "World");
+
+    rope.erase(0, rope.size());
+    ASSERT_TRUE(rope.empty());
+}
+
+TEST(Rope, SplitsChunks)
+{
+    Rope<char> rope;
+    std::string big(Rope<char>::MaxChunk * 8, 'a');
+    rope.assign(big.begin(), big.end());
+    ASSERT_GT(rope.segment_count(), 8u);
+
+    // Fill one chunk until it must split
+    std::string small(Rope<char>::MaxChunk / 4, 'b');
+    for (int i = 0; i < 8; i++)
+    {
+        rope.insert(10, small.begin(), small.end());
+        big.insert(10, small);
+    }
+    ASSERT_TRUE(rope.string() == big);
+}
+
+// Random edits checked against a std::string, for both kinds of storage
+TEST(TextStorage, RandomEdits)
+{
+    for (auto type : { TextStorageType::GapBuffer, TextStorageType::Rope })
+    {
+        std::mt19937 random(1);
+        std::string expected(20000, 'x');
+        for (size_t i = 0; i < expected.size(); i++)
+        {
+            expected[i] = char('a' + (i % 26));
+        }
+
+        TextStorage<char> storage;
+        storage.SetType(type);
+        storage.assign(expected.begin(), expected.end());
+
+        for (int edit = 0; edit < 2000; edit++)
+        {
+            auto pos = random() % (expected.size() + 1);
+            if (random() % 2)
+            {
+                std::string str(random() % 5000, char('A' + edit % 26));
+                storage.insert(storage.begin() + pos, str.begin(), str.end());
+                expected.insert(pos, str);
+            }
+            else
+            {
+                auto count = std::min(size_t(random() % 3000), expected.size() - pos);
+                storage.erase(storage.begin() + pos, storage.begin() + pos + count);
+                expected.erase(pos, count);
+            }
+        }
+        ASSERT_EQ(storage.size(), expected.size());
+        ASSERT_TRUE(storage.string() == expected);
+        ASSERT_TRUE(std::string(storage.begin(), storage.end()) == expected);
+
+        // Switching storage keeps the contents
+        storage.SetType(type == TextStorageType::Rope ? TextStorageType::GapBuffer : TextStorageType::Rope);
+        ASSERT_TRUE(storage.string() == expected);
+
+        std::string delim("X\n");
+        auto itr = storage.find_first_of(storage.begin(), storage.end(), delim.begin(), delim.end());
+        auto found = expected.find_first_of(delim);
+        ASSERT_EQ(itr == storage.end() ? std::string::npos : size_t(itr - storage.begin()), found);
+    }
+}
+
+TEST(TextStorage, BufferUsesRope)
+{
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->GetEmptyBuffer("test.txt");
+    pBuffer->SetText("one\ntwo\nthree");
+    ASSERT_EQ(pBuffer->GetStorageType(), TextStorageType::GapBuffer);
+
+    pBuffer->SetStorageType(TextStorageType::Rope);
+    pBuffer->Insert(4, "inserted ");
+    pBuffer->Delete(0, 4);
+    ASSERT_EQ(pBuffer->GetText().string(), std::string("inserted two\nthree") + '\0');
+    ASSERT_EQ(pBuffer->GetLineCount(), 2);
+}
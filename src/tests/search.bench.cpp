@@ -0,0 +1,109 @@
+#include "zep/text_scan.h"
+#include "zep/text_storage.h"
+
+#include "benchmark.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+#include "longtext.tt"
+
+using namespace Zep;
+
+namespace
+{
+
+const size_t BenchmarkTextSize = 64 * 1024 * 1024;
+
+const std::string StartNeedle("ZepStartNeedle");
+
+// The long text sample repeated, with a needle at the very start and another at the very end
+void FillStorage(TextStorage<uint8_t>& storage, TextStorageType type, const std::string& needle)
+{
+    std::string text = StartNeedle;
+    text.reserve(BenchmarkTextSize + longTextSample.size());
+    while (text.size() < BenchmarkTextSize)
+    {
+        text += longTextSample;
+    }
+    text += needle;
+
+    storage.SetType(type);
+    storage.assign(text.begin(), text.end());
+
+    // Put the gap in the middle
+    std::string ch("x");
+    storage.insert(storage.begin() + storage.size() / 2, ch.begin(), ch.end());
+}
+
+const char* StorageName(TextStorageType type)
+{
+    return type == TextStorageType::Rope ? "Rope" : "GapBuffer";
+}
+
+} // namespace
+
+// Finding a match at the end of a big buffer; the whole buffer is scanned
+TEST(SearchBenchmark, WholeBuffer)
+{
+    const std::string needle("ZepSearchNeedle");
+    for (auto type : { TextStorageType::GapBuffer, TextStorageType::Rope })
+    {
+        TextStorage<uint8_t> storage;
+        FillStorage(storage, type, needle);
+        auto pNeedle = (const uint8_t*)needle.data();
+        auto expected = storage.size() - needle.size();
+
+        // The previous search; compare at every position through the iterators
+        {
+            timer t;
+            timer_start(t);
+            size_t found = storage.size();
+            for (auto itr = storage.begin(); itr != storage.end(); itr++)
+            {
+                auto itrNext = itr;
+                size_t index = 0;
+                while (index < needle.size() && itrNext != storage.end() && *itrNext == pNeedle[index])
+                {
+                    index++;
+                    itrNext++;
+                }
+                if (index == needle.size())
+                {
+                    found = itr.p;
+                    break;
+                }
+            }
+            BenchmarkReportThroughput(std::string("Iterator search, ") + StorageName(type), t, storage.size());
+            ASSERT_EQ(found, expected);
+        }
+
+        for (auto level : { TextScanLevel::Scalar, TextScanLevel::SSE2, TextScanLevel::AVX2 })
+        {
+            if (level > TextScanGetSupportedLevel())
+            {
+                continue;
+            }
+            TextScanSetLevel(level);
+            auto name = std::string(StorageName(type)) + ", " + TextScanLevelName(level);
+
+            timer t;
+            timer_start(t);
+            auto found = storage.find(0, storage.size(), pNeedle, needle.size());
+            BenchmarkReportThroughput("Find, " + name, t, storage.size());
+            ASSERT_EQ(found, expected);
+
+            timer_start(t);
+            found = storage.find(0, storage.size(), (const uint8_t*)"zepsearchneedle", needle.size(), true);
+            BenchmarkReportThroughput("Find ignoring case, " + name, t, storage.size());
+            ASSERT_EQ(found, expected);
+
+            // Backwards from the end, looking for something at the start
+            timer_start(t);
+            found = storage.rfind(0, storage.size(), (const uint8_t*)StartNeedle.data(), StartNeedle.size());
+            BenchmarkReportThroughput("Reverse find, " + name, t, storage.size());
+            ASSERT_EQ(found, 0u);
+        }
+        TextScanSetLevel(TextScanGetSupportedLevel());
+    }
+}
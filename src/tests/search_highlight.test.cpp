@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+
+#include "config_app.h"
+
+#include "zep/buffer.h"
+#include "zep/display.h"
+#include "zep/editor.h"
+#include "zep/search_highlight.h"
+
+using namespace Zep;
+
+class SearchHighlightTest : public testing::Test
+{
+public:
+    SearchHighlightTest()
+    {
+        // Threads left on, so the search runs in the background where it can
+        spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT);
+        pBuffer = spEditor->InitWithText("Test Buffer", "");
+    }
+
+    // The matches, the slow way
+    std::vector<long> Expected(const std::string& pattern, bool ignoreCase = false)
+    {
+        std::vector<long> matches;
+        auto found = pBuffer->Search(pattern, 0, SearchDirection::Forward, InvalidOffset, ignoreCase);
+        while (found != InvalidOffset)
+        {
+            matches.push_back(found);
+            found = pBuffer->Search(pattern, found + 1, SearchDirection::Forward, InvalidOffset, ignoreCase);
+        }
+        return matches;
+    }
+
+    const std::vector<long>& Matches(const std::string& pattern, bool ignoreCase = false, BufferRange visible = BufferRange(0, 0))
+    {
+        auto& searchHighlight = pBuffer->GetSearchHighlight();
+        searchHighlight.SetPattern(pattern, ignoreCase, visible);
+        searchHighlight.Wait();
+        return searchHighlight.GetMatches();
+    }
+
+public:
+    std::shared_ptr<ZepEditor> spEditor;
+    ZepBuffer* pBuffer;
+};
+
+TEST_F(SearchHighlightTest, FindsEveryMatch)
+{
+    std::string text;
+    for (int line = 0; line < 20000; line++)
+    {
+        text += "line " + std::to_string(line) + " has a Match in it, match\n";
+    }
+    pBuffer->SetText(text);
+
+    ASSERT_EQ(Matches("match").size(), size_t(20000));
+    ASSERT_TRUE(Matches("match") == Expected("match"));
+
+    // Starting in the middle finds the same
+    auto middle = BufferRange(long(text.size() / 2), long(text.size() / 2 + 1000));
+    ASSERT_TRUE(Matches("Match", true, middle) == Expected("Match", true));
+    ASSERT_EQ(Matches("Match", true, middle).size(), size_t(40000));
+}
+
+TEST_F(SearchHighlightTest, NarrowsExtendedPattern)
+{
+    pBuffer->SetText("ab abc abd abc ABC");
+
+    ASSERT_TRUE(Matches("ab") == std::vector<long>({ 0, 3, 7, 11 }));
+    ASSERT_TRUE(Matches("abc") == std::vector<long>({ 3, 11 }));
+    ASSERT_TRUE(Matches("abc ") == std::vector<long>({ 3, 11 }));
+    ASSERT_TRUE(Matches("ab") == std::vector<long>({ 0, 3, 7, 11 }));
+
+    // Changing the case rule searches again
+    ASSERT_TRUE(Matches("abc", true) == std::vector<long>({ 3, 11, 15 }));
+}
+
+TEST_F(SearchHighlightTest, MatchesInRange)
+{
+    pBuffer->SetText("two two\ntwo");
+    Matches("two");
+
+    const long* pBegin;
+    const long* pEnd;
+    pBuffer->GetSearchHighlight().GetMatches(5, 8, pBegin, pEnd);
+    ASSERT_EQ(pEnd - pBegin, 1);
+    ASSERT_EQ(*pBegin, 4);
+
+    pBuffer->GetSearchHighlight().GetMatches(0, 12, pBegin, pEnd);
+    ASSERT_EQ(pEnd - pBegin, 3);
+}
+
+TEST_F(SearchHighlightTest, FollowsEdits)
+{
+    pBuffer->SetText("one two one two");
+    Matches("two");
+    auto& searchHighlight = pBuffer->GetSearchHighlight();
+
+    pBuffer->Insert(0, "two ");
+    searchHighlight.Wait();
+    ASSERT_TRUE(searchHighlight.GetMatches() == Expected("two"));
+    ASSERT_EQ(searchHighlight.GetMatches().size(), size_t(3));
+
+    // Breaking a match up, and making one across the join
+    pBuffer->Insert(9, "x");
+    searchHighlight.Wait();
+    ASSERT_TRUE(searchHighlight.GetMatches() == Expected("two"));
+    pBuffer->Delete(8, 13);
+    searchHighlight.Wait();
+    ASSERT_TRUE(searchHighlight.GetMatches() == Expected("two"));
+
+    pBuffer->Replace(0, 1, "x");
+    searchHighlight.Wait();
+    ASSERT_TRUE(searchHighlight.GetMatches() == Expected("two"));
+
+    pBuffer->SetText("no matches");
+    searchHighlight.Wait();
+    ASSERT_TRUE(searchHighlight.GetMatches().empty());
+
+    pBuffer->SetText("two matches, two");
+    searchHighlight.Wait();
+    ASSERT_TRUE(searchHighlight.GetMatches() == std::vector<long>({ 0, 13 }));
+}
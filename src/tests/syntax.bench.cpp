@@ -0,0 +1,244 @@
+#include "config_app.h"
+
+#include "zep/buffer.h"
+#include "zep/display.h"
+#include "zep/editor.h"
+#include "zep/syntax.h"
+#include "zep/syntax_grammar.h"
+#include "zep/syntax_runs.h"
+
+#include "benchmark.h"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace Zep;
+
+namespace
+{
+
+// C++ of the usual shape; keywords, identifiers, numbers, strings and comments
+std::string MakeSyntaxBenchmarkText(long lines)
+{
+    std::string text;
+    for (long line = 0; line < lines; line++)
+    {
+        switch (line % 4)
+        {
+        case 0:
+            text += "    int value" + std::to_string(line) + " = ComputeSomething(" + std::to_string(line) + ", \"text\");\n";
+            break;
+        case 1:
+            text += "    // Work out the next value from the last one\n";
+            break;
+        case 2:
+            text += "    if (value > 0) { return value * 2; }\n";
+            break;
+        default:
+            text += "\n";
+            break;
+        }
+    }
+    return text;
+}
+
+// JSON records, with a brace, bracket or parenthesis every few characters
+std::string MakeBracketBenchmarkText(long records)
+{
+    std::string text = "[\n";
+    for (long record = 0; record < records; record++)
+    {
+        auto id = std::to_string(record);
+        text += "    { \"id\": " + id + ", \"tags\": [\"a\", \"b\"], \"pos\": { \"x\": [1, 2], \"y\": { \"z\": \"(" + id + ")\" } } },\n";
+    }
+    text += "]\n";
+    return text;
+}
+
+} // namespace
+
+TEST(SyntaxBenchmark, EditLargeFile)
+{
+    const long Lines = 1000000;
+    const long Edits = 10;
+
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    auto text = MakeSyntaxBenchmarkText(Lines);
+
+    timer t;
+    timer_start(t);
+    auto pBuffer = spEditor->InitWithText("Syntax Benchmark.cpp", text);
+    auto pSyntax = pBuffer->GetSyntax();
+    pSyntax->Wait();
+    BenchmarkReportThroughput("Load and lex", t, text.size());
+
+    // Runs are 8 bytes; a SyntaxData per character would be 12
+    auto runs = pSyntax->GetRuns().GetRunCount();
+    std::cout << "Syntax runs: " << runs << " (" << double(runs * 8) / double(text.size()) << " bytes/char)" << std::endl;
+
+    // Splicing the stored syntax on its own; independent of the file size
+    SyntaxRuns copy;
+    std::vector<SyntaxSpan> spans;
+    pSyntax->GetRuns().GetSpans(0, pSyntax->GetRuns().size(), spans);
+    copy.Replace(0, 0, spans);
+
+    const long Splices = 100000;
+    long lineStart, lineEnd;
+    pBuffer->GetLineOffsets(Lines / 2, lineStart, lineEnd);
+    timer_start(t);
+    for (long splice = 0; splice < Splices; splice++)
+    {
+        copy.Insert(lineStart + 8, 1);
+        copy.Erase(lineStart + 8, lineStart + 9);
+    }
+    BenchmarkReport("Splice syntax (insert and erase)", t, Splices);
+
+    // Typing in the middle of the file, with everything else an edit does
+    timer_start(t);
+    for (long edit = 0; edit < Edits; edit++)
+    {
+        pBuffer->Insert(lineStart + 8, "x");
+        pSyntax->Wait();
+    }
+    BenchmarkReport("Insert a character", t, Edits);
+
+    timer_start(t);
+    for (long edit = 0; edit < Edits; edit++)
+    {
+        pBuffer->Delete(lineStart + 8, lineStart + 9);
+        pSyntax->Wait();
+    }
+    BenchmarkReport("Delete a character", t, Edits);
+}
+
+TEST(SyntaxBenchmark, LexThroughput)
+{
+    const long Lines = 1000000;
+
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    auto text = MakeSyntaxBenchmarkText(Lines);
+    auto pBuffer = spEditor->InitWithText("Syntax Benchmark.cpp", text);
+    auto pSyntax = pBuffer->GetSyntax();
+    pSyntax->Wait();
+
+    // Lex the whole file again; only the syntax hears about it, so this is just the lexer
+    timer t;
+    timer_start(t);
+    pSyntax->Notify(std::make_shared<BufferMessage>(pBuffer, BufferMessageType::TextChanged, 0, pBuffer->EndLocation()));
+    pSyntax->Wait();
+    BenchmarkReportThroughput("Lex C++", t, text.size());
+}
+
+TEST(SyntaxBenchmark, GrammarLexThroughput)
+{
+    const long Lines = 1000000;
+
+    // The built in C++ lexer, as a grammar
+    std::string error;
+    auto spGrammar = LoadSyntaxGrammar(R"toml(
+[syntax]
+id = "cpp_grammar"
+extensions = [".cppgrammar"]
+keywords = ["int", "if", "return"]
+identifiers = ["std", "min", "max"]
+
+[[syntax.region]]
+type = "comment"
+open = "//"
+
+[[syntax.region]]
+type = "comment"
+open = "/*"
+close = "*/"
+multiline = true
+
+[[syntax.region]]
+type = "string"
+open = "\""
+close = "\""
+escape = "\\"
+)toml", error);
+    ASSERT_TRUE(spGrammar != nullptr) << error;
+
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    RegisterSyntaxGrammar(*spEditor, spGrammar);
+    auto text = MakeSyntaxBenchmarkText(Lines);
+    auto pBuffer = spEditor->InitWithText("Syntax Benchmark.cppgrammar", text);
+    auto pSyntax = pBuffer->GetSyntax();
+    pSyntax->Wait();
+
+    timer t;
+    timer_start(t);
+    pSyntax->Notify(std::make_shared<BufferMessage>(pBuffer, BufferMessageType::TextChanged, 0, pBuffer->EndLocation()));
+    pSyntax->Wait();
+    BenchmarkReportThroughput("Lex C++ from a grammar", t, text.size());
+}
+
+TEST(SyntaxBenchmark, RainbowBracketsJson)
+{
+    const long Records = 10000;
+    const long Edits = 1000;
+
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    spEditor->RegisterSyntaxFactory({ ".json" }, SyntaxProvider{ "json", tSyntaxFactory([](ZepBuffer* pBuffer) {
+        return std::make_shared<ZepSyntax>(*pBuffer);
+    }) });
+    auto text = MakeBracketBenchmarkText(Records);
+    std::cout << "Brackets: " << std::count_if(text.begin(), text.end(), [](char ch) { return std::strchr("{}[]()", ch) != nullptr && ch != 0; }) << std::endl;
+
+    timer t;
+    timer_start(t);
+    auto pBuffer = spEditor->InitWithText("Brackets Benchmark.json", text);
+    auto pSyntax = pBuffer->GetSyntax();
+    pSyntax->Wait();
+    BenchmarkReportThroughput("Load and lex", t, text.size());
+
+    long lineStart, lineEnd;
+    pBuffer->GetLineOffsets(Records / 2, lineStart, lineEnd);
+
+    // Typing, which moves the brackets after it
+    timer_start(t);
+    for (long edit = 0; edit < Edits; edit++)
+    {
+        pBuffer->Insert(lineStart + 4, "x");
+        pBuffer->Delete(lineStart + 4, lineStart + 5);
+        pSyntax->Wait();
+    }
+    BenchmarkReport("Type and delete a character", t, Edits);
+
+    // Opening and closing a brace, which changes the depth of every bracket after it
+    timer_start(t);
+    for (long edit = 0; edit < Edits; edit++)
+    {
+        pBuffer->Insert(lineStart + 4, "{");
+        pBuffer->Delete(lineStart + 4, lineStart + 5);
+        pSyntax->Wait();
+    }
+    BenchmarkReport("Type and delete a brace", t, Edits);
+
+    // What a frame asks for; a screen of lines at the end of the file
+    std::vector<SyntaxSpan> spans;
+    long screenStart, screenEnd;
+    pBuffer->GetLineOffsets(Records - 50, screenStart, screenEnd);
+    pBuffer->GetLineOffsets(Records, lineStart, screenEnd);
+    timer_start(t);
+    for (long frame = 0; frame < Edits; frame++)
+    {
+        pSyntax->GetSyntaxSpans(screenStart, screenEnd, spans);
+    }
+    BenchmarkReport("Get the spans of a screen", t, Edits);
+
+    // The '%' motion from the opening bracket of the file, to the other end of it
+    long match = 0;
+    timer_start(t);
+    for (long query = 0; query < Edits; query++)
+    {
+        match += pBuffer->MatchingBracket(0);
+    }
+    BenchmarkReport("Match the outer bracket", t, Edits);
+    ASSERT_EQ(match, Edits * long(text.size() - 2));
+}
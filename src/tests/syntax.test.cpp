@@ -4,8 +4,12 @@
 #include "zep/display.h"
 #include "zep/editor.h"
 #include "zep/syntax.h"
+#include "zep/syntax_rainbow_brackets.h"
+#include "zep/theme.h"
 
 #include <gtest/gtest.h>
+#include <map>
+#include <random>
 
 using namespace Zep;
 class SyntaxTest : public testing::Test
@@ -40,3 +44,288 @@ CPP_SYNTAX_TEST(cpp_identifier, "a = std::min(a,b);", 4, Identifier);
 CPP_SYNTAX_TEST(cpp_string,     "a = \"hello\";", 4, String);
 CPP_SYNTAX_TEST(cpp_number,     "a = 1234;", 4, Number);
 
+CPP_SYNTAX_TEST(cpp_comment,    "a = 1; // hello", 9, Comment);
+CPP_SYNTAX_TEST(cpp_multiline_comment, "a /* b\nc\nd */ int", 7, Comment);
+CPP_SYNTAX_TEST(cpp_after_multiline_comment, "a /* b\nc\nd */ int", 14, Keyword);
+CPP_SYNTAX_TEST(cpp_continued_string, "a = \"one\\\ntwo\";", 11, String);
+
+// Editing one line only lexes that line, unless the state at its end changes
+TEST_F(SyntaxTest, RelexesOnlyChangedLines)
+{
+    std::string text;
+    for (int line = 0; line < 100000; line++)
+    {
+        text += "int value" + std::to_string(line) + " = " + std::to_string(line) + "; // comment\n";
+    }
+
+    ZepBuffer* pBuffer = spEditor->GetEmptyBuffer("test.cpp");
+    pBuffer->SetText(text);
+    auto pSyntax = pBuffer->GetSyntax();
+    pSyntax->Wait();
+
+    long lineStart, lineEnd;
+    pBuffer->GetLineOffsets(50000, lineStart, lineEnd);
+    ASSERT_EQ(pSyntax->GetSyntaxAt(lineStart).foreground, ThemeColor::Keyword);
+
+    // Typing on a line
+    auto lexed = pSyntax->GetLexedLineCount();
+    pBuffer->Insert(lineStart + 4, "x");
+    pSyntax->Wait();
+    ASSERT_EQ(pSyntax->GetLexedLineCount() - lexed, 1);
+
+    // Splitting a line
+    lexed = pSyntax->GetLexedLineCount();
+    pBuffer->Insert(lineStart, "int a;\n");
+    pSyntax->Wait();
+    ASSERT_EQ(pSyntax->GetLexedLineCount() - lexed, 2);
+    ASSERT_EQ(pSyntax->GetSyntaxAt(lineStart + 7).foreground, ThemeColor::Keyword);
+
+    // Joining it again
+    lexed = pSyntax->GetLexedLineCount();
+    pBuffer->Delete(lineStart + 6, lineStart + 7);
+    pSyntax->Wait();
+    ASSERT_EQ(pSyntax->GetLexedLineCount() - lexed, 1);
+
+    // Opening a comment changes every line after it, closing it changes them back
+    pBuffer->GetLineOffsets(99990, lineStart, lineEnd);
+    lexed = pSyntax->GetLexedLineCount();
+    pBuffer->Insert(lineStart, "/*");
+    pSyntax->Wait();
+    ASSERT_EQ(pSyntax->GetLexedLineCount() - lexed, 11);
+    ASSERT_EQ(pSyntax->GetSyntaxAt(pBuffer->EndLocation() - 5).foreground, ThemeColor::Comment);
+
+    pBuffer->GetLineOffsets(99995, lineStart, lineEnd);
+    lexed = pSyntax->GetLexedLineCount();
+    pBuffer->Insert(lineStart, "*/");
+    pSyntax->Wait();
+    ASSERT_EQ(pSyntax->GetLexedLineCount() - lexed, 6);
+    ASSERT_EQ(pSyntax->GetSyntaxAt(lineStart + 2).foreground, ThemeColor::Keyword);
+}
+
+TEST_F(SyntaxTest, LexesVisibleLinesFirst)
+{
+    std::string text;
+    for (int line = 0; line < 1000; line++)
+    {
+        text += "int value" + std::to_string(line) + " = " + std::to_string(line) + ";\n";
+    }
+
+    ZepBuffer* pBuffer = spEditor->GetEmptyBuffer("test.cpp");
+    auto pSyntax = pBuffer->GetSyntax();
+    pSyntax->SetVisibleLines(nullptr, 900, 950);
+
+    // The visible lines are lexed ahead of the rest, then again in order (with the empty line at the end).
+    // Loaded as a file, so the text isn't an insert which moves the visible lines down
+    auto lexed = pSyntax->GetLexedLineCount();
+    pBuffer->SetText(text, true);
+    pSyntax->Wait();
+    ASSERT_EQ(pSyntax->GetLexedLineCount() - lexed, 1001 + 50);
+
+    long lineStart, lineEnd;
+    pBuffer->GetLineOffsets(920, lineStart, lineEnd);
+    ASSERT_EQ(pSyntax->GetSyntaxAt(lineStart).foreground, ThemeColor::Keyword);
+
+    // An edit well above them that doesn't reach them leaves them alone
+    lexed = pSyntax->GetLexedLineCount();
+    pBuffer->Insert(4, "x");
+    pSyntax->Wait();
+    ASSERT_EQ(pSyntax->GetLexedLineCount() - lexed, 1);
+
+    // An edit that does reach them still ends up right, once lexed in order
+    pBuffer->Insert(0, "/*");
+    pSyntax->Wait();
+    pBuffer->GetLineOffsets(920, lineStart, lineEnd);
+    ASSERT_EQ(pSyntax->GetSyntaxAt(lineStart).foreground, ThemeColor::Comment);
+
+    // Deleting the lines a window shows drops them, so none are lexed ahead when the text is loaded again
+    pBuffer->GetLineOffsets(850, lineStart, lineEnd);
+    pBuffer->Delete(lineStart, pBuffer->EndLocation());
+    pSyntax->Wait();
+    lexed = pSyntax->GetLexedLineCount();
+    pBuffer->SetText(text, true);
+    pSyntax->Wait();
+    ASSERT_LT(pSyntax->GetLexedLineCount() - lexed, 1001 + 50);
+
+    // ... as does a window going away
+    int window = 0;
+    auto pWindow = reinterpret_cast<const ZepWindow*>(&window);
+    pSyntax->SetVisibleLines(pWindow, 900, 950);
+    pSyntax->ClearVisibleLines(pWindow);
+    lexed = pSyntax->GetLexedLineCount();
+    pBuffer->SetText(text, true);
+    pSyntax->Wait();
+    ASSERT_LT(pSyntax->GetLexedLineCount() - lexed, 1001 + 50);
+}
+
+TEST_F(SyntaxTest, SpansMatchSyntaxAt)
+{
+    ZepBuffer* pBuffer = spEditor->GetEmptyBuffer("test.cpp");
+    pBuffer->SetText("int value = fn((1), \"str\"); // done\nreturn value;\n");
+    auto pSyntax = pBuffer->GetSyntax();
+    pSyntax->Wait();
+
+    std::vector<SyntaxSpan> spans;
+    pSyntax->GetSyntaxSpans(2, pBuffer->EndLocation(), spans);
+    ASSERT_FALSE(spans.empty());
+    ASSERT_EQ(spans.front().first, 2);
+    ASSERT_EQ(spans.back().last, pBuffer->EndLocation());
+
+    // The runs cover the range, each is as long as it can be, and the brackets are colored by the adornment
+    for (size_t index = 0; index < spans.size(); index++)
+    {
+        auto& span = spans[index];
+        if (index > 0)
+        {
+            ASSERT_EQ(spans[index - 1].last, span.first);
+            ASSERT_NE(spans[index - 1].data, span.data);
+        }
+        for (auto ch = span.first; ch < span.last; ch++)
+        {
+            ASSERT_EQ(pSyntax->GetSyntaxAt(ch), span.data);
+        }
+    }
+
+    auto bracket = pSyntax->GetSyntaxAt(15).foreground;
+    ASSERT_NE(bracket, pSyntax->GetSyntaxAt(14).foreground);
+    ASSERT_NE(bracket, pSyntax->GetSyntaxAt(16).foreground);
+}
+
+TEST(SyntaxWordTable, FindsWordsInPlace)
+{
+    SyntaxWordTable words({ "if", "while", "both" }, { "printf", "both" }, false);
+    std::string line = "while(printf) both if_not";
+    ASSERT_EQ(words.Find(line.data(), 5), ThemeColor::Keyword);
+    ASSERT_EQ(words.Find(line.data() + 6, 6), ThemeColor::Identifier);
+    ASSERT_EQ(words.Find(line.data() + 14, 4), ThemeColor::Keyword);
+    ASSERT_EQ(words.Find(line.data() + 19, 2), ThemeColor::Keyword);
+    ASSERT_EQ(words.Find(line.data() + 19, 6), ThemeColor::None);
+    ASSERT_EQ(words.Find(line.data(), 4), ThemeColor::None);
+
+    SyntaxWordTable caseless({ "Project" }, {}, true);
+    ASSERT_EQ(caseless.Find("PROJECT", 7), ThemeColor::Keyword);
+    ASSERT_EQ(caseless.Find("project", 7), ThemeColor::Keyword);
+    ASSERT_EQ(caseless.Find("projects", 8), ThemeColor::None);
+}
+
+namespace
+{
+
+// The bracket colors worked out from scratch, the simple way
+std::map<long, SyntaxData> GetExpectedBrackets(const std::string& text)
+{
+    struct Bracket
+    {
+        int type;
+        bool open;
+        int32_t indent;
+        bool valid;
+    };
+    std::map<long, Bracket> brackets;
+    for (long offset = 0; offset < long(text.size()); offset++)
+    {
+        auto pFound = std::strchr("()[]{}", text[offset]);
+        if (text[offset] != 0 && pFound)
+        {
+            auto index = int(pFound - "()[]{}");
+            brackets[offset] = Bracket{ index / 2, index % 2 == 0, 0, true };
+        }
+    }
+
+    int32_t indents[3] = { 0, 0, 0 };
+    for (auto& b : brackets)
+    {
+        auto& bracket = b.second;
+        if (!bracket.open)
+        {
+            indents[bracket.type]--;
+        }
+        bracket.indent = indents[bracket.type];
+        bracket.valid = indents[bracket.type] >= 0;
+        if (!bracket.valid)
+        {
+            indents[bracket.type] = 0;
+        }
+        if (bracket.open)
+        {
+            indents[bracket.type]++;
+        }
+    }
+    for (int type = 0; type < 3; type++)
+    {
+        if (indents[type] > 0)
+        {
+            for (auto& b : brackets)
+            {
+                if (b.second.type == type)
+                {
+                    b.second.valid = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    std::map<long, SyntaxData> expected;
+    for (auto& b : brackets)
+    {
+        SyntaxData data;
+        if (!b.second.valid)
+        {
+            data.foreground = ThemeColor::Text;
+            data.background = ThemeColor::Error;
+        }
+        else
+        {
+            data.foreground = (ThemeColor)(((int32_t)ThemeColor::UniqueColor0 + b.second.indent) % (int32_t)ThemeColor::UniqueColorLast);
+            data.background = ThemeColor::None;
+        }
+        expected[b.first] = data;
+    }
+    return expected;
+}
+
+} // namespace
+
+// The brackets are kept up to date by each edit; they should match a recount of the whole buffer
+TEST_F(SyntaxTest, RainbowBracketsFollowEdits)
+{
+    ZepBuffer* pBuffer = spEditor->GetEmptyBuffer("test.cpp");
+    pBuffer->SetText("int main() { return f(a[0], {1, 2}); }\n");
+    ZepSyntaxAdorn_RainbowBrackets brackets(*pBuffer->GetSyntax(), *pBuffer);
+
+    std::mt19937 random(4321);
+    const std::string pieces[] = { "(", ")", "[", "]", "{", "}", "a", "bc", "({", "})", "\n", "x(y[z]{w})" };
+    for (int step = 0; step < 500; step++)
+    {
+        auto size = long(pBuffer->GetText().size()) - 1;
+        auto location = long(random() % uint32_t(size + 1));
+        if (random() % 3 == 0 && size > 0)
+        {
+            auto end = std::min(size, location + 1 + long(random() % 6));
+            pBuffer->Delete(location, end);
+        }
+        else
+        {
+            pBuffer->Insert(location, pieces[random() % (sizeof(pieces) / sizeof(pieces[0]))]);
+        }
+
+        auto text = pBuffer->GetText().string();
+        auto expected = GetExpectedBrackets(text);
+        ASSERT_EQ(brackets.GetBracketCount(), long(expected.size()));
+        for (long offset = 0; offset < long(text.size()); offset++)
+        {
+            bool found = false;
+            auto data = brackets.GetSyntaxAt(offset, found);
+            auto itr = expected.find(offset);
+            ASSERT_EQ(found, itr != expected.end()) << "step " << step << " offset " << offset;
+            if (found)
+            {
+                ASSERT_EQ(data, itr->second) << "step " << step << " offset " << offset;
+            }
+        }
+
+        std::vector<SyntaxSpan> spans;
+        brackets.GetSyntaxSpans(0, long(text.size()), spans);
+        ASSERT_EQ(spans.size(), expected.size());
+    }
+}
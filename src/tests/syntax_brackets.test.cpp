@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+
+#include "zep/syntax_brackets.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace Zep;
+
+namespace
+{
+
+std::vector<SyntaxBracket> FindBrackets(const std::string& text, long first, long last)
+{
+    std::vector<SyntaxBracket> brackets;
+    for (auto offset = first; offset < last; offset++)
+    {
+        SyntaxBracket bracket;
+        if (SyntaxBrackets::GetBracketType(text[size_t(offset)], bracket.type, bracket.open))
+        {
+            bracket.offset = offset;
+            brackets.push_back(bracket);
+        }
+    }
+    return brackets;
+}
+
+// Pair the brackets up with a stack for each type
+std::vector<long> GetExpectedPairs(const std::string& text)
+{
+    std::vector<long> pairs(text.size(), -1);
+    std::vector<long> stacks[size_t(BracketType::Max)];
+    for (long offset = 0; offset < long(text.size()); offset++)
+    {
+        BracketType type;
+        bool open;
+        if (!SyntaxBrackets::GetBracketType(text[size_t(offset)], type, open))
+        {
+            continue;
+        }
+
+        auto& stack = stacks[size_t(type)];
+        if (open)
+        {
+            stack.push_back(offset);
+        }
+        else if (!stack.empty())
+        {
+            pairs[size_t(offset)] = stack.back();
+            pairs[size_t(stack.back())] = offset;
+            stack.pop_back();
+        }
+    }
+    return pairs;
+}
+
+} // namespace
+
+TEST(SyntaxBrackets, FindsPairsAndScopes)
+{
+    const std::string text = "f(a[1], {b}) ) (";
+    SyntaxBrackets brackets;
+    brackets.Replace(0, 0, FindBrackets(text, 0, long(text.size())));
+    ASSERT_EQ(brackets.GetCount(), 8);
+
+    ASSERT_EQ(brackets.MatchingBracket(1), 11);
+    ASSERT_EQ(brackets.MatchingBracket(11), 1);
+    ASSERT_EQ(brackets.MatchingBracket(3), 5);
+    ASSERT_EQ(brackets.MatchingBracket(13), -1); // A close with nothing open
+    ASSERT_EQ(brackets.MatchingBracket(15), -1); // An open which isn't closed
+    ASSERT_EQ(brackets.MatchingBracket(0), -1);
+    ASSERT_EQ(brackets.GetFirstUnclosed(BracketType::Bracket), 1);
+
+    long open, close;
+    ASSERT_TRUE(brackets.EnclosingScope(9, open, close));
+    ASSERT_EQ(open, 8);
+    ASSERT_EQ(close, 10);
+    ASSERT_TRUE(brackets.EnclosingScope(9, open, close, BracketType::Bracket));
+    ASSERT_EQ(open, 1);
+    ASSERT_EQ(close, 11);
+    ASSERT_FALSE(brackets.EnclosingScope(14, open, close));
+
+    // Moving the text along moves the pairs
+    brackets.Insert(2, 5);
+    ASSERT_EQ(brackets.MatchingBracket(1), 16);
+    brackets.Erase(2, 7);
+    ASSERT_EQ(brackets.MatchingBracket(1), 11);
+}
+
+TEST(SyntaxBrackets, MatchesStackPairs)
+{
+    std::mt19937 random(2468);
+    auto fnRandom = [&](long count) {
+        return long(random() % uint32_t(count));
+    };
+
+    const char chars[] = "(){}[]ab";
+    std::string text;
+    SyntaxBrackets brackets;
+    for (int step = 0; step < 1000; step++)
+    {
+        auto size = long(text.size());
+        auto first = fnRandom(size + 1);
+        if (fnRandom(3) == 0)
+        {
+            auto last = std::min(size, first + fnRandom(20));
+            text.erase(size_t(first), size_t(last - first));
+            brackets.Erase(first, last);
+        }
+        else
+        {
+            std::string insert;
+            auto length = 1 + fnRandom(20);
+            for (long index = 0; index < length; index++)
+            {
+                insert += chars[fnRandom(8)];
+            }
+            text.insert(size_t(first), insert);
+            brackets.Insert(first, length);
+            brackets.Replace(first, first + length, FindBrackets(text, first, first + length));
+        }
+
+        auto pairs = GetExpectedPairs(text);
+        for (long offset = 0; offset < long(text.size()); offset++)
+        {
+            ASSERT_EQ(brackets.MatchingBracket(offset), pairs[size_t(offset)]) << "step " << step << " offset " << offset;
+        }
+
+        // The scope at a bracket is its pair; around any other character, the nearest pair around it
+        auto offset = fnRandom(long(text.size()) + 1);
+        long expectedOpen = -1, expectedClose = -1;
+        bool onBracket = offset < long(text.size()) && pairs[size_t(offset)] >= 0;
+        if (onBracket)
+        {
+            expectedOpen = std::min(offset, pairs[size_t(offset)]);
+            expectedClose = std::max(offset, pairs[size_t(offset)]);
+        }
+        for (long index = 0; index < long(text.size()) && !onBracket; index++)
+        {
+            auto pair = pairs[size_t(index)];
+            if (pair > index && index <= offset && pair >= offset && index > expectedOpen)
+            {
+                expectedOpen = index;
+                expectedClose = pair;
+            }
+        }
+        long open = -1, close = -1;
+        ASSERT_EQ(brackets.EnclosingScope(offset, open, close), expectedOpen >= 0);
+        if (expectedOpen >= 0)
+        {
+            ASSERT_EQ(open, expectedOpen);
+            ASSERT_EQ(close, expectedClose);
+        }
+    }
+}
@@ -0,0 +1,167 @@
+#include "config_app.h"
+
+#include "zep/buffer.h"
+#include "zep/display.h"
+#include "zep/editor.h"
+#include "zep/syntax_grammar.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+
+#if defined(__linux__)
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace Zep;
+
+namespace
+{
+
+const char* TestGrammar = R"toml(
+[syntax]
+id = "test_lang"
+extensions = [".tlang"]
+keywords = ["let", "fn"]
+identifiers = ["print"]
+
+[[syntax.region]]
+type = "comment"
+open = "#"
+
+[[syntax.region]]
+type = "comment"
+open = "(*"
+close = "*)"
+multiline = true
+nested = true
+
+[[syntax.region]]
+type = "string"
+open = "\""
+close = "\""
+escape = "\\"
+
+[[syntax.region]]
+type = "string"
+open = "r\"("
+close = ")\""
+multiline = true
+)toml";
+
+} // namespace
+
+class SyntaxGrammarTest : public testing::Test
+{
+public:
+    SyntaxGrammarTest()
+    {
+        spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+
+        std::string error;
+        auto spGrammar = LoadSyntaxGrammar(TestGrammar, error);
+        EXPECT_TRUE(spGrammar != nullptr) << error;
+        if (spGrammar)
+        {
+            RegisterSyntaxGrammar(*spEditor, spGrammar);
+        }
+    }
+
+    ThemeColor ColorAt(const std::string& text, long offset)
+    {
+        auto pBuffer = spEditor->GetEmptyBuffer("test.tlang");
+        pBuffer->SetText(text);
+        pBuffer->GetSyntax()->Wait();
+        return pBuffer->GetSyntax()->GetSyntaxAt(offset).foreground;
+    }
+
+public:
+    std::shared_ptr<ZepEditor> spEditor;
+};
+
+TEST_F(SyntaxGrammarTest, ColorsTokens)
+{
+    ASSERT_EQ(ColorAt("let a = print(1);", 0), ThemeColor::Keyword);
+    ASSERT_EQ(ColorAt("let a = print(1);", 8), ThemeColor::Identifier);
+    ASSERT_EQ(ColorAt("let a = print(1);", 14), ThemeColor::Number);
+    ASSERT_EQ(ColorAt("let a = 1; # let", 14), ThemeColor::Comment);
+}
+
+TEST_F(SyntaxGrammarTest, ColorsStrings)
+{
+    // An escaped quote doesn't close the string
+    ASSERT_EQ(ColorAt("a = \"x\\\" let\" fn", 10), ThemeColor::String);
+    ASSERT_EQ(ColorAt("a = \"x\\\" let\" fn", 14), ThemeColor::Keyword);
+
+    // A string ends with the line, unless the line ends with an escape
+    ASSERT_EQ(ColorAt("a = \"x\nlet", 7), ThemeColor::Keyword);
+    ASSERT_EQ(ColorAt("a = \"x\\\nlet\" fn", 8), ThemeColor::String);
+    ASSERT_EQ(ColorAt("a = \"x\\\nlet\" fn", 13), ThemeColor::Keyword);
+
+    // A raw string carries on over lines, and the longest open wins over the token it starts with
+    ASSERT_EQ(ColorAt("a = r\"(one\n\"let\"\n)\" fn", 12), ThemeColor::String);
+    ASSERT_EQ(ColorAt("a = r\"(one\n\"let\"\n)\" fn", 20), ThemeColor::Keyword);
+}
+
+TEST_F(SyntaxGrammarTest, NestsBlockComments)
+{
+    const std::string text = "(* a (* b\n*) let\n*) let";
+    ASSERT_EQ(ColorAt(text, 3), ThemeColor::Comment);
+    ASSERT_EQ(ColorAt(text, 13), ThemeColor::Comment); // Still inside the outer comment
+    ASSERT_EQ(ColorAt(text, 20), ThemeColor::Keyword);
+}
+
+TEST_F(SyntaxGrammarTest, RelexesWhenACommentOpens)
+{
+    auto pBuffer = spEditor->GetEmptyBuffer("test.tlang");
+    pBuffer->SetText("a\nlet\nlet\n");
+    auto pSyntax = pBuffer->GetSyntax();
+    pSyntax->Wait();
+    ASSERT_EQ(pSyntax->GetSyntaxAt(6).foreground, ThemeColor::Keyword);
+
+    pBuffer->Insert(0, "(*");
+    pSyntax->Wait();
+    ASSERT_EQ(pSyntax->GetSyntaxAt(8).foreground, ThemeColor::Comment);
+
+    pBuffer->Delete(0, 2);
+    pSyntax->Wait();
+    ASSERT_EQ(pSyntax->GetSyntaxAt(6).foreground, ThemeColor::Keyword);
+}
+
+TEST(SyntaxGrammar, ReportsErrors)
+{
+    std::string error;
+    ASSERT_EQ(LoadSyntaxGrammar("[syntax\nid = 1", error), nullptr);
+    ASSERT_FALSE(error.empty());
+
+    error.clear();
+    ASSERT_EQ(LoadSyntaxGrammar("[syntax]\nid = \"a\"\n[[syntax.region]]\ntype = \"bold\"\nopen = \"*\"\n", error), nullptr);
+    ASSERT_FALSE(error.empty());
+}
+
+#if defined(__linux__)
+// Grammars in subfolders of the syntax folder aren't picked up
+TEST(SyntaxGrammar, RegistersFolderWithoutSubfolders)
+{
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    auto fnGrammar = [](const std::string& id, const std::string& extension) {
+        return "[syntax]\nid = \"" + id + "\"\nextensions = [\"" + extension + "\"]\nkeywords = [\"let\"]\n";
+    };
+
+    mkdir("syntax_grammar_test", 0755);
+    mkdir("syntax_grammar_test/more", 0755);
+    std::ofstream("syntax_grammar_test/top.toml") << fnGrammar("top_lang", ".toplang");
+    std::ofstream("syntax_grammar_test/more/sub.toml") << fnGrammar("sub_lang", ".sublang");
+
+    RegisterSyntaxGrammars(*spEditor, ZepPath("syntax_grammar_test"));
+    ASSERT_NE(spEditor->GetEmptyBuffer("test.toplang")->GetSyntax(), nullptr);
+    ASSERT_EQ(spEditor->GetEmptyBuffer("test.sublang")->GetSyntax(), nullptr);
+
+    std::remove("syntax_grammar_test/more/sub.toml");
+    std::remove("syntax_grammar_test/top.toml");
+    rmdir("syntax_grammar_test/more");
+    rmdir("syntax_grammar_test");
+}
+#endif
@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include "zep/syntax.h"
+#include "zep/syntax_runs.h"
+#include "zep/theme.h"
+
+#include <random>
+#include <vector>
+
+using namespace Zep;
+
+namespace
+{
+
+SyntaxData MakeData(ThemeColor foreground)
+{
+    SyntaxData data;
+    data.foreground = foreground;
+    return data;
+}
+
+SyntaxSpan MakeSpan(long first, long last, ThemeColor foreground)
+{
+    SyntaxSpan span;
+    span.first = first;
+    span.last = last;
+    span.data = MakeData(foreground);
+    return span;
+}
+
+} // namespace
+
+TEST(SyntaxRuns, ReplacesAndJoinsRuns)
+{
+    SyntaxRuns runs;
+    runs.Assign(100);
+    ASSERT_EQ(runs.size(), 100);
+    ASSERT_EQ(runs.GetRunCount(), 1u);
+
+    runs.Replace(10, 20, { MakeSpan(10, 15, ThemeColor::Keyword), MakeSpan(15, 20, ThemeColor::Comment) });
+    ASSERT_EQ(runs.size(), 100);
+    ASSERT_EQ(runs.Get(9).foreground, ThemeColor::Normal);
+    ASSERT_EQ(runs.Get(10).foreground, ThemeColor::Keyword);
+    ASSERT_EQ(runs.Get(15).foreground, ThemeColor::Comment);
+    ASSERT_EQ(runs.Get(20).foreground, ThemeColor::Normal);
+    ASSERT_EQ(runs.GetRunCount(), 4u);
+
+    // Inserting inside a run cuts it; putting the same color back joins it up again
+    runs.Insert(12, 3);
+    ASSERT_EQ(runs.size(), 103);
+    ASSERT_EQ(runs.Get(12).foreground, ThemeColor::Normal);
+    ASSERT_EQ(runs.Get(15).foreground, ThemeColor::Keyword);
+    runs.Replace(12, 15, { MakeSpan(12, 15, ThemeColor::Keyword) });
+    ASSERT_EQ(runs.GetRunCount(), 4u);
+
+    runs.Erase(0, 50);
+    ASSERT_EQ(runs.size(), 53);
+    ASSERT_EQ(runs.GetRunCount(), 1u);
+
+    std::vector<SyntaxSpan> spans;
+    runs.GetSpans(10, 20, spans);
+    ASSERT_EQ(spans.size(), 1u);
+    ASSERT_EQ(spans[0].first, 10);
+    ASSERT_EQ(spans[0].last, 20);
+}
+
+TEST(SyntaxRuns, MatchesSimpleList)
+{
+    std::mt19937 random(1234);
+    auto fnRandom = [&](long count) {
+        return long(random() % uint32_t(count));
+    };
+
+    SyntaxRuns runs;
+    std::vector<SyntaxData> expected(5000);
+    runs.Assign(long(expected.size()));
+
+    const ThemeColor colors[] = { ThemeColor::Normal, ThemeColor::Keyword, ThemeColor::Comment, ThemeColor::String };
+    for (int step = 0; step < 2000; step++)
+    {
+        auto size = long(expected.size());
+        auto action = fnRandom(3);
+        auto first = fnRandom(size + 1);
+        if (action == 0)
+        {
+            auto length = fnRandom(100);
+            runs.Insert(first, length);
+            expected.insert(expected.begin() + first, size_t(length), SyntaxData{});
+        }
+        else if (action == 1)
+        {
+            auto last = std::min(size, first + fnRandom(100));
+            runs.Erase(first, last);
+            expected.erase(expected.begin() + first, expected.begin() + last);
+        }
+        else
+        {
+            // A few lines of tokens
+            std::vector<SyntaxSpan> spans;
+            auto last = std::min(size, first + fnRandom(500));
+            for (auto pos = first; pos < last;)
+            {
+                auto end = std::min(last, pos + 1 + fnRandom(8));
+                spans.push_back(MakeSpan(pos, end, colors[fnRandom(4)]));
+                std::fill(expected.begin() + pos, expected.begin() + end, spans.back().data);
+                pos = end;
+            }
+            runs.Replace(first, last, spans);
+        }
+
+        ASSERT_EQ(runs.size(), long(expected.size()));
+        if (expected.empty())
+        {
+            continue;
+        }
+
+        auto offset = fnRandom(long(expected.size()));
+        ASSERT_EQ(runs.Get(offset), expected[size_t(offset)]);
+
+        // The spans cover the range and match, a character at a time
+        std::vector<SyntaxSpan> spans;
+        auto begin = fnRandom(long(expected.size()));
+        auto end = std::min(long(expected.size()), begin + fnRandom(200));
+        runs.GetSpans(begin, end, spans);
+        auto pos = begin;
+        for (auto& span : spans)
+        {
+            ASSERT_EQ(span.first, pos);
+            for (; pos < span.last; pos++)
+            {
+                ASSERT_EQ(span.data, expected[size_t(pos)]);
+            }
+        }
+        ASSERT_EQ(pos, end);
+    }
+}
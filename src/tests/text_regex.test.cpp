@@ -0,0 +1,128 @@
+#include "zep/text_regex.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+using namespace Zep;
+
+namespace
+{
+
+// Storage holding the text, with the gap (or a chunk boundary) in the middle of a line
+void Fill(TextStorage<uint8_t>& storage, TextStorageType type, const std::string& text, size_t gap)
+{
+    storage.SetType(type);
+    storage.assign(text.begin(), text.begin() + gap);
+    std::string rest = text.substr(gap) + std::string(1, '\0');
+    storage.insert(storage.end(), rest.begin(), rest.end());
+}
+
+// "offset:match" for each match
+std::vector<std::string> Matches(const TextStorage<uint8_t>& storage, const std::string& pattern, long first = 0, long last = 1000000)
+{
+    std::vector<std::string> matches;
+    auto spRegex = RegexCompile(pattern);
+    EXPECT_TRUE(spRegex != nullptr);
+    RegexForEachMatch(storage, first, last, *spRegex, [&](const std::cmatch& match, long offset) {
+        matches.push_back(std::to_string(offset) + ":" + match.str(0));
+        return true;
+    });
+    return matches;
+}
+
+} // namespace
+
+TEST(TextRegex, CompileIsCached)
+{
+    auto spRegex = RegexCompile("a+b");
+    ASSERT_TRUE(spRegex != nullptr);
+    ASSERT_EQ(spRegex, RegexCompile("a+b"));
+    ASSERT_NE(spRegex, RegexCompile("a+b", RegexFlags::IgnoreCase));
+    ASSERT_TRUE(RegexCompile("(unclosed") == nullptr);
+}
+
+TEST(TextRegex, FindsLiteral)
+{
+    auto fnLiteral = [](const std::string& pattern) {
+        auto spRegex = RegexCompile(pattern);
+        return spRegex->literal + (spRegex->literalOnly ? "!" : "");
+    };
+
+    ASSERT_EQ(fnLiteral("two"), "two!");
+    ASSERT_EQ(fnLiteral("a\\.b"), "a.b!");
+    ASSERT_EQ(fnLiteral("(\\w+)\\(left, right\\)"), "(left, right)");
+    ASSERT_EQ(fnLiteral("^abc\\d+de$"), "abc");
+    ASSERT_EQ(fnLiteral("abcd?ef"), "abc");
+    ASSERT_EQ(fnLiteral("ab+cd"), "ab");
+    ASSERT_EQ(fnLiteral("[abc]+xy(z|w)"), "xy");
+    ASSERT_EQ(fnLiteral("abc|def"), "");
+    ASSERT_EQ(fnLiteral("a{2}bb"), "bb");
+    ASSERT_EQ(fnLiteral("ca{12}t"), "c");
+    ASSERT_EQ(fnLiteral("ca{2,20}tx"), "tx");
+    ASSERT_EQ(fnLiteral("(ab){3}cd"), "cd");
+}
+
+TEST(TextRegex, MatchesLinesAcrossSegments)
+{
+    const std::string text = "one two\nthree two one\n\ntwo";
+    for (auto type : { TextStorageType::GapBuffer, TextStorageType::Rope })
+    {
+        for (size_t gap = 0; gap <= text.size(); gap++)
+        {
+            TextStorage<uint8_t> storage;
+            Fill(storage, type, text, gap);
+
+            ASSERT_TRUE(Matches(storage, "two") == std::vector<std::string>({ "4:two", "14:two", "23:two" }));
+            ASSERT_TRUE(Matches(storage, "^t\\w+") == std::vector<std::string>({ "8:three", "23:two" }));
+            ASSERT_TRUE(Matches(storage, "\\w+$") == std::vector<std::string>({ "4:two", "18:one", "23:two" }));
+            ASSERT_TRUE(Matches(storage, "^$") == std::vector<std::string>({ "22:" }));
+            ASSERT_TRUE(Matches(storage, "(three )?two") == std::vector<std::string>({ "4:two", "8:three two", "23:two" }));
+
+            // Only matches starting in the range, but the lines are matched from their start
+            ASSERT_TRUE(Matches(storage, "^\\w+", 9, 23) == std::vector<std::string>());
+            ASSERT_TRUE(Matches(storage, "\\bt\\w+", 5, 23) == std::vector<std::string>({ "8:three", "14:two" }));
+        }
+    }
+}
+
+// The counts in a quantifier aren't text the line has to contain
+TEST(TextRegex, MatchesCountedRepeats)
+{
+    const std::string text = "caaaaaaaaaaaat\ncat\ncaat 12\n";
+    TextStorage<uint8_t> storage;
+    Fill(storage, TextStorageType::GapBuffer, text, 5);
+    ASSERT_TRUE(Matches(storage, "ca{12}t") == std::vector<std::string>({ "0:caaaaaaaaaaaat" }));
+    ASSERT_TRUE(Matches(storage, "ca{2,20}t") == std::vector<std::string>({ "0:caaaaaaaaaaaat", "19:caat" }));
+    ASSERT_TRUE(Matches(storage, "ca{1}t") == std::vector<std::string>({ "15:cat" }));
+}
+
+TEST(TextRegex, EmptyMatches)
+{
+    TextStorage<uint8_t> storage;
+    Fill(storage, TextStorageType::GapBuffer, "ab\nc", 1);
+    ASSERT_TRUE(Matches(storage, "x*") == std::vector<std::string>({ "0:", "1:", "2:", "3:", "4:" }));
+}
+
+TEST(TextRegex, Replace)
+{
+    const std::string text = "one two\nthree two two\nfour";
+    TextStorage<uint8_t> storage;
+    Fill(storage, TextStorageType::GapBuffer, text, 10);
+
+    auto spRegex = RegexCompile("(t)(wo)");
+    auto result = RegexReplace(storage, 0, long(text.size()), *spRegex, "<\\2-&-\\1>", true);
+    ASSERT_EQ(result.count, 3);
+    ASSERT_EQ(result.first, 4);
+    ASSERT_EQ(result.last, 21);
+    ASSERT_STREQ(result.text.c_str(), "<wo-two-t>\nthree <wo-two-t> <wo-two-t>");
+    ASSERT_EQ(result.lastReplacement, 32);
+
+    // Just the first on each line
+    result = RegexReplace(storage, 0, long(text.size()), *spRegex, "2\\n", false);
+    ASSERT_EQ(result.count, 2);
+    ASSERT_STREQ(result.text.c_str(), "2\n\nthree 2\n");
+
+    result = RegexReplace(storage, 0, long(text.size()), *RegexCompile("none"), "x", true);
+    ASSERT_EQ(result.count, 0);
+}
@@ -0,0 +1,79 @@
+#include "zep/text_scan.h"
+
+#include "benchmark.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+#include "longtext.tt"
+
+using namespace Zep;
+
+namespace
+{
+
+const size_t BenchmarkTextSize = 256 * 1024 * 1024;
+
+// The long text sample, repeated to make a big file
+const std::string& ScaledText()
+{
+    static std::string text;
+    if (text.empty())
+    {
+        text.reserve(BenchmarkTextSize + longTextSample.size());
+        while (text.size() < BenchmarkTextSize)
+        {
+            text += longTextSample;
+        }
+    }
+    return text;
+}
+
+} // namespace
+
+// Finding the line ends and \r/\t flags, as SetText and Insert do
+TEST(TextScanBenchmark, Lines)
+{
+    auto& text = ScaledText();
+    for (auto level : { TextScanLevel::Scalar, TextScanLevel::SSE2, TextScanLevel::AVX2 })
+    {
+        if (level > TextScanGetSupportedLevel())
+        {
+            continue;
+        }
+        TextScanSetLevel(level);
+
+        std::vector<long> lineEnds;
+        lineEnds.reserve(text.size() / 16);
+        timer t;
+        timer_start(t);
+        TextScanLines((const uint8_t*)text.data(), text.size(), 0, lineEnds);
+        BenchmarkReportThroughput(std::string("Scan lines, ") + TextScanLevelName(level), t, text.size());
+        ASSERT_FALSE(lineEnds.empty());
+    }
+    TextScanSetLevel(TextScanGetSupportedLevel());
+}
+
+// Searching for a character set which isn't in the text, as the syntax highlighter does at the end of a file
+TEST(TextScanBenchmark, FindFirstOf)
+{
+    auto& text = ScaledText();
+    auto pStart = (const uint8_t*)text.data();
+    auto pEnd = pStart + text.size();
+    const uint8_t set[] = { 0x01, 0x02, 0x03 };
+    for (auto level : { TextScanLevel::Scalar, TextScanLevel::SSE2, TextScanLevel::AVX2 })
+    {
+        if (level > TextScanGetSupportedLevel())
+        {
+            continue;
+        }
+        TextScanSetLevel(level);
+
+        timer t;
+        timer_start(t);
+        auto pFound = TextScanFindFirstOf(pStart, pEnd, set, 3);
+        BenchmarkReportThroughput(std::string("Find first of 3, ") + TextScanLevelName(level), t, text.size());
+        ASSERT_EQ(pFound, pEnd);
+    }
+    TextScanSetLevel(TextScanGetSupportedLevel());
+}
@@ -0,0 +1,142 @@
+#include "zep/text_scan.h"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cctype>
+#include <random>
+#include <string>
+
+using namespace Zep;
+
+namespace
+{
+
+// Text with lines of random length, and the odd \r and \t
+std::string MakeText(size_t size, uint32_t seed, bool withSpecials)
+{
+    std::mt19937 random(seed);
+    std::string text;
+    while (text.size() < size)
+    {
+        auto ch = random() % 64;
+        if (ch < 4)
+        {
+            text.push_back('\n');
+        }
+        else if (withSpecials && ch == 4)
+        {
+            text.push_back('\r');
+        }
+        else if (withSpecials && ch == 5)
+        {
+            text.push_back('\t');
+        }
+        else
+        {
+            text.push_back(char('a' + (ch % 26)));
+        }
+    }
+    return text;
+}
+
+class TextScanTest : public testing::Test
+{
+public:
+    ~TextScanTest()
+    {
+        TextScanSetLevel(TextScanGetSupportedLevel());
+    }
+};
+
+} // namespace
+
+// Every level must find the same lines and flags as a simple loop, including the unaligned tails
+TEST_F(TextScanTest, LinesMatchAtEveryLevel)
+{
+    for (auto level : { TextScanLevel::Scalar, TextScanLevel::SSE2, TextScanLevel::AVX2 })
+    {
+        TextScanSetLevel(level);
+        for (auto size : { 0, 1, 15, 16, 17, 31, 32, 33, 100, 4097 })
+        {
+            for (auto withSpecials : { false, true })
+            {
+                auto text = MakeText(size, uint32_t(size), withSpecials);
+
+                std::vector<long> expected;
+                uint32_t expectedFlags = TextScanFlags::None;
+                for (size_t index = 0; index < text.size(); index++)
+                {
+                    if (text[index] == '\n')
+                        expected.push_back(long(index) + 11);
+                    else if (text[index] == '\r')
+                        expectedFlags |= TextScanFlags::HasCR;
+                    else if (text[index] == '\t')
+                        expectedFlags |= TextScanFlags::HasTab;
+                }
+
+                std::vector<long> lineEnds;
+                auto flags = TextScanLines((const uint8_t*)text.data(), text.size(), 10, lineEnds);
+                ASSERT_TRUE(lineEnds == expected) << TextScanLevelName(TextScanGetLevel()) << " size " << size;
+                ASSERT_EQ(flags, expectedFlags) << TextScanLevelName(TextScanGetLevel()) << " size " << size;
+            }
+        }
+    }
+}
+
+TEST_F(TextScanTest, FindFirstOfMatchesAtEveryLevel)
+{
+    auto text = MakeText(1000, 7, true);
+    auto pStart = (const uint8_t*)text.data();
+    auto pEnd = pStart + text.size();
+
+    for (auto level : { TextScanLevel::Scalar, TextScanLevel::SSE2, TextScanLevel::AVX2 })
+    {
+        TextScanSetLevel(level);
+        for (std::string set : { "\r", "\t\r", "xyz", "\n\r\t#", "#" })
+        {
+            for (size_t start = 0; start < 64; start++)
+            {
+                auto pExpected = std::find_first_of(pStart + start, pEnd, set.begin(), set.end());
+                auto pFound = TextScanFindFirstOf(pStart + start, pEnd, (const uint8_t*)set.data(), set.size());
+                ASSERT_EQ(pFound - pStart, pExpected - pStart) << TextScanLevelName(TextScanGetLevel());
+            }
+        }
+
+        // Sets too big for the kernel still work through the wrapper
+        std::string bigSet("abcdefgh");
+        auto pFound = FindFirstOf<uint8_t>(pStart, pEnd, bigSet.begin(), bigSet.end());
+        ASSERT_EQ(pFound, std::find_first_of(pStart, pEnd, bigSet.begin(), bigSet.end()));
+    }
+}
+
+TEST_F(TextScanTest, FindStringMatchesAtEveryLevel)
+{
+    auto text = MakeText(2000, 11, false);
+    text += "The End";
+    auto pStart = (const uint8_t*)text.data();
+    auto pEnd = pStart + text.size();
+
+    for (auto level : { TextScanLevel::Scalar, TextScanLevel::SSE2, TextScanLevel::AVX2 })
+    {
+        TextScanSetLevel(level);
+        for (std::string needle : { "a", "ab", "abc", "\nb", "The End", "the end", "zzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz" })
+        {
+            for (size_t start = 0; start < 40; start += 3)
+            {
+                for (auto ignoreCase : { false, true })
+                {
+                    auto equal = [&](char a, char b) {
+                        return ignoreCase ? std::tolower(a) == std::tolower(b) : a == b;
+                    };
+                    auto itrExpected = std::search(text.begin() + start, text.end(), needle.begin(), needle.end(), equal);
+                    auto pFound = TextScanFindString(pStart + start, pEnd, (const uint8_t*)needle.data(), needle.size(), ignoreCase);
+                    ASSERT_EQ(pFound - pStart, itrExpected - text.begin()) << TextScanLevelName(TextScanGetLevel()) << " " << needle;
+
+                    auto itrLast = std::find_end(text.begin() + start, text.end(), needle.begin(), needle.end(), equal);
+                    pFound = TextScanFindStringReverse(pStart + start, pEnd, (const uint8_t*)needle.data(), needle.size(), ignoreCase);
+                    ASSERT_EQ(pFound - pStart, itrLast - text.begin()) << TextScanLevelName(TextScanGetLevel()) << " " << needle;
+                }
+            }
+        }
+    }
+}
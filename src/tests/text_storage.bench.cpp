@@ -0,0 +1,108 @@
+#include "zep/text_storage.h"
+
+#include "benchmark.h"
+
+#include <gtest/gtest.h>
+#include <random>
+
+using namespace Zep;
+
+namespace
+{
+
+const size_t BenchmarkFileSize = 64 * 1024 * 1024;
+
+void FillStorage(TextStorage<uint8_t>& storage, TextStorageType type)
+{
+    std::vector<uint8_t> text(BenchmarkFileSize);
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        text[i] = (i % 80) == 79 ? '\n' : uint8_t('a' + (i % 26));
+    }
+    storage.SetType(type);
+    storage.assign(text.begin(), text.end());
+}
+
+const char* StorageName(TextStorageType type)
+{
+    return type == TextStorageType::Rope ? "Rope" : "GapBuffer";
+}
+
+} // namespace
+
+// Alternating single character edits at the top and the bottom of a big file
+TEST(TextStorageBenchmark, ScatteredEdits)
+{
+    for (auto type : { TextStorageType::GapBuffer, TextStorageType::Rope })
+    {
+        TextStorage<uint8_t> storage;
+        FillStorage(storage, type);
+
+        const int Edits = 200;
+        std::string ch("x");
+        timer t;
+        timer_start(t);
+        for (int edit = 0; edit < Edits; edit++)
+        {
+            auto pos = (edit % 2) ? storage.size() - 10 : 10;
+            storage.insert(storage.begin() + pos, ch.begin(), ch.end());
+            storage.erase(storage.begin() + pos + 1, storage.begin() + pos + 2);
+        }
+        BenchmarkReport(std::string("Scattered edits, ") + StorageName(type), t, Edits);
+    }
+}
+
+// Typing a word at many cursors spread through a big file
+TEST(TextStorageBenchmark, MultiCursor)
+{
+    for (auto type : { TextStorageType::GapBuffer, TextStorageType::Rope })
+    {
+        TextStorage<uint8_t> storage;
+        FillStorage(storage, type);
+
+        const size_t Cursors = 50;
+        const size_t Chars = 4;
+        std::vector<size_t> cursors;
+        for (size_t cursor = 0; cursor < Cursors; cursor++)
+        {
+            cursors.push_back((storage.size() / Cursors) * cursor);
+        }
+
+        std::string ch("x");
+        timer t;
+        timer_start(t);
+        for (size_t typed = 0; typed < Chars; typed++)
+        {
+            for (size_t cursor = 0; cursor < Cursors; cursor++)
+            {
+                // Each insert moves this cursor and all the later ones along
+                storage.insert(storage.begin() + cursors[cursor], ch.begin(), ch.end());
+                for (size_t later = cursor; later < Cursors; later++)
+                {
+                    cursors[later]++;
+                }
+            }
+        }
+        BenchmarkReport(std::string("Multi cursor typing, ") + StorageName(type), t, Cursors * Chars);
+    }
+}
+
+// Reading the whole file through iterators, as the syntax highlighter does
+TEST(TextStorageBenchmark, SequentialRead)
+{
+    for (auto type : { TextStorageType::GapBuffer, TextStorageType::Rope })
+    {
+        TextStorage<uint8_t> storage;
+        FillStorage(storage, type);
+
+        timer t;
+        timer_start(t);
+        size_t lines = 0;
+        for (auto itr = storage.begin(); itr != storage.end(); itr++)
+        {
+            lines += (*itr == '\n') ? 1 : 0;
+        }
+        BenchmarkReportThroughput(std::string("Sequential read, ") + StorageName(type), t, storage.size());
+        ASSERT_GT(lines, 0u);
+    }
+}
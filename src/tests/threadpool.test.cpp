@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+
+#include "zep/mcommon/threadpool.h"
+
+#include <chrono>
+
+namespace
+{
+
+// Holds a worker until it is released, or its group is cancelled
+struct Blocker
+{
+    std::promise<void> started;
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+
+    bool Run(const cancel_token& token)
+    {
+        started.set_value();
+        while (released.wait_for(std::chrono::milliseconds(1)) != std::future_status::ready)
+        {
+            if (token.is_cancelled())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace
+
+TEST(ThreadPool, RunsWithoutWorkers)
+{
+    ThreadPool pool(1);
+    int group = 0;
+    bool ran = false;
+    auto result = pool.enqueue_group(&group, task_priority::normal, [&](const cancel_token& token, int value) {
+        ran = !token.is_cancelled();
+        return value * 2;
+    },
+        21);
+    ASSERT_TRUE(ran);
+    ASSERT_EQ(result.get(), 42);
+    pool.cancel_group(&group);
+}
+
+TEST(ThreadPool, TakesHigherPrioritiesFirst)
+{
+    Blocker first, second;
+    ThreadPool pool(2);
+    int group = 0;
+    pool.enqueue_group(&group, task_priority::normal, [&](const cancel_token& token) { return first.Run(token); });
+    pool.enqueue_group(&group, task_priority::normal, [&](const cancel_token& token) { return second.Run(token); });
+    first.started.get_future().wait();
+    second.started.get_future().wait();
+
+    // Both workers are busy; the tasks queue up, and are run by the first worker freed
+    std::mutex orderLock;
+    std::vector<int> order;
+    auto fnRecord = [&](int value) {
+        std::lock_guard<std::mutex> lock(orderLock);
+        order.push_back(value);
+    };
+    auto low = pool.enqueue_group(&group, task_priority::low, [&](const cancel_token&) { fnRecord(-1); });
+    for (int index = 0; index < 3; index++)
+    {
+        pool.enqueue([&, index]() { fnRecord(index); });
+    }
+    pool.enqueue_group(&group, task_priority::high, [&](const cancel_token&) { fnRecord(10); });
+
+    first.release.set_value();
+    low.wait();
+    second.release.set_value();
+    pool.cancel_group(&group);
+
+    // Plain tasks are normal priority, and run in the order they came
+    ASSERT_EQ(order, std::vector<int>({ 10, 0, 1, 2, -1 }));
+}
+
+TEST(ThreadPool, CancelsGroupWithoutWaiting)
+{
+    Blocker first, second;
+    ThreadPool pool(2);
+    int group = 0;
+    int otherGroup = 0;
+    auto firstResult = pool.enqueue_group(&group, task_priority::normal, [&](const cancel_token& token) { return first.Run(token); });
+    auto secondResult = pool.enqueue_group(&otherGroup, task_priority::normal, [&](const cancel_token& token) { return second.Run(token); });
+    first.started.get_future().wait();
+    second.started.get_future().wait();
+
+    std::atomic<bool> ran = { false };
+    auto queued = pool.enqueue_group(&group, task_priority::high, [&](const cancel_token&) { ran = true; });
+    auto otherQueued = pool.enqueue_group(&otherGroup, task_priority::low, [&](const cancel_token&) { return 1; });
+
+    // The queued task is dropped at once; the running one sees its token
+    pool.cancel_group(&group);
+    ASSERT_EQ(queued.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+    ASSERT_THROW(queued.get(), std::future_error);
+    ASSERT_FALSE(firstResult.get());
+
+    // The other group carries on
+    ASSERT_FALSE(pool.group_token(&otherGroup).is_cancelled());
+    second.release.set_value();
+    ASSERT_TRUE(secondResult.get());
+    ASSERT_EQ(otherQueued.get(), 1);
+    ASSERT_FALSE(ran);
+
+    // The group starts again with a new token
+    ASSERT_FALSE(pool.group_token(&group).is_cancelled());
+    pool.cancel_group(&group);
+    pool.cancel_group(&otherGroup);
+}
+
+TEST(ThreadPool, ForgetsFinishedGroups)
+{
+    Blocker blocker;
+    ThreadPool pool(2);
+    int groups[100];
+    std::vector<std::future<void>> results;
+    for (auto& group : groups)
+    {
+        results.push_back(pool.enqueue_group(&group, task_priority::normal, [](const cancel_token&) {}));
+    }
+    for (auto& result : results)
+    {
+        result.get();
+    }
+
+    // A cancelled group's running task doesn't end the group which takes its place
+    int group = 0;
+    auto blocked = pool.enqueue_group(&group, task_priority::normal, [&](const cancel_token& token) { return blocker.Run(token); });
+    blocker.started.get_future().wait();
+    pool.cancel_group(&group);
+    Blocker next;
+    auto nextResult = pool.enqueue_group(&group, task_priority::normal, [&](const cancel_token& token) { return next.Run(token); });
+    ASSERT_FALSE(blocked.get());
+    next.started.get_future().wait();
+    ASSERT_EQ(pool.group_count(), size_t(1));
+    next.release.set_value();
+    ASSERT_TRUE(nextResult.get());
+
+    // The futures are ready before the tasks are counted out of their groups
+    for (int wait = 0; wait < 1000 && pool.group_count() != 0; wait++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_EQ(pool.group_count(), size_t(0));
+}
+
+TEST(ThreadPool, ShutsDownWhileWorkersWait)
+{
+    for (int pass = 0; pass < 200; pass++)
+    {
+        ThreadPool pool(4);
+        pool.shutdown();
+    }
+}
@@ -0,0 +1,145 @@
+#include "config_app.h"
+
+#include "zep/buffer.h"
+#include "zep/display.h"
+#include "zep/editor.h"
+#include "zep/search_highlight.h"
+#include "zep/tab_window.h"
+#include "zep/window.h"
+#include "zep/window_wrap.h"
+
+#include "benchmark.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+using namespace Zep;
+
+namespace
+{
+
+// Lines of different lengths, so some of them wrap
+std::string MakeWindowBenchmarkText(long lines)
+{
+    std::string text;
+    for (long line = 0; line < lines; line++)
+    {
+        text += "Line " + std::to_string(line) + std::string(size_t((line * 37) % 200), 'x') + "\n";
+    }
+    return text;
+}
+
+} // namespace
+
+TEST(WindowBenchmark, ScrollLargeFile)
+{
+    const long Lines = 1000000;
+    const long Frames = 2000;
+
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->InitWithText("Window Benchmark", MakeWindowBenchmarkText(Lines));
+    auto pWindow = spEditor->GetActiveTabWindow()->GetActiveWindow();
+    spEditor->SetDisplayRegion(NVec2f(0.0f, 0.0f), NVec2f(160.0f, 768.0f));
+
+    timer t;
+    timer_start(t);
+    pWindow->Display();
+    BenchmarkReport("First frame", t, 1);
+
+    // Page through the whole file; each frame moves the cursor, and the view follows it
+    timer_start(t);
+    for (long frame = 0; frame < Frames; frame++)
+    {
+        pWindow->MoveToBufferLine(frame * (Lines / Frames));
+        pWindow->Display();
+    }
+    BenchmarkReport("Scroll to the end (per frame)", t, Frames);
+
+    // Near the end of the file, where a walk from the top would cost the most
+    timer_start(t);
+    for (long frame = 0; frame < Frames; frame++)
+    {
+        pWindow->MoveToBufferLine(Lines - 1 - (frame % 100));
+        pWindow->Display();
+    }
+    BenchmarkReport("Scroll at the end (per frame)", t, Frames);
+
+    // The layout alone, without drawing the lines
+    timer_start(t);
+    for (long frame = 0; frame < Frames; frame++)
+    {
+        pWindow->UpdateLayout(true);
+    }
+    BenchmarkReport("Layout at the end (per frame)", t, Frames);
+
+    ASSERT_GT(pWindow->BufferToDisplay().y, Lines - 100);
+}
+
+TEST(WindowBenchmark, DrawSearchHighlights)
+{
+    const long Frames = 1000;
+
+    // 88 matches a line, for about 5k on the screen
+    std::string text;
+    for (long line = 0; line < 1000; line++)
+    {
+        for (long match = 0; match < 88; match++)
+        {
+            text += "ab";
+        }
+        text += "\n";
+    }
+
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->InitWithText("Window Benchmark", text);
+    auto pWindow = spEditor->GetActiveTabWindow()->GetActiveWindow();
+    spEditor->SetDisplayRegion(NVec2f(0.0f, 0.0f), NVec2f(1024.0f, 768.0f));
+    pWindow->Display();
+
+    timer t;
+    timer_start(t);
+    for (long frame = 0; frame < Frames; frame++)
+    {
+        pWindow->Display();
+    }
+    BenchmarkReport("No highlights (per frame)", t, Frames);
+
+    auto& searchHighlight = pBuffer->GetSearchHighlight();
+    searchHighlight.SetPattern("a", false, pWindow->GetVisibleBufferRange());
+    searchHighlight.Wait();
+    auto visible = pWindow->GetVisibleBufferRange();
+    const long* pMatch = nullptr;
+    const long* pMatchEnd = nullptr;
+    searchHighlight.GetMatches(visible.first, visible.second, pMatch, pMatchEnd);
+
+    timer_start(t);
+    for (long frame = 0; frame < Frames; frame++)
+    {
+        pWindow->Display();
+    }
+    BenchmarkReport(std::to_string(pMatchEnd - pMatch) + " highlights (per frame)", t, Frames);
+}
+
+TEST(WindowBenchmark, WrapEdits)
+{
+    const long Lines = 1000000;
+    const long Edits = 10000;
+
+    WindowWrap wrap;
+    WindowWrap::Line line;
+    line.height = 10.0f;
+    wrap.Assign(std::vector<WindowWrap::Line>(Lines, line));
+
+    // A line added and removed near the top, where the most lines follow it
+    timer t;
+    timer_start(t);
+    for (long edit = 0; edit < Edits; edit++)
+    {
+        wrap.Insert(edit % 100, 1, line);
+        wrap.Erase(edit % 100 + 1, 1);
+    }
+    BenchmarkReport("Insert and erase a line (per edit)", t, Edits);
+
+    ASSERT_EQ(wrap.GetLineCount(), Lines);
+    ASSERT_EQ(wrap.GetScreenLineCount(), Lines);
+}
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+
+#include "config_app.h"
+
+#include "zep/buffer.h"
+#include "zep/display.h"
+#include "zep/editor.h"
+#include "zep/search_highlight.h"
+#include "zep/tab_window.h"
+#include "zep/window.h"
+
+#include <cstring>
+
+using namespace Zep;
+
+namespace
+{
+
+// Counts the draw calls, and keeps the text drawn
+class ZepDisplayCounting : public ZepDisplayNull
+{
+public:
+    virtual void DrawChars(const NVec2f& pos, const NVec4f& col, const utf8* text_begin, const utf8* text_end = nullptr) const override
+    {
+        (void)pos;
+        (void)col;
+        drawChars++;
+        text.append((const char*)text_begin, text_end ? (const char*)text_end : (const char*)text_begin + strlen((const char*)text_begin));
+        text += "\n";
+    }
+
+    virtual void DrawRectFilled(const NRectf& a, const NVec4f& col = NVec4f(1.0f)) const override
+    {
+        (void)a;
+        (void)col;
+        drawRects++;
+    };
+
+    void Reset()
+    {
+        drawChars = 0;
+        drawRects = 0;
+        text.clear();
+    }
+
+    mutable long drawChars = 0;
+    mutable long drawRects = 0;
+    mutable std::string text;
+};
+
+} // namespace
+
+class WindowDrawTest : public testing::Test
+{
+public:
+    WindowDrawTest()
+    {
+        pDisplay = new ZepDisplayCounting();
+        spEditor = std::make_shared<ZepEditor>(pDisplay, ZEP_ROOT, ZepEditorFlags::DisableThreads);
+        pBuffer = spEditor->InitWithText("Test Buffer", "");
+        pWindow = spEditor->GetActiveTabWindow()->GetActiveWindow();
+        spEditor->SetDisplayRegion(NVec2f(0.0f, 0.0f), NVec2f(1024.0f, 1024.0f));
+
+        std::string text;
+        for (int line = 0; line < 200; line++)
+        {
+            text += "aaaaaaaa bbbbbbbb aaaaaaaa line " + std::to_string(line) + " cccccccccccccccccccc\n";
+        }
+        pBuffer->SetText(text);
+    }
+
+    void Display()
+    {
+        pWindow->Display();
+        pDisplay->Reset();
+        pWindow->Display();
+    }
+
+public:
+    std::shared_ptr<ZepEditor> spEditor;
+    ZepDisplayCounting* pDisplay;
+    ZepBuffer* pBuffer;
+    ZepWindow* pWindow;
+};
+
+TEST_F(WindowDrawTest, DrawsTextInRuns)
+{
+    Display();
+
+    auto visible = pWindow->GetVisibleBufferRange();
+    auto visibleLines = pBuffer->GetBufferLine(visible.second - 1);
+    ASSERT_GT(visibleLines, 10);
+
+    // Every line on screen was drawn whole
+    for (long line = 0; line < visibleLines; line++)
+    {
+        auto lineText = "aaaaaaaa bbbbbbbb aaaaaaaa line " + std::to_string(line) + " cccccccccccccccccccc";
+        ASSERT_NE(pDisplay->text.find(lineText), std::string::npos) << lineText;
+    }
+
+    // A run for the text, one for the line number, and a few more for the rest of the window; not one per character
+    auto visibleChars = long(visible.second - visible.first);
+    ASSERT_LT(pDisplay->drawChars * 10, visibleChars);
+}
+
+TEST_F(WindowDrawTest, MergesBackgroundRects)
+{
+    Display();
+    auto plainRects = pDisplay->drawRects;
+
+    // Every 'a' matches; each run of them gets one rect
+    auto& searchHighlight = pBuffer->GetSearchHighlight();
+    searchHighlight.SetPattern("a", false, pWindow->GetVisibleBufferRange());
+    searchHighlight.Wait();
+    Display();
+    ASSERT_LE(pDisplay->drawRects - plainRects, pWindow->GetNumDisplayedLines() * 2);
+
+    // The selection covers a whole line
+    pBuffer->SetSelection(BufferRange(0, pWindow->GetVisibleBufferRange().second));
+    Display();
+    ASSERT_LE(pDisplay->drawRects - plainRects, pWindow->GetNumDisplayedLines() * 6);
+}
+
+TEST_F(WindowDrawTest, DrawsMarkerRangesWhole)
+{
+    Display();
+    auto plainRects = pDisplay->drawRects;
+
+    // One rect a line for a marker across the whole screen
+    auto spMarker = std::make_shared<RangeMarker>();
+    spMarker->SetRange(BufferRange(0, pWindow->GetVisibleBufferRange().second));
+    spMarker->displayType = RangeMarkerDisplayType::Background;
+    pBuffer->AddRangeMarker(spMarker);
+    Display();
+    ASSERT_LE(pDisplay->drawRects - plainRects, pWindow->GetNumDisplayedLines());
+    ASSERT_GT(pDisplay->drawRects, plainRects);
+}
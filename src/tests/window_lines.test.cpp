@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+
+#include "config_app.h"
+
+#include "zep/buffer.h"
+#include "zep/display.h"
+#include "zep/editor.h"
+#include "zep/syntax.h"
+#include "zep/tab_window.h"
+#include "zep/window.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+using namespace Zep;
+
+namespace
+{
+// Only the allocations made on this thread while counting is on are counted
+thread_local bool countAllocations = false;
+thread_local long heapAllocations = 0;
+
+struct CountAllocations
+{
+    CountAllocations()
+    {
+        heapAllocations = 0;
+        countAllocations = true;
+    }
+    ~CountAllocations()
+    {
+        countAllocations = false;
+    }
+};
+} // namespace
+
+// This replaces new for the whole test binary, but is just malloc outside a measured section
+void* operator new(size_t size)
+{
+    if (countAllocations)
+    {
+        heapAllocations++;
+    }
+    if (auto pMem = std::malloc(size ? size : 1))
+    {
+        return pMem;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pMem) noexcept
+{
+    std::free(pMem);
+}
+
+TEST(WindowLines, RelayoutDoesNotAllocate)
+{
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->InitWithText("Test Buffer", "");
+    auto pWindow = spEditor->GetActiveTabWindow()->GetActiveWindow();
+    spEditor->SetDisplayRegion(NVec2f(0.0f, 0.0f), NVec2f(200.0f, 400.0f));
+
+    std::string text;
+    for (int line = 0; line < 1000; line++)
+    {
+        text += std::string(size_t((line * 37) % 400), char('a' + line % 26)) + "\n";
+    }
+    pBuffer->SetText(text);
+
+    // The first layouts grow the storage to fit the window
+    pWindow->UpdateLayout(true);
+    pWindow->UpdateLayout(true);
+    auto visible = pWindow->GetVisibleBufferRange();
+    ASSERT_GT(visible.second, visible.first);
+
+    {
+        CountAllocations count;
+        for (int layout = 0; layout < 100; layout++)
+        {
+            pWindow->UpdateLayout(true);
+        }
+    }
+    ASSERT_EQ(heapAllocations, 0);
+    ASSERT_EQ(pWindow->GetVisibleBufferRange().first, visible.first);
+    ASSERT_EQ(pWindow->GetVisibleBufferRange().second, visible.second);
+}
+
+TEST(WindowLines, SyntaxSpansDoNotAllocate)
+{
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->GetEmptyBuffer("test.cpp");
+    std::string text;
+    for (int line = 0; line < 100; line++)
+    {
+        text += "int value" + std::to_string(line) + " = (a[" + std::to_string(line) + "] + 1); // done\n";
+    }
+    pBuffer->SetText(text);
+    auto pSyntax = pBuffer->GetSyntax();
+    pSyntax->Wait();
+
+    // The first lines grow the scratch space
+    std::vector<SyntaxSpan> spans;
+    long lineStart, lineEnd;
+    size_t maxSpans = 0;
+    for (long line = 0; line < pBuffer->GetLineCount(); line++)
+    {
+        pBuffer->GetLineOffsets(line, lineStart, lineEnd);
+        pSyntax->GetSyntaxSpans(lineStart, lineEnd, spans);
+        maxSpans = std::max(maxSpans, spans.size());
+    }
+    ASSERT_GT(maxSpans, size_t(4));
+
+    {
+        CountAllocations count;
+        for (long line = 0; line < pBuffer->GetLineCount(); line++)
+        {
+            pBuffer->GetLineOffsets(line, lineStart, lineEnd);
+            pSyntax->GetSyntaxSpans(lineStart, lineEnd, spans);
+        }
+    }
+    ASSERT_EQ(heapAllocations, 0);
+}
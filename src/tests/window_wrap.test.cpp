@@ -0,0 +1,197 @@
+#include <gtest/gtest.h>
+
+#include "config_app.h"
+
+#include "zep/buffer.h"
+#include "zep/display.h"
+#include "zep/editor.h"
+#include "zep/tab_window.h"
+#include "zep/window.h"
+#include "zep/window_wrap.h"
+
+using namespace Zep;
+
+namespace
+{
+
+WindowWrap::Line MakeLine(uint32_t screenLines)
+{
+    WindowWrap::Line line;
+    line.screenLines = screenLines;
+    line.height = float(screenLines) * 10.0f;
+    return line;
+}
+
+} // namespace
+
+TEST(WindowWrap, FindsLinesFromPrefixSums)
+{
+    WindowWrap wrap;
+    wrap.Assign({ MakeLine(1), MakeLine(3), MakeLine(2), MakeLine(1) });
+    ASSERT_EQ(wrap.GetScreenLineCount(), 7);
+    ASSERT_EQ(wrap.GetHeight(), 70.0f);
+    ASSERT_EQ(wrap.GetScreenLine(2), 4);
+    ASSERT_EQ(wrap.GetLineY(3), 60.0f);
+
+    long screenLine = 3;
+    ASSERT_EQ(wrap.FindScreenLine(screenLine), 1);
+    ASSERT_EQ(screenLine, 2);
+
+    float y = 45.0f;
+    ASSERT_EQ(wrap.FindLineAtY(y), 2);
+    ASSERT_EQ(y, 5.0f);
+
+    // Past the end is the last line
+    screenLine = 100;
+    ASSERT_EQ(wrap.FindScreenLine(screenLine), 3);
+    ASSERT_EQ(screenLine, 0);
+
+    wrap.SetLine(0, MakeLine(4));
+    ASSERT_EQ(wrap.GetScreenLineCount(), 10);
+    ASSERT_EQ(wrap.GetScreenLine(3), 9);
+}
+
+TEST(WindowWrap, InsertsAndErasesLines)
+{
+    WindowWrap wrap;
+    wrap.Assign({ MakeLine(1), MakeLine(2) });
+    wrap.Insert(1, 2, MakeLine(3));
+    ASSERT_EQ(wrap.GetLineCount(), 4);
+    ASSERT_EQ(wrap.GetScreenLineCount(), 9);
+    ASSERT_EQ(wrap.GetScreenLine(3), 7);
+
+    wrap.Erase(0, 2);
+    ASSERT_EQ(wrap.GetLineCount(), 2);
+    ASSERT_EQ(wrap.GetScreenLineCount(), 5);
+    ASSERT_EQ(wrap.GetLineY(1), 30.0f);
+}
+
+// Edits across the blocks, against a plain list of lines
+TEST(WindowWrap, MatchesSimpleList)
+{
+    std::vector<uint32_t> expected(3000);
+    std::vector<WindowWrap::Line> lines;
+    for (size_t index = 0; index < expected.size(); index++)
+    {
+        expected[index] = uint32_t(index % 4) + 1;
+        lines.push_back(MakeLine(expected[index]));
+    }
+
+    WindowWrap wrap;
+    wrap.Assign(std::move(lines));
+
+    uint32_t seed = 1;
+    auto fnRandom = [&](long range) {
+        seed = seed * 1664525 + 1013904223;
+        return long((seed >> 8) % uint32_t(range));
+    };
+
+    for (int edit = 0; edit < 300; edit++)
+    {
+        auto line = fnRandom(long(expected.size()) + 1);
+        auto screenLines = uint32_t(fnRandom(3)) + 1;
+        switch (edit % 4)
+        {
+        case 0:
+        {
+            // Some big enough to split blocks, or to take several
+            auto count = fnRandom(edit % 8 == 0 ? 3000 : 20) + 1;
+            wrap.Insert(line, count, MakeLine(screenLines));
+            expected.insert(expected.begin() + line, size_t(count), screenLines);
+            break;
+        }
+        case 1:
+        {
+            auto count = std::min(fnRandom(edit % 8 == 1 ? 2000 : 20) + 1, long(expected.size()) - line);
+            wrap.Erase(line, count);
+            expected.erase(expected.begin() + line, expected.begin() + line + count);
+            break;
+        }
+        default:
+            if (line < long(expected.size()))
+            {
+                wrap.SetLine(line, MakeLine(screenLines));
+                expected[line] = screenLines;
+            }
+            break;
+        }
+
+        ASSERT_EQ(wrap.GetLineCount(), long(expected.size())) << "Edit " << edit;
+        long screenLine = 0;
+        for (long index = 0; index < long(expected.size()); index += 37)
+        {
+            ASSERT_EQ(wrap.GetLine(index).screenLines, expected[index]);
+        }
+        for (long index = 0; index < long(expected.size()); index++)
+        {
+            if (index % 37 == 0)
+            {
+                ASSERT_EQ(wrap.GetScreenLine(index), screenLine) << "Edit " << edit;
+                ASSERT_EQ(wrap.GetLineY(index), float(screenLine) * 10.0f);
+
+                auto find = screenLine + long(expected[index]) - 1;
+                ASSERT_EQ(wrap.FindScreenLine(find), index);
+                ASSERT_EQ(find, long(expected[index]) - 1);
+
+                auto y = float(screenLine) * 10.0f + 5.0f;
+                ASSERT_EQ(wrap.FindLineAtY(y), index);
+            }
+            screenLine += long(expected[index]);
+        }
+        ASSERT_EQ(wrap.GetScreenLineCount(), screenLine);
+    }
+}
+
+// Edits only rewrap the lines they touch; the result should match wrapping the whole buffer again
+TEST(WindowWrap, EditsMatchFullRewrap)
+{
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->InitWithText("Test Buffer", "");
+    auto pWindow = spEditor->GetActiveTabWindow()->GetActiveWindow();
+
+    // Narrow, so long lines wrap
+    spEditor->SetDisplayRegion(NVec2f(0.0f, 0.0f), NVec2f(80.0f, 200.0f));
+
+    std::string text;
+    for (int line = 0; line < 200; line++)
+    {
+        text += std::string(size_t((line * 37) % 150), char('a' + line % 26)) + "\n";
+    }
+    pBuffer->SetText(text);
+    ASSERT_GT(pWindow->BufferToDisplay(pBuffer->EndLocation()).y, pBuffer->GetLineCount());
+
+    auto fnDisplayed = [&]() {
+        std::vector<NVec2i> displayed;
+        for (long offset = 0; offset < long(pBuffer->GetText().size()); offset++)
+        {
+            displayed.push_back(pWindow->BufferToDisplay(offset));
+        }
+        return displayed;
+    };
+
+    uint32_t seed = 1;
+    auto fnRandom = [&](long range) {
+        seed = seed * 1664525 + 1013904223;
+        return long((seed >> 8) % uint32_t(range));
+    };
+
+    for (int edit = 0; edit < 50; edit++)
+    {
+        auto size = long(pBuffer->GetText().size()) - 1;
+        auto start = fnRandom(size);
+        if (edit % 3 == 0)
+        {
+            pBuffer->Delete(start, std::min(size, start + fnRandom(200)));
+        }
+        else
+        {
+            auto insert = std::string(size_t(fnRandom(120)), 'x');
+            insert.insert(size_t(fnRandom(long(insert.size()) + 1)), "\n");
+            pBuffer->Insert(start, insert);
+        }
+
+        auto incremental = fnDisplayed();
+        pWindow->SetBuffer(pBuffer);
+        ASSERT_EQ(incremental, fnDisplayed()) << "Edit " << edit;
+    }
+}
@@ -0,0 +1,423 @@
+#include "zep/text_regex.h"
+#include "zep/text_scan.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace Zep
+{
+
+namespace
+{
+
+const uint8_t NewLine = '\n';
+
+// Recently compiled patterns; the most recently used last
+const size_t MaxCachedRegex = 16;
+struct CachedRegex
+{
+    std::string pattern;
+    uint32_t flags;
+    std::shared_ptr<const TextRegex> spRegex;
+};
+std::mutex cacheLock;
+std::vector<CachedRegex> cache;
+
+// The end of the text; the terminating 0 of a buffer isn't part of it
+long TextEnd(const TextStorage<uint8_t>& text)
+{
+    auto end = long(text.size());
+    if (end > 0 && text[end - 1] == 0)
+    {
+        end--;
+    }
+    return end;
+}
+
+void AppendText(const TextStorage<uint8_t>& text, long first, long last, std::string& str)
+{
+    text.ForEachSegment(size_t(first), size_t(last), [&](const uint8_t* pData, size_t count, size_t) {
+        str.append((const char*)pData, count);
+        return true;
+    });
+}
+
+// The longest run of plain characters in the pattern that every match must contain; outside of any group, and not
+// made optional by a quantifier.  Any alternation at the top level means there isn't one
+void FindLiteral(const std::string& pattern, std::string& literal, bool& literalOnly)
+{
+    literal.clear();
+    literalOnly = !pattern.empty();
+
+    std::string run;
+    auto fnEndRun = [&]() {
+        if (run.size() > literal.size())
+        {
+            literal = run;
+        }
+        run.clear();
+    };
+
+    int depth = 0;
+    for (size_t index = 0; index < pattern.size(); index++)
+    {
+        auto ch = pattern[index];
+        bool isLiteral = false;
+        if (ch == '\\' && (index + 1) < pattern.size())
+        {
+            // Escaped punctuation is itself; escaped letters and digits are classes, anchors or back references
+            ch = pattern[++index];
+            isLiteral = !std::isalnum((unsigned char)ch);
+        }
+        else if (ch == '[')
+        {
+            // Skip the class; a ] straight after the [ (or [^) is part of it
+            index++;
+            if (index < pattern.size() && pattern[index] == '^')
+            {
+                index++;
+            }
+            if (index < pattern.size() && pattern[index] == ']')
+            {
+                index++;
+            }
+            while (index < pattern.size() && pattern[index] != ']')
+            {
+                index += (pattern[index] == '\\') ? 2 : 1;
+            }
+        }
+        else if (ch == '(')
+        {
+            depth++;
+        }
+        else if (ch == ')')
+        {
+            depth--;
+        }
+        else if (ch == '|' && depth == 0)
+        {
+            literal.clear();
+            literalOnly = false;
+            return;
+        }
+        else if (ch == '{')
+        {
+            // A {m,n} quantifier; its digits aren't text to match
+            while (index < pattern.size() && pattern[index] != '}')
+            {
+                index++;
+            }
+        }
+        else
+        {
+            isLiteral = std::string(".^$|}*+?").find(ch) == std::string::npos;
+        }
+
+        if (!isLiteral || depth != 0)
+        {
+            literalOnly = false;
+            fnEndRun();
+            continue;
+        }
+
+        // A quantifier can make this character optional, or repeat it
+        auto next = (index + 1) < pattern.size() ? pattern[index + 1] : 0;
+        if (next == '*' || next == '?' || next == '{')
+        {
+            literalOnly = false;
+            fnEndRun();
+        }
+        else if (next == '+')
+        {
+            literalOnly = false;
+            run.push_back(ch);
+            fnEndRun();
+        }
+        else
+        {
+            run.push_back(ch);
+        }
+    }
+    fnEndRun();
+
+    literalOnly = literalOnly && !literal.empty();
+}
+
+// Call fn(pLine, pLineEnd, lineStart) for each line starting before last, beginning with the one holding first.
+// The lines don't include the '\n'.  Only lines containing the literal are visited
+template <class F>
+void ForEachLine(const TextStorage<uint8_t>& text, long first, long last, const TextRegex& regex, F fn)
+{
+    auto textEnd = TextEnd(text);
+    last = std::min(last, textEnd);
+    if (first >= last)
+    {
+        return;
+    }
+
+    // Back to the start of the line
+    size_t pos = 0;
+    if (first > 0)
+    {
+        auto found = text.rfind(0, size_t(first), &NewLine, 1);
+        pos = (found == size_t(first)) ? 0 : found + 1;
+    }
+
+    auto pLiteral = (const uint8_t*)regex.literal.data();
+    auto literalCount = regex.literal.size();
+
+    std::vector<uint8_t> copy;
+    const uint8_t* pSegment;
+    size_t segmentStart;
+    size_t segmentLength;
+    while (long(pos) < last)
+    {
+        if (literalCount != 0)
+        {
+            // On to the line with the next literal in it
+            auto found = text.find(pos, size_t(textEnd), pLiteral, literalCount, regex.ignoreCase);
+            if (found == size_t(textEnd))
+            {
+                return;
+            }
+
+            auto lineStart = text.rfind(pos, found, &NewLine, 1);
+            pos = (lineStart == found) ? pos : lineStart + 1;
+            if (long(pos) >= last)
+            {
+                return;
+            }
+        }
+
+        text.GetSegment(pos, pSegment, segmentStart, segmentLength);
+        auto runEnd = std::min(segmentStart + segmentLength, size_t(textEnd));
+        auto pLine = pSegment + (pos - segmentStart);
+        auto pRunEnd = pSegment + (runEnd - segmentStart);
+        auto pFound = TextScanFindFirstOf(pLine, pRunEnd, &NewLine, 1);
+
+        size_t lineEnd;
+        bool more;
+        if (pFound != pRunEnd || runEnd == size_t(textEnd))
+        {
+            // The line is all in this run
+            lineEnd = pos + size_t(pFound - pLine);
+            more = fn(pLine, pFound, long(pos));
+        }
+        else
+        {
+            // The line carries on into the next run; copy it
+            lineEnd = text.find(runEnd, size_t(textEnd), &NewLine, 1);
+            copy.clear();
+            text.ForEachSegment(pos, lineEnd, [&](const uint8_t* pData, size_t count, size_t) {
+                copy.insert(copy.end(), pData, pData + count);
+                return true;
+            });
+            more = fn(copy.data(), copy.data() + copy.size(), long(pos));
+        }
+
+        if (!more)
+        {
+            return;
+        }
+        pos = lineEnd + 1;
+    }
+}
+
+} // namespace
+
+std::shared_ptr<const TextRegex> RegexCompile(const std::string& pattern, uint32_t flags)
+{
+    std::lock_guard<std::mutex> lock(cacheLock);
+    for (auto itr = cache.begin(); itr != cache.end(); itr++)
+    {
+        if (itr->flags == flags && itr->pattern == pattern)
+        {
+            std::rotate(itr, itr + 1, cache.end());
+            return cache.back().spRegex;
+        }
+    }
+
+    auto syntax = std::regex::ECMAScript | std::regex::optimize;
+    if (flags & RegexFlags::IgnoreCase)
+    {
+        syntax |= std::regex::icase;
+    }
+
+    auto spRegex = std::make_shared<TextRegex>();
+    try
+    {
+        spRegex->regex = std::regex(pattern, syntax);
+    }
+    catch (std::regex_error&)
+    {
+        return nullptr;
+    }
+    spRegex->ignoreCase = (flags & RegexFlags::IgnoreCase) != 0;
+    FindLiteral(pattern, spRegex->literal, spRegex->literalOnly);
+
+    if (cache.size() >= MaxCachedRegex)
+    {
+        cache.erase(cache.begin());
+    }
+    cache.push_back(CachedRegex{ pattern, flags, spRegex });
+    return spRegex;
+}
+
+void RegexForEachMatch(const TextStorage<uint8_t>& text, long first, long last, const TextRegex& regex, const RegexMatchCallback& fn)
+{
+    if (regex.literalOnly)
+    {
+        // Find the literal; the regex only fills in the match
+        auto textEnd = size_t(TextEnd(text));
+        auto pLiteral = (const uint8_t*)regex.literal.data();
+        auto literalCount = regex.literal.size();
+        auto end = std::min(textEnd, size_t(std::max(0l, last)) + literalCount - 1);
+
+        std::vector<char> copy;
+        std::cmatch match;
+        const uint8_t* pSegment;
+        size_t segmentStart;
+        size_t segmentLength;
+        for (auto pos = size_t(std::max(0l, first)); pos < end;)
+        {
+            auto found = text.find(pos, end, pLiteral, literalCount, regex.ignoreCase);
+            if (found == end)
+            {
+                return;
+            }
+
+            const char* pMatch;
+            text.GetSegment(found, pSegment, segmentStart, segmentLength);
+            if ((found + literalCount) <= (segmentStart + segmentLength))
+            {
+                pMatch = (const char*)pSegment + (found - segmentStart);
+            }
+            else
+            {
+                copy.assign(text.begin() + found, text.begin() + found + literalCount);
+                pMatch = copy.data();
+            }
+
+            if (!std::regex_match(pMatch, pMatch + literalCount, match, regex.regex) || !fn(match, long(found)))
+            {
+                return;
+            }
+            pos = found + literalCount;
+        }
+        return;
+    }
+
+    ForEachLine(text, first, last, regex, [&](const uint8_t* pLine, const uint8_t* pLineEnd, long lineStart) {
+        auto pBegin = (const char*)pLine;
+        auto pEnd = (const char*)pLineEnd;
+        auto pSearch = pBegin;
+        auto flags = std::regex_constants::match_default;
+        std::cmatch match;
+        while (std::regex_search(pSearch, pEnd, match, regex.regex, flags))
+        {
+            auto offset = lineStart + long(match[0].first - pBegin);
+            if (offset >= last)
+            {
+                return false;
+            }
+            if (offset >= first && !fn(match, offset))
+            {
+                return false;
+            }
+
+            // Step over an empty match, so it isn't found again
+            pSearch = match[0].second;
+            if (match.length(0) == 0)
+            {
+                if (pSearch == pEnd)
+                {
+                    break;
+                }
+                pSearch++;
+            }
+
+            // There is always a character before the search now; so ^ won't match, and \b looks at it
+            flags = std::regex_constants::match_prev_avail;
+        }
+        return true;
+    });
+}
+
+void RegexAppendReplacement(std::string& str, const std::cmatch& match, const std::string& replacement)
+{
+    for (size_t index = 0; index < replacement.size(); index++)
+    {
+        auto ch = replacement[index];
+        if (ch == '&')
+        {
+            str.append(match[0].first, match[0].second);
+        }
+        else if (ch == '\\' && (index + 1) < replacement.size())
+        {
+            ch = replacement[++index];
+            if (ch >= '0' && ch <= '9')
+            {
+                auto group = size_t(ch - '0');
+                if (group < match.size() && match[group].matched)
+                {
+                    str.append(match[group].first, match[group].second);
+                }
+            }
+            else if (ch == 'n' || ch == 'r')
+            {
+                str.push_back('\n');
+            }
+            else
+            {
+                str.push_back(ch);
+            }
+        }
+        else
+        {
+            str.push_back(ch);
+        }
+    }
+}
+
+RegexReplaceResult RegexReplace(const TextStorage<uint8_t>& text, long first, long last, const TextRegex& regex, const std::string& replacement, bool global)
+{
+    RegexReplaceResult result;
+    auto textEnd = TextEnd(text);
+    long skipUntil = 0;
+
+    RegexForEachMatch(text, first, last, regex, [&](const std::cmatch& match, long offset) {
+        // Only the first match on a line, unless global
+        if (offset < skipUntil)
+        {
+            return true;
+        }
+
+        if (result.count == 0)
+        {
+            result.first = offset;
+        }
+        else
+        {
+            // The text between this match and the last one stays the same
+            AppendText(text, result.last, offset, result.text);
+        }
+
+        result.lastReplacement = result.first + long(result.text.size());
+        RegexAppendReplacement(result.text, match, replacement);
+        result.last = offset + long(match.length(0));
+        result.count++;
+
+        if (!global)
+        {
+            skipUntil = long(text.find(size_t(result.last), size_t(textEnd), &NewLine, 1));
+        }
+        return true;
+    });
+
+    return result;
+}
+
+} // namespace Zep
@@ -0,0 +1,610 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "zep/text_scan.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ZEP_SCAN_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang need the AVX2 functions marked, since the rest of the code isn't built for AVX2
+#if defined(ZEP_SCAN_X86) && (defined(__GNUC__) || defined(__clang__))
+#define ZEP_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define ZEP_TARGET_AVX2
+#endif
+
+namespace Zep
+{
+
+namespace
+{
+
+inline uint32_t CountTrailingZeros(uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return uint32_t(index);
+#else
+    return uint32_t(__builtin_ctz(mask));
+#endif
+}
+
+inline uint32_t CountLeadingZeros(uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return 31 - uint32_t(index);
+#else
+    return uint32_t(__builtin_clz(mask));
+#endif
+}
+
+// ASCII only; other bytes are left alone
+inline uint8_t FoldCase(uint8_t ch)
+{
+    return (ch >= 'A' && ch <= 'Z') ? uint8_t(ch + ('a' - 'A')) : ch;
+}
+
+inline uint8_t OtherCase(uint8_t ch)
+{
+    if (ch >= 'a' && ch <= 'z')
+    {
+        return uint8_t(ch - ('a' - 'A'));
+    }
+    return FoldCase(ch);
+}
+
+inline bool MatchAt(const uint8_t* pText, const uint8_t* pNeedle, size_t count, bool ignoreCase)
+{
+    if (!ignoreCase)
+    {
+        return memcmp(pText, pNeedle, count) == 0;
+    }
+
+    for (size_t index = 0; index < count; index++)
+    {
+        if (FoldCase(pText[index]) != FoldCase(pNeedle[index]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Try every position; used for the ends of the vector searches
+const uint8_t* FindStringNaive(const uint8_t* pStart, const uint8_t* pEnd, const uint8_t* pNeedle, size_t count, bool ignoreCase)
+{
+    for (auto p = pStart; p + count <= pEnd; p++)
+    {
+        if (MatchAt(p, pNeedle, count, ignoreCase))
+        {
+            return p;
+        }
+    }
+    return pEnd;
+}
+
+const uint8_t* FindStringNaiveReverse(const uint8_t* pStart, const uint8_t* pEnd, const uint8_t* pNeedle, size_t count, bool ignoreCase)
+{
+    if (size_t(pEnd - pStart) < count)
+    {
+        return pEnd;
+    }
+
+    for (auto p = pEnd - count;; p--)
+    {
+        if (MatchAt(p, pNeedle, count, ignoreCase))
+        {
+            return p;
+        }
+        if (p == pStart)
+        {
+            break;
+        }
+    }
+    return pEnd;
+}
+
+// Scalar versions; also used for the tails of the vector versions
+uint32_t ScanLinesScalar(const uint8_t* pData, size_t count, long base, std::vector<long>& lineEnds)
+{
+    uint32_t flags = TextScanFlags::None;
+    for (size_t index = 0; index < count; index++)
+    {
+        switch (pData[index])
+        {
+        case '\n':
+            lineEnds.push_back(base + long(index) + 1);
+            break;
+        case '\r':
+            flags |= TextScanFlags::HasCR;
+            break;
+        case '\t':
+            flags |= TextScanFlags::HasTab;
+            break;
+        default:
+            break;
+        }
+    }
+    return flags;
+}
+
+const uint8_t* FindFirstOfScalar(const uint8_t* pStart, const uint8_t* pEnd, const uint8_t* pSet, size_t setCount)
+{
+    if (setCount == 1)
+    {
+        auto pFound = (const uint8_t*)memchr(pStart, pSet[0], pEnd - pStart);
+        return pFound ? pFound : pEnd;
+    }
+
+    for (; pStart < pEnd; pStart++)
+    {
+        for (size_t index = 0; index < setCount; index++)
+        {
+            if (*pStart == pSet[index])
+            {
+                return pStart;
+            }
+        }
+    }
+    return pEnd;
+}
+
+// Boyer-Moore-Horspool; the text under the last character of the needle decides how far to move
+const uint8_t* FindStringScalar(const uint8_t* pStart, const uint8_t* pEnd, const uint8_t* pNeedle, size_t count, bool ignoreCase)
+{
+    auto size = size_t(pEnd - pStart);
+    if (size < count)
+    {
+        return pEnd;
+    }
+
+    size_t shift[256];
+    std::fill(shift, shift + 256, count);
+    for (size_t index = 0; index + 1 < count; index++)
+    {
+        shift[pNeedle[index]] = count - 1 - index;
+        if (ignoreCase)
+        {
+            shift[OtherCase(pNeedle[index])] = count - 1 - index;
+        }
+    }
+
+    for (size_t pos = 0; pos + count <= size; pos += shift[pStart[pos + count - 1]])
+    {
+        if (MatchAt(pStart + pos, pNeedle, count, ignoreCase))
+        {
+            return pStart + pos;
+        }
+    }
+    return pEnd;
+}
+
+// Horspool backwards; the text under the first character of the needle decides how far to move
+const uint8_t* FindStringReverseScalar(const uint8_t* pStart, const uint8_t* pEnd, const uint8_t* pNeedle, size_t count, bool ignoreCase)
+{
+    auto size = size_t(pEnd - pStart);
+    if (size < count)
+    {
+        return pEnd;
+    }
+
+    size_t shift[256];
+    std::fill(shift, shift + 256, count);
+    for (size_t index = count - 1; index > 0; index--)
+    {
+        shift[pNeedle[index]] = index;
+        if (ignoreCase)
+        {
+            shift[OtherCase(pNeedle[index])] = index;
+        }
+    }
+
+    for (size_t pos = size - count;;)
+    {
+        if (MatchAt(pStart + pos, pNeedle, count, ignoreCase))
+        {
+            return pStart + pos;
+        }
+
+        auto step = shift[pStart[pos]];
+        if (pos < step)
+        {
+            break;
+        }
+        pos -= step;
+    }
+    return pEnd;
+}
+
+#ifdef ZEP_SCAN_X86
+
+uint32_t ScanLinesSSE2(const uint8_t* pData, size_t count, long base, std::vector<long>& lineEnds)
+{
+    const auto newLine = _mm_set1_epi8('\n');
+    const auto cr = _mm_set1_epi8('\r');
+    const auto tab = _mm_set1_epi8('\t');
+
+    uint32_t crMask = 0;
+    uint32_t tabMask = 0;
+    size_t index = 0;
+    for (; index + 16 <= count; index += 16)
+    {
+        auto block = _mm_loadu_si128((const __m128i*)(pData + index));
+        crMask |= uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(block, cr)));
+        tabMask |= uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(block, tab)));
+        auto lineMask = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newLine)));
+        while (lineMask)
+        {
+            lineEnds.push_back(base + long(index + CountTrailingZeros(lineMask)) + 1);
+            lineMask &= lineMask - 1;
+        }
+    }
+
+    uint32_t flags = (crMask ? TextScanFlags::HasCR : 0) | (tabMask ? TextScanFlags::HasTab : 0);
+    return flags | ScanLinesScalar(pData + index, count - index, base + long(index), lineEnds);
+}
+
+const uint8_t* FindFirstOfSSE2(const uint8_t* pStart, const uint8_t* pEnd, const uint8_t* pSet, size_t setCount)
+{
+    __m128i set[MaxTextScanSet];
+    for (size_t index = 0; index < setCount; index++)
+    {
+        set[index] = _mm_set1_epi8(char(pSet[index]));
+    }
+
+    for (; pStart + 16 <= pEnd; pStart += 16)
+    {
+        auto block = _mm_loadu_si128((const __m128i*)pStart);
+        auto match = _mm_setzero_si128();
+        for (size_t index = 0; index < setCount; index++)
+        {
+            match = _mm_or_si128(match, _mm_cmpeq_epi8(block, set[index]));
+        }
+        auto mask = uint32_t(_mm_movemask_epi8(match));
+        if (mask)
+        {
+            return pStart + CountTrailingZeros(mask);
+        }
+    }
+    return FindFirstOfScalar(pStart, pEnd, pSet, setCount);
+}
+
+ZEP_TARGET_AVX2 uint32_t ScanLinesAVX2(const uint8_t* pData, size_t count, long base, std::vector<long>& lineEnds)
+{
+    const auto newLine = _mm256_set1_epi8('\n');
+    const auto cr = _mm256_set1_epi8('\r');
+    const auto tab = _mm256_set1_epi8('\t');
+
+    uint32_t crMask = 0;
+    uint32_t tabMask = 0;
+    size_t index = 0;
+    for (; index + 32 <= count; index += 32)
+    {
+        auto block = _mm256_loadu_si256((const __m256i*)(pData + index));
+        crMask |= uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, cr)));
+        tabMask |= uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, tab)));
+        auto lineMask = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newLine)));
+        while (lineMask)
+        {
+            lineEnds.push_back(base + long(index + CountTrailingZeros(lineMask)) + 1);
+            lineMask &= lineMask - 1;
+        }
+    }
+
+    uint32_t flags = (crMask ? TextScanFlags::HasCR : 0) | (tabMask ? TextScanFlags::HasTab : 0);
+    return flags | ScanLinesScalar(pData + index, count - index, base + long(index), lineEnds);
+}
+
+ZEP_TARGET_AVX2 const uint8_t* FindFirstOfAVX2(const uint8_t* pStart, const uint8_t* pEnd, const uint8_t* pSet, size_t setCount)
+{
+    __m256i set[MaxTextScanSet];
+    for (size_t index = 0; index < setCount; index++)
+    {
+        set[index] = _mm256_set1_epi8(char(pSet[index]));
+    }
+
+    for (; pStart + 32 <= pEnd; pStart += 32)
+    {
+        auto block = _mm256_loadu_si256((const __m256i*)pStart);
+        auto match = _mm256_setzero_si256();
+        for (size_t index = 0; index < setCount; index++)
+        {
+            match = _mm256_or_si256(match, _mm256_cmpeq_epi8(block, set[index]));
+        }
+        auto mask = uint32_t(_mm256_movemask_epi8(match));
+        if (mask)
+        {
+            return pStart + CountTrailingZeros(mask);
+        }
+    }
+    return FindFirstOfScalar(pStart, pEnd, pSet, setCount);
+}
+
+// Candidates are the positions where both the first and the last character of the needle match;
+// only those are compared in full
+const uint8_t* FindStringSSE2(const uint8_t* pStart, const uint8_t* pEnd, const uint8_t* pNeedle, size_t count, bool ignoreCase)
+{
+    const auto first = _mm_set1_epi8(char(pNeedle[0]));
+    const auto firstOther = _mm_set1_epi8(char(ignoreCase ? OtherCase(pNeedle[0]) : pNeedle[0]));
+    const auto last = _mm_set1_epi8(char(pNeedle[count - 1]));
+    const auto lastOther = _mm_set1_epi8(char(ignoreCase ? OtherCase(pNeedle[count - 1]) : pNeedle[count - 1]));
+
+    auto size = size_t(pEnd - pStart);
+    size_t pos = 0;
+    for (; pos + 16 + count - 1 <= size; pos += 16)
+    {
+        auto blockFirst = _mm_loadu_si128((const __m128i*)(pStart + pos));
+        auto blockLast = _mm_loadu_si128((const __m128i*)(pStart + pos + count - 1));
+        auto matchFirst = _mm_or_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockFirst, firstOther));
+        auto matchLast = _mm_or_si128(_mm_cmpeq_epi8(blockLast, last), _mm_cmpeq_epi8(blockLast, lastOther));
+        auto mask = uint32_t(_mm_movemask_epi8(_mm_and_si128(matchFirst, matchLast)));
+        while (mask)
+        {
+            auto p = pStart + pos + CountTrailingZeros(mask);
+            if (MatchAt(p, pNeedle, count, ignoreCase))
+            {
+                return p;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return FindStringNaive(pStart + pos, pEnd, pNeedle, count, ignoreCase);
+}
+
+const uint8_t* FindStringReverseSSE2(const uint8_t* pStart, const uint8_t* pEnd, const uint8_t* pNeedle, size_t count, bool ignoreCase)
+{
+    auto size = size_t(pEnd - pStart);
+    if (size < count)
+    {
+        return pEnd;
+    }
+
+    const auto first = _mm_set1_epi8(char(pNeedle[0]));
+    const auto firstOther = _mm_set1_epi8(char(ignoreCase ? OtherCase(pNeedle[0]) : pNeedle[0]));
+    const auto last = _mm_set1_epi8(char(pNeedle[count - 1]));
+    const auto lastOther = _mm_set1_epi8(char(ignoreCase ? OtherCase(pNeedle[count - 1]) : pNeedle[count - 1]));
+
+    // Walk back through the possible start positions, a block at a time
+    auto starts = size - count + 1;
+    while (starts >= 16)
+    {
+        auto pos = starts - 16;
+        auto blockFirst = _mm_loadu_si128((const __m128i*)(pStart + pos));
+        auto blockLast = _mm_loadu_si128((const __m128i*)(pStart + pos + count - 1));
+        auto matchFirst = _mm_or_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockFirst, firstOther));
+        auto matchLast = _mm_or_si128(_mm_cmpeq_epi8(blockLast, last), _mm_cmpeq_epi8(blockLast, lastOther));
+        auto mask = uint32_t(_mm_movemask_epi8(_mm_and_si128(matchFirst, matchLast)));
+        while (mask)
+        {
+            auto bit = 31 - CountLeadingZeros(mask);
+            auto p = pStart + pos + bit;
+            if (MatchAt(p, pNeedle, count, ignoreCase))
+            {
+                return p;
+            }
+            mask &= ~(1u << bit);
+        }
+        starts = pos;
+    }
+
+    auto pHeadEnd = pStart + starts + count - 1;
+    auto pFound = FindStringNaiveReverse(pStart, pHeadEnd, pNeedle, count, ignoreCase);
+    return pFound == pHeadEnd ? pEnd : pFound;
+}
+// Candidates are the positions where both the first and the last character of the needle match;
+// only those are compared in full
+ZEP_TARGET_AVX2 const uint8_t* FindStringAVX2(const uint8_t* pStart, const uint8_t* pEnd, const uint8_t* pNeedle, size_t count, bool ignoreCase)
+{
+    const auto first = _mm256_set1_epi8(char(pNeedle[0]));
+    const auto firstOther = _mm256_set1_epi8(char(ignoreCase ? OtherCase(pNeedle[0]) : pNeedle[0]));
+    const auto last = _mm256_set1_epi8(char(pNeedle[count - 1]));
+    const auto lastOther = _mm256_set1_epi8(char(ignoreCase ? OtherCase(pNeedle[count - 1]) : pNeedle[count - 1]));
+
+    auto size = size_t(pEnd - pStart);
+    size_t pos = 0;
+    for (; pos + 32 + count - 1 <= size; pos += 32)
+    {
+        auto blockFirst = _mm256_loadu_si256((const __m256i*)(pStart + pos));
+        auto blockLast = _mm256_loadu_si256((const __m256i*)(pStart + pos + count - 1));
+        auto matchFirst = _mm256_or_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockFirst, firstOther));
+        auto matchLast = _mm256_or_si256(_mm256_cmpeq_epi8(blockLast, last), _mm256_cmpeq_epi8(blockLast, lastOther));
+        auto mask = uint32_t(_mm256_movemask_epi8(_mm256_and_si256(matchFirst, matchLast)));
+        while (mask)
+        {
+            auto p = pStart + pos + CountTrailingZeros(mask);
+            if (MatchAt(p, pNeedle, count, ignoreCase))
+            {
+                return p;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return FindStringNaive(pStart + pos, pEnd, pNeedle, count, ignoreCase);
+}
+
+ZEP_TARGET_AVX2 const uint8_t* FindStringReverseAVX2(const uint8_t* pStart, const uint8_t* pEnd, const uint8_t* pNeedle, size_t count, bool ignoreCase)
+{
+    auto size = size_t(pEnd - pStart);
+    if (size < count)
+    {
+        return pEnd;
+    }
+
+    const auto first = _mm256_set1_epi8(char(pNeedle[0]));
+    const auto firstOther = _mm256_set1_epi8(char(ignoreCase ? OtherCase(pNeedle[0]) : pNeedle[0]));
+    const auto last = _mm256_set1_epi8(char(pNeedle[count - 1]));
+    const auto lastOther = _mm256_set1_epi8(char(ignoreCase ? OtherCase(pNeedle[count - 1]) : pNeedle[count - 1]));
+
+    // Walk back through the possible start positions, a block at a time
+    auto starts = size - count + 1;
+    while (starts >= 32)
+    {
+        auto pos = starts - 32;
+        auto blockFirst = _mm256_loadu_si256((const __m256i*)(pStart + pos));
+        auto blockLast = _mm256_loadu_si256((const __m256i*)(pStart + pos + count - 1));
+        auto matchFirst = _mm256_or_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockFirst, firstOther));
+        auto matchLast = _mm256_or_si256(_mm256_cmpeq_epi8(blockLast, last), _mm256_cmpeq_epi8(blockLast, lastOther));
+        auto mask = uint32_t(_mm256_movemask_epi8(_mm256_and_si256(matchFirst, matchLast)));
+        while (mask)
+        {
+            auto bit = 31 - CountLeadingZeros(mask);
+            auto p = pStart + pos + bit;
+            if (MatchAt(p, pNeedle, count, ignoreCase))
+            {
+                return p;
+            }
+            mask &= ~(1u << bit);
+        }
+        starts = pos;
+    }
+
+    auto pHeadEnd = pStart + starts + count - 1;
+    auto pFound = FindStringNaiveReverse(pStart, pHeadEnd, pNeedle, count, ignoreCase);
+    return pFound == pHeadEnd ? pEnd : pFound;
+}
+
+bool CPUHasAVX2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+    // The OS must save the YMM registers too
+    __cpuid(info, 1);
+    bool osSavesYMM = (info[2] & (1 << 27)) && ((_xgetbv(0) & 6) == 6);
+    __cpuidex(info, 7, 0);
+    return osSavesYMM && (info[1] & (1 << 5));
+#elif defined(__GNUC__) || defined(__clang__)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+#endif // ZEP_SCAN_X86
+
+struct TextScanKernels
+{
+    TextScanLevel level;
+    uint32_t (*scanLines)(const uint8_t*, size_t, long, std::vector<long>&);
+    const uint8_t* (*findFirstOf)(const uint8_t*, const uint8_t*, const uint8_t*, size_t);
+    const uint8_t* (*findString)(const uint8_t*, const uint8_t*, const uint8_t*, size_t, bool);
+    const uint8_t* (*findStringReverse)(const uint8_t*, const uint8_t*, const uint8_t*, size_t, bool);
+};
+
+const TextScanKernels& GetKernels(TextScanLevel level)
+{
+    static const TextScanKernels scalar = { TextScanLevel::Scalar, &ScanLinesScalar, &FindFirstOfScalar, &FindStringScalar, &FindStringReverseScalar };
+#ifdef ZEP_SCAN_X86
+    static const TextScanKernels sse2 = { TextScanLevel::SSE2, &ScanLinesSSE2, &FindFirstOfSSE2, &FindStringSSE2, &FindStringReverseSSE2 };
+    static const TextScanKernels avx2 = { TextScanLevel::AVX2, &ScanLinesAVX2, &FindFirstOfAVX2, &FindStringAVX2, &FindStringReverseAVX2 };
+    switch (level)
+    {
+    case TextScanLevel::AVX2:
+        return avx2;
+    case TextScanLevel::SSE2:
+        return sse2;
+    default:
+        break;
+    }
+#else
+    (void)level;
+#endif
+    return scalar;
+}
+
+std::atomic<const TextScanKernels*> CurrentKernels{ nullptr };
+
+const TextScanKernels& Kernels()
+{
+    auto pKernels = CurrentKernels.load(std::memory_order_relaxed);
+    if (!pKernels)
+    {
+        pKernels = &GetKernels(TextScanGetSupportedLevel());
+        CurrentKernels.store(pKernels, std::memory_order_relaxed);
+    }
+    return *pKernels;
+}
+
+} // namespace
+
+TextScanLevel TextScanGetSupportedLevel()
+{
+#ifdef ZEP_SCAN_X86
+    static const TextScanLevel supported = CPUHasAVX2() ? TextScanLevel::AVX2 : TextScanLevel::SSE2;
+    return supported;
+#else
+    return TextScanLevel::Scalar;
+#endif
+}
+
+TextScanLevel TextScanGetLevel()
+{
+    return Kernels().level;
+}
+
+void TextScanSetLevel(TextScanLevel level)
+{
+    level = std::min(level, TextScanGetSupportedLevel());
+    CurrentKernels.store(&GetKernels(level), std::memory_order_relaxed);
+}
+
+const char* TextScanLevelName(TextScanLevel level)
+{
+    switch (level)
+    {
+    case TextScanLevel::AVX2:
+        return "AVX2";
+    case TextScanLevel::SSE2:
+        return "SSE2";
+    default:
+        return "Scalar";
+    }
+}
+
+uint32_t TextScanLines(const uint8_t* pData, size_t count, long base, std::vector<long>& lineEnds)
+{
+    return Kernels().scanLines(pData, count, base, lineEnds);
+}
+
+const uint8_t* TextScanFindFirstOf(const uint8_t* pStart, const uint8_t* pEnd, const uint8_t* pSet, size_t setCount)
+{
+    if (setCount == 0 || pStart >= pEnd)
+    {
+        return pEnd;
+    }
+    return Kernels().findFirstOf(pStart, pEnd, pSet, setCount);
+}
+
+const uint8_t* TextScanFindString(const uint8_t* pStart, const uint8_t* pEnd, const uint8_t* pNeedle, size_t count, bool ignoreCase)
+{
+    if (count == 0 || size_t(pEnd - pStart) < count)
+    {
+        return pEnd;
+    }
+    return Kernels().findString(pStart, pEnd, pNeedle, count, ignoreCase);
+}
+
+const uint8_t* TextScanFindStringReverse(const uint8_t* pStart, const uint8_t* pEnd, const uint8_t* pNeedle, size_t count, bool ignoreCase)
+{
+    if (count == 0 || size_t(pEnd - pStart) < count)
+    {
+        return pEnd;
+    }
+    return Kernels().findStringReverse(pStart, pEnd, pNeedle, count, ignoreCase);
+}
+
+} // namespace Zep
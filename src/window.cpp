@@ -1,11 +1,14 @@
+#include <algorithm>
 #include <cctype>
 #include <cmath>
+#include <limits>
 #include <sstream>
 
 #include "zep/buffer.h"
 #include "zep/display.h"
 #include "zep/mode.h"
 #include "zep/scroller.h"
+#include "zep/search_highlight.h"
 #include "zep/syntax.h"
 #include "zep/tab_window.h"
 #include "zep/theme.h"
@@ -22,6 +25,61 @@ namespace Zep
 #define UTF8_CHAR_LEN(byte) ((0xE5000000 >> ((byte >> 3) & 0x1e)) & 3) + 1
 
 const float ScrollBarSize = 17.0f;
+
+// An edit touching more lines than this has them estimated, and wrapped when they are shown
+const long MaxEditWrapLines = 256;
+
+void WindowLines::Clear()
+{
+    // Clearing keeps the capacity
+    columnOffsets.clear();
+    lastNonCROffset.clear();
+    spanYPx.clear();
+    textHeight.clear();
+    margins.clear();
+    bufferLineNumber.clear();
+    lineIndex.clear();
+    pixelRenderRange.clear();
+}
+
+void WindowLines::Add(const SpanInfo& span)
+{
+    columnOffsets.push_back(span.columnOffsets);
+    lastNonCROffset.push_back(span.lastNonCROffset);
+    spanYPx.push_back(span.spanYPx);
+    textHeight.push_back(span.textHeight);
+    margins.push_back(span.margins);
+    bufferLineNumber.push_back(span.bufferLineNumber);
+    lineIndex.push_back(span.lineIndex);
+    pixelRenderRange.push_back(span.pixelRenderRange);
+}
+
+SpanInfo WindowLines::Get(size_t index) const
+{
+    SpanInfo span;
+    span.columnOffsets = columnOffsets[index];
+    span.lastNonCROffset = lastNonCROffset[index];
+    span.spanYPx = spanYPx[index];
+    span.textHeight = textHeight[index];
+    span.margins = margins[index];
+    span.bufferLineNumber = bufferLineNumber[index];
+    span.lineIndex = lineIndex[index];
+    span.pixelRenderRange = pixelRenderRange[index];
+    return span;
+}
+
+long WindowLines::Find(BufferLocation location) const
+{
+    auto itr = std::upper_bound(columnOffsets.begin(), columnOffsets.end(), location, [](BufferLocation loc, const BufferRange& range) {
+        return loc < range.first;
+    });
+    if (itr == columnOffsets.begin() || location >= (itr - 1)->second)
+    {
+        return -1;
+    }
+    return long(itr - columnOffsets.begin()) - 1;
+}
+
 ZepWindow::ZepWindow(ZepTabWindow& window, ZepBuffer* buffer)
     : ZepComponent(window.GetEditor())
     , m_tabWindow(window)
@@ -63,6 +121,10 @@ ZepWindow::ZepWindow(ZepTabWindow& window, ZepBuffer* buffer)
 
 ZepWindow::~ZepWindow()
 {
+    if (auto pSyntax = m_pBuffer ? m_pBuffer->GetSyntax() : nullptr)
+    {
+        pSyntax->ClearVisibleLines(this);
+    }
 }
 
 void ZepWindow::UpdateScrollers()
@@ -77,9 +139,10 @@ void ZepWindow::UpdateScrollers()
         m_scrollVisibilityChanged = (old_percent != m_vScroller->vScrollVisiblePercent);
         return;
     }
-    m_vScroller->vScrollVisiblePercent = std::min(float(m_maxDisplayLines) / float(m_windowLines.size()), 1.0f);
+    auto screenLines = std::max(1l, m_lineWrap.GetScreenLineCount());
+    m_vScroller->vScrollVisiblePercent = std::min(float(m_maxDisplayLines) / float(screenLines), 1.0f);
     m_vScroller->vScrollPosition = std::abs(m_bufferOffsetYPx) / m_bufferSizeYPx;
-    m_vScroller->vScrollLinePercent = 1.0f / m_windowLines.size();
+    m_vScroller->vScrollLinePercent = 1.0f / screenLines;
     m_vScroller->vScrollPagePercent = m_vScroller->vScrollVisiblePercent;
 
     if (GetEditor().GetConfig().showScrollBar == 0)
@@ -131,7 +194,7 @@ void ZepWindow::UpdateAirline()
         };
     }
     m_airline.leftBoxes.push_back(AirBox{ m_pBuffer->GetDisplayName(), FilterActiveColor(m_pBuffer->GetTheme().GetColor(ThemeColor::AirlineBackground)) });
-    m_airline.rightBoxes.push_back(AirBox{ std::to_string(m_pBuffer->GetLineEnds().size()) + " Lines", m_pBuffer->GetTheme().GetColor(ThemeColor::LineNumberBackground) });
+    m_airline.rightBoxes.push_back(AirBox{ std::to_string(m_pBuffer->GetLineCount()) + " Lines", m_pBuffer->GetTheme().GetColor(ThemeColor::LineNumberBackground) });
 }
 
 void ZepWindow::SetCursorType(CursorType mode)
@@ -152,6 +215,7 @@ void ZepWindow::Notify(std::shared_ptr<ZepMessage> payload)
         }
 
         m_layoutDirty = true;
+        UpdateWrapForEdit(*pMsg);
 
         if (pMsg->type != BufferMessageType::PreBufferChange)
         {
@@ -166,7 +230,7 @@ void ZepWindow::Notify(std::shared_ptr<ZepMessage> payload)
         if (payload->pComponent == m_vScroller.get())
         {
             auto pScroller = dynamic_cast<Scroller*>(payload->pComponent);
-            m_bufferOffsetYPx = pScroller->vScrollPosition * (m_windowLines.size() * GetEditor().GetDisplay().GetFontHeightPixels());
+            m_bufferOffsetYPx = pScroller->vScrollPosition * (m_lineWrap.GetScreenLineCount() * GetEditor().GetDisplay().GetFontHeightPixels());
             UpdateVisibleLineRange();
             EnsureCursorVisible();
             DisableToolTipTillMove();
@@ -194,6 +258,7 @@ void ZepWindow::Notify(std::shared_ptr<ZepMessage> payload)
     else if (payload->messageId == Msg::ConfigChanged)
     {
         m_layoutDirty = true;
+        m_wrapReset = true;
     }
 }
 
@@ -215,24 +280,16 @@ void ZepWindow::SetDisplayRegion(const NRectf& region)
 void ZepWindow::EnsureCursorVisible()
 {
     UpdateLayout();
-    BufferLocation loc = m_bufferCursor;
-    for (auto& line : m_windowLines)
+    auto cursorLine = long(BufferToDisplay(m_bufferCursor).y);
+    if (cursorLine < m_visibleLineRange.x)
     {
-        if (line->columnOffsets.first <= loc && line->columnOffsets.second > loc)
-        {
-            auto cursorLine = line->lineIndex;
-            if (cursorLine < m_visibleLineRange.x)
-            {
-                MoveCursorY(std::abs(m_visibleLineRange.x - cursorLine));
-            }
-            else if (cursorLine >= m_visibleLineRange.y)
-            {
-                MoveCursorY((long(m_visibleLineRange.y) - cursorLine) - 1);
-            }
-            m_cursorMoved = false;
-            return;
-        }
+        MoveCursorY(std::abs(m_visibleLineRange.x - cursorLine));
     }
+    else if (cursorLine >= m_visibleLineRange.y)
+    {
+        MoveCursorY((long(m_visibleLineRange.y) - cursorLine) - 1);
+    }
+    m_cursorMoved = false;
 }
 
 void ZepWindow::ScrollToCursor()
@@ -244,7 +301,7 @@ void ZepWindow::ScrollToCursor()
 
     auto old_offset = m_bufferOffsetYPx;
     auto two_lines = (GetEditor().GetDisplay().GetFontHeightPixels() * 2);
-    auto& cursorLine = GetCursorLineInfo(BufferToDisplay().y);
+    auto cursorLine = GetCursorLineInfo(BufferToDisplay().y);
 
     if (m_bufferOffsetYPx > (cursorLine.spanYPx - two_lines))
     {
@@ -314,140 +371,289 @@ float ZepWindow::GetLineTopMargin(long line)
     return height;
 }
 
-// This is the most expensive part of window update; applying line span generation for wrapped text.
-// It can take about a millisecond to do during editing on release buildj; but this is fast enough for now.
-// There are several ways in which this function can be optimized:
-// - Only regenerate spans which have changed, since only the edited line range will change.
-// - Generate blocks of text, based on syntax highlighting, instead of single characters.
-// - Have a no-wrap text mode and save a lot of the wrapping work.
-// - Do some threading
+// Wrapping is the most expensive part of the window update, so each buffer line's wrap is kept between layouts.
+// An edit only wraps the lines it touches again; lines which haven't been shown are estimated from their length,
+// and wrapped properly when they are needed.  Only the lines on screen have spans made for them
 void ZepWindow::UpdateLineSpans()
 {
     TIME_SCOPE(UpdateLineSpans);
 
     m_maxDisplayLines = (long)std::max(0.0f, std::floor(m_textRegion->rect.Height() / m_defaultLineSize));
-    float screenPosX = m_textRegion->rect.topLeftPx.x;
 
-    // For now, we are compromising on ASCII; so don't query font fixed_size each time
-    const auto& textBuffer = m_pBuffer->GetText();
+    // Start the wrap again if the space for the text changes
+    auto& display = GetEditor().GetDisplay();
+    auto extents = NVec2f(m_textRegion->rect.topLeftPx.x, m_textRegion->rect.bottomRightPx.x);
+    auto charSize = NVec2f(display.GetDefaultCharSize().x, display.GetFontHeightPixels());
+    if (m_wrapReset || extents != m_wrapExtents || charSize != m_wrapCharSize || m_lineWrap.GetLineCount() != m_pBuffer->GetLineCount())
+    {
+        m_wrapExtents = extents;
+        m_wrapCharSize = charSize;
+        ResetWrap();
+    }
+    m_lineSpansLine = -1;
 
-    long bufferLine = 0;
-    long spanLine = 0;
-    float bufferPosYPx = 0.0f;
+    // The bottom of the last screen line
+    auto& lastSpans = GetLineSpans(std::max(0l, m_lineWrap.GetLineCount() - 1));
+    m_bufferSizeYPx = lastSpans.back().spanYPx + m_wrapCharSize.y + DPI_Y(GetEditor().GetConfig().lineMargins.y);
 
-    // Nuke the existing spans
-    // In future we can in-place modify for speed
-    std::for_each(m_windowLines.begin(), m_windowLines.end(), [](SpanInfo* pInfo) { delete pInfo; });
-    m_windowLines.clear();
+    UpdateVisibleLineRange();
+    m_layoutDirty = true;
+}
 
-    auto& display = GetEditor().GetDisplay();
+// Estimate every line from its length
+void ZepWindow::ResetWrap()
+{
+    auto& config = GetEditor().GetConfig();
+    auto textHeight = m_wrapCharSize.y;
+    auto bottomMargin = DPI_Y((float)config.lineMargins.y);
 
-    float textHeight = GetEditor().GetDisplay().GetFontHeightPixels();
+    // A line wraps before the character which would reach the right edge; see MeasureLine
+    m_wrapLineChars = std::numeric_limits<long>::max() / 2;
+    if (m_wrap && m_wrapCharSize.x > 0.0f)
+    {
+        m_wrapLineChars = std::max(1l, long(std::ceil((m_wrapExtents.y - m_wrapExtents.x) / m_wrapCharSize.x)) - 1);
+    }
+    m_wrapFirstHeight = textHeight + DPI_Y((float)config.lineMargins.x) + bottomMargin + bottomMargin;
+    m_wrapNextHeight = textHeight + (float)config.lineMargins.x + bottomMargin;
 
-    // Process every buffer line
-    for (;;)
+    std::vector<WindowWrap::Line> lines;
+    lines.reserve(size_t(m_pBuffer->GetLineCount()));
+    long lineStart = 0;
+    for (auto lineEnd : m_pBuffer->GetLineIndex())
     {
-        // We haven't processed this line yet, so we can't display anything
-        // else
-        if (m_pBuffer->GetLineCount() <= bufferLine)
-            break;
+        lines.push_back(EstimateLine(lineEnd - lineStart));
+        lineStart = lineEnd;
+    }
+    m_lineWrap.Assign(std::move(lines));
 
-        BufferRange columnOffsets;
-        if (!m_pBuffer->GetLineOffsets(bufferLine, columnOffsets.first, columnOffsets.second))
-            break;
+    m_lineSpansLine = -1;
+    m_visibleStale = true;
+    m_wrapReset = false;
+}
 
-        NVec2f margins = NVec2f(GetLineTopMargin(bufferLine), DPI_Y((float)GetEditor().GetConfig().lineMargins.y));
-        float fullLineHeight = textHeight + margins.x + margins.y;
+WindowWrap::Line ZepWindow::EstimateLine(long length) const
+{
+    WindowWrap::Line line;
+    line.screenLines = uint32_t(std::max(1l, (length + m_wrapLineChars - 1) / m_wrapLineChars));
+    line.height = m_wrapFirstHeight + (line.screenLines - 1) * m_wrapNextHeight;
+    line.measured = false;
+    return line;
+}
 
-        // Start a new line
-        SpanInfo* lineInfo = new SpanInfo();
-        lineInfo->bufferLineNumber = bufferLine;
-        lineInfo->lineIndex = spanLine;
-        lineInfo->columnOffsets.first = columnOffsets.first;
-        lineInfo->columnOffsets.second = columnOffsets.first;
-        lineInfo->spanYPx = bufferPosYPx;
-        lineInfo->margins = margins;
-        lineInfo->textHeight = textHeight;
-        lineInfo->pixelRenderRange.x = screenPosX;
+// Keep the wrap in step with an edit; only the lines it touched are wrapped again
+void ZepWindow::UpdateWrapForEdit(const BufferMessage& message)
+{
+    if (m_wrapReset)
+    {
+        return;
+    }
 
-        // These offsets are 0 -> n + 1, i.e. the last offset the buffer returns is 1 beyond the current
-        for (auto ch = columnOffsets.first; ch < columnOffsets.second; ch++)
+    auto lineCount = m_pBuffer->GetLineCount();
+    auto wrapLines = m_lineWrap.GetLineCount();
+    long firstLine = 0;
+    long lastLine = 0;
+    switch (message.type)
+    {
+    case BufferMessageType::TextAdded:
+        if (lineCount < wrapLines)
+        {
+            m_wrapReset = true;
+            return;
+        }
+        firstLine = m_pBuffer->GetBufferLine(message.startLocation);
+        lastLine = firstLine + (lineCount - wrapLines) + 1;
+        if (lineCount > wrapLines)
         {
-            const utf8* pCh = &textBuffer[ch];
-            const auto textSize = display.GetCharSize(pCh);
+            m_lineWrap.Insert(firstLine + 1, lineCount - wrapLines, WindowWrap::Line());
+        }
+        break;
+    case BufferMessageType::TextDeleted:
+        if (lineCount > wrapLines)
+        {
+            m_wrapReset = true;
+            return;
+        }
+        firstLine = m_pBuffer->GetBufferLine(message.startLocation);
+        lastLine = firstLine + 1;
+        if (lineCount < wrapLines)
+        {
+            m_lineWrap.Erase(firstLine + 1, wrapLines - lineCount);
+        }
+        break;
+    case BufferMessageType::TextChanged:
+        if (lineCount != wrapLines)
+        {
+            m_wrapReset = true;
+            return;
+        }
+        firstLine = m_pBuffer->GetBufferLine(message.startLocation);
+        lastLine = m_pBuffer->GetBufferLine(message.endLocation) + 1;
+        break;
+    case BufferMessageType::Loaded:
+        m_wrapReset = true;
+        return;
+    default:
+        return;
+    }
 
-            // Wrap if we have displayed at least one char, and we have to
-            if (m_wrap && ch != columnOffsets.first)
+    lastLine = std::min(lastLine, lineCount);
+    for (auto line = firstLine; line < lastLine; line++)
+    {
+        if (lastLine - firstLine <= MaxEditWrapLines)
+        {
+            MeasureLine(line, nullptr);
+        }
+        else
+        {
+            long lineStart, lineEnd;
+            m_pBuffer->GetLineOffsets(line, lineStart, lineEnd);
+            m_lineWrap.SetLine(line, EstimateLine(lineEnd - lineStart));
+        }
+    }
+    m_lineSpansLine = -1;
+    m_visibleStale = true;
+}
+
+// Wrap a buffer line the way it will be drawn, and make the spans for its screen lines if asked
+void ZepWindow::MeasureLine(long bufferLine, std::vector<SpanInfo>* pSpans)
+{
+    auto& display = GetEditor().GetDisplay();
+    float textHeight = m_wrapCharSize.y;
+    float screenPosX = m_textRegion->rect.topLeftPx.x;
+
+    // For now, we are compromising on ASCII; so don't query font fixed_size each time
+    // Walk the text with an iterator, which only looks up the storage when it leaves a contiguous run
+    auto itrText = m_pBuffer->GetText().begin();
+
+    if (pSpans)
+    {
+        pSpans->clear();
+    }
+
+    BufferRange columnOffsets;
+    if (!m_pBuffer->GetLineOffsets(bufferLine, columnOffsets.first, columnOffsets.second))
+    {
+        // Sanity; there is always a line to show
+        if (pSpans)
+        {
+            SpanInfo lineInfo;
+            lineInfo.columnOffsets.first = 0;
+            lineInfo.columnOffsets.second = 0;
+            lineInfo.lastNonCROffset = 0;
+            lineInfo.margins = NVec2f(0.0f);
+            lineInfo.textHeight = 0.0f;
+            lineInfo.bufferLineNumber = 0;
+            lineInfo.pixelRenderRange = NVec2f(0.0f, 0.0f);
+            pSpans->push_back(lineInfo);
+        }
+        return;
+    }
+
+    NVec2f margins = NVec2f(GetLineTopMargin(bufferLine), DPI_Y((float)GetEditor().GetConfig().lineMargins.y));
+    float fullLineHeight = textHeight + margins.x + margins.y;
+
+    WindowWrap::Line size;
+    size.screenLines = 1;
+    size.height = fullLineHeight;
+    size.measured = true;
+
+    // Start a new line; the spans are placed once the whole line is wrapped
+    SpanInfo lineInfo;
+    lineInfo.bufferLineNumber = bufferLine;
+    lineInfo.columnOffsets.first = columnOffsets.first;
+    lineInfo.columnOffsets.second = columnOffsets.first;
+    lineInfo.margins = margins;
+    lineInfo.textHeight = textHeight;
+    lineInfo.pixelRenderRange.x = screenPosX;
+
+    // These offsets are 0 -> n + 1, i.e. the last offset the buffer returns is 1 beyond the current
+    for (auto ch = columnOffsets.first; ch < columnOffsets.second; ch++)
+    {
+        const utf8* pCh = &itrText[ch];
+        const auto textSize = display.GetCharSize(pCh);
+
+        // Wrap if we have displayed at least one char, and we have to
+        if (m_wrap && ch != columnOffsets.first)
+        {
+            // At least a single char has wrapped; close the old line, start a new one
+            if (((screenPosX + textSize.x) + textSize.x) >= (m_textRegion->rect.bottomRightPx.x))
             {
-                // At least a single char has wrapped; close the old line, start a new one
-                if (((screenPosX + textSize.x) + textSize.x) >= (m_textRegion->rect.bottomRightPx.x))
+                // Remember the offset beyond the end of the line
+                lineInfo.columnOffsets.second = ch;
+                lineInfo.pixelRenderRange.y = screenPosX;
+                if (pSpans)
                 {
-                    // Remember the offset beyond the end of the line
-                    lineInfo->columnOffsets.second = ch;
-                    lineInfo->pixelRenderRange.y = screenPosX;
-                    m_windowLines.push_back(lineInfo);
-
-                    // Next line
-                    lineInfo = new SpanInfo();
-                    spanLine++;
-                    bufferPosYPx += fullLineHeight;
-
-                    // Reset the line margin and height, because when we split a line we don't include a
-                    // custom widget space above it.  That goes just above the first part of the line
-                    margins.x = (float)GetEditor().GetConfig().lineMargins.x;
-                    fullLineHeight = textHeight + margins.x + margins.y;
-
-                    // Now jump to the next 'screen line' for the rest of this 'buffer line'
-                    lineInfo->columnOffsets = BufferRange(ch, ch + 1);
-                    lineInfo->lastNonCROffset = 0;
-                    lineInfo->lineIndex = spanLine;
-                    lineInfo->bufferLineNumber = bufferLine;
-                    lineInfo->spanYPx = bufferPosYPx;
-                    lineInfo->margins = margins;
-                    lineInfo->textHeight = textHeight;
-                    screenPosX = m_textRegion->rect.topLeftPx.x;
-                    lineInfo->pixelRenderRange.x = screenPosX;
+                    pSpans->push_back(lineInfo);
                 }
-                else
-                {
-                    screenPosX += textSize.x;
-                }
-            }
 
-            lineInfo->spanYPx = bufferPosYPx;
-            lineInfo->columnOffsets.second = ch + 1;
-            lineInfo->pixelRenderRange.y = screenPosX;
-            lineInfo->lastNonCROffset = std::max(ch, 0l);
+                // Reset the line margin and height, because when we split a line we don't include a
+                // custom widget space above it.  That goes just above the first part of the line
+                margins.x = (float)GetEditor().GetConfig().lineMargins.x;
+                fullLineHeight = textHeight + margins.x + margins.y;
+                size.screenLines++;
+                size.height += fullLineHeight;
+
+                // Now jump to the next 'screen line' for the rest of this 'buffer line'
+                lineInfo = SpanInfo();
+                lineInfo.columnOffsets = BufferRange(ch, ch + 1);
+                lineInfo.lastNonCROffset = 0;
+                lineInfo.bufferLineNumber = bufferLine;
+                lineInfo.margins = margins;
+                lineInfo.textHeight = textHeight;
+                screenPosX = m_textRegion->rect.topLeftPx.x;
+                lineInfo.pixelRenderRange.x = screenPosX;
+            }
+            else
+            {
+                screenPosX += textSize.x;
+            }
         }
 
-        // Complete the line
-        m_windowLines.push_back(lineInfo);
+        lineInfo.columnOffsets.second = ch + 1;
+        lineInfo.pixelRenderRange.y = screenPosX;
+        lineInfo.lastNonCROffset = std::max(ch, 0l);
+    }
 
-        // Next time round - down a buffer line, down a span line
-        bufferLine++;
-        spanLine++;
-        screenPosX = m_textRegion->rect.topLeftPx.x;
-        bufferPosYPx += fullLineHeight;
+    // Complete the line
+    if (pSpans)
+    {
+        pSpans->push_back(lineInfo);
     }
 
-    // Sanity
-    if (m_windowLines.empty())
+    // The lines after this one move if it changed
+    auto& oldSize = m_lineWrap.GetLine(bufferLine);
+    if (oldSize.screenLines != size.screenLines || oldSize.height != size.height)
     {
-        SpanInfo* lineInfo = new SpanInfo();
-        lineInfo->columnOffsets.first = 0;
-        lineInfo->columnOffsets.second = 0;
-        lineInfo->lastNonCROffset = 0;
-        lineInfo->margins = NVec2f(0.0f);
-        lineInfo->textHeight = 0.0f;
-        lineInfo->bufferLineNumber = 0;
-        lineInfo->pixelRenderRange = NVec2f(0.0f, 0.0f);
-        m_windowLines.push_back(lineInfo);
+        m_visibleStale = true;
+        if (bufferLine < m_lineSpansLine)
+        {
+            m_lineSpansLine = -1;
+        }
     }
+    m_lineWrap.SetLine(bufferLine, size);
 
-    m_bufferSizeYPx = m_windowLines[m_windowLines.size() - 1]->spanYPx + textHeight + DPI_Y(GetEditor().GetConfig().lineMargins.y);
+    if (pSpans)
+    {
+        auto spanLine = m_lineWrap.GetScreenLine(bufferLine);
+        auto bufferPosYPx = m_lineWrap.GetLineY(bufferLine);
+        for (auto& span : *pSpans)
+        {
+            span.lineIndex = int(spanLine++);
+            span.spanYPx = bufferPosYPx;
+            bufferPosYPx += span.FullLineHeight();
+        }
+    }
+}
 
-    UpdateVisibleLineRange();
-    m_layoutDirty = true;
+// The spans of a buffer line; the last line asked for is kept
+const std::vector<SpanInfo>& ZepWindow::GetLineSpans(long bufferLine)
+{
+    if (bufferLine != m_lineSpansLine)
+    {
+        MeasureLine(bufferLine, &m_lineSpans);
+        m_lineSpansLine = bufferLine;
+    }
+    return m_lineSpans;
 }
 
 void ZepWindow::UpdateVisibleLineRange()
@@ -456,37 +662,78 @@ void ZepWindow::UpdateVisibleLineRange()
 
     m_visibleLineExtents = NVec2f(m_bufferRegion->rect.Width(), 0);
 
-    m_visibleLineRange.x = (long)m_windowLines.size();
-    m_visibleLineRange.y = 0;
-    for (long line = 0; line < long(m_windowLines.size()); line++)
+    m_windowLines.Clear();
+
+    // Wrap the lines from the top of the view, until the view is full.  Wrapping a line only moves the lines after it
+    auto offsetInLine = m_bufferOffsetYPx;
+    auto lineCount = std::max(1l, m_lineWrap.GetLineCount());
+    bool full = false;
+    for (auto bufferLine = m_lineWrap.FindLineAtY(offsetInLine); bufferLine < lineCount && !full; bufferLine++)
     {
-        auto& windowLine = *m_windowLines[line];
-        if ((windowLine.spanYPx + windowLine.FullLineHeight()) <= m_bufferOffsetYPx)
+        // Skip to the first span reaching into the view; they are in order down the screen
+        auto& spans = GetLineSpans(bufferLine);
+        auto itrSpan = std::upper_bound(spans.begin(), spans.end(), m_bufferOffsetYPx, [](float y, const SpanInfo& span) {
+            return y < (span.spanYPx + span.FullLineHeight());
+        });
+        for (; itrSpan != spans.end(); itrSpan++)
         {
-            continue;
-        }
+            auto& windowLine = *itrSpan;
+            if ((windowLine.spanYPx - m_bufferOffsetYPx) >= m_textRegion->rect.Height())
+            {
+                full = true;
+                break;
+            }
 
-        if ((windowLine.spanYPx - m_bufferOffsetYPx) >= m_textRegion->rect.Height())
-        {
-            break;
+            m_windowLines.Add(windowLine);
+
+            m_visibleLineExtents.x = std::min(windowLine.pixelRenderRange.x, m_visibleLineExtents.x);
+            m_visibleLineExtents.y = std::max(windowLine.pixelRenderRange.y, m_visibleLineExtents.y);
         }
+    }
 
-        m_visibleLineRange.x = std::min(m_visibleLineRange.x, long(line));
-        m_visibleLineRange.y = long(line);
+    if (m_windowLines.Empty())
+    {
+        m_visibleLineRange = NVec2i(0, 0);
+    }
+    else
+    {
+        m_visibleLineRange.x = m_windowLines.lineIndex.front();
+        m_visibleLineRange.y = m_windowLines.lineIndex.back() + 1;
+    }
+    m_visibleStale = false;
 
-        m_visibleLineExtents.x = std::min(windowLine.pixelRenderRange.x, m_visibleLineExtents.x);
-        m_visibleLineExtents.y = std::max(windowLine.pixelRenderRange.y, m_visibleLineExtents.y);
+    // Let the syntax worker color what is on screen first
+    auto pSyntax = m_pBuffer->GetSyntax();
+    if (pSyntax && !m_windowLines.Empty())
+    {
+        pSyntax->SetVisibleLines(this, m_windowLines.bufferLineNumber.front(), m_windowLines.bufferLineNumber.back() + 1);
     }
-    m_visibleLineRange.y++;
     UpdateScrollers();
 }
 
-const SpanInfo& ZepWindow::GetCursorLineInfo(long y)
+SpanInfo ZepWindow::GetCursorLineInfo(long y)
 {
     UpdateLayout();
     y = std::max(0l, y);
-    y = std::min(y, long(m_windowLines.size() - 1));
-    return *m_windowLines[y];
+    y = std::min(y, std::max(0l, m_lineWrap.GetScreenLineCount() - 1));
+    if (!m_visibleStale && y >= m_visibleLineRange.x && y < m_visibleLineRange.y)
+    {
+        return m_windowLines.Get(size_t(y - m_visibleLineRange.x));
+    }
+
+    // Wrap the line the screen line lands on, until it lands on one which is wrapped; the estimates before it
+    // can only be replaced a line at a time
+    for (;;)
+    {
+        auto lineScreenLine = y;
+        auto bufferLine = m_lineWrap.FindScreenLine(lineScreenLine);
+        if (m_lineWrap.GetLineCount() == 0 || m_lineWrap.GetLine(bufferLine).measured)
+        {
+            auto& spans = GetLineSpans(bufferLine);
+            return spans[std::min(size_t(lineScreenLine), spans.size() - 1)];
+        }
+        MeasureLine(bufferLine, nullptr);
+    }
 }
 
 // Convert a normalized y coordinate to the window region
@@ -564,8 +811,8 @@ void ZepWindow::DrawLineWidgets(SpanInfo& lineInfo)
     }
 }
 
-// TODO: This function draws one char at a time.  It could be more optimal at the expense of some
-// complexity.  Basically, I don't like the current implementation, but it works for now.
+// Characters are drawn in runs of one color, and the rects behind them in runs with the same layers, so a line is a
+// handful of draw calls instead of a few per character.
 // The text is displayed acorrding to the region bounds and the display lineData
 // Additionally (and perhaps that should be a seperate function), this code draws line numbers
 bool ZepWindow::DisplayLine(SpanInfo& lineInfo, int displayPass)
@@ -624,7 +871,7 @@ bool ZepWindow::DisplayLine(SpanInfo& lineInfo, int displayPass)
                 // Don't draw over the visual region
                 if (GetBuffer().GetMode()->GetEditorMode() != EditorMode::Visual)
                 {
-                    auto& cursorLine = GetCursorLineInfo(cursorCL.y);
+                    auto cursorLine = GetCursorLineInfo(cursorCL.y);
 
                     if (IsInsideTextRegion(cursorCL))
                     {
@@ -705,156 +952,307 @@ bool ZepWindow::DisplayLine(SpanInfo& lineInfo, int displayPass)
     auto screenPosX = m_textRegion->rect.topLeftPx.x;
     auto pSyntax = m_pBuffer->GetSyntax();
 
-    auto tipTimeSeconds = timer_get_elapsed_seconds(m_toolTipTimer);
-
     display.SetClipRect(m_textRegion->rect);
 
-    // Walk from the start of the line to the end of the line (in buffer chars)
-    for (auto ch = lineInfo.columnOffsets.first; ch < lineInfo.columnOffsets.second; ch++)
+    // The colors of the line, in runs
+    if (pSyntax)
     {
-        const utf8* pCh;
-        const utf8* pEnd;
-        bool hiddenChar;
-        GetCharPointer(ch, pCh, pEnd, hiddenChar);
+        pSyntax->GetSyntaxSpans(lineInfo.columnOffsets.first, lineInfo.columnOffsets.second, m_syntaxSpans);
+    }
+    else
+    {
+        SyntaxSpan span;
+        span.first = lineInfo.columnOffsets.first;
+        span.last = lineInfo.columnOffsets.second;
+        span.data.foreground = ThemeColor::Text;
+        m_syntaxSpans.assign(1, span);
+    }
+
+    auto lineTop = ToWindowY(lineInfo.spanYPx);
+    auto lineBottom = ToWindowY(lineInfo.spanYPx + lineInfo.FullLineHeight());
 
-        auto textSize = display.GetTextSize(pCh, pEnd);
-        if (displayPass == WindowPass::Background)
+    if (displayPass == WindowPass::Background)
+    {
+        // Where each character starts, and where the last one ends; everything behind the text is drawn as
+        // one rect per range of characters, whatever the length of the range
+        m_charPositions.clear();
+        for (auto ch = lineInfo.columnOffsets.first; ch < lineInfo.columnOffsets.second; ch++)
         {
-            NRectf charRect(NVec2f(screenPosX, ToWindowY(lineInfo.spanYPx)), NVec2f(screenPosX + textSize.x, ToWindowY(lineInfo.spanYPx + lineInfo.FullLineHeight())));
-            if (charRect.Contains(m_mouseHoverPos))
+            m_charPositions.push_back(screenPosX);
+            screenPosX += GetCharWidth(ch);
+        }
+        m_charPositions.push_back(screenPosX);
+
+        auto fnDrawRange = [&](BufferLocation first, BufferLocation last, bool underline, const NVec4f& color) {
+            first = std::max(first, lineInfo.columnOffsets.first);
+            last = std::min(last, lineInfo.columnOffsets.second);
+            if (first < last)
             {
-                // Record the mouse-over buffer location
-                m_mouseBufferLocation = ch;
+                auto left = m_charPositions[first - lineInfo.columnOffsets.first];
+                auto right = m_charPositions[last - lineInfo.columnOffsets.first];
+                display.DrawRectFilled(NRectf(NVec2f(left, underline ? lineBottom - 1 : lineTop), NVec2f(right, lineBottom)), color);
             }
+        };
 
-            // If the syntax overrides the background, show it first
-            if (pSyntax && pSyntax->GetSyntaxAt(ch).background != ThemeColor::None)
+        // If the syntax overrides the background, show it first, under the whole run
+        for (auto& span : m_syntaxSpans)
+        {
+            if (span.data.background != ThemeColor::None)
             {
-                display.DrawRectFilled(charRect, m_pBuffer->GetTheme().GetColor(pSyntax->GetSyntaxAt(ch).background));
+                fnDrawRange(span.first, span.last, false, m_pBuffer->GetTheme().GetColor(span.data.background));
             }
+        }
 
-            // Show any markers
-            m_pBuffer->ForEachMarker(RangeMarkerType::All, SearchDirection::Forward, lineInfo.columnOffsets.first, lineInfo.columnOffsets.second, [&](const std::shared_ptr<RangeMarker>& marker) {
+        // Show search matches, with the current one picked out.  Matches that touch are drawn together
+        auto& searchHighlight = m_pBuffer->GetSearchHighlight();
+        auto searchLength = long(searchHighlight.GetPattern().size());
+        auto searchCurrent = BufferRange(searchHighlight.GetCurrent(), searchHighlight.GetCurrent() + searchLength);
+        if (searchHighlight.GetCurrent() == InvalidOffset)
+        {
+            searchCurrent = BufferRange(InvalidOffset, InvalidOffset);
+        }
 
-                // Don't show hidden markers 
-                if (marker->displayType == RangeMarkerDisplayType::Hidden)
-                {
-                    return true;
-                }
+        auto matchColor = m_pBuffer->GetTheme().GetColor(ThemeColor::VisualSelectBackground);
+        auto fnDrawMatches = [&](const BufferRange& matches) {
+            // Around the current match, which has its own color
+            if (searchCurrent.first < matches.second && searchCurrent.second > matches.first)
+            {
+                fnDrawRange(matches.first, searchCurrent.first, false, matchColor);
+                fnDrawRange(searchCurrent.second, matches.second, false, matchColor);
+            }
+            else
+            {
+                fnDrawRange(matches.first, matches.second, false, matchColor);
+            }
+        };
 
-                auto sel = marker->range;
-                if (marker->ContainsLocation(ch))
+        const long* pMatch = nullptr;
+        const long* pMatchEnd = nullptr;
+        searchHighlight.GetMatches(lineInfo.columnOffsets.first, lineInfo.columnOffsets.second, pMatch, pMatchEnd);
+        if (pMatch != pMatchEnd)
+        {
+            auto matches = BufferRange(*pMatch, *pMatch + searchLength);
+            for (pMatch++; pMatch != pMatchEnd; pMatch++)
+            {
+                if (*pMatch > matches.second)
                 {
-                    if (marker->displayType & RangeMarkerDisplayType::Underline)
-                    {
-                        display.DrawRectFilled(NRectf(NVec2f(screenPosX, ToWindowY(lineInfo.spanYPx + lineInfo.FullLineHeight()) - 1), NVec2f(screenPosX + textSize.x, ToWindowY(lineInfo.spanYPx + lineInfo.FullLineHeight()))), m_pBuffer->GetTheme().GetColor(marker->highlightColor));
-                    }
-
-                    if (marker->displayType & RangeMarkerDisplayType::Background)
-                    {
-                        display.DrawRectFilled(charRect, m_pBuffer->GetTheme().GetColor(marker->backgroundColor));
-                    }
+                    fnDrawMatches(matches);
+                    matches.first = *pMatch;
+                }
+                matches.second = *pMatch + searchLength;
+            }
+            fnDrawMatches(matches);
+        }
+        fnDrawRange(searchCurrent.first, searchCurrent.second, false, m_pBuffer->GetTheme().GetColor(ThemeColor::Info));
 
-                    // If this marker has an associated tooltip, pop it up after a time delay
-                    // TODO: Make tooltip generation seperate to this display loop
-                    if (m_toolTips.empty() && !m_tipDisabledTillMove && (tipTimeSeconds > 0.5f))
-                    {
-                        bool showTip = false;
-                        if (marker->displayType & RangeMarkerDisplayType::Tooltip)
-                        {
-                            if (m_mouseBufferLocation == ch)
-                            {
-                                showTip = true;
-                            }
-                        }
+        // Show any markers; each is a range, found once for the line
+        m_pBuffer->ForEachMarker(RangeMarkerType::All, SearchDirection::Forward, lineInfo.columnOffsets.first, lineInfo.columnOffsets.second, [&](const std::shared_ptr<RangeMarker>& marker) {
+            // Don't show hidden markers
+            if (marker->displayType == RangeMarkerDisplayType::Hidden)
+            {
+                return true;
+            }
 
-                        // If we want the tip showing at anywhere on the line, show it
-                        if (marker->displayType & RangeMarkerDisplayType::TooltipAtLine)
-                        {
-                            // TODO: This should be a helper function
-                            if (m_mouseHoverPos.y >= ToWindowY(lineInfo.spanYPx) && m_mouseHoverPos.y < (ToWindowY(lineInfo.spanYPx) + textSize.y) && (m_mouseHoverPos.x < m_textRegion->rect.topLeftPx.x + lineInfo.Length() * textSize.x))
-                            {
-                                showTip = true;
-                            }
-                        }
+            auto markerRange = marker->GetRange();
+            if (marker->displayType & RangeMarkerDisplayType::Underline)
+            {
+                fnDrawRange(markerRange.first, markerRange.second, true, m_pBuffer->GetTheme().GetColor(marker->highlightColor));
+            }
 
-                        if (showTip)
-                        {
-                            // Register this tooltip
-                            m_toolTips[NVec2f(m_mouseHoverPos.x, m_mouseHoverPos.y + textBorder)] = marker;
-                        }
-                    }
-                }
-                return true;
-            });
+            if (marker->displayType & RangeMarkerDisplayType::Background)
+            {
+                fnDrawRange(markerRange.first, markerRange.second, false, m_pBuffer->GetTheme().GetColor(marker->backgroundColor));
+            }
+            return true;
+        });
 
-            // Draw the visual selection marker second
-            if (IsActiveWindow())
+        // Draw the visual selection marker last; it doesn't cover the hidden end of the line
+        if (IsActiveWindow() && GetBuffer().HasSelection())
+        {
+            auto sel = m_pBuffer->GetSelection();
+            sel.second = std::min(sel.second, lineInfo.columnOffsets.second);
+            while (sel.second > sel.first && IsHiddenChar(sel.second - 1))
             {
-                if (GetBuffer().HasSelection())
-                {
-                    auto sel = m_pBuffer->GetSelection();
-                    if (sel.ContainsLocation(ch) && !hiddenChar)
-                    {
-                        display.DrawRectFilled(NRectf(NVec2f(screenPosX, ToWindowY(lineInfo.spanYPx)), NVec2f(screenPosX + textSize.x, ToWindowY(lineInfo.spanYPx + lineInfo.FullLineHeight()))), m_pBuffer->GetTheme().GetColor(ThemeColor::VisualSelectBackground));
-                    }
-                }
+                sel.second--;
             }
+            fnDrawRange(sel.first, sel.second, false, m_pBuffer->GetTheme().GetColor(ThemeColor::VisualSelectBackground));
         }
-        // Second pass, characters
-        else
+    }
+    else
+    {
+        // Characters are drawn a run at a time; a run is contiguous text in one color
+        NVec2f textRunPos;
+        NVec4f textRunColor;
+        const utf8* pTextRun = nullptr;
+        const utf8* pTextRunEnd = nullptr;
+        auto flushText = [&]() {
+            if (pTextRun != pTextRunEnd)
+            {
+                display.DrawChars(textRunPos, textRunColor, pTextRun, pTextRunEnd);
+            }
+            pTextRun = pTextRunEnd = nullptr;
+        };
+
+        if (lineInfo.Length() > 0)
         {
             DrawLineWidgets(lineInfo);
+        }
 
-            if (!hiddenChar || m_windowFlags & WindowFlags::ShowCR)
+        // Walk from the start of the line to the end of the line (in buffer chars), a run at a time
+        for (auto& span : m_syntaxSpans)
+        {
+            auto& syntax = span.data;
+            auto foregroundColor = m_pBuffer->GetTheme().GetColor(syntax.foreground);
+            for (auto ch = span.first; ch < span.last; ch++)
             {
-                auto centerChar = NVec2f(screenPosX + textSize.x / 2, ToWindowY(lineInfo.spanYPx) + textSize.y / 2);
-                if ((m_windowFlags & WindowFlags::ShowWhiteSpace) && pSyntax && pSyntax->GetSyntaxAt(ch).foreground == ThemeColor::Whitespace)
-                {
-                    // Show a dot
-                    display.DrawRectFilled(NRectf(centerChar - NVec2f(1.0f, 1.0f), centerChar + NVec2f(1.0f, 1.0f)), m_pBuffer->GetTheme().GetColor(ThemeColor::Whitespace));
-                }
-                else
+                const utf8* pCh;
+                const utf8* pEnd;
+                bool hiddenChar;
+                GetCharPointer(ch, pCh, pEnd, hiddenChar);
+
+                auto textSize = GetCharSize(pCh, pEnd);
+                if (!hiddenChar || m_windowFlags & WindowFlags::ShowCR)
                 {
-                    NVec4f col;
-                    if (hiddenChar)
+                    auto centerChar = NVec2f(screenPosX + textSize.x / 2, lineTop + textSize.y / 2);
+                    if ((m_windowFlags & WindowFlags::ShowWhiteSpace) && syntax.foreground == ThemeColor::Whitespace)
                     {
-                        col = m_pBuffer->GetTheme().GetColor(ThemeColor::HiddenText);
+                        // Show a dot
+                        display.DrawRectFilled(NRectf(centerChar - NVec2f(1.0f, 1.0f), centerChar + NVec2f(1.0f, 1.0f)), m_pBuffer->GetTheme().GetColor(ThemeColor::Whitespace));
                     }
                     else
                     {
-                        if (pSyntax)
+                        auto col = hiddenChar ? m_pBuffer->GetTheme().GetColor(ThemeColor::HiddenText) : foregroundColor;
+                        if (syntax.background != ThemeColor::None)
                         {
-                            col = m_pBuffer->GetTheme().GetColor(pSyntax->GetSyntaxAt(ch).foreground);
+                            display.DrawRectFilled(NRectf(centerChar - NVec2f(1.0f, 1.0f), centerChar + NVec2f(1.0f, 1.0f)), m_pBuffer->GetTheme().GetColor(syntax.background));
                         }
-                        else
+
+                        // Printable ASCII joins the run if it follows on in memory; anything else is drawn alone
+                        if (pTextRun && pCh == pTextRunEnd && col == textRunColor && !hiddenChar && *pCh >= ' ' && *pCh < 0x80)
                         {
-                            col = m_pBuffer->GetTheme().GetColor(ThemeColor::Text);
+                            pTextRunEnd = pEnd;
                         }
-                    }
-
-                    if (pSyntax)
-                    {
-                        auto backgroundColor = pSyntax->GetSyntaxAt(ch).background;
-                        if (backgroundColor != ThemeColor::None)
+                        else
                         {
-                            display.DrawRectFilled(NRectf(centerChar - NVec2f(1.0f, 1.0f), centerChar + NVec2f(1.0f, 1.0f)), m_pBuffer->GetTheme().GetColor(backgroundColor));
+                            flushText();
+                            textRunPos = NVec2f(screenPosX, ToWindowY(lineInfo.spanYPx + lineInfo.margins.x));
+                            textRunColor = col;
+                            if (!hiddenChar && *pCh >= ' ' && *pCh < 0x80)
+                            {
+                                pTextRun = pCh;
+                                pTextRunEnd = pEnd;
+                            }
+                            else
+                            {
+                                display.DrawChars(textRunPos, col, pCh, pEnd);
+                            }
                         }
                     }
-                    display.DrawChars(NVec2f(screenPosX, ToWindowY(lineInfo.spanYPx + lineInfo.margins.x)), col, pCh, pEnd);
                 }
+
+                screenPosX += textSize.x;
             }
         }
-
-        screenPosX += textSize.x;
+        flushText();
     }
 
-    DisplayCursor();
-
     display.SetClipRect(NRectf{});
 
     return true;
-} // namespace Zep
+}
+
+// The width of a character as drawn; plain ASCII comes from the display's cache
+NVec2f ZepWindow::GetCharSize(const utf8* pCh, const utf8* pEnd)
+{
+    auto& display = GetEditor().GetDisplay();
+    return (*pCh & 0x80) ? display.GetTextSize(pCh, pEnd) : display.GetCharSize(pCh);
+}
+
+float ZepWindow::GetCharWidth(BufferLocation loc)
+{
+    const utf8* pCh;
+    const utf8* pEnd;
+    bool hiddenChar;
+    GetCharPointer(loc, pCh, pEnd, hiddenChar);
+    return GetCharSize(pCh, pEnd).x;
+}
+
+bool ZepWindow::IsHiddenChar(BufferLocation loc)
+{
+    auto ch = m_pBuffer->GetText()[loc];
+    return ch == '\n' || ch == 0;
+}
+
+// Find the character under the mouse, and pop up the tip of a marker there after a delay.  This is done once a
+// frame, for the one line the mouse is on, instead of for every character drawn
+void ZepWindow::UpdateMouseHover()
+{
+    m_mouseBufferLocation = BufferLocation{ -1 };
+
+    // The screen line under the mouse; the spans are in order down the screen
+    auto mouseY = m_mouseHoverPos.y - m_bufferRegion->rect.topLeftPx.y + m_bufferOffsetYPx;
+    auto itrSpan = std::upper_bound(m_windowLines.spanYPx.begin(), m_windowLines.spanYPx.end(), mouseY);
+    if (itrSpan == m_windowLines.spanYPx.begin())
+    {
+        return;
+    }
+    auto lineInfo = m_windowLines.Get(size_t(itrSpan - m_windowLines.spanYPx.begin()) - 1);
+    if (mouseY >= lineInfo.spanYPx + lineInfo.FullLineHeight())
+    {
+        return;
+    }
+
+    auto screenPosX = m_textRegion->rect.topLeftPx.x;
+    for (auto ch = lineInfo.columnOffsets.first; ch < lineInfo.columnOffsets.second; ch++)
+    {
+        auto width = GetCharWidth(ch);
+        if (m_mouseHoverPos.x >= screenPosX && m_mouseHoverPos.x < screenPosX + width)
+        {
+            m_mouseBufferLocation = ch;
+            break;
+        }
+        screenPosX += width;
+    }
+
+    if (!m_toolTips.empty() || m_tipDisabledTillMove || (timer_get_elapsed_seconds(m_toolTipTimer) <= 0.5f))
+    {
+        return;
+    }
+
+    auto& display = GetEditor().GetDisplay();
+    auto lineTop = ToWindowY(lineInfo.spanYPx);
+    m_pBuffer->ForEachMarker(RangeMarkerType::All, SearchDirection::Forward, lineInfo.columnOffsets.first, lineInfo.columnOffsets.second, [&](const std::shared_ptr<RangeMarker>& marker) {
+        if (marker->displayType == RangeMarkerDisplayType::Hidden || !marker->IntersectsRange(lineInfo.columnOffsets))
+        {
+            return true;
+        }
+
+        bool showTip = false;
+        if (marker->displayType & RangeMarkerDisplayType::Tooltip)
+        {
+            if (m_mouseBufferLocation != -1 && marker->ContainsLocation(m_mouseBufferLocation))
+            {
+                showTip = true;
+            }
+        }
+
+        // If we want the tip showing at anywhere on the line, show it
+        if (marker->displayType & RangeMarkerDisplayType::TooltipAtLine)
+        {
+            if (m_mouseHoverPos.y >= lineTop && m_mouseHoverPos.y < (lineTop + display.GetFontHeightPixels()) && (m_mouseHoverPos.x < m_textRegion->rect.topLeftPx.x + lineInfo.Length() * display.GetDefaultCharSize().x))
+            {
+                showTip = true;
+            }
+        }
+
+        if (showTip)
+        {
+            // Register this tooltip
+            m_toolTips[NVec2f(m_mouseHoverPos.x, m_mouseHoverPos.y + textBorder)] = marker;
+        }
+        return true;
+    });
+}
 
 bool ZepWindow::IsInsideTextRegion(NVec2i pos) const
 {
@@ -953,7 +1351,7 @@ long ZepWindow::GetMaxDisplayLines()
 long ZepWindow::GetNumDisplayedLines()
 {
     UpdateLayout();
-    return std::min((long)m_windowLines.size(), GetMaxDisplayLines());
+    return std::min(m_lineWrap.GetScreenLineCount(), GetMaxDisplayLines());
 }
 
 void ZepWindow::SetBufferCursor(BufferLocation location)
@@ -980,8 +1378,15 @@ void ZepWindow::SetBuffer(ZepBuffer* pBuffer)
 {
     assert(pBuffer);
 
+    // The old buffer's syntax stops lexing ahead for this window
+    if (auto pSyntax = m_pBuffer ? m_pBuffer->GetSyntax() : nullptr)
+    {
+        pSyntax->ClearVisibleLines(this);
+    }
+
     m_pBuffer = pBuffer;
     m_layoutDirty = true;
+    m_wrapReset = true;
     m_bufferOffsetYPx = 0;
     m_bufferCursor = pBuffer->Clamp(pBuffer->GetLastEditLocation());
     m_lastCursorColumn = 0;
@@ -1202,7 +1607,6 @@ void ZepWindow::Display()
 
     auto& display = GetEditor().GetDisplay();
     auto cursorCL = BufferToDisplay(m_bufferCursor);
-    m_mouseBufferLocation = BufferLocation{ -1 };
 
     // Always update
     UpdateAirline();
@@ -1237,14 +1641,23 @@ void ZepWindow::Display()
         }
     }
 
+    // Lines wrapped since the layout may have moved the ones on screen
+    if (m_visibleStale)
+    {
+        UpdateVisibleLineRange();
+    }
+
     {
         TIME_SCOPE(DrawLine);
         for (int displayPass = 0; displayPass < WindowPass::Max; displayPass++)
         {
-            for (long windowLine = m_visibleLineRange.x; windowLine < m_visibleLineRange.y; windowLine++)
+            for (size_t index = 0; index < m_windowLines.Size(); index++)
             {
-                auto& lineInfo = *m_windowLines[windowLine];
-                if (!DisplayLine(lineInfo, displayPass))
+                // Drawing finds where the line went, for the tooltips and widgets
+                auto lineInfo = m_windowLines.Get(index);
+                auto drawn = DisplayLine(lineInfo, displayPass);
+                m_windowLines.pixelRenderRange[index] = lineInfo.pixelRenderRange;
+                if (!drawn)
                 {
                     break;
                 }
@@ -1252,6 +1665,13 @@ void ZepWindow::Display()
         }
     }
 
+    // The cursor goes over the text
+    display.SetClipRect(m_textRegion->rect);
+    DisplayCursor();
+    display.SetClipRect(NRectf{});
+
+    UpdateMouseHover();
+
     // Is the cursor on a tooltip row or mark?
     if (m_toolTips.empty())
     {
@@ -1281,7 +1701,7 @@ void ZepWindow::Display()
                 return true;
             }
 
-            auto sel = marker->range;
+            auto sel = marker->GetRange();
             if (marker->displayType & RangeMarkerDisplayType::CursorTip)
             {
                 if (m_bufferCursor >= sel.first && m_bufferCursor < sel.second)
@@ -1378,9 +1798,9 @@ void ZepWindow::MoveCursorY(int yDistance, LineLocation clampLocation)
     // Find the screen line relative target
     auto target = cursorCL + NVec2i(0, yDistance);
     target.y = std::max(0l, target.y);
-    target.y = std::min(target.y, long(m_windowLines.size() - 1));
+    target.y = std::min(target.y, m_lineWrap.GetScreenLineCount() - 1);
 
-    auto& line = *m_windowLines[target.y];
+    auto line = GetCursorLineInfo(target.y);
 
     // Snap to the new vertical column if necessary (see comment below)
     if (target.x < m_lastCursorColumn)
@@ -1438,6 +1858,15 @@ void ZepWindow::MoveCursorY(int yDistance, LineLocation clampLocation)
     m_pBuffer->SetLastEditLocation(m_bufferCursor);
 }
 
+BufferRange ZepWindow::GetVisibleBufferRange() const
+{
+    if (m_windowLines.Empty())
+    {
+        return BufferRange(0, 0);
+    }
+    return BufferRange(m_windowLines.columnOffsets.front().first, m_windowLines.columnOffsets.back().second);
+}
+
 NVec2i ZepWindow::BufferToDisplay()
 {
     return BufferToDisplay(m_bufferCursor);
@@ -1448,23 +1877,36 @@ NVec2i ZepWindow::BufferToDisplay(const BufferLocation& loc)
     UpdateLayout();
 
     NVec2i ret(0, 0);
-    int line_number = 0;
 
-    // TODO:  A map
-    for (auto& line : m_windowLines)
+    // Usually the location is on screen, and its span is already made
+    if (!m_visibleStale)
     {
-        if (line->columnOffsets.first <= loc && line->columnOffsets.second > loc)
+        auto visibleIndex = m_windowLines.Find(loc);
+        if (visibleIndex >= 0)
         {
-            ret.y = line_number;
-            ret.x = loc - line->columnOffsets.first;
+            ret.y = m_windowLines.lineIndex[size_t(visibleIndex)];
+            ret.x = loc - m_windowLines.columnOffsets[size_t(visibleIndex)].first;
             return ret;
         }
-        line_number++;
+    }
+
+    // Otherwise only the line the location is on needs wrapping
+    auto bufferLine = std::max(0l, m_pBuffer->GetBufferLine(loc));
+    auto& spans = GetLineSpans(bufferLine);
+    auto itrSpan = std::upper_bound(spans.begin(), spans.end(), loc, [](BufferLocation location, const SpanInfo& span) {
+        return location < span.columnOffsets.first;
+    });
+    if (itrSpan != spans.begin() && (itrSpan - 1)->BufferCursorInside(loc))
+    {
+        ret.y = (itrSpan - 1)->lineIndex;
+        ret.x = loc - (itrSpan - 1)->columnOffsets.first;
+        return ret;
     }
 
     // Max
-    ret.y = int(m_windowLines.size() - 1);
-    ret.x = m_windowLines[m_windowLines.size() - 1]->columnOffsets.second - 1;
+    auto& lastSpans = GetLineSpans(std::max(0l, m_lineWrap.GetLineCount() - 1));
+    ret.y = lastSpans.back().lineIndex;
+    ret.x = lastSpans.back().columnOffsets.second - 1;
     return ret;
 }
 
@@ -0,0 +1,310 @@
+#include "zep/window_wrap.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+namespace Zep
+{
+
+void WindowWrap::Block::Rebuild()
+{
+    std::vector<long> lineScreenLines(lines.size());
+    std::vector<double> lineHeights(lines.size());
+    totalScreenLines = 0;
+    totalHeight = 0.0;
+    for (size_t index = 0; index < lines.size(); index++)
+    {
+        lineScreenLines[index] = long(lines[index].screenLines);
+        lineHeights[index] = double(lines[index].height);
+        totalScreenLines += lineScreenLines[index];
+        totalHeight += lineHeights[index];
+    }
+    screenLines.Build(lineScreenLines);
+    heights.Build(lineHeights);
+}
+
+long WindowWrap::GetScreenLineCount() const
+{
+    return m_totalScreenLines;
+}
+
+float WindowWrap::GetHeight() const
+{
+    return float(m_totalHeight);
+}
+
+const WindowWrap::Line& WindowWrap::GetLine(long line) const
+{
+    auto block = FindBlockForLine(line);
+    return m_blocks[block].lines[size_t(line)];
+}
+
+void WindowWrap::Assign(std::vector<Line>&& lines)
+{
+    m_blocks.clear();
+
+    // Fill blocks 3/4 full, so that new lines don't immediately split them
+    const size_t fill = (MaxBlockLines * 3) / 4;
+    for (size_t line = 0; line < lines.size(); line += fill)
+    {
+        Block block;
+        block.lines.assign(lines.begin() + line, lines.begin() + std::min(lines.size(), line + fill));
+        block.Rebuild();
+        m_blocks.push_back(std::move(block));
+    }
+    Rebuild();
+}
+
+void WindowWrap::Insert(long line, long count, const Line& size)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    if (m_blocks.empty())
+    {
+        m_blocks.push_back(Block());
+        m_blocks.back().lines.assign(size_t(count), size);
+        SplitBlock(0);
+        Rebuild();
+        return;
+    }
+
+    // After the last line is the end of the last block
+    auto local = line;
+    size_t blockIndex = m_blocks.size() - 1;
+    if (line < m_totalLines)
+    {
+        blockIndex = FindBlockForLine(local);
+    }
+    else
+    {
+        local = long(m_blocks.back().lines.size());
+    }
+
+    auto& block = m_blocks[blockIndex];
+    block.lines.insert(block.lines.begin() + local, size_t(count), size);
+    if (long(block.lines.size()) > MaxBlockLines)
+    {
+        SplitBlock(blockIndex);
+        Rebuild();
+        return;
+    }
+
+    // Only this block is rebuilt; the blocks after it move with the block sums
+    auto screenLines = block.totalScreenLines;
+    auto height = block.totalHeight;
+    block.Rebuild();
+    screenLines = block.totalScreenLines - screenLines;
+    height = block.totalHeight - height;
+
+    m_blockLines.Add(blockIndex, count);
+    m_blockScreenLines.Add(blockIndex, screenLines);
+    m_blockHeights.Add(blockIndex, height);
+    m_totalLines += count;
+    m_totalScreenLines += screenLines;
+    m_totalHeight += height;
+}
+
+void WindowWrap::Erase(long line, long count)
+{
+    count = std::min(count, m_totalLines - line);
+    if (count <= 0)
+    {
+        return;
+    }
+
+    auto firstLocal = line;
+    auto firstBlock = FindBlockForLine(firstLocal);
+    auto& block = m_blocks[firstBlock];
+    if (firstLocal + count < long(block.lines.size()))
+    {
+        block.lines.erase(block.lines.begin() + firstLocal, block.lines.begin() + firstLocal + count);
+
+        auto screenLines = block.totalScreenLines;
+        auto height = block.totalHeight;
+        block.Rebuild();
+        screenLines = block.totalScreenLines - screenLines;
+        height = block.totalHeight - height;
+
+        m_blockLines.Add(firstBlock, -count);
+        m_blockScreenLines.Add(firstBlock, screenLines);
+        m_blockHeights.Add(firstBlock, height);
+        m_totalLines -= count;
+        m_totalScreenLines += screenLines;
+        m_totalHeight += height;
+        return;
+    }
+
+    // The lines span blocks, or take the end of one; merge what is left of them into one
+    block.lines.resize(size_t(firstLocal));
+    auto lastBlock = m_blocks.size();
+    if (line + count < m_totalLines)
+    {
+        auto lastLocal = line + count;
+        lastBlock = FindBlockForLine(lastLocal);
+        auto& lines = m_blocks[lastBlock].lines;
+        block.lines.insert(block.lines.end(), lines.begin() + lastLocal, lines.end());
+        lastBlock++;
+    }
+    m_blocks.erase(m_blocks.begin() + firstBlock + 1, m_blocks.begin() + lastBlock);
+
+    if (m_blocks[firstBlock].lines.empty())
+    {
+        m_blocks.erase(m_blocks.begin() + firstBlock);
+    }
+    else
+    {
+        SplitBlock(firstBlock);
+    }
+    Rebuild();
+}
+
+void WindowWrap::SetLine(long line, const Line& size)
+{
+    auto local = line;
+    auto blockIndex = FindBlockForLine(local);
+    auto& block = m_blocks[blockIndex];
+    auto& current = block.lines[size_t(local)];
+    auto screenLines = long(size.screenLines) - long(current.screenLines);
+    auto height = double(size.height) - double(current.height);
+    current = size;
+
+    block.screenLines.Add(size_t(local), screenLines);
+    block.heights.Add(size_t(local), height);
+    block.totalScreenLines += screenLines;
+    block.totalHeight += height;
+
+    m_blockScreenLines.Add(blockIndex, screenLines);
+    m_blockHeights.Add(blockIndex, height);
+    m_totalScreenLines += screenLines;
+    m_totalHeight += height;
+}
+
+long WindowWrap::GetScreenLine(long line) const
+{
+    if (line >= m_totalLines)
+    {
+        return m_totalScreenLines;
+    }
+
+    auto block = FindBlockForLine(line);
+    return m_blockScreenLines.Prefix(block) + m_blocks[block].screenLines.Prefix(size_t(line));
+}
+
+float WindowWrap::GetLineY(long line) const
+{
+    if (line >= m_totalLines)
+    {
+        return float(m_totalHeight);
+    }
+
+    auto block = FindBlockForLine(line);
+    return float(m_blockHeights.Prefix(block) + m_blocks[block].heights.Prefix(size_t(line)));
+}
+
+long WindowWrap::FindScreenLine(long& screenLine) const
+{
+    if (m_blocks.empty())
+    {
+        return 0;
+    }
+
+    auto block = m_blockScreenLines.Search(screenLine);
+    if (block >= m_blocks.size())
+    {
+        // Past the end; the last screen line of the last line
+        screenLine = long(m_blocks.back().lines.back().screenLines) - 1;
+        return m_totalLines - 1;
+    }
+
+    auto& lines = m_blocks[block].lines;
+    auto line = std::min(m_blocks[block].screenLines.Search(screenLine), lines.size() - 1);
+    return m_blockLines.Prefix(block) + long(line);
+}
+
+long WindowWrap::FindLineAtY(float& y) const
+{
+    if (m_blocks.empty())
+    {
+        return 0;
+    }
+
+    double offset = std::max(0.0, double(y));
+    auto block = m_blockHeights.Search(offset);
+    if (block >= m_blocks.size())
+    {
+        y = m_blocks.back().lines.back().height;
+        return m_totalLines - 1;
+    }
+
+    // The block's sum and its lines' can round apart; past its last line is the end of that line
+    auto& lines = m_blocks[block].lines;
+    auto line = m_blocks[block].heights.Search(offset);
+    if (line >= lines.size())
+    {
+        line = lines.size() - 1;
+        offset = double(lines.back().height);
+    }
+    y = float(offset);
+    return m_blockLines.Prefix(block) + long(line);
+}
+
+size_t WindowWrap::FindBlockForLine(long& line) const
+{
+    auto block = m_blockLines.Search(line);
+    assert(block < m_blocks.size());
+    return block;
+}
+
+// Split a block which has grown too big; a big insert can need more than two
+void WindowWrap::SplitBlock(size_t blockIndex)
+{
+    const size_t fill = (MaxBlockLines * 3) / 4;
+    auto lines = std::move(m_blocks[blockIndex].lines);
+    if (long(lines.size()) <= MaxBlockLines)
+    {
+        m_blocks[blockIndex].lines = std::move(lines);
+        m_blocks[blockIndex].Rebuild();
+        return;
+    }
+
+    std::vector<Block> blocks((lines.size() + fill - 1) / fill);
+    for (size_t index = 0; index < blocks.size(); index++)
+    {
+        blocks[index].lines.assign(lines.begin() + index * fill, lines.begin() + std::min(lines.size(), (index + 1) * fill));
+        blocks[index].Rebuild();
+    }
+    m_blocks[blockIndex] = std::move(blocks[0]);
+    m_blocks.insert(m_blocks.begin() + blockIndex + 1, std::make_move_iterator(blocks.begin() + 1), std::make_move_iterator(blocks.end()));
+}
+
+void WindowWrap::Rebuild()
+{
+    std::vector<long> lines;
+    std::vector<long> screenLines;
+    std::vector<double> heights;
+    lines.reserve(m_blocks.size());
+    screenLines.reserve(m_blocks.size());
+    heights.reserve(m_blocks.size());
+
+    m_totalLines = 0;
+    m_totalScreenLines = 0;
+    m_totalHeight = 0.0;
+    for (auto& block : m_blocks)
+    {
+        lines.push_back(long(block.lines.size()));
+        screenLines.push_back(block.totalScreenLines);
+        heights.push_back(block.totalHeight);
+        m_totalLines += lines.back();
+        m_totalScreenLines += screenLines.back();
+        m_totalHeight += heights.back();
+    }
+    m_blockLines.Build(lines);
+    m_blockScreenLines.Build(screenLines);
+    m_blockHeights.Build(heights);
+}
+
+} // namespace Zep